@@ -32,6 +32,8 @@
 #include <libopencm3/stm32/f1/nvic.h>
 
 #include "driver/adc.h"
+#include "driver/profile.h"
+#include "driver/ramfunc.h"
 #include "driver/led.h"
 
 /* Define ADC channel gpio and channels. */
@@ -62,6 +64,7 @@
 #define ADC_RAW_SAMPLE_COUNT (8 * 2)
 #define ADC_SAMPLE_TIME ADC_SMPR_SMP_7DOT5CYC
 
+#ifndef ADC_PWM_TRIGGER
 static const uint8_t const adc1_channel_array[ADC_RAW_SAMPLE_COUNT] = {
 	ADC_CHAN_U_VOLTAGE,
 	ADC_CHAN_V_VOLTAGE,
@@ -83,6 +86,53 @@ static const uint8_t const adc2_channel_array[ADC_RAW_SAMPLE_COUNT] = {
 	ADC_CHAN_W_VOLTAGE,
 	ADC_CHAN_CURRENT
 };
+#endif
+
+#ifdef ADC_PWM_TRIGGER
+/* PWM triggered conversion.
+ *
+ * Instead of converting continuously, TIM1 TRGO (OC4REF, see pwm_init())
+ * starts the dual injected sequences of ADC1 and ADC2 once per pwm period,
+ * at a quiet and known point of the pwm cycle. The end of conversion
+ * interrupt copies the injected data registers into raw_data, alternating
+ * between the two halves, so the callbacks see the same layout as with the
+ * free running DMA conversion. Enable by adding -DADC_PWM_TRIGGER to the
+ * target CFLAGS.
+ */
+#define ADC_INJECTED_COUNT 4
+
+/* Supply voltage and current are converted first, the current sampling
+ * starts right at the trigger. The field oriented control places the
+ * trigger in the pwm period to sample the supply current while a given
+ * phase is the only one conducting it.
+ */
+static const uint8_t adc1_injected_array[ADC_INJECTED_COUNT] = {
+	ADC_CHAN_V_BATT,
+	ADC_CHAN_U_VOLTAGE,
+	ADC_CHAN_V_VOLTAGE,
+	ADC_CHAN_W_VOLTAGE
+};
+
+static const uint8_t adc2_injected_array[ADC_INJECTED_COUNT] = {
+	ADC_CHAN_CURRENT,
+	ADC_CHAN_V_VOLTAGE,
+	ADC_CHAN_W_VOLTAGE,
+	ADC_CHAN_U_VOLTAGE
+};
+
+/* raw_data slots of the injected data registers for each raw_data half. */
+static const uint8_t adc1_injected_slots[2][ADC_INJECTED_COUNT]
+	RAMFUNC_DATA = {
+	{ ADC_RAW_A1_VB1, ADC_RAW_A1_UV1, ADC_RAW_A1_VV1, ADC_RAW_A1_WV1 },
+	{ ADC_RAW_A1_VB2, ADC_RAW_A1_UV2, ADC_RAW_A1_VV2, ADC_RAW_A1_WV2 }
+};
+
+static const uint8_t adc2_injected_slots[2][ADC_INJECTED_COUNT]
+	RAMFUNC_DATA = {
+	{ ADC_RAW_A2_CU1, ADC_RAW_A2_VV1, ADC_RAW_A2_WV1, ADC_RAW_A2_UV1 },
+	{ ADC_RAW_A2_CU2, ADC_RAW_A2_VV2, ADC_RAW_A2_WV2, ADC_RAW_A2_UV2 }
+};
+#endif
 
 /* Define local state. */
 struct adc_state {
@@ -90,6 +140,9 @@ struct adc_state {
 	uint16_t raw_data[ADC_RAW_SAMPLE_COUNT];
 	adc_callback_t half_transfer_callback;
 	adc_callback_t transfer_complete_callback;
+#ifdef ADC_PWM_TRIGGER
+	int half; /**< raw_data half the next sample set goes to */
+#endif
 } adc_state;
 
 /**
@@ -121,6 +174,37 @@ void adc_config(uint32_t adc, const uint8_t const *channel_array)
 				 (uint8_t *)channel_array);
 }
 
+#ifdef ADC_PWM_TRIGGER
+/**
+ * Configure a specific adc for pwm triggered injected conversion.
+ */
+void adc_config_injected(uint32_t adc, const uint8_t *channel_array,
+			 uint32_t trigger)
+{
+	adc_enable_scan_mode(adc);
+	adc_set_single_conversion_mode(adc);
+	adc_set_right_aligned(adc);
+	adc_enable_external_trigger_injected(adc, trigger);
+	adc_set_sample_time_on_all_channels(adc, ADC_SAMPLE_TIME);
+
+	adc_power_on(adc);
+
+	{
+		int i;
+		/* Wait a bit for the adc to power on. */
+		for (i = 0; i < 800000; i++) {
+			__asm("nop");
+		}
+	}
+
+	adc_reset_calibration(adc);
+	adc_calibration(adc);
+
+	adc_set_injected_sequence(adc, ADC_INJECTED_COUNT,
+				  (uint8_t *)channel_array);
+}
+#endif
+
 /**
  * Initialize analog to digital converter
  */
@@ -152,6 +236,31 @@ void adc_init(adc_callback_t half_transfer_callback,
 		      ADC_PORT_V_BATT |
 		      ADC_PORT_CURRENT);
 
+#ifdef ADC_PWM_TRIGGER
+	adc_state.half = 0;
+
+	/* Configure interrupts in NVIC. */
+	nvic_set_priority(NVIC_ADC1_2_IRQ, 0);
+	nvic_enable_irq(NVIC_ADC1_2_IRQ);
+
+	/* Disable ADC's. */
+	adc_off(ADC1);
+	adc_off(ADC2);
+
+	/* Enable dualmode. */
+	adc_set_dual_mode(ADC_CR1_DUALMOD_ISM); /* Dualmode injected only. */
+
+	/* Configure the adc channels. ADC1 is triggered by TIM1 and starts
+	 * ADC2, the ADC2 trigger has to be set to software.
+	 */
+	adc_config_injected(ADC1, adc1_injected_array,
+			    ADC_CR2_JEXTSEL_TIM1_TRGO);
+	adc_config_injected(ADC2, adc2_injected_array,
+			    ADC_CR2_JEXTSEL_JSWSTART);
+
+	/* Interrupt at the end of every injected sequence. */
+	adc_enable_eoc_interrupt_injected(ADC1);
+#else
 	/* Configure DMA for data aquisition. */
 	/* Channel 1 reacts to: ADC1, TIM2_CH3 and TIM4_CH1 */
 	dma_channel_reset(DMA1, DMA_CHANNEL1);
@@ -190,10 +299,48 @@ void adc_init(adc_callback_t half_transfer_callback,
 
 	/* Start converting. */
 	adc_start_conversion_regular(ADC1);
+#endif
 }
 
-void dma1_channel1_isr(void)
+#ifdef ADC_PWM_TRIGGER
+RAMFUNC_CODE void adc1_2_isr(void)
+{
+	const uint8_t *adc1_slots = adc1_injected_slots[adc_state.half];
+	const uint8_t *adc2_slots = adc2_injected_slots[adc_state.half];
+	uint16_t *raw_data = adc_state.raw_data;
+
+	PROFILE_ENTER();
+
+	/* rc_w0, a read modify write would clear EOC or JSTRT set meanwhile. */
+	ADC_SR(ADC1) = ~ADC_SR_JEOC;
+
+	raw_data[adc1_slots[0]] = ADC_JDR1(ADC1);
+	raw_data[adc1_slots[1]] = ADC_JDR2(ADC1);
+	raw_data[adc1_slots[2]] = ADC_JDR3(ADC1);
+	raw_data[adc1_slots[3]] = ADC_JDR4(ADC1);
+	raw_data[adc2_slots[0]] = ADC_JDR1(ADC2);
+	raw_data[adc2_slots[1]] = ADC_JDR2(ADC2);
+	raw_data[adc2_slots[2]] = ADC_JDR3(ADC2);
+	raw_data[adc2_slots[3]] = ADC_JDR4(ADC2);
+
+	if (adc_state.half == 0) {
+		adc_state.half = 1;
+		if (adc_state.half_transfer_callback) {
+			adc_state.half_transfer_callback(false, raw_data);
+		}
+	} else {
+		adc_state.half = 0;
+		if (adc_state.transfer_complete_callback) {
+			adc_state.transfer_complete_callback(true, raw_data);
+		}
+	}
+
+	PROFILE_EXIT(PROFILE_ADC);
+}
+#else
+RAMFUNC_CODE void dma1_channel1_isr(void)
 {
+	PROFILE_ENTER();
 
 	/* Half dma transfer interrupt. */
 	if (dma_get_interrupt_flag(DMA1, DMA_CHANNEL1, DMA_HTIF)) {
@@ -215,4 +362,7 @@ void dma1_channel1_isr(void)
 	}
 
 	dma_clear_interrupt_flags(DMA1, DMA_CHANNEL1, DMA_FLAGS);
+
+	PROFILE_EXIT(PROFILE_ADC);
 }
+#endif
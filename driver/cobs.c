@@ -0,0 +1,69 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   cobs.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Consistent overhead byte stuffing.
+ *
+ * The frames of the telemetry, the log and the governor protocol contain no
+ * zero byte after encoding, a zero byte delimits them on the wire.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "driver/cobs.h"
+
+/**
+ * COBS encode a frame and append the delimiter.
+ *
+ * @param in Frame to encode.
+ * @param len Length of in.
+ * @param out Gets the encoded frame, COBS_ENCODED_MAX(len) bytes.
+ *
+ * @return Length of the encoded frame.
+ */
+size_t cobs_encode(const uint8_t *in, size_t len, uint8_t *out)
+{
+	size_t code_pos = 0;
+	size_t pos = 1;
+	uint8_t code = 1;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (in[i] == 0) {
+			out[code_pos] = code;
+			code_pos = pos++;
+			code = 1;
+			continue;
+		}
+
+		out[pos++] = in[i];
+		if (++code == 0xff) {
+			out[code_pos] = code;
+			code_pos = pos++;
+			code = 1;
+		}
+	}
+	out[code_pos] = code;
+	out[pos++] = 0;
+
+	return pos;
+}
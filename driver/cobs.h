@@ -0,0 +1,30 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __COBS_H
+#define __COBS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Largest encoded size of len bytes, with the delimiter. */
+#define COBS_ENCODED_MAX(len) ((len) + ((len) / 254) + 2)
+
+size_t cobs_encode(const uint8_t *in, size_t len, uint8_t *out);
+
+#endif /* __COBS_H */
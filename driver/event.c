@@ -0,0 +1,174 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   event.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Lock free event queues from the interrupts to the main loop.
+ *
+ * Interrupt handlers should only do the time critical part of their work
+ * and post the rest as an event, a handler and one word of data, to be run
+ * by event_process() in the main loop.
+ *
+ * Every queue is a ring with a single producer, the interrupts of one
+ * priority level, and a single consumer, the main loop. The producer only
+ * writes the head index and the consumer only the tail index, so neither
+ * side has to mask the interrupts. A full queue drops the new event and
+ * counts it.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "driver/event.h"
+
+/* Events per queue, has to be a power of two. Override in the target CFLAGS
+ * if needed.
+ */
+#ifndef EVENT_QUEUE_SIZE
+#define EVENT_QUEUE_SIZE 32
+#endif
+
+#if (EVENT_QUEUE_SIZE & (EVENT_QUEUE_SIZE - 1)) != 0
+#error "EVENT_QUEUE_SIZE has to be a power of two"
+#endif
+
+/* Keeps the compiler from moving the record accesses across the index
+ * update. The Cortex-M3 has a single core and does not reorder its own
+ * memory accesses, no barrier instruction is needed.
+ */
+#define EVENT_BARRIER() __asm__ volatile ("" : : : "memory")
+
+struct event {
+	event_handler_t handler;
+	uint32_t data;
+};
+
+struct event_queue {
+	struct event ring[EVENT_QUEUE_SIZE];
+	volatile uint32_t head; /**< Next slot to post to, producer only */
+	volatile uint32_t tail; /**< Next slot to process, consumer only */
+	volatile uint32_t dropped; /**< Events lost to a full queue */
+};
+
+static struct event_queue event_queues[EVENT_PRIORITIES];
+
+/**
+ * Initialize the event queues.
+ */
+void event_init(void)
+{
+	int i;
+
+	for (i = 0; i < EVENT_PRIORITIES; i++) {
+		event_queues[i].head = 0;
+		event_queues[i].tail = 0;
+		event_queues[i].dropped = 0;
+	}
+}
+
+/**
+ * Post an event, call from the interrupts of one priority level per queue.
+ *
+ * @param priority Queue to post to.
+ * @param handler Function event_process() calls with data.
+ * @param data Passed to handler.
+ *
+ * @return false if the queue was full and the event dropped.
+ */
+bool event_post(enum event_priority priority, event_handler_t handler,
+		uint32_t data)
+{
+	struct event_queue *queue = &event_queues[priority];
+	uint32_t head = queue->head;
+
+	if ((head - queue->tail) >= EVENT_QUEUE_SIZE) {
+		queue->dropped++;
+		return false;
+	}
+
+	queue->ring[head & (EVENT_QUEUE_SIZE - 1)].handler = handler;
+	queue->ring[head & (EVENT_QUEUE_SIZE - 1)].data = data;
+	EVENT_BARRIER();
+	queue->head = head + 1;
+
+	return true;
+}
+
+/**
+ * Run the pending events, call from the main loop.
+ *
+ * After every event the queues are checked again from the highest priority
+ * on, an event of a lower priority never runs while a higher one waits.
+ *
+ * @return Number of events run.
+ */
+int event_process(void)
+{
+	struct event_queue *queue;
+	struct event event;
+	uint32_t tail;
+	int i, count = 0;
+
+	i = 0;
+	while (i < EVENT_PRIORITIES) {
+		queue = &event_queues[i];
+		tail = queue->tail;
+		if (tail == queue->head) {
+			i++;
+			continue;
+		}
+
+		EVENT_BARRIER();
+		event = queue->ring[tail & (EVENT_QUEUE_SIZE - 1)];
+		EVENT_BARRIER();
+		queue->tail = tail + 1;
+
+		event.handler(event.data);
+		count++;
+		i = 0;
+	}
+
+	return count;
+}
+
+/**
+ * Check if any event waits to be run.
+ */
+bool event_pending(void)
+{
+	int i;
+
+	for (i = 0; i < EVENT_PRIORITIES; i++) {
+		if (event_queues[i].tail != event_queues[i].head) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Get the number of events dropped because the queue was full.
+ */
+uint32_t event_get_dropped(enum event_priority priority)
+{
+	return event_queues[priority].dropped;
+}
@@ -0,0 +1,45 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __EVENT_H
+#define __EVENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Event queues, one per interrupt priority level. Every queue may only be
+ * posted to from interrupts of one priority level, those can not preempt
+ * each other, and is drained in the main loop. The higher priority queues
+ * are drained first.
+ */
+enum event_priority {
+	EVENT_PRIORITY_HIGH,
+	EVENT_PRIORITY_NORMAL,
+	EVENT_PRIORITY_LOW,
+	EVENT_PRIORITIES
+};
+
+typedef void (*event_handler_t)(uint32_t data);
+
+void event_init(void);
+bool event_post(enum event_priority priority, event_handler_t handler,
+		uint32_t data);
+int event_process(void);
+bool event_pending(void);
+uint32_t event_get_dropped(enum event_priority priority);
+
+#endif /* __EVENT_H */
@@ -0,0 +1,141 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   link.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Line speed negotiation with the host.
+ *
+ * The host always finds the controller at USART_DEFAULT_BAUDRATE. It asks
+ * for a faster line with link_request(), the USART switches as soon as the
+ * bytes already on their way are out. The host then has to talk to the
+ * controller at the new speed and confirm it with link_confirm() within
+ * LINK_CONFIRM_TIMEOUT, otherwise the link falls back to the default speed.
+ * A host that lost the controller after a failed switch finds it again at
+ * the default speed.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "driver/link.h"
+
+#include "driver/usart.h"
+#include "driver/sys_tick.h"
+
+/* Internal state. */
+struct link_state_data {
+	volatile enum link_state state;
+	volatile int timer; /**< Confirm timeout soft timer, -1 if none */
+	volatile uint32_t fallbacks; /**< Switches the host did not confirm */
+} link_state_data;
+
+/**
+ * Stop waiting for the confirmation.
+ */
+static void link_stop_timer(void)
+{
+	if (link_state_data.timer >= 0) {
+		sys_tick_timer_unregister(link_state_data.timer);
+		link_state_data.timer = -1;
+	}
+}
+
+/**
+ * The host did not confirm in time, go back to the default speed.
+ */
+static void link_timeout(int id)
+{
+	(void)id;
+
+	link_stop_timer();
+	(void)usart_change_baudrate(USART_DEFAULT_BAUDRATE);
+	link_state_data.state = LINK_DEFAULT;
+	link_state_data.fallbacks++;
+}
+
+/**
+ * Initialize the internal state.
+ *
+ * The USART has to be initialized at USART_DEFAULT_BAUDRATE.
+ */
+void link_init(void)
+{
+	link_state_data.state = LINK_DEFAULT;
+	link_state_data.timer = -1;
+	link_state_data.fallbacks = 0;
+}
+
+/**
+ * Switch to a new line speed on request of the host.
+ *
+ * The default speed needs no confirmation.
+ *
+ * @return false if the line speed can not be reached, nothing changes then.
+ */
+bool link_request(uint32_t baudrate)
+{
+	if (!usart_change_baudrate(baudrate)) {
+		return false;
+	}
+
+	link_stop_timer();
+
+	if (baudrate == USART_DEFAULT_BAUDRATE) {
+		link_state_data.state = LINK_DEFAULT;
+		return true;
+	}
+
+	link_state_data.state = LINK_SWITCHING;
+	link_state_data.timer = sys_tick_timer_register(link_timeout,
+							LINK_CONFIRM_TIMEOUT);
+	if (link_state_data.timer < 0) {
+		/* Without the timeout a failed switch would be for good. */
+		link_timeout(-1);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * The host reached the controller at the new line speed, keep it.
+ */
+void link_confirm(void)
+{
+	if (link_state_data.state != LINK_SWITCHING) {
+		return;
+	}
+
+	link_stop_timer();
+	link_state_data.state = LINK_CONFIRMED;
+}
+
+enum link_state link_get_state(void)
+{
+	return link_state_data.state;
+}
+
+/**
+ * Get the number of line speed switches that fell back to the default.
+ */
+uint32_t link_get_fallbacks(void)
+{
+	return link_state_data.fallbacks;
+}
@@ -0,0 +1,40 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LINK_H
+#define __LINK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Time the host has to confirm a new line speed, in us. */
+#define LINK_CONFIRM_TIMEOUT 500000
+
+enum link_state {
+	LINK_DEFAULT,
+	LINK_SWITCHING,
+	LINK_CONFIRMED
+};
+
+void link_init(void);
+bool link_request(uint32_t baudrate);
+void link_confirm(void);
+enum link_state link_get_state(void);
+uint32_t link_get_fallbacks(void);
+
+#endif /* __LINK_H */
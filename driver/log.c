@@ -0,0 +1,272 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   log.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Deferred binary log.
+ *
+ * LOG() stores the address of its format string and up to LOG_ARGS raw
+ * arguments in a ring, it takes a few cycles and is cheap enough for the
+ * interrupt handlers. The format strings live in a section of their own
+ * that is not loaded into flash, the host decoder (host/logdec.c) finds them
+ * in the ELF file and puts the messages together.
+ *
+ * Like the event queues every context has a ring with a single producer,
+ * the interrupts of one priority level or the main loop, and a single
+ * consumer. A sequence number counted over all rings orders the records
+ * when they are read out and shows the records a full ring dropped as a
+ * gap.
+ *
+ * Read the records with log_read() or stream them out of the USART by
+ * passing log_get_byte() to usart_init(), as COBS frames of the format
+ * string address, the low half of the sequence number, the arguments up to
+ * the last one that is not zero and a checksum that makes the byte sum zero.
+ * A record written while the USART interrupt preempted the call of an older
+ * one goes out before the older one.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "driver/log.h"
+
+#include "driver/cobs.h"
+
+/* Records per ring, has to be a power of two. Override in the target CFLAGS
+ * if needed.
+ */
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 16
+#endif
+
+#if (LOG_RING_SIZE & (LOG_RING_SIZE - 1)) != 0
+#error "LOG_RING_SIZE has to be a power of two"
+#endif
+
+/* Keeps the compiler from moving the record accesses across the index
+ * update.
+ */
+#define LOG_BARRIER() __asm__ volatile ("" : : : "memory")
+
+struct log_ring {
+	struct log_record ring[LOG_RING_SIZE];
+	volatile uint32_t head; /**< Next slot to write, producer only */
+	volatile uint32_t tail; /**< Next slot to read, consumer only */
+	volatile uint32_t dropped; /**< Records lost to a full ring */
+};
+
+/* Internal state. */
+static struct {
+	struct log_ring rings[LOG_CONTEXTS];
+	uint32_t seq; /**< Next sequence number */
+	log_trigger_output_t trigger_output;
+	volatile bool sending;
+	uint8_t frame[LOG_FRAME_MAX];
+	uint8_t frame_pos;
+	uint8_t frame_len;
+} log_state;
+
+/**
+ * Initialize the log.
+ *
+ * @param trigger_output Called when a record is written while nothing is
+ *                       being sent, like usart_enable_send(). May be NULL.
+ */
+void log_init(log_trigger_output_t trigger_output)
+{
+	int i;
+
+	for (i = 0; i < LOG_CONTEXTS; i++) {
+		log_state.rings[i].head = 0;
+		log_state.rings[i].tail = 0;
+		log_state.rings[i].dropped = 0;
+	}
+	log_state.seq = 0;
+	log_state.trigger_output = trigger_output;
+	log_state.sending = false;
+	log_state.frame_pos = 0;
+	log_state.frame_len = 0;
+}
+
+/**
+ * Write a record, use LOG() instead.
+ */
+void log_put(enum log_context context, const char *fmt, uint32_t a0,
+	     uint32_t a1, uint32_t a2)
+{
+	struct log_ring *ring = &log_state.rings[context];
+	struct log_record *record;
+	uint32_t head = ring->head;
+	uint32_t seq;
+
+	/* The only read-modify-write shared between the contexts, LDREX/STREX
+	 * on the Cortex-M3.
+	 */
+	seq = __atomic_fetch_add(&log_state.seq, 1, __ATOMIC_RELAXED);
+
+	if ((head - ring->tail) >= LOG_RING_SIZE) {
+		ring->dropped++;
+		return;
+	}
+
+	record = &ring->ring[head & (LOG_RING_SIZE - 1)];
+	record->id = (uint32_t)(uintptr_t)fmt;
+	record->seq = seq;
+	record->args[0] = a0;
+	record->args[1] = a1;
+	record->args[2] = a2;
+	LOG_BARRIER();
+	ring->head = head + 1;
+
+	if (!log_state.sending && log_state.trigger_output != NULL) {
+		log_state.sending = true;
+		log_state.trigger_output();
+	}
+}
+
+/**
+ * Find the ring with the oldest record.
+ *
+ * @return The ring, NULL if all are empty.
+ */
+static struct log_ring *log_oldest(void)
+{
+	struct log_ring *ring, *oldest = NULL;
+	uint32_t seq = 0;
+	int i;
+
+	for (i = 0; i < LOG_CONTEXTS; i++) {
+		ring = &log_state.rings[i];
+		if (ring->tail == ring->head) {
+			continue;
+		}
+		LOG_BARRIER();
+		if (oldest == NULL ||
+		    (int32_t)(ring->ring[ring->tail & (LOG_RING_SIZE - 1)].seq -
+			      seq) < 0) {
+			oldest = ring;
+			seq = ring->ring[ring->tail & (LOG_RING_SIZE - 1)].seq;
+		}
+	}
+
+	return oldest;
+}
+
+/**
+ * Take the oldest record out of the log. Either use this or log_get_byte().
+ *
+ * @return false if the log is empty.
+ */
+bool log_read(struct log_record *record)
+{
+	struct log_ring *ring = log_oldest();
+	uint32_t tail;
+
+	if (ring == NULL) {
+		return false;
+	}
+
+	tail = ring->tail;
+	*record = ring->ring[tail & (LOG_RING_SIZE - 1)];
+	LOG_BARRIER();
+	ring->tail = tail + 1;
+
+	return true;
+}
+
+/**
+ * Check if any record waits to be read.
+ */
+bool log_pending(void)
+{
+	return log_oldest() != NULL;
+}
+
+/**
+ * COBS encode the oldest record into the frame buffer.
+ *
+ * @return false if the log is empty.
+ */
+static bool log_encode(void)
+{
+	struct log_record record;
+	uint8_t payload[LOG_FRAME_MAX];
+	uint8_t len = 0, sum = 0;
+	int i, args;
+
+	if (!log_read(&record)) {
+		return false;
+	}
+
+	for (i = 0; i < 4; i++) {
+		payload[len++] = (uint8_t)(record.id >> (8 * i));
+	}
+	payload[len++] = (uint8_t)record.seq;
+	payload[len++] = (uint8_t)(record.seq >> 8);
+
+	for (args = LOG_ARGS; args > 0 && record.args[args - 1] == 0;
+	     args--) {
+	}
+	for (i = 0; i < 4 * args; i++) {
+		payload[len++] = (uint8_t)(record.args[i / 4] >> (8 * (i % 4)));
+	}
+
+	for (i = 0; i < len; i++) {
+		sum += payload[i];
+	}
+	payload[len++] = (uint8_t)-sum;
+
+	log_state.frame_len = (uint8_t)cobs_encode(payload, len,
+						   log_state.frame);
+	log_state.frame_pos = 0;
+
+	return true;
+}
+
+/**
+ * USART send callback, hands out the frames byte by byte.
+ *
+ * @return The next byte, -1 if the log is empty.
+ */
+int32_t log_get_byte(void)
+{
+	if (log_state.frame_pos == log_state.frame_len && !log_encode()) {
+		/* Clear the flag before the last look at the rings, a record
+		 * written in between starts sending again.
+		 */
+		log_state.sending = false;
+		LOG_BARRIER();
+		if (!log_encode()) {
+			return -1;
+		}
+		log_state.sending = true;
+	}
+
+	return log_state.frame[log_state.frame_pos++];
+}
+
+/**
+ * Get the number of records dropped because the ring was full.
+ */
+uint32_t log_get_dropped(enum log_context context)
+{
+	return log_state.rings[context].dropped;
+}
@@ -0,0 +1,85 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LOG_H
+#define __LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Arguments a log record can carry. */
+#define LOG_ARGS 3
+
+/* Section of the format strings. The firmware linker script keeps it out
+ * of flash, it only exists in the ELF file for the host decoder.
+ */
+#define LOG_SECTION __attribute__((section(".log_strings"), used))
+
+/* Largest frame on the wire: id, sequence number, arguments, checksum,
+ * COBS overhead and delimiter.
+ */
+#define LOG_FRAME_MAX (4 + 2 + (4 * LOG_ARGS) + 1 + 2)
+
+/* Contexts logging into a ring of their own. Every ring may only be written
+ * from one context, interrupts of one priority level, which can not preempt
+ * each other, or the main loop.
+ */
+enum log_context {
+	LOG_ISR_HIGH,
+	LOG_ISR_NORMAL,
+	LOG_ISR_LOW,
+	LOG_MAIN,
+	LOG_CONTEXTS
+};
+
+/**
+ * A log record, the address of the format string and the raw arguments.
+ */
+struct log_record {
+	uint32_t id; /**< Address of the format string */
+	uint32_t seq; /**< Position in the log, over all contexts */
+	uint32_t args[LOG_ARGS];
+};
+
+typedef void (*log_trigger_output_t)(void);
+
+/**
+ * Log a printf style message with up to LOG_ARGS integer arguments. Only
+ * the address of the format string and the arguments are stored, the
+ * message is put together on the host from the ELF file. %s is not
+ * supported.
+ *
+ * @param context Context of the call site.
+ */
+#define LOG(context, ...) LOG_PUT(context, __VA_ARGS__, 0, 0, 0, 0)
+
+#define LOG_PUT(context, fmt, a0, a1, a2, ...) do {			\
+	static const char log_fmt[] LOG_SECTION = fmt;			\
+	log_put(context, log_fmt, (uint32_t)(a0), (uint32_t)(a1),	\
+		(uint32_t)(a2));					\
+} while (0)
+
+void log_init(log_trigger_output_t trigger_output);
+void log_put(enum log_context context, const char *fmt, uint32_t a0,
+	     uint32_t a1, uint32_t a2);
+bool log_read(struct log_record *record);
+bool log_pending(void);
+int32_t log_get_byte(void);
+uint32_t log_get_dropped(enum log_context context);
+
+#endif /* __LOG_H */
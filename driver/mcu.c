@@ -23,19 +23,72 @@
  * @brief  mcu driver implementation.
  *
  * Implements functions for initializing global mcu specific features like
- * the rcc.
+ * the rcc. The clock tree it sets up is described in driver/mcu.h.
+ *
+ * Built with -DRAMFUNC it also copies the code and tables marked with
+ * RAMFUNC_CODE and RAMFUNC_DATA (driver/ramfunc.h) from flash to SRAM, which
+ * the libopencm3 startup code does not know about, and moves the vector
+ * table to SRAM, so the exception entry does not fetch the handler address
+ * from flash either.
  */
 
+#include <stdint.h>
+
 #include <libopencm3/stm32/f1/rcc.h>
+#include <libopencm3/stm32/f1/nvic.h>
+#include <libopencm3/cm3/scb.h>
 
 #include "driver/mcu.h"
 
+#ifdef RAMFUNC
+/* .ramfunc section in SRAM, its image in flash and the vector table in
+ * flash, from src/stm32.ld.
+ */
+extern uint32_t _ramfunc, _eramfunc, _ramfunc_loadaddr;
+extern const uint32_t _flash_vectors[];
+
+/* Vector table in SRAM. VTOR needs it aligned to its size rounded up to a
+ * power of two, 84 entries take 512 bytes.
+ */
+static uint32_t mcu_vectors[16 + NVIC_IRQ_COUNT] __attribute__((aligned(512)));
+
+/**
+ * Copy the .ramfunc section to SRAM and switch to the vector table in SRAM.
+ *
+ * Has to run before the first interrupt is enabled and before the first
+ * function in SRAM is called.
+ */
+static void mcu_ramfunc_init(void)
+{
+	uint32_t *src, *dest;
+	int i;
+
+	for (src = &_ramfunc_loadaddr, dest = &_ramfunc; dest < &_eramfunc;
+	     src++, dest++) {
+		*dest = *src;
+	}
+
+	for (i = 0; i < 16 + NVIC_IRQ_COUNT; i++) {
+		mcu_vectors[i] = _flash_vectors[i];
+	}
+	SCB_VTOR = (uint32_t)mcu_vectors;
+}
+#endif
+
 /**
  * Initialize STM32 system specific subsystems.
  */
 void mcu_init(void)
 {
 	/* Initialize the microcontroller system. Initialize clocks. */
+#ifdef MCU_HSE_12MHZ
+	rcc_clock_setup_in_hse_12mhz_out_72mhz();
+#else
 	rcc_clock_setup_in_hsi_out_64mhz();
+#endif
+
+#ifdef RAMFUNC
+	mcu_ramfunc_init();
+#endif
 }
 
@@ -19,6 +19,33 @@
 #ifndef __MCU_H
 #define __MCU_H
 
+/* Clock tree, fixed at compile time. Boards with a 12MHz crystal, like the
+ * clogic v1.1 (conf/clogic-v1_1-board-config.yaml), are built with
+ * -DMCU_HSE_12MHZ and run at 72MHz, otherwise the core runs at 64MHz from
+ * the internal 8MHz RC oscillator. mcu_init() sets the clocks up, the
+ * drivers derive their prescalers, periods and dividers from these.
+ */
+#ifdef MCU_HSE_12MHZ
+#define MCU_HSE 12000000
+#define MCU_SYSCLK 72000000
+#define MCU_ADC_PRESCALER 6
+#else
+#define MCU_SYSCLK 64000000
+#define MCU_ADC_PRESCALER 8
+#endif
+
+/* AHB and APB2 undivided, APB1 at most 36MHz. */
+#define MCU_HCLK MCU_SYSCLK
+#define MCU_PCLK1 (MCU_HCLK / 2)
+#define MCU_PCLK2 MCU_HCLK
+
+/* Timers on a divided APB bus run at twice its clock. The ADC clock may
+ * be 14MHz at most.
+ */
+#define MCU_TIM1_CLK MCU_PCLK2
+#define MCU_TIM2_CLK (2 * MCU_PCLK1)
+#define MCU_ADC_CLK (MCU_PCLK2 / MCU_ADC_PRESCALER)
+
 void mcu_init(void);
 
 #endif /* __MCU_H */
@@ -0,0 +1,187 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   profile.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Interrupt handler profiling with the DWT cycle counter.
+ *
+ * Built with -DPROFILE the drivers read the cycle counter at the entry and
+ * the exit of their interrupt handlers. The cycles of a handler that
+ * preempted another one are taken out of the figures of the interrupted
+ * one and counted as its preemption, so every cycle spent in a handler is
+ * counted exactly once. The exit of every handler also extends the 32 bit
+ * counter, which wraps after a minute at 72MHz, to the cycles elapsed since
+ * the statistics were reset, the base of the CPU load.
+ *
+ * Without -DPROFILE the handlers are not instrumented and all figures stay
+ * zero.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/scs.h>
+
+#include "driver/profile.h"
+
+/* Internal state. */
+static struct {
+	struct profile_stats stats[PROFILE_ISRS];
+	uint32_t nested; /**< Cycles of the handlers preempting the current */
+	uint32_t last; /**< Cycle counter when elapsed was updated */
+	uint64_t elapsed; /**< Cycles since the reset */
+} profile_state;
+
+/**
+ * Start the cycle counter and reset the statistics.
+ */
+void profile_init(void)
+{
+	SCS_DEMCR |= SCS_DEMCR_TRCENA;
+	SCS_DWT_CTRL |= SCS_DWT_CTRL_CYCCNTENA;
+
+	profile_reset();
+}
+
+/**
+ * Reset the statistics.
+ */
+void profile_reset(void)
+{
+	uint32_t primask;
+	int i;
+
+	primask = cm_mask_interrupts(1);
+	for (i = 0; i < PROFILE_ISRS; i++) {
+		profile_state.stats[i].count = 0;
+		profile_state.stats[i].min = 0;
+		profile_state.stats[i].max = 0;
+		profile_state.stats[i].total = 0;
+		profile_state.stats[i].preempted = 0;
+	}
+	profile_state.last = SCS_DWT_CYCCNT;
+	profile_state.elapsed = 0;
+	cm_mask_interrupts(primask);
+}
+
+/**
+ * Handler entry, use PROFILE_ENTER() instead.
+ */
+void profile_enter(struct profile_frame *frame)
+{
+	uint32_t primask;
+
+	primask = cm_mask_interrupts(1);
+	frame->nested = profile_state.nested;
+	profile_state.nested = 0;
+	frame->start = SCS_DWT_CYCCNT;
+	cm_mask_interrupts(primask);
+}
+
+/**
+ * Handler exit, use PROFILE_EXIT() instead.
+ */
+void profile_exit(enum profile_isr isr, struct profile_frame *frame)
+{
+	struct profile_stats *stats = &profile_state.stats[isr];
+	uint32_t now, cycles, self, primask;
+
+	primask = cm_mask_interrupts(1);
+	now = SCS_DWT_CYCCNT;
+	cycles = now - frame->start;
+	self = cycles - profile_state.nested;
+
+	stats->count++;
+	if (stats->count == 1 || self < stats->min) {
+		stats->min = self;
+	}
+	if (self > stats->max) {
+		stats->max = self;
+	}
+	stats->total += self;
+	stats->preempted += profile_state.nested;
+
+	/* The interrupted handler was preempted for all of this one. */
+	profile_state.nested = frame->nested + cycles;
+
+	profile_state.elapsed += now - profile_state.last;
+	profile_state.last = now;
+	cm_mask_interrupts(primask);
+}
+
+/**
+ * Get a consistent copy of the statistics of a handler.
+ */
+void profile_get(enum profile_isr isr, struct profile_stats *stats)
+{
+	uint32_t primask;
+
+	primask = cm_mask_interrupts(1);
+	*stats = profile_state.stats[isr];
+	cm_mask_interrupts(primask);
+}
+
+/**
+ * Get the cycles elapsed since the statistics were reset.
+ */
+uint64_t profile_get_elapsed(void)
+{
+	uint64_t elapsed;
+	uint32_t now, primask;
+
+	primask = cm_mask_interrupts(1);
+	now = SCS_DWT_CYCCNT;
+	profile_state.elapsed += now - profile_state.last;
+	profile_state.last = now;
+	elapsed = profile_state.elapsed;
+	cm_mask_interrupts(primask);
+
+	return elapsed;
+}
+
+/**
+ * Get the CPU load of a handler since the statistics were reset.
+ *
+ * @param isr Handler, PROFILE_ISRS for all of them together.
+ *
+ * @return Share of the cycles in 0.01%.
+ */
+uint16_t profile_get_load(enum profile_isr isr)
+{
+	uint64_t elapsed = profile_get_elapsed();
+	uint64_t total = 0;
+	uint32_t primask;
+	int i;
+
+	if (elapsed == 0) {
+		return 0;
+	}
+
+	primask = cm_mask_interrupts(1);
+	for (i = 0; i < PROFILE_ISRS; i++) {
+		if ((enum profile_isr)i == isr || isr == PROFILE_ISRS) {
+			total += profile_state.stats[i].total;
+		}
+	}
+	cm_mask_interrupts(primask);
+
+	return (uint16_t)((total * 10000) / elapsed);
+}
@@ -0,0 +1,77 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Interrupt handlers that are profiled. */
+enum profile_isr {
+	PROFILE_PWM, /**< tim1_trg_com_isr */
+	PROFILE_ADC, /**< dma1_channel1_isr or adc1_2_isr */
+	PROFILE_TIMER, /**< tim2_isr */
+	PROFILE_USART, /**< usart1_isr and its DMA channel handlers */
+	PROFILE_SYS_TICK, /**< sys_tick_handler */
+	PROFILE_ISRS
+};
+
+/**
+ * Cycle statistics of a handler. The cycles of the handlers that
+ * preempted it are not counted in, they are counted separately.
+ */
+struct profile_stats {
+	uint32_t count; /**< Invocations */
+	uint32_t min; /**< Fewest cycles of an invocation */
+	uint32_t max; /**< Most cycles of an invocation */
+	uint64_t total; /**< Cycles of all invocations */
+	uint64_t preempted; /**< Cycles of the handlers that preempted it */
+};
+
+/**
+ * Cycle counter at the entry of a handler, on the stack of the handler.
+ */
+struct profile_frame {
+	uint32_t start;
+	uint32_t nested; /**< Preempting cycles of the interrupted handler */
+};
+
+/* Instrumentation of the handlers, only built with -DPROFILE. Put
+ * PROFILE_ENTER() in front of the first statement and PROFILE_EXIT() after
+ * the last one of a handler.
+ */
+#ifdef PROFILE
+#define PROFILE_ENTER()						\
+	struct profile_frame profile_frame;				\
+	profile_enter(&profile_frame)
+#define PROFILE_EXIT(isr) profile_exit(isr, &profile_frame)
+#else
+#define PROFILE_ENTER() do { } while (0)
+#define PROFILE_EXIT(isr) do { } while (0)
+#endif
+
+void profile_init(void);
+void profile_reset(void);
+void profile_enter(struct profile_frame *frame);
+void profile_exit(enum profile_isr isr, struct profile_frame *frame);
+void profile_get(enum profile_isr isr, struct profile_stats *stats);
+uint64_t profile_get_elapsed(void);
+uint16_t profile_get_load(enum profile_isr isr);
+
+#endif /* __PROFILE_H */
@@ -31,27 +31,196 @@
 #include <libopencm3/stm32/timer.h>
 #include <libopencm3/stm32/f1/gpio.h>
 
-#include <lg/gpdef.h>
-#include <lg/gprotc.h>
-
 #include "driver/pwm.h"
+#include "driver/profile.h"
+#include "driver/ramfunc.h"
 
 #include "driver/led.h"
 
 /* PWM_DEFINES */
-#define PWM__ZERO_VALUE 0x3FF
+#define PWM__ZERO_VALUE (PWM_DUTY_MAX / 2)
 
-/* At 64MHz system clock this should result in about 16KHz pwm frequency.
- * Thanks to the pwm scheme we are running the motor will see double the
- * frequency, resulting in ~32khz!
+/* PWM_FREQUENCY, about 16KHz. Thanks to the pwm scheme we are running the
+ * motor will see double the frequency, resulting in ~32khz!
  *
  * As we are using center aligned PWM the period has to be half as big.
  * As we need two (one up count and one downcount) period counts per
  * waveform periods.
  *
- * Using 2047 divider. (64MHz / 0x7FF = 15.632KHz)
+ * Using 2047 divider at 64MHz. (64MHz / 0x7FF = 15.632KHz)
+ */
+#define PWM__MAX_VALUE PWM_DUTY_MAX
+
+/* Compare value offset of a pwm_set() value, INT16_MAX is
+ * PWM__ZERO_VALUE. Exactly the value divided by 2^5 at 64MHz.
+ */
+#define PWM__OFFSET(value) \
+	(((int32_t)(value) * (PWM__ZERO_VALUE + 1)) / 32768)
+
+/* Default ADC trigger point, counter value while counting up.
+ *
+ * Around PWM__ZERO_VALUE one of the driven phases is high and the other one
+ * low, the star point sits at half the supply voltage and the floating phase
+ * is not clamped by the body diodes. The ADC converts one channel every 20
+ * ADC clock cycles, 160 ticks at 64MHz, supply voltage and current first.
+ * Starting two conversions early centers the three phase voltage samples
+ * around PWM__ZERO_VALUE.
+ */
+#define PWM__ADC_TRIGGER_VALUE \
+	(PWM__ZERO_VALUE - (2 * 20 * (MCU_TIM1_CLK / MCU_ADC_CLK)))
+
+#if defined(PWM_COMM_TABLE) || defined(PWM_COMM_GAPLESS)
+/* Table driven commutation.
+ *
+ * Instead of reconfiguring the output compare units through the library
+ * calls, the commutation interrupt writes precomputed images of the output
+ * compare modes and output enables. The images only cover the OC1M-OC3M and
+ * CC1-CC3 enable bits, all other bits of CCMR1, CCMR2 and CCER are left
+ * untouched. Enable by adding -DPWM_COMM_TABLE to the target CFLAGS.
+ *
+ * Gapless commutation (-DPWM_COMM_GAPLESS) uses the same images. The
+ * interrupt preloads the image of the following step right away instead of
+ * the all floating idle step, every pwm_comm() moves on to the next step
+ * with a single COM event.
+ */
+struct pwm_comm_image {
+	uint32_t ccmr1;
+	uint32_t ccmr2;
+	uint32_t ccer;
+};
+
+#define PWM__CCMR1_MASK (TIM_CCMR1_OC1M_MASK | TIM_CCMR1_OC2M_MASK)
+#define PWM__CCMR2_MASK TIM_CCMR2_OC3M_MASK
+#define PWM__CCER_MASK (TIM_CCER_CC1E | TIM_CCER_CC1NE | \
+			TIM_CCER_CC2E | TIM_CCER_CC2NE | \
+			TIM_CCER_CC3E | TIM_CCER_CC3NE)
+
+/* Phase U, V or W pwm driven or floating. */
+#define PWM__CCER_U_PWM TIM_CCER_CC1E
+#define PWM__CCER_U_FLOAT (TIM_CCER_CC1E | TIM_CCER_CC1NE)
+#define PWM__CCER_V_PWM TIM_CCER_CC2E
+#define PWM__CCER_V_FLOAT (TIM_CCER_CC2E | TIM_CCER_CC2NE)
+#define PWM__CCER_W_PWM TIM_CCER_CC3E
+#define PWM__CCER_W_FLOAT (TIM_CCER_CC3E | TIM_CCER_CC3NE)
+
+/* Output configuration indexed by the step that is being entered. */
+static const struct pwm_comm_image pwm_comm_table[6] RAMFUNC_DATA = {
+	{ /* Step 0, U floating */
+		TIM_CCMR1_OC1M_FORCE_LOW | TIM_CCMR1_OC2M_PWM1,
+		TIM_CCMR2_OC3M_PWM1,
+		PWM__CCER_U_FLOAT | PWM__CCER_V_PWM | PWM__CCER_W_PWM
+	},
+	{ /* Step 1, W floating */
+		TIM_CCMR1_OC1M_PWM1 | TIM_CCMR1_OC2M_PWM1,
+		TIM_CCMR2_OC3M_FORCE_LOW,
+		PWM__CCER_U_PWM | PWM__CCER_V_PWM | PWM__CCER_W_FLOAT
+	},
+	{ /* Step 2, V floating */
+		TIM_CCMR1_OC1M_PWM1 | TIM_CCMR1_OC2M_FORCE_LOW,
+		TIM_CCMR2_OC3M_PWM1,
+		PWM__CCER_U_PWM | PWM__CCER_V_FLOAT | PWM__CCER_W_PWM
+	},
+	{ /* Step 3, U floating */
+		TIM_CCMR1_OC1M_FORCE_LOW | TIM_CCMR1_OC2M_PWM1,
+		TIM_CCMR2_OC3M_PWM1,
+		PWM__CCER_U_FLOAT | PWM__CCER_V_PWM | PWM__CCER_W_PWM
+	},
+	{ /* Step 4, W floating */
+		TIM_CCMR1_OC1M_PWM1 | TIM_CCMR1_OC2M_PWM1,
+		TIM_CCMR2_OC3M_FORCE_LOW,
+		PWM__CCER_U_PWM | PWM__CCER_V_PWM | PWM__CCER_W_FLOAT
+	},
+	{ /* Step 5, V floating */
+		TIM_CCMR1_OC1M_PWM1 | TIM_CCMR1_OC2M_FORCE_LOW,
+		TIM_CCMR2_OC3M_PWM1,
+		PWM__CCER_U_PWM | PWM__CCER_V_FLOAT | PWM__CCER_W_PWM
+	}
+};
+
+#ifndef PWM_COMM_GAPLESS
+/* All phases floating, inserted between two steps. */
+static const struct pwm_comm_image pwm_comm_idle RAMFUNC_DATA = {
+	TIM_CCMR1_OC1M_FORCE_LOW | TIM_CCMR1_OC2M_FORCE_LOW,
+	TIM_CCMR2_OC3M_FORCE_LOW,
+	PWM__CCER_U_FLOAT | PWM__CCER_V_FLOAT | PWM__CCER_W_FLOAT
+};
+#endif
+
+/* Duty cycle direction of the U, V and W compare values in each step.
+ * The floating phase keeps the direction it had in the previous step.
  */
-#define PWM__MAX_VALUE 0x7FF
+static const int8_t pwm_duty_sign[6][3] RAMFUNC_DATA = {
+	{ -1, -1, +1 },
+	{ +1, -1, +1 },
+	{ +1, -1, -1 },
+	{ +1, +1, -1 },
+	{ -1, +1, -1 },
+	{ -1, +1, +1 }
+};
+
+/**
+ * Write the output configuration of a step into the preload registers, it
+ * becomes active with the next COM event.
+ */
+static inline void pwm_comm_load(const struct pwm_comm_image *image)
+{
+	TIM_CCMR1(TIM1) = (TIM_CCMR1(TIM1) & ~PWM__CCMR1_MASK) | image->ccmr1;
+	TIM_CCMR2(TIM1) = (TIM_CCMR2(TIM1) & ~PWM__CCMR2_MASK) | image->ccmr2;
+	TIM_CCER(TIM1) = (TIM_CCER(TIM1) & ~PWM__CCER_MASK) | image->ccer;
+}
+#endif
+
+/* Space vector modulation waveform, first quarter of one electrical turn.
+ *
+ * The sine of the phase minus the mean of the largest and the smallest of
+ * the three phase sines (min max injection), scaled by 2/sqrt(3) to reach
+ * full scale. The waveform is symmetric around 90 and 180 degrees, the
+ * first quarter is enough. Entry i is at i * 90deg / 256:
+ *
+ *   f(a) = sin(a) - (max + min) / 2 of sin(a), sin(a - 120), sin(a + 120)
+ *   round(32767 * f(i * pi / 512) * 2 / sqrt(3))
+ *
+ * host_sine recomputes every entry and fails if one is off.
+ */
+static const int16_t pwm_svm_table[257] = {
+	0, 348, 696, 1045, 1393, 1741, 2089, 2437,
+	2785, 3133, 3480, 3828, 4175, 4522, 4869, 5216,
+	5563, 5909, 6256, 6602, 6947, 7293, 7638, 7983,
+	8328, 8672, 9016, 9359, 9703, 10046, 10388, 10730,
+	11072, 11414, 11754, 12095, 12435, 12774, 13113, 13452,
+	13790, 14128, 14465, 14801, 15137, 15472, 15807, 16141,
+	16475, 16808, 17140, 17472, 17803, 18133, 18463, 18792,
+	19120, 19447, 19774, 20100, 20426, 20750, 21074, 21397,
+	21719, 22040, 22361, 22680, 22999, 23317, 23634, 23950,
+	24266, 24580, 24893, 25206, 25517, 25828, 26137, 26446,
+	26754, 27060, 27366, 27670, 27974, 28276, 28444, 28543,
+	28641, 28738, 28834, 28929, 29023, 29116, 29208, 29298,
+	29388, 29476, 29563, 29650, 29735, 29819, 29901, 29983,
+	30064, 30143, 30221, 30298, 30374, 30449, 30523, 30595,
+	30667, 30737, 30806, 30874, 30941, 31006, 31071, 31134,
+	31196, 31257, 31317, 31375, 31433, 31489, 31544, 31598,
+	31650, 31702, 31752, 31801, 31849, 31896, 31941, 31985,
+	32028, 32070, 32111, 32150, 32189, 32226, 32261, 32296,
+	32329, 32361, 32392, 32422, 32451, 32478, 32504, 32529,
+	32552, 32575, 32596, 32616, 32634, 32652, 32668, 32683,
+	32697, 32709, 32721, 32731, 32740, 32747, 32754, 32759,
+	32763, 32765, 32767, 32767, 32766, 32764, 32760, 32755,
+	32749, 32742, 32734, 32724, 32713, 32701, 32688, 32673,
+	32657, 32640, 32622, 32603, 32582, 32560, 32537, 32512,
+	32487, 32460, 32432, 32402, 32372, 32340, 32307, 32273,
+	32238, 32201, 32163, 32124, 32084, 32043, 32000, 31956,
+	31911, 31865, 31817, 31769, 31719, 31668, 31616, 31562,
+	31507, 31452, 31395, 31337, 31277, 31217, 31155, 31092,
+	31028, 30963, 30896, 30829, 30760, 30690, 30619, 30547,
+	30474, 30399, 30324, 30247, 30169, 30090, 30010, 29929,
+	29846, 29763, 29678, 29592, 29505, 29417, 29328, 29238,
+	29147, 29054, 28961, 28866, 28771, 28674, 28576, 28477,
+	28377
+};
+
+/* Electrical angle of phase V and W behind phase U, 120 and 240 degrees. */
+#define PWM__ANGLE_V 21845
+#define PWM__ANGLE_W 43691
 
 /* Internal state. */
 
@@ -222,6 +391,21 @@ void pwm_init(void)
 	timer_enable_oc_output(TIM1, TIM_OC3);
 	timer_enable_oc_output(TIM1, TIM_OC3N);
 
+	/* -- OC4 configuration -- */
+
+	/* OC4 has no output pin, its reference signal starts the ADC
+	 * conversions through TRGO. In PWM2 mode the reference rises once per
+	 * pwm period, when the counter passes the compare value counting up.
+	 */
+	timer_disable_oc_clear(TIM1, TIM_OC4);
+	timer_enable_oc_preload(TIM1, TIM_OC4);
+	timer_set_oc_slow_mode(TIM1, TIM_OC4);
+	timer_set_oc_mode(TIM1, TIM_OC4, TIM_OCM_PWM2);
+	timer_set_oc_value(TIM1, TIM_OC4, PWM__ADC_TRIGGER_VALUE);
+
+	/* Trigger output (TRGO) follows OC4REF. */
+	timer_set_master_mode(TIM1, TIM_CR2_MMS_COMPARE_OC4REF);
+
 	/* ---- */
 	/* ARR reload enable */
 	timer_enable_preload(TIM1);
@@ -231,6 +415,12 @@ void pwm_init(void)
 	 */
 	timer_enable_preload_complementry_enable_bits(TIM1);
 
+#ifdef PWM_COMM_GAPLESS
+	/* No idle state, the first pwm_comm() switches to step 1 directly. */
+	pwm_state.idle = false;
+	pwm_comm_load(&pwm_comm_table[1]);
+#endif
+
 	/* Enable outputs in the break subsystem */
 	timer_enable_break_main_output(TIM1);
 
@@ -242,10 +432,27 @@ void pwm_init(void)
 
 }
 
+/**
+ * Set the point in the pwm period at which the ADC conversions start.
+ *
+ * @param value Counter value while counting up, 1 to PWM__MAX_VALUE. Only
+ *              used by the ADC driver when it is built with ADC_PWM_TRIGGER.
+ */
+void pwm_set_adc_trigger(uint16_t value)
+{
+	if (value < 1) {
+		value = 1;
+	} else if (value > PWM__MAX_VALUE) {
+		value = PWM__MAX_VALUE;
+	}
+
+	timer_set_oc_value(TIM1, TIM_OC4, value);
+}
+
 /**
  * Trigger one commutation event.
  */
-void pwm_comm(void)
+RAMFUNC_CODE void pwm_comm(void)
 {
 	timer_generate_event(TIM1, TIM_EGR_COMG);
 }
@@ -306,18 +513,141 @@ static inline void tim1_set_oc3(uint32_t val)
 	tim1_set_oc(TIM_OC3, val);
 }
 
+/**
+ * Drive all three half bridges with pwm, each with its own duty cycle set by
+ * pwm_set_duty(). Used by the field oriented control, the commutation
+ * interrupt is disabled until the next pwm_init().
+ */
+void pwm_all_on(void)
+{
+	timer_disable_irq(TIM1, TIM_DIER_COMIE);
+
+	tim1_set_oc1(PWM__ZERO_VALUE);
+	tim1_set_oc2(PWM__ZERO_VALUE);
+	tim1_set_oc3(PWM__ZERO_VALUE);
+
+	timer_set_oc_mode(TIM1, TIM_OC1, TIM_OCM_PWM1);
+	timer_set_oc_mode(TIM1, TIM_OC2, TIM_OCM_PWM1);
+	timer_set_oc_mode(TIM1, TIM_OC3, TIM_OCM_PWM1);
+	timer_enable_oc_output(TIM1, TIM_OC1);
+	timer_disable_oc_output(TIM1, TIM_OC1N);
+	timer_enable_oc_output(TIM1, TIM_OC2);
+	timer_disable_oc_output(TIM1, TIM_OC2N);
+	timer_enable_oc_output(TIM1, TIM_OC3);
+	timer_disable_oc_output(TIM1, TIM_OC3N);
+	pwm_comm();
+
+	pwm_state.on = true;
+}
+
+/**
+ * Set the compare values of the three phases directly.
+ *
+ * A phase is high while the counter is below its value, 0 to PWM_DUTY_MAX.
+ * Only useful after pwm_all_on().
+ */
+void pwm_set_duty(uint16_t u, uint16_t v, uint16_t w)
+{
+	TIM_CCR1(TIM1) = u;
+	TIM_CCR2(TIM1) = v;
+	TIM_CCR3(TIM1) = w;
+}
+
+/**
+ * Space vector modulation waveform at the given angle, linear interpolation
+ * of pwm_svm_table. Exactly the table entry at multiples of 64.
+ *
+ * @param angle Electrical angle, 65536 is one turn.
+ *
+ * @return Waveform in Q15.
+ */
+int32_t pwm_svm(uint16_t angle)
+{
+	uint16_t x = angle & 0x3FFF;
+	int32_t value;
+
+	/* Second and fourth quarter mirror the first and third. */
+	if ((angle & 0x4000) != 0) {
+		x = 0x4000 - x;
+	}
+
+	value = pwm_svm_table[x >> 6];
+	if ((x & 0x3F) != 0) {
+		value += ((pwm_svm_table[(x >> 6) + 1] - value) *
+			  (x & 0x3F)) >> 6;
+	}
+
+	return ((angle & 0x8000) != 0) ? -value : value;
+}
+
+/**
+ * Compare value offset of a Q30 product of the amplitude and the waveform.
+ * Floors like the product shifted down by 20 bits at 64MHz.
+ */
+static inline int32_t pwm_sine_offset(int32_t product)
+{
+	return ((product >> 10) * (PWM__ZERO_VALUE + 1)) >> 20;
+}
+
+/**
+ * Sinusoidal drive, set all three phases from the space vector modulation
+ * waveform. Smoother and quieter than the six step commutation, for
+ * example to run slowly with an open loop angle. Only useful after
+ * pwm_all_on().
+ *
+ * @param angle Electrical angle of phase U, 65536 is one turn.
+ * @param amplitude Same scale as the value of pwm_set(), INT16_MAX is the
+ *                  largest amplitude without clipping.
+ */
+void pwm_set_sine(uint16_t angle, int16_t amplitude)
+{
+	/* Q15 product, scaled down like in pwm_set(). */
+	tim1_set_oc1(PWM__ZERO_VALUE +
+		     pwm_sine_offset(amplitude * pwm_svm(angle)));
+	tim1_set_oc2(PWM__ZERO_VALUE +
+		     pwm_sine_offset(amplitude *
+				     pwm_svm(angle - PWM__ANGLE_V)));
+	tim1_set_oc3(PWM__ZERO_VALUE +
+		     pwm_sine_offset(amplitude *
+				     pwm_svm(angle - PWM__ANGLE_W)));
+}
+
 /**
  * Set the pwm duty cycle according to the current comm state.
  */
-void pwm_set(int16_t value)
+RAMFUNC_CODE void pwm_set(int16_t value)
 {
 	/* Store the value passet into the driver state. */
 	pwm_state.value = value;
 
-	/* Divide the value passed by 2^5, as this is our pwm range available.
+	/* Scale the value passed down to the pwm range available.
+	 */
+	value = PWM__OFFSET(value);
+
+#if defined(PWM_COMM_GAPLESS)
+	/* Without the idle state between the steps the compare value of the
+	 * floating phase has to be right when the next step drives it. Its
+	 * direction in the next step is the one of the following table entry,
+	 * the phase that stays driven keeps its direction. The compare values
+	 * are preloaded, this is in place long before the next COM event.
 	 */
-	value /= 1<<5;
+	{
+		const int8_t *sign = pwm_duty_sign[(pwm_state.step == 5) ? 0 :
+						   pwm_state.step + 1];
 
+		TIM_CCR1(TIM1) = PWM__ZERO_VALUE + (sign[0] * value);
+		TIM_CCR2(TIM1) = PWM__ZERO_VALUE + (sign[1] * value);
+		TIM_CCR3(TIM1) = PWM__ZERO_VALUE + (sign[2] * value);
+	}
+#elif defined(PWM_COMM_TABLE)
+	{
+		const int8_t *sign = pwm_duty_sign[pwm_state.step];
+
+		TIM_CCR1(TIM1) = PWM__ZERO_VALUE + (sign[0] * value);
+		TIM_CCR2(TIM1) = PWM__ZERO_VALUE + (sign[1] * value);
+		TIM_CCR3(TIM1) = PWM__ZERO_VALUE + (sign[2] * value);
+	}
+#else
 	/* Calculate and set the pwm values for the phases.
 	 * See that we are setting the pwm value for the disabled phase too.
 	 * This is in advance of a commutation. This way me make sure that the
@@ -356,13 +686,79 @@ void pwm_set(int16_t value)
 		tim1_set_oc3(PWM__ZERO_VALUE + value); /* disabled next high */
 		break;
 	}
+#endif
+}
+
+#if defined(PWM_COMM_GAPLESS)
+/**
+ * PWM timer commutation event interrupt handler
+ *
+ * Gapless variant, the COM event just applied the next step. Preload the
+ * step after it, one interrupt per commutation.
+ */
+RAMFUNC_CODE void tim1_trg_com_isr(void)
+{
+	int next;
+
+	PROFILE_ENTER();
+
+	timer_clear_flag(TIM1, TIM_SR_COMIF);
+
+	pwm_state.step = (pwm_state.step == 5) ? 0 : pwm_state.step + 1;
+	next = (pwm_state.step == 5) ? 0 : pwm_state.step + 1;
+
+	pwm_comm_load(&pwm_comm_table[next]);
+
+	pwm_set(pwm_state.value);
+
+	PROFILE_EXIT(PROFILE_PWM);
 }
+#elif defined(PWM_COMM_TABLE)
+/**
+ * PWM timer commutation event interrupt handler
+ *
+ * Table driven variant, see pwm_comm_table.
+ */
+RAMFUNC_CODE void tim1_trg_com_isr(void)
+{
+	const struct pwm_comm_image *image;
+
+	PROFILE_ENTER();
+
+	timer_clear_flag(TIM1, TIM_SR_COMIF);
 
+	if (pwm_state.idle) {
+		pwm_state.idle = false;
+		pwm_state.step = (pwm_state.step == 5) ? 0 :
+						       pwm_state.step + 1;
+		image = &pwm_comm_table[pwm_state.step];
+	} else {
+		/* Idle state between commutations, see below. */
+		pwm_state.idle = true;
+		image = &pwm_comm_idle;
+	}
+
+	pwm_comm_load(image);
+
+	/* Load the new step right away, the preloaded configuration has to be
+	 * complete before the event is generated.
+	 */
+	if (!pwm_state.idle) {
+		TIM_EGR(TIM1) = TIM_EGR_COMG;
+	}
+
+	pwm_set(pwm_state.value);
+
+	PROFILE_EXIT(PROFILE_PWM);
+}
+#else
 /**
  * PWM timer commutation event interrupt handler
  */
-void tim1_trg_com_isr(void)
+RAMFUNC_CODE void tim1_trg_com_isr(void)
 {
+	PROFILE_ENTER();
+
 	timer_clear_flag(TIM1, TIM_SR_COMIF);
 
 	TOGGLE(LED_GREEN);
@@ -448,4 +844,7 @@ void tim1_trg_com_isr(void)
 	pwm_set(pwm_state.value);
 
 	OFF(LED_GREEN);
+
+	PROFILE_EXIT(PROFILE_PWM);
 }
+#endif
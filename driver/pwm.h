@@ -21,10 +21,28 @@
 
 #include <stdint.h>
 
+#include "driver/mcu.h"
+
+/* Pwm frequency, the center aligned counter counts up to PWM_DUTY_MAX and
+ * back down once per period.
+ */
+#define PWM_FREQUENCY 15625
+
+/* Compare value of a phase that is high during the whole pwm period, range
+ * of pwm_set_duty() and pwm_set_adc_trigger(). 0x7FF at 64MHz, 0x8FF at
+ * 72MHz.
+ */
+#define PWM_DUTY_MAX ((MCU_TIM1_CLK / (2 * PWM_FREQUENCY)) - 1)
+
 void pwm_init(void);
 void pwm_off(void);
 void pwm_all_lo(void);
 void pwm_set(int16_t value);
 void pwm_comm(void);
+void pwm_set_adc_trigger(uint16_t value);
+void pwm_all_on(void);
+void pwm_set_duty(uint16_t u, uint16_t v, uint16_t w);
+void pwm_set_sine(uint16_t angle, int16_t amplitude);
+int32_t pwm_svm(uint16_t angle);
 
 #endif /* __PWM_H */
@@ -0,0 +1,47 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RAMFUNC_H
+#define __RAMFUNC_H
+
+/* Placement of the hot interrupt handlers, the functions they call and their
+ * lookup tables in SRAM, only built with -DRAMFUNC. Code runs from SRAM
+ * without the flash wait states (two at 64MHz) on the instruction fetches
+ * and the literal pool loads. mcu_init() copies the sections from flash and
+ * moves the vector table to SRAM.
+ *
+ * Put RAMFUNC_CODE in front of a function definition and RAMFUNC_DATA
+ * behind the declarator of a constant table. Calls between flash and SRAM
+ * go through long branch veneers the linker inserts. The host linker only
+ * provides section bounds for section names that are C identifiers, the
+ * simulation uses them to tell which handlers run from SRAM.
+ */
+#ifdef RAMFUNC
+#ifdef __arm__
+#define RAMFUNC_CODE __attribute__((section(".ramfunc")))
+#define RAMFUNC_DATA __attribute__((section(".ramdata")))
+#else
+#define RAMFUNC_CODE __attribute__((section("ramfunc")))
+#define RAMFUNC_DATA __attribute__((section("ramdata")))
+#endif
+#else
+#define RAMFUNC_CODE
+#define RAMFUNC_DATA
+#endif
+
+#endif /* __RAMFUNC_H */
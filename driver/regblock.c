@@ -0,0 +1,237 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   regblock.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Block access to a bank of protocol registers.
+ *
+ * The protocol registers are an array of 16 bit words. Variables of the
+ * application, 16 bit or 32 bit split over two registers low word first,
+ * are mapped onto them. regblock_read() copies all mapped variables of a
+ * range of registers into the registers with the interrupts masked, so
+ * the range is a consistent snapshot, and then touches every register of
+ * the range to have the protocol send them out in one burst.
+ * regblock_write() applies a range of registers the host wrote to the
+ * writable variables in the same way, all at once.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <libopencm3/cm3/cortex.h>
+
+#include "driver/regblock.h"
+
+/**
+ * A variable mapped onto registers.
+ */
+struct regblock_map {
+	volatile void *var;
+	uint8_t addr; /**< Register of the (low) word */
+	uint8_t words; /**< Registers the variable covers */
+	bool writable;
+};
+
+/* Internal state. */
+struct regblock_state {
+	uint16_t *regs;
+	uint8_t count; /**< Number of registers */
+	regblock_touch_callback_t touch_callback;
+	struct regblock_map maps[REGBLOCK_MAP_NUM];
+	int map_count;
+} regblock_state;
+
+/**
+ * Initialize the register bank.
+ *
+ * @param regs The protocol registers.
+ * @param count Number of registers.
+ * @param touch_callback Called for every register of a read block.
+ */
+void regblock_init(uint16_t *regs, uint8_t count,
+		   regblock_touch_callback_t touch_callback)
+{
+	regblock_state.regs = regs;
+	regblock_state.count = count;
+	regblock_state.touch_callback = touch_callback;
+	regblock_state.map_count = 0;
+}
+
+/**
+ * Map a variable onto one or two registers.
+ *
+ * @param addr Register of the variable, of the low word if 32 bit.
+ * @param writable regblock_write() may change the variable.
+ *
+ * @return Mapping index, or -1 if the registers do not exist, are mapped
+ *         already or all mappings are used.
+ */
+int regblock_map(uint8_t addr, volatile void *var, enum regblock_width width,
+		 bool writable)
+{
+	struct regblock_map *map;
+	uint8_t words = (width == REGBLOCK_U32) ? 2 : 1;
+	int i;
+
+	if (regblock_state.map_count >= REGBLOCK_MAP_NUM ||
+	    (uint16_t)addr + words > regblock_state.count) {
+		return -1;
+	}
+
+	for (i = 0; i < regblock_state.map_count; i++) {
+		map = &regblock_state.maps[i];
+		if (addr < map->addr + map->words &&
+		    map->addr < addr + words) {
+			return -1;
+		}
+	}
+
+	map = &regblock_state.maps[regblock_state.map_count];
+	map->var = var;
+	map->addr = addr;
+	map->words = words;
+	map->writable = writable;
+
+	return regblock_state.map_count++;
+}
+
+static bool regblock_range_valid(uint8_t first, uint8_t count)
+{
+	return count != 0 &&
+	       (uint16_t)first + count <= regblock_state.count;
+}
+
+/**
+ * Copy the words of a mapped variable that lie in a range of registers
+ * from the variable to the registers or back.
+ */
+static void regblock_copy(const struct regblock_map *map, uint8_t first,
+			  uint8_t count, bool to_regs)
+{
+	uint32_t value, mask;
+	uint8_t addr;
+	int shift;
+	int i;
+
+	if (map->words == 2) {
+		value = *(volatile uint32_t *)map->var;
+	} else {
+		value = *(volatile uint16_t *)map->var;
+	}
+
+	for (i = 0; i < map->words; i++) {
+		addr = map->addr + (uint8_t)i;
+		if (addr < first || addr >= first + count) {
+			continue;
+		}
+		shift = 16 * i;
+		if (to_regs) {
+			regblock_state.regs[addr] = (uint16_t)(value >> shift);
+		} else {
+			mask = (uint32_t)0xffff << shift;
+			value = (value & ~mask) |
+				((uint32_t)regblock_state.regs[addr] << shift);
+		}
+	}
+
+	if (to_regs) {
+		return;
+	}
+
+	if (map->words == 2) {
+		*(volatile uint32_t *)map->var = value;
+	} else {
+		*(volatile uint16_t *)map->var = (uint16_t)value;
+	}
+}
+
+/**
+ * Take a snapshot of the mapped variables of a range of registers.
+ *
+ * @return false if the range does not exist.
+ */
+bool regblock_snapshot(uint8_t first, uint8_t count)
+{
+	uint32_t primask;
+	int i;
+
+	if (!regblock_range_valid(first, count)) {
+		return false;
+	}
+
+	primask = cm_mask_interrupts(1);
+	for (i = 0; i < regblock_state.map_count; i++) {
+		regblock_copy(&regblock_state.maps[i], first, count, true);
+	}
+	cm_mask_interrupts(primask);
+
+	return true;
+}
+
+/**
+ * Take a snapshot of a range of registers and have all registers of the
+ * range sent.
+ *
+ * @return false if the range does not exist.
+ */
+bool regblock_read(uint8_t first, uint8_t count)
+{
+	int i;
+
+	if (!regblock_snapshot(first, count)) {
+		return false;
+	}
+
+	if (regblock_state.touch_callback) {
+		for (i = first; i < first + count; i++) {
+			regblock_state.touch_callback((uint8_t)i);
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Apply a range of registers to the writable variables mapped onto them.
+ *
+ * @return false if the range does not exist.
+ */
+bool regblock_write(uint8_t first, uint8_t count)
+{
+	const struct regblock_map *map;
+	uint32_t primask;
+	int i;
+
+	if (!regblock_range_valid(first, count)) {
+		return false;
+	}
+
+	primask = cm_mask_interrupts(1);
+	for (i = 0; i < regblock_state.map_count; i++) {
+		map = &regblock_state.maps[i];
+		if (map->writable) {
+			regblock_copy(map, first, count, false);
+		}
+	}
+	cm_mask_interrupts(primask);
+
+	return true;
+}
@@ -0,0 +1,48 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __REGBLOCK_H
+#define __REGBLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Maximum number of variables mapped onto registers. */
+#define REGBLOCK_MAP_NUM 16
+
+enum regblock_width {
+	REGBLOCK_U16,
+	REGBLOCK_U32
+};
+
+/**
+ * Register touched callback type, tells the protocol to send a register.
+ *
+ * @param addr Register address.
+ */
+typedef void (*regblock_touch_callback_t)(uint8_t addr);
+
+void regblock_init(uint16_t *regs, uint8_t count,
+		   regblock_touch_callback_t touch_callback);
+int regblock_map(uint8_t addr, volatile void *var, enum regblock_width width,
+		 bool writable);
+bool regblock_snapshot(uint8_t first, uint8_t count);
+bool regblock_read(uint8_t first, uint8_t count);
+bool regblock_write(uint8_t first, uint8_t count);
+
+#endif /* __REGBLOCK_H */
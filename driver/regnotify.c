@@ -0,0 +1,163 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   regnotify.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Coalescing register change notifications.
+ *
+ * regnotify_touch() only sets the bit of the register in a dirty bitmap,
+ * it is cheap and can be called from any interrupt as often as the value
+ * changes. regnotify_flush(), called from the main loop, sends the dirty
+ * registers whose minimum update interval elapsed since they were sent
+ * last. Registers touched again before that stay dirty and are sent once,
+ * with the value they have by then. The link load of a register is so
+ * bounded by its interval, however fast it changes.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "driver/regnotify.h"
+
+#include "driver/sys_tick.h"
+
+/* Internal state. */
+struct regnotify_state {
+	regnotify_send_callback_t send_callback;
+	volatile uint32_t dirty; /**< Registers touched and not sent yet */
+	uint32_t fresh; /**< Registers never sent, not rate limited */
+	uint32_t interval[REGNOTIFY_REGS]; /**< Minimum send interval in us */
+	uint32_t last[REGNOTIFY_REGS]; /**< Sys Tick timer of the last send */
+	volatile uint32_t touches;
+	uint32_t sent;
+} regnotify_state;
+
+/**
+ * Initialize the dirty bitmap.
+ *
+ * @param send_callback Called for every register to send.
+ * @param interval Minimum send interval of all registers in us.
+ */
+void regnotify_init(regnotify_send_callback_t send_callback,
+		    uint32_t interval)
+{
+	int i;
+
+	regnotify_state.send_callback = send_callback;
+	regnotify_state.dirty = 0;
+	regnotify_state.fresh = 0xffffffff;
+	for (i = 0; i < REGNOTIFY_REGS; i++) {
+		regnotify_state.interval[i] = interval;
+		regnotify_state.last[i] = 0;
+	}
+	regnotify_state.touches = 0;
+	regnotify_state.sent = 0;
+}
+
+/**
+ * Set the minimum send interval of one register in us.
+ */
+void regnotify_set_interval(uint8_t addr, uint32_t interval)
+{
+	if (addr < REGNOTIFY_REGS) {
+		regnotify_state.interval[addr] = interval;
+	}
+}
+
+/**
+ * Mark a register as changed.
+ */
+void regnotify_touch(uint8_t addr)
+{
+	if (addr >= REGNOTIFY_REGS) {
+		return;
+	}
+
+	/* LDREX/STREX on the Cortex-M3, safe with the interrupts masked or
+	 * not and from any priority.
+	 */
+	__atomic_fetch_or(&regnotify_state.dirty, (uint32_t)1 << addr,
+			  __ATOMIC_RELAXED);
+	__atomic_fetch_add(&regnotify_state.touches, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Send the dirty registers that are due.
+ *
+ * @return Number of registers sent.
+ */
+int regnotify_flush(void)
+{
+	uint32_t dirty = regnotify_state.dirty;
+	uint32_t bit;
+	uint8_t addr;
+	int sent = 0;
+
+	while (dirty != 0) {
+		addr = (uint8_t)__builtin_ctz(dirty);
+		bit = (uint32_t)1 << addr;
+		dirty &= ~bit;
+
+		if ((regnotify_state.fresh & bit) == 0 &&
+		    !sys_tick_check_timer(regnotify_state.last[addr],
+					  regnotify_state.interval[addr])) {
+			continue;
+		}
+
+		/* Clear before sending, a touch from now on sends again. */
+		__atomic_fetch_and(&regnotify_state.dirty, ~bit,
+				   __ATOMIC_RELAXED);
+
+		regnotify_state.fresh &= ~bit;
+		regnotify_state.last[addr] = sys_tick_get_timer();
+		if (regnotify_state.send_callback) {
+			regnotify_state.send_callback(addr);
+		}
+		sent++;
+	}
+
+	regnotify_state.sent += (uint32_t)sent;
+
+	return sent;
+}
+
+/**
+ * Check if any register waits to be sent.
+ */
+bool regnotify_pending(void)
+{
+	return regnotify_state.dirty != 0;
+}
+
+/**
+ * Get the number of touches, sent or coalesced.
+ */
+uint32_t regnotify_get_touches(void)
+{
+	return regnotify_state.touches;
+}
+
+/**
+ * Get the number of registers sent.
+ */
+uint32_t regnotify_get_sent(void)
+{
+	return regnotify_state.sent;
+}
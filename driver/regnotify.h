@@ -0,0 +1,44 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __REGNOTIFY_H
+#define __REGNOTIFY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Number of registers, one bit each in the dirty bitmap. */
+#define REGNOTIFY_REGS 32
+
+/**
+ * Register send callback type, tells the protocol to send a register.
+ *
+ * @param addr Register address.
+ */
+typedef void (*regnotify_send_callback_t)(uint8_t addr);
+
+void regnotify_init(regnotify_send_callback_t send_callback,
+		    uint32_t interval);
+void regnotify_set_interval(uint8_t addr, uint32_t interval);
+void regnotify_touch(uint8_t addr);
+int regnotify_flush(void);
+bool regnotify_pending(void);
+uint32_t regnotify_get_touches(void);
+uint32_t regnotify_get_sent(void);
+
+#endif /* __REGNOTIFY_H */
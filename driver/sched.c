@@ -0,0 +1,298 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   sched.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Cooperative rate monotonic scheduler.
+ *
+ * Periodic tasks run to completion in the main loop, released on the Sys
+ * Tick time base. The task with the shortest period has the highest
+ * priority, after every task the scheduler starts over from the highest
+ * priority. The events the interrupts posted with event_post() run before
+ * any task. With nothing to do the core sleeps in WFI until the next
+ * interrupt, a Sys Tick soft timer wakes it up at the next release.
+ *
+ * The execution time of every task is measured with
+ * sys_tick_get_cycles().
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <libopencm3/cm3/cortex.h>
+
+#include "driver/sched.h"
+
+#include "driver/sys_tick.h"
+#include "driver/event.h"
+
+/* Number of task slots, override in the target CFLAGS if needed. */
+#ifndef SCHED_TASK_NUM
+#define SCHED_TASK_NUM 8
+#endif
+
+/* Sys Tick resolution in us. */
+#define SCHED_TICK_US 100
+
+/* Longest sleep without a task to release, in us. */
+#define SCHED_IDLE_US 100000
+
+struct sched_task {
+	sched_task_t task; /**< NULL while the slot is free */
+	uint32_t period; /**< Period in Sys Tick ticks */
+	uint32_t release; /**< Sys Tick time of the next release */
+	struct sched_stats stats;
+};
+
+/* Internal state. */
+struct sched_state {
+	struct sched_task tasks[SCHED_TASK_NUM];
+
+	/* Task slots ordered by period, shortest first. */
+	uint8_t order[SCHED_TASK_NUM];
+	uint8_t count;
+
+	int wakeup; /**< Sys Tick soft timer ending the sleep */
+	uint64_t idle_cycles;
+} sched_state;
+
+static void sched_wakeup_callback(int id)
+{
+	(void)id;
+}
+
+/**
+ * Initialize the scheduler, needs the Sys Tick driver.
+ */
+void sched_init(void)
+{
+	int i;
+
+	for (i = 0; i < SCHED_TASK_NUM; i++) {
+		sched_state.tasks[i].task = NULL;
+	}
+	sched_state.count = 0;
+	sched_state.idle_cycles = 0;
+	sched_state.wakeup = sys_tick_timer_register(sched_wakeup_callback,
+						     SCHED_IDLE_US);
+}
+
+/**
+ * Register a periodic task, it is first released one period from now.
+ *
+ * @param task Function to run.
+ * @param period Period in us, at least the Sys Tick resolution of 100us.
+ *
+ * @return Task id or -1 if all slots are taken.
+ */
+int sched_task_register(sched_task_t task, uint32_t period)
+{
+	struct sched_task *t;
+	int id, i;
+
+	for (id = 0; id < SCHED_TASK_NUM; id++) {
+		if (sched_state.tasks[id].task == NULL) {
+			break;
+		}
+	}
+	if (id == SCHED_TASK_NUM) {
+		return -1;
+	}
+
+	t = &sched_state.tasks[id];
+	t->task = task;
+	t->period = period / SCHED_TICK_US;
+	if (t->period == 0) {
+		t->period = 1;
+	}
+	t->release = sys_tick_get_timer() + t->period;
+	t->stats.runs = 0;
+	t->stats.skipped = 0;
+	t->stats.cycles_min = UINT32_MAX;
+	t->stats.cycles_max = 0;
+	t->stats.cycles_total = 0;
+	t->stats.latency_max = 0;
+
+	/* Insert by period, behind the tasks of the same period. */
+	for (i = sched_state.count; i > 0; i--) {
+		if (sched_state.tasks[sched_state.order[i - 1]].period <=
+		    t->period) {
+			break;
+		}
+		sched_state.order[i] = sched_state.order[i - 1];
+	}
+	sched_state.order[i] = (uint8_t)id;
+	sched_state.count++;
+
+	return id;
+}
+
+/**
+ * Remove a task, may be called from the task itself.
+ */
+void sched_task_unregister(int id)
+{
+	int i, j;
+
+	if (id < 0 || id >= SCHED_TASK_NUM ||
+	    sched_state.tasks[id].task == NULL) {
+		return;
+	}
+
+	sched_state.tasks[id].task = NULL;
+
+	for (i = 0, j = 0; i < sched_state.count; i++) {
+		if (sched_state.order[i] != id) {
+			sched_state.order[j++] = sched_state.order[i];
+		}
+	}
+	sched_state.count--;
+}
+
+/**
+ * Run a released task and account its execution time.
+ */
+static void sched_run_task(struct sched_task *t, uint32_t now)
+{
+	uint32_t late = now - t->release;
+	uint32_t start, cycles;
+
+	/* Skip the releases that passed while the task waited. */
+	if (late >= t->period) {
+		t->stats.skipped += late / t->period;
+		t->release += (late / t->period) * t->period;
+	}
+	t->release += t->period;
+
+	start = sys_tick_get_cycles();
+	if ((late * SCHED_TICK_US) > t->stats.latency_max) {
+		t->stats.latency_max = late * SCHED_TICK_US;
+	}
+
+	t->task();
+
+	cycles = sys_tick_get_cycles() - start;
+	t->stats.runs++;
+	t->stats.cycles_total += cycles;
+	if (cycles < t->stats.cycles_min) {
+		t->stats.cycles_min = cycles;
+	}
+	if (cycles > t->stats.cycles_max) {
+		t->stats.cycles_max = cycles;
+	}
+}
+
+/**
+ * Sleep until the next interrupt, unless there is work by now.
+ *
+ * The interrupts are masked from the last check on, an interrupt raised
+ * meanwhile ends the WFI right away and is served after it. The checks
+ * must not unmask them, hence sys_tick_get_timer_locked().
+ */
+static void sched_sleep(uint32_t now)
+{
+	uint32_t next = SCHED_IDLE_US / SCHED_TICK_US;
+	uint32_t start;
+	int i;
+
+	for (i = 0; i < sched_state.count; i++) {
+		if ((sched_state.tasks[sched_state.order[i]].release - now) <
+		    next) {
+			next = sched_state.tasks[sched_state.order[i]].release -
+			       now;
+		}
+	}
+	if (sched_state.wakeup >= 0) {
+		sys_tick_timer_update(sched_state.wakeup,
+				      next * SCHED_TICK_US);
+	}
+
+	start = sys_tick_get_cycles();
+	cm_disable_interrupts();
+	if (!event_pending() && sys_tick_get_timer_locked() == now) {
+		__WFI();
+	}
+	cm_enable_interrupts();
+	sched_state.idle_cycles += sys_tick_get_cycles() - start;
+}
+
+/**
+ * Run the pending events and the released task of the highest priority,
+ * or sleep until the next interrupt.
+ *
+ * @return true if something was run, false if the core slept.
+ */
+bool sched_process(void)
+{
+	struct sched_task *t;
+	uint32_t now;
+	int i;
+
+	if (event_process() != 0) {
+		return true;
+	}
+
+	now = sys_tick_get_timer();
+
+	for (i = 0; i < sched_state.count; i++) {
+		t = &sched_state.tasks[sched_state.order[i]];
+		if ((int32_t)(now - t->release) >= 0) {
+			sched_run_task(t, now);
+			return true;
+		}
+	}
+
+	sched_sleep(now);
+	return false;
+}
+
+/**
+ * Scheduler main loop.
+ */
+void sched_run(void)
+{
+	while (true) {
+		(void)sched_process();
+	}
+}
+
+/**
+ * Get the execution statistics of a task.
+ *
+ * @return NULL if id is no registered task.
+ */
+const struct sched_stats *sched_get_stats(int id)
+{
+	if (id < 0 || id >= SCHED_TASK_NUM ||
+	    sched_state.tasks[id].task == NULL) {
+		return NULL;
+	}
+
+	return &sched_state.tasks[id].stats;
+}
+
+/**
+ * Get the core clock cycles the scheduler slept.
+ */
+uint64_t sched_get_idle_cycles(void)
+{
+	return sched_state.idle_cycles;
+}
@@ -0,0 +1,46 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __SCHED_H
+#define __SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef void (*sched_task_t)(void);
+
+/**
+ * Execution statistics of one task.
+ */
+struct sched_stats {
+	uint32_t runs;
+	uint32_t skipped; /**< Releases missed because the task ran late */
+	uint32_t cycles_min; /**< Shortest run in core clock cycles */
+	uint32_t cycles_max; /**< Longest run in core clock cycles */
+	uint64_t cycles_total;
+	uint32_t latency_max; /**< Longest wait from release to start in us */
+};
+
+void sched_init(void);
+int sched_task_register(sched_task_t task, uint32_t period);
+void sched_task_unregister(int id);
+bool sched_process(void);
+void sched_run(void) __attribute__((noreturn));
+const struct sched_stats *sched_get_stats(int id);
+uint64_t sched_get_idle_cycles(void);
+
+#endif /* __SCHED_H */
@@ -0,0 +1,414 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   scope.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Triggered capture of control loop variables.
+ *
+ * Records up to SCOPE_CHANNELS channels in the ADC DMA callback, at the
+ * full ADC callback rate or decimated, into a static buffer used as a ring.
+ * A channel is an ADC raw_data slot, a 16 bit variable or a getter
+ * function, all stored as 16 bit samples. The buffer holds
+ * SCOPE_BUFFER_SIZE / channels samples of every channel.
+ *
+ * scope_arm() starts recording. Once the ring holds the requested number of
+ * pre trigger samples the trigger is checked on every sample: a rising or
+ * falling edge of a channel through a level, any change of a channel, or
+ * scope_trigger() called from anywhere, like a register write. Recording
+ * stops when the samples after the trigger fill the rest of the buffer.
+ * The capture then stays in RAM until the next scope_arm() and is read out
+ * at leisure with scope_read(), sample pre_samples being the trigger.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "driver/scope.h"
+
+enum scope_source {
+	SCOPE_SOURCE_RAW,
+	SCOPE_SOURCE_VAR,
+	SCOPE_SOURCE_GETTER
+};
+
+struct scope_channel {
+	enum scope_source source;
+	const volatile int16_t *var;
+	scope_getter_t getter;
+	uint8_t slots[2]; /**< raw_data slot in the first and second half */
+};
+
+/* Internal state. */
+struct scope_state {
+	struct scope_channel channels[SCOPE_CHANNELS];
+	int count; /**< Configured channels */
+	volatile enum scope_mode mode;
+
+	int trigger_channel;
+	enum scope_trigger trigger;
+	int32_t level;
+	int16_t last; /**< Previous sample of the trigger channel */
+	bool have_last; /**< last holds a sample of this capture */
+	volatile bool manual; /**< scope_trigger() was called */
+
+	uint16_t decimation;
+	uint16_t skipped; /**< ADC callbacks since the last sample */
+
+	uint16_t depth; /**< Samples per channel */
+	uint16_t pre; /**< Samples to keep before the trigger */
+	uint16_t filled; /**< Samples recorded since arming, up to pre */
+	uint16_t remaining; /**< Samples still to record after the trigger */
+	uint16_t write; /**< Next sample to write */
+	uint16_t start; /**< Oldest sample of the finished capture */
+
+	int16_t buffer[SCOPE_BUFFER_SIZE];
+} scope_state;
+
+/**
+ * Initialize the internal state, no channels configured.
+ */
+void scope_init(void)
+{
+	scope_state.count = 0;
+	scope_state.mode = SCOPE_IDLE;
+	scope_state.trigger_channel = 0;
+	scope_state.trigger = SCOPE_TRIGGER_MANUAL;
+	scope_state.level = 0;
+	scope_state.manual = false;
+	scope_state.decimation = 1;
+	scope_state.skipped = 0;
+	scope_state.depth = 0;
+}
+
+/**
+ * Reserve the next channel, only while not recording.
+ */
+static struct scope_channel *scope_add(enum scope_source source)
+{
+	struct scope_channel *channel;
+
+	if (scope_state.mode == SCOPE_ARMED ||
+	    scope_state.mode == SCOPE_TRIGGERED ||
+	    scope_state.count >= SCOPE_CHANNELS) {
+		return NULL;
+	}
+
+	/* The buffer layout changes, the last capture is gone. */
+	scope_state.mode = SCOPE_IDLE;
+
+	channel = &scope_state.channels[scope_state.count];
+	channel->source = source;
+	channel->var = NULL;
+	channel->getter = NULL;
+	channel->slots[0] = 0;
+	channel->slots[1] = 0;
+
+	return channel;
+}
+
+/**
+ * Add an ADC sample channel.
+ *
+ * @param slot1 raw_data slot of the sample in the first half.
+ * @param slot2 raw_data slot of the same sample in the second half.
+ *
+ * @return Channel index, or -1 if recording or all channels are used.
+ */
+int scope_add_raw(int slot1, int slot2)
+{
+	struct scope_channel *channel = scope_add(SCOPE_SOURCE_RAW);
+
+	if (channel == NULL) {
+		return -1;
+	}
+
+	channel->slots[0] = (uint8_t)slot1;
+	channel->slots[1] = (uint8_t)slot2;
+
+	return scope_state.count++;
+}
+
+/**
+ * Add a variable channel.
+ *
+ * @return Channel index, or -1 if recording or all channels are used.
+ */
+int scope_add_var(const volatile int16_t *var)
+{
+	struct scope_channel *channel = scope_add(SCOPE_SOURCE_VAR);
+
+	if (channel == NULL) {
+		return -1;
+	}
+
+	channel->var = var;
+
+	return scope_state.count++;
+}
+
+/**
+ * Add a channel sampled by calling a function in the ADC interrupt, the
+ * result is truncated to 16 bit.
+ *
+ * @return Channel index, or -1 if recording or all channels are used.
+ */
+int scope_add_getter(scope_getter_t getter)
+{
+	struct scope_channel *channel = scope_add(SCOPE_SOURCE_GETTER);
+
+	if (channel == NULL) {
+		return -1;
+	}
+
+	channel->getter = getter;
+
+	return scope_state.count++;
+}
+
+/**
+ * Remove all channels, only while not recording.
+ */
+void scope_clear(void)
+{
+	if (scope_state.mode != SCOPE_ARMED &&
+	    scope_state.mode != SCOPE_TRIGGERED) {
+		scope_state.mode = SCOPE_IDLE;
+		scope_state.count = 0;
+	}
+}
+
+/**
+ * Set the trigger condition, used by the next scope_arm().
+ *
+ * @param channel Channel the trigger looks at.
+ * @param trigger Condition, edges trigger on the first sample past level.
+ * @param level Trigger level of the edge conditions.
+ */
+void scope_set_trigger(int channel, enum scope_trigger trigger,
+		       int32_t level)
+{
+	scope_state.trigger_channel = channel;
+	scope_state.trigger = trigger;
+	scope_state.level = level;
+}
+
+/**
+ * Record every decimation-th ADC callback.
+ */
+void scope_set_decimation(uint16_t decimation)
+{
+	scope_state.decimation = (decimation != 0) ? decimation : 1;
+}
+
+/**
+ * Start recording and wait for the trigger.
+ *
+ * @param pre_samples Samples to keep before the trigger.
+ *
+ * @return false if there are no channels, the trigger channel does not
+ *         exist or pre_samples does not leave room for the trigger.
+ */
+bool scope_arm(uint16_t pre_samples)
+{
+	uint16_t depth;
+
+	if (scope_state.count == 0 ||
+	    (scope_state.trigger != SCOPE_TRIGGER_MANUAL &&
+	     scope_state.trigger_channel >= scope_state.count)) {
+		return false;
+	}
+
+	depth = SCOPE_BUFFER_SIZE / (uint16_t)scope_state.count;
+	if (pre_samples >= depth) {
+		return false;
+	}
+
+	scope_state.mode = SCOPE_IDLE;
+	scope_state.depth = depth;
+	scope_state.pre = pre_samples;
+	scope_state.filled = 0;
+	scope_state.have_last = false;
+	scope_state.write = 0;
+	scope_state.skipped = 0;
+	scope_state.manual = false;
+	scope_state.mode = SCOPE_ARMED;
+
+	return true;
+}
+
+/**
+ * Trigger the capture now, or as soon as the pre trigger samples are in.
+ */
+void scope_trigger(void)
+{
+	scope_state.manual = true;
+}
+
+/**
+ * Stop recording, a finished capture stays readable.
+ */
+void scope_stop(void)
+{
+	if (scope_state.mode != SCOPE_DONE) {
+		scope_state.mode = SCOPE_IDLE;
+	}
+}
+
+/**
+ * Check the trigger condition on the latest sample.
+ */
+static bool scope_check_trigger(int16_t value)
+{
+	bool triggered = scope_state.manual;
+
+	if (!scope_state.have_last) {
+		return triggered;
+	}
+
+	switch (scope_state.trigger) {
+	case SCOPE_TRIGGER_RISING:
+		triggered |= scope_state.last <= scope_state.level &&
+			     value > scope_state.level;
+		break;
+	case SCOPE_TRIGGER_FALLING:
+		triggered |= scope_state.last >= scope_state.level &&
+			     value < scope_state.level;
+		break;
+	case SCOPE_TRIGGER_CHANGE:
+		triggered |= value != scope_state.last;
+		break;
+	case SCOPE_TRIGGER_MANUAL:
+	default:
+		break;
+	}
+
+	return triggered;
+}
+
+/**
+ * ADC DMA callback, records a sample and runs the trigger.
+ */
+void scope_adc_callback(bool transfer_complete, uint16_t *raw_data)
+{
+	const struct scope_channel *channel;
+	int16_t *row;
+	int16_t value;
+	int half = transfer_complete ? 1 : 0;
+	int i;
+
+	if (scope_state.mode != SCOPE_ARMED &&
+	    scope_state.mode != SCOPE_TRIGGERED) {
+		return;
+	}
+
+	if (++scope_state.skipped < scope_state.decimation) {
+		return;
+	}
+	scope_state.skipped = 0;
+
+	row = &scope_state.buffer[scope_state.write *
+				  (uint16_t)scope_state.count];
+	for (i = 0; i < scope_state.count; i++) {
+		channel = &scope_state.channels[i];
+		switch (channel->source) {
+		case SCOPE_SOURCE_RAW:
+			row[i] = (int16_t)raw_data[channel->slots[half]];
+			break;
+		case SCOPE_SOURCE_VAR:
+			row[i] = *channel->var;
+			break;
+		case SCOPE_SOURCE_GETTER:
+			row[i] = (int16_t)channel->getter();
+			break;
+		}
+	}
+
+	if (++scope_state.write == scope_state.depth) {
+		scope_state.write = 0;
+	}
+
+	if (scope_state.mode == SCOPE_TRIGGERED) {
+		if (--scope_state.remaining == 0) {
+			scope_state.start = scope_state.write;
+			scope_state.mode = SCOPE_DONE;
+		}
+		return;
+	}
+
+	/* Armed, wait for the pre trigger samples, then for the trigger. */
+	value = (scope_state.trigger_channel < scope_state.count) ?
+		row[scope_state.trigger_channel] : 0;
+
+	if (scope_state.filled < scope_state.pre) {
+		scope_state.filled++;
+	} else if (scope_check_trigger(value)) {
+		scope_state.remaining = scope_state.depth - scope_state.pre - 1;
+		if (scope_state.remaining == 0) {
+			scope_state.start = scope_state.write;
+			scope_state.mode = SCOPE_DONE;
+		} else {
+			scope_state.mode = SCOPE_TRIGGERED;
+		}
+		return;
+	}
+
+	scope_state.last = value;
+	scope_state.have_last = true;
+}
+
+enum scope_mode scope_get_mode(void)
+{
+	return scope_state.mode;
+}
+
+/**
+ * Get the samples per channel of the capture.
+ */
+uint16_t scope_get_depth(void)
+{
+	return scope_state.depth;
+}
+
+/**
+ * Read a sample of the finished capture.
+ *
+ * @param sample Sample index, 0 is the oldest, pre_samples the trigger.
+ * @param channel Channel index.
+ *
+ * @return The sample, 0 if there is no capture or no such sample.
+ */
+int16_t scope_read(uint16_t sample, int channel)
+{
+	uint16_t index;
+
+	if (scope_state.mode != SCOPE_DONE || sample >= scope_state.depth ||
+	    channel < 0 || channel >= scope_state.count) {
+		return 0;
+	}
+
+	index = scope_state.start + sample;
+	if (index >= scope_state.depth) {
+		index -= scope_state.depth;
+	}
+
+	return scope_state.buffer[(index * (uint16_t)scope_state.count) +
+				  (uint16_t)channel];
+}
@@ -0,0 +1,63 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCOPE_H
+#define __SCOPE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Maximum number of channels captured together. */
+#define SCOPE_CHANNELS 4
+
+/* Capture buffer size in samples of all channels together. */
+#define SCOPE_BUFFER_SIZE 4096
+
+enum scope_trigger {
+	SCOPE_TRIGGER_MANUAL,
+	SCOPE_TRIGGER_RISING,
+	SCOPE_TRIGGER_FALLING,
+	SCOPE_TRIGGER_CHANGE
+};
+
+enum scope_mode {
+	SCOPE_IDLE,
+	SCOPE_ARMED,
+	SCOPE_TRIGGERED,
+	SCOPE_DONE
+};
+
+typedef int32_t (*scope_getter_t)(void);
+
+void scope_init(void);
+int scope_add_raw(int slot1, int slot2);
+int scope_add_var(const volatile int16_t *var);
+int scope_add_getter(scope_getter_t getter);
+void scope_clear(void);
+void scope_set_trigger(int channel, enum scope_trigger trigger,
+		       int32_t level);
+void scope_set_decimation(uint16_t decimation);
+bool scope_arm(uint16_t pre_samples);
+void scope_trigger(void);
+void scope_stop(void);
+void scope_adc_callback(bool transfer_complete, uint16_t *raw_data);
+enum scope_mode scope_get_mode(void);
+uint16_t scope_get_depth(void);
+int16_t scope_read(uint16_t sample, int channel);
+
+#endif /* __SCOPE_H */
@@ -24,6 +24,11 @@
  *
  * Sys Tick is a part of the Cortex M3 core and can be used as a system timer.
  * This implementation uses it as a coarce soft timer source.
+ *
+ * By default Sys Tick interrupts every SYS_TICK_RESOLUTION. Built with
+ * -DSYS_TICK_TICKLESS the period is reprogrammed instead to end when the
+ * next soft timer expires, at least every SYS_TICK_MAX_TICKS, and the time
+ * in between is read from the counter.
  */
 
 #include <stdint.h>
@@ -31,8 +36,11 @@
 #include <stdbool.h>
 
 #include <libopencm3/cm3/systick.h>
+#include <libopencm3/cm3/cortex.h>
 
 #include "driver/sys_tick.h"
+#include "driver/mcu.h"
+#include "driver/profile.h"
 
 #include "driver/led.h"
 
@@ -48,10 +56,54 @@
  */
 #define SYS_TICK_RESOLUTION 100
 
+/**
+ * Core clock cycles per SYS_TICK_RESOLUTION.
+ */
+#define SYS_TICK_CYCLES (MCU_HCLK / (1000000 / SYS_TICK_RESOLUTION))
+
+#if (MCU_HCLK % (1000000 / SYS_TICK_RESOLUTION)) != 0
+#error "AHB clock is not a multiple of the Sys Tick rate"
+#endif
+
 /**
  * Private global sys tick counter.
  */
-static uint32_t sys_tick_global_counter;
+static volatile uint32_t sys_tick_global_counter;
+
+#ifdef SYS_TICK_TICKLESS
+/**
+ * Longest Sys Tick period in SYS_TICK_RESOLUTION ticks, the reload value
+ * has 24bit.
+ */
+#define SYS_TICK_MAX_TICKS ((STK_LOAD_RELOAD + 1) / SYS_TICK_CYCLES)
+
+/**
+ * Core clock cycles from the last read of the counter in
+ * sys_tick_program() to its restart. Override in the target CFLAGS, the
+ * simulation runs the code between two interrupts in no time.
+ */
+#ifndef SYS_TICK_RESTART_CYCLES
+#define SYS_TICK_RESTART_CYCLES 20
+#endif
+
+/**
+ * Length of the current period in ticks, it started at
+ * sys_tick_global_counter.
+ */
+static uint32_t sys_tick_period;
+
+/**
+ * Core clock cycles of the current period that elapsed before the counter
+ * was restarted last.
+ */
+static uint32_t sys_tick_offset;
+
+/**
+ * Set while the handler runs the callbacks, it programs the next period
+ * once they are done.
+ */
+static bool sys_tick_dispatching;
+#endif
 
 /**
  * Represents one Sys Tick based soft timer.
@@ -59,7 +111,7 @@ static uint32_t sys_tick_global_counter;
 struct sys_tick_timer {
 	sys_tick_timer_callback_t callback; /**< Callback fn-pointer */
 	uint32_t start_time; /**< Start timestamp of the timer */
-	uint32_t delta_time; /**< Duration of the timer */
+	uint32_t delta_ticks; /**< Duration of the timer in ticks */
 };
 
 /**
@@ -76,19 +128,140 @@ void sys_tick_init(void)
 
 	/* Setup SysTick Timer for 100uSec Interrupts */
 	systick_set_clocksource(STK_CTRL_CLKSOURCE_AHB);
-	systick_set_reload((64000000 / (1000000 / SYS_TICK_RESOLUTION)) - 1);
+#ifdef SYS_TICK_TICKLESS
+	/* No timers yet, interrupt only to keep the counter going. */
+	systick_set_reload((SYS_TICK_MAX_TICKS * SYS_TICK_CYCLES) - 1);
+	sys_tick_period = SYS_TICK_MAX_TICKS;
+	sys_tick_offset = 0;
+	sys_tick_dispatching = false;
+#else
+	systick_set_reload(SYS_TICK_CYCLES - 1);
+#endif
 	systick_interrupt_enable();
 
 	for (i = 0; i < SYS_TICK_TIMER_NUM; i++) {
 		sys_tick_timers[i].callback = NULL;
 		sys_tick_timers[i].start_time = 0;
-		sys_tick_timers[i].delta_time = 0;
+		sys_tick_timers[i].delta_ticks = 0;
 	}
 
 	/* Start counting. */
 	systick_counter_enable();
 }
 
+#ifdef SYS_TICK_TICKLESS
+/**
+ * Core clock cycles elapsed in the current period.
+ *
+ * A period that ended but was not handled yet is accounted for here, the
+ * handler only adds it when it still finds COUNTFLAG set. Reading
+ * COUNTFLAG clears it, call this with the interrupts disabled or from the
+ * handler.
+ */
+static uint32_t sys_tick_elapsed(void)
+{
+	uint32_t value = systick_get_value();
+
+	if (systick_get_countflag()) {
+		sys_tick_global_counter += sys_tick_period;
+		sys_tick_offset = 0;
+		value = systick_get_value();
+	}
+
+	/* The counter stays zero after a restart until it reloads, the
+	 * reload takes one cycle.
+	 */
+	if (value == 0) {
+		return sys_tick_offset;
+	}
+
+	return sys_tick_offset + systick_get_reload() + 1 - value;
+}
+
+/**
+ * Earliest soft timer deadline in ticks relative to the start of the
+ * period, SYS_TICK_MAX_TICKS without timers.
+ *
+ * @param now Ticks of the period that elapsed.
+ */
+static uint32_t sys_tick_program_next(uint32_t now)
+{
+	uint32_t next = SYS_TICK_MAX_TICKS;
+	uint32_t due;
+	int i;
+
+	for (i = 0; i < SYS_TICK_TIMER_NUM; i++) {
+		if (sys_tick_timers[i].callback == NULL) {
+			continue;
+		}
+		due = sys_tick_timers[i].start_time +
+		      sys_tick_timers[i].delta_ticks -
+		      sys_tick_global_counter;
+		/* Overdue timers run at the next tick. */
+		if ((int32_t)(due - now) <= 0) {
+			due = now + 1;
+		}
+		if (due < next) {
+			next = due;
+		}
+	}
+
+	return next;
+}
+
+/**
+ * Let the current period end with the next expiring soft timer.
+ *
+ * The counter is restarted with the cycles that are left, the elapsed ones
+ * are kept in sys_tick_offset. With only SYS_TICK_TIMER_NUM slots a scan
+ * for the earliest one is cheaper than keeping them sorted. The counter is
+ * read again after the scan and the cycles up to the restart are added, so
+ * no cycles get lost on a reprogram. Call with the interrupts disabled.
+ */
+static void sys_tick_program(void)
+{
+	uint32_t counter, elapsed, now, next;
+
+	do {
+		elapsed = sys_tick_elapsed();
+		counter = sys_tick_global_counter;
+
+		/* Ticks relative to the start of the period. */
+		now = elapsed / SYS_TICK_CYCLES;
+		next = sys_tick_program_next(now);
+
+		/* The period may have ended during the scan. */
+		elapsed = sys_tick_elapsed() + SYS_TICK_RESTART_CYCLES;
+	} while (counter != sys_tick_global_counter);
+
+	/* A reload value of 0 would stop the counter. */
+	while ((int32_t)((next * SYS_TICK_CYCLES) - elapsed) < 2) {
+		next++;
+	}
+
+	systick_set_reload((next * SYS_TICK_CYCLES) - elapsed - 1);
+	STK_VAL = 0;
+	sys_tick_offset = elapsed;
+	sys_tick_period = next;
+}
+
+/**
+ * Reprogram the period after a timer changed, unless the handler does it.
+ */
+static void sys_tick_reschedule(void)
+{
+	uint32_t primask;
+
+	if (sys_tick_dispatching) {
+		return;
+	}
+
+	primask = cm_mask_interrupts(1);
+	sys_tick_program();
+	cm_mask_interrupts(primask);
+}
+#endif
+
 /**
  * Get a new timer.
  *
@@ -99,7 +272,81 @@ void sys_tick_init(void)
  */
 uint32_t sys_tick_get_timer(void)
 {
+#ifdef SYS_TICK_TICKLESS
+	uint32_t timer, primask;
+
+	primask = cm_mask_interrupts(1);
+	timer = sys_tick_get_timer_locked();
+	cm_mask_interrupts(primask);
+
+	return timer;
+#else
+	return sys_tick_global_counter;
+#endif
+}
+
+/**
+ * Get a new timer with the interrupts already masked.
+ *
+ * Same as sys_tick_get_timer() but leaves PRIMASK alone, for code that
+ * checks the time and goes to sleep without unmasking the interrupts in
+ * between.
+ *
+ * @return Timer ID
+ */
+uint32_t sys_tick_get_timer_locked(void)
+{
+#ifdef SYS_TICK_TICKLESS
+	/* The callbacks run at the end of the period. */
+	if (sys_tick_dispatching) {
+		return sys_tick_global_counter;
+	}
+
+	return sys_tick_global_counter +
+	       (sys_tick_elapsed() / SYS_TICK_CYCLES);
+#else
 	return sys_tick_global_counter;
+#endif
+}
+
+/**
+ * Get a time stamp in core clock cycles, for measuring short durations.
+ *
+ * Combines the tick counter with the Sys Tick counter value, it wraps
+ * after about a minute. While Sys Tick has to wait for its interrupt to be
+ * served the time stamp may be a tick early.
+ *
+ * @return Core clock cycles since sys_tick_init().
+ */
+uint32_t sys_tick_get_cycles(void)
+{
+#ifdef SYS_TICK_TICKLESS
+	uint32_t elapsed, primask;
+
+	if (sys_tick_dispatching) {
+		elapsed = sys_tick_elapsed();
+	} else {
+		primask = cm_mask_interrupts(1);
+		elapsed = sys_tick_elapsed();
+		cm_mask_interrupts(primask);
+	}
+
+	return (sys_tick_global_counter * SYS_TICK_CYCLES) + elapsed;
+#else
+	uint32_t counter, value;
+
+	do {
+		counter = sys_tick_global_counter;
+		value = systick_get_value();
+	} while (counter != sys_tick_global_counter);
+
+	/* Zero right after the end of a period, before the reload. */
+	if (value == 0) {
+		return counter * SYS_TICK_CYCLES;
+	}
+
+	return (counter * SYS_TICK_CYCLES) + SYS_TICK_CYCLES - value;
+#endif
 }
 
 /**
@@ -112,7 +359,7 @@ uint32_t sys_tick_get_timer(void)
  */
 bool sys_tick_check_timer(uint32_t timer, uint32_t time)
 {
-	if ((sys_tick_global_counter - timer) >= (time / SYS_TICK_RESOLUTION)) {
+	if ((sys_tick_get_timer() - timer) >= (time / SYS_TICK_RESOLUTION)) {
 		return true;
 	} else {
 		return false;
@@ -130,13 +377,17 @@ bool sys_tick_check_timer(uint32_t timer, uint32_t time)
 int sys_tick_timer_register(sys_tick_timer_callback_t callback, uint32_t time)
 {
 	int i;
-	uint32_t start_time = sys_tick_global_counter;
+	uint32_t start_time = sys_tick_get_timer();
 
 	for (i = 0; i < SYS_TICK_TIMER_NUM; i++) {
 		if (!sys_tick_timers[i].callback) {
 			sys_tick_timers[i].callback = callback;
 			sys_tick_timers[i].start_time = start_time;
-			sys_tick_timers[i].delta_time = time;
+			sys_tick_timers[i].delta_ticks =
+				time / SYS_TICK_RESOLUTION;
+#ifdef SYS_TICK_TICKLESS
+			sys_tick_reschedule();
+#endif
 			return i;
 		}
 	}
@@ -151,7 +402,10 @@ void sys_tick_timer_unregister(int id)
 {
 	sys_tick_timers[id].callback = NULL;
 	sys_tick_timers[id].start_time = 0;
-	sys_tick_timers[id].delta_time = 0;
+	sys_tick_timers[id].delta_ticks = 0;
+#ifdef SYS_TICK_TICKLESS
+	sys_tick_reschedule();
+#endif
 }
 
 /**
@@ -159,8 +413,11 @@ void sys_tick_timer_unregister(int id)
  */
 void sys_tick_timer_update(int id, uint32_t time)
 {
-	sys_tick_timers[id].start_time = sys_tick_global_counter;
-	sys_tick_timers[id].delta_time = time;
+	sys_tick_timers[id].start_time = sys_tick_get_timer();
+	sys_tick_timers[id].delta_ticks = time / SYS_TICK_RESOLUTION;
+#ifdef SYS_TICK_TICKLESS
+	sys_tick_reschedule();
+#endif
 }
 
 /**
@@ -168,16 +425,41 @@ void sys_tick_timer_update(int id, uint32_t time)
  */
 void sys_tick_handler(void)
 {
+#ifdef SYS_TICK_TICKLESS
+	uint32_t primask;
+#endif
 	int i;
 
+	PROFILE_ENTER();
+
+#ifdef SYS_TICK_TICKLESS
+	/* Adds the period that just ended to the counter. */
+	(void)sys_tick_elapsed();
+	sys_tick_dispatching = true;
+#else
 	sys_tick_global_counter++;
+#endif
 
+	/* The durations are in ticks already, no division per timer. */
 	for (i = 0; i < SYS_TICK_TIMER_NUM; i++) {
 		if ((sys_tick_timers[i].callback != NULL) &&
-		    sys_tick_check_timer(sys_tick_timers[i].start_time,
-					 sys_tick_timers[i].delta_time)) {
+		    (sys_tick_global_counter -
+		     sys_tick_timers[i].start_time) >=
+		    sys_tick_timers[i].delta_ticks) {
 			sys_tick_timers[i].start_time = sys_tick_global_counter;
 			sys_tick_timers[i].callback(i);
 		}
 	}
+
+#ifdef SYS_TICK_TICKLESS
+	/* A higher priority handler reading the time in the middle of the
+	 * reprogram would see the new reload against the old offset.
+	 */
+	primask = cm_mask_interrupts(1);
+	sys_tick_dispatching = false;
+	sys_tick_program();
+	cm_mask_interrupts(primask);
+#endif
+
+	PROFILE_EXIT(PROFILE_SYS_TICK);
 }
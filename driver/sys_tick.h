@@ -30,6 +30,8 @@ typedef void (*sys_tick_timer_callback_t) (int id);
 
 void sys_tick_init(void);
 uint32_t sys_tick_get_timer(void);
+uint32_t sys_tick_get_timer_locked(void);
+uint32_t sys_tick_get_cycles(void);
 bool sys_tick_check_timer(uint32_t timer, uint32_t time);
 int sys_tick_timer_register(sys_tick_timer_callback_t callback, uint32_t time);
 void sys_tick_timer_unregister(int id);
@@ -0,0 +1,442 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   telemetry.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Binary telemetry stream of control loop variables.
+ *
+ * Samples up to TELEMETRY_CHANNELS channels in the ADC DMA callback, every
+ * n-th call as set by the decimation, into a ring of records. A channel is
+ * an ADC raw_data slot, a variable or a getter function that is called in
+ * the ADC interrupt. The USART send callback encodes the records into
+ * frames while sending them, so a record dropped on a full ring does not
+ * disturb the encoding of the next.
+ *
+ * Frame format, COBS encoded and terminated by a zero byte:
+ * - header: bits 0-6 sample sequence number, counting dropped samples too,
+ *   bit 7 (TELEMETRY_KEYFRAME) set if the values are absolute
+ * - one varint per channel, little endian groups of seven bits, bit 7 set
+ *   on all but the last group, of the zigzag encoded difference to the
+ *   previous frame, or of the zigzag encoded value in a keyframe
+ * - checksum, the bytes of the frame before decoding add up to zero
+ *
+ * The first frame after telemetry_start() and every
+ * TELEMETRY_KEYFRAME_INTERVAL-th frame is a keyframe, a host that lost a
+ * frame synchronizes again with it.
+ *
+ * Pass telemetry_adc_callback() to adc_init(), or call it from the ADC
+ * callbacks, and telemetry_get_byte() to usart_init().
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "driver/telemetry.h"
+
+#include "driver/cobs.h"
+#include "driver/usart.h"
+
+/* Number of records in the ring, has to be a power of two. */
+#define TELEMETRY_RING_SIZE 32
+
+#if (TELEMETRY_RING_SIZE & (TELEMETRY_RING_SIZE - 1)) != 0
+#error "TELEMETRY_RING_SIZE has to be a power of two"
+#endif
+
+#if TELEMETRY_FRAME_MAX > 254
+#error "Telemetry frames have to fit into one COBS block"
+#endif
+
+/* Keeps the compiler from moving record accesses across head and tail
+ * updates.
+ */
+#define TELEMETRY_BARRIER() __asm__ volatile ("" : : : "memory")
+
+enum telemetry_source {
+	TELEMETRY_SOURCE_RAW,
+	TELEMETRY_SOURCE_VAR,
+	TELEMETRY_SOURCE_GETTER
+};
+
+struct telemetry_channel {
+	enum telemetry_source source;
+	enum telemetry_type type;
+	const volatile void *var;
+	telemetry_getter_t getter;
+	uint8_t slots[2]; /**< raw_data slot in the first and second half */
+};
+
+struct telemetry_record {
+	uint8_t seq; /**< Sample sequence number */
+	uint8_t count; /**< Number of channels */
+	bool key; /**< First record after start */
+	int32_t values[TELEMETRY_CHANNELS];
+};
+
+/* Internal state. */
+struct telemetry_state {
+	struct telemetry_channel channels[TELEMETRY_CHANNELS];
+	int count; /**< Configured channels */
+	volatile bool running;
+	volatile bool restarted; /**< Next record is the first after start */
+	uint16_t decimation;
+	uint16_t skipped; /**< ADC callbacks since the last sample */
+	uint8_t seq;
+
+	struct telemetry_record ring[TELEMETRY_RING_SIZE];
+	volatile uint16_t head; /**< Next record to write, sampler only */
+	volatile uint16_t tail; /**< Next record to send, sender only */
+	volatile bool sending; /**< The USART collects bytes from us */
+
+	uint8_t frame[TELEMETRY_FRAME_MAX];
+	uint8_t frame_len;
+	uint8_t frame_pos;
+	int32_t previous[TELEMETRY_CHANNELS]; /**< Values of the last frame */
+	uint16_t since_keyframe;
+
+	volatile uint32_t records;
+	volatile uint32_t dropped;
+} telemetry_state;
+
+/**
+ * Initialize the internal state, no channels configured.
+ */
+void telemetry_init(void)
+{
+	telemetry_state.count = 0;
+	telemetry_state.running = false;
+	telemetry_state.restarted = false;
+	telemetry_state.decimation = 1;
+	telemetry_state.skipped = 0;
+	telemetry_state.seq = 0;
+	telemetry_state.head = 0;
+	telemetry_state.tail = 0;
+	telemetry_state.sending = false;
+	telemetry_state.frame_len = 0;
+	telemetry_state.frame_pos = 0;
+	telemetry_state.since_keyframe = 0;
+	telemetry_state.records = 0;
+	telemetry_state.dropped = 0;
+}
+
+/**
+ * Reserve the next channel, only while stopped.
+ */
+static struct telemetry_channel *telemetry_add(enum telemetry_source source)
+{
+	struct telemetry_channel *channel;
+
+	if (telemetry_state.running ||
+	    telemetry_state.count >= TELEMETRY_CHANNELS) {
+		return NULL;
+	}
+
+	channel = &telemetry_state.channels[telemetry_state.count];
+	channel->source = source;
+	channel->type = TELEMETRY_S32;
+	channel->var = NULL;
+	channel->getter = NULL;
+	channel->slots[0] = 0;
+	channel->slots[1] = 0;
+
+	return channel;
+}
+
+/**
+ * Add an ADC sample channel.
+ *
+ * @param slot1 raw_data slot of the sample in the first half.
+ * @param slot2 raw_data slot of the same sample in the second half.
+ *
+ * @return Channel index, or -1 if running or all channels are used.
+ */
+int telemetry_add_raw(int slot1, int slot2)
+{
+	struct telemetry_channel *channel =
+		telemetry_add(TELEMETRY_SOURCE_RAW);
+
+	if (channel == NULL) {
+		return -1;
+	}
+
+	channel->type = TELEMETRY_U16;
+	channel->slots[0] = (uint8_t)slot1;
+	channel->slots[1] = (uint8_t)slot2;
+
+	return telemetry_state.count++;
+}
+
+/**
+ * Add a variable channel.
+ *
+ * @return Channel index, or -1 if running or all channels are used.
+ */
+int telemetry_add_var(const volatile void *var, enum telemetry_type type)
+{
+	struct telemetry_channel *channel =
+		telemetry_add(TELEMETRY_SOURCE_VAR);
+
+	if (channel == NULL) {
+		return -1;
+	}
+
+	channel->type = type;
+	channel->var = var;
+
+	return telemetry_state.count++;
+}
+
+/**
+ * Add a channel sampled by calling a function in the ADC interrupt.
+ *
+ * @return Channel index, or -1 if running or all channels are used.
+ */
+int telemetry_add_getter(telemetry_getter_t getter)
+{
+	struct telemetry_channel *channel =
+		telemetry_add(TELEMETRY_SOURCE_GETTER);
+
+	if (channel == NULL) {
+		return -1;
+	}
+
+	channel->getter = getter;
+
+	return telemetry_state.count++;
+}
+
+/**
+ * Remove all channels, only while stopped.
+ */
+void telemetry_clear(void)
+{
+	if (!telemetry_state.running) {
+		telemetry_state.count = 0;
+	}
+}
+
+/**
+ * Take a record every decimation-th ADC callback.
+ */
+void telemetry_set_decimation(uint16_t decimation)
+{
+	telemetry_state.decimation = (decimation != 0) ? decimation : 1;
+}
+
+/**
+ * Start sampling, the first frame is a keyframe.
+ */
+void telemetry_start(void)
+{
+	telemetry_state.skipped = 0;
+	telemetry_state.restarted = true;
+	telemetry_state.running = true;
+}
+
+/**
+ * Stop sampling, the records in the ring are still sent.
+ */
+void telemetry_stop(void)
+{
+	telemetry_state.running = false;
+}
+
+/**
+ * Read the current value of a variable channel.
+ */
+static int32_t telemetry_read_var(const struct telemetry_channel *channel)
+{
+	switch (channel->type) {
+	case TELEMETRY_U8:
+		return *(const volatile uint8_t *)channel->var;
+	case TELEMETRY_S8:
+		return *(const volatile int8_t *)channel->var;
+	case TELEMETRY_U16:
+		return *(const volatile uint16_t *)channel->var;
+	case TELEMETRY_S16:
+		return *(const volatile int16_t *)channel->var;
+	case TELEMETRY_U32:
+		return (int32_t)*(const volatile uint32_t *)channel->var;
+	case TELEMETRY_S32:
+	default:
+		return *(const volatile int32_t *)channel->var;
+	}
+}
+
+/**
+ * ADC DMA callback, samples all channels into the ring.
+ */
+void telemetry_adc_callback(bool transfer_complete, uint16_t *raw_data)
+{
+	const struct telemetry_channel *channel;
+	struct telemetry_record *record;
+	uint16_t head = telemetry_state.head;
+	int half = transfer_complete ? 1 : 0;
+	int i;
+
+	if (!telemetry_state.running) {
+		return;
+	}
+
+	if (++telemetry_state.skipped < telemetry_state.decimation) {
+		return;
+	}
+	telemetry_state.skipped = 0;
+	telemetry_state.seq++;
+
+	if ((uint16_t)(head - telemetry_state.tail) >= TELEMETRY_RING_SIZE) {
+		telemetry_state.dropped++;
+		return;
+	}
+
+	record = &telemetry_state.ring[head & (TELEMETRY_RING_SIZE - 1)];
+	record->seq = telemetry_state.seq;
+	record->count = (uint8_t)telemetry_state.count;
+	record->key = telemetry_state.restarted;
+	telemetry_state.restarted = false;
+
+	for (i = 0; i < telemetry_state.count; i++) {
+		channel = &telemetry_state.channels[i];
+		switch (channel->source) {
+		case TELEMETRY_SOURCE_RAW:
+			record->values[i] = raw_data[channel->slots[half]];
+			break;
+		case TELEMETRY_SOURCE_VAR:
+			record->values[i] = telemetry_read_var(channel);
+			break;
+		case TELEMETRY_SOURCE_GETTER:
+			record->values[i] = channel->getter();
+			break;
+		}
+	}
+
+	TELEMETRY_BARRIER();
+	telemetry_state.head = head + 1;
+	telemetry_state.records++;
+
+	if (!telemetry_state.sending) {
+		telemetry_state.sending = true;
+		usart_enable_send();
+	}
+}
+
+/**
+ * Encode the oldest record of the ring into the frame buffer.
+ *
+ * @return false if the ring is empty.
+ */
+static bool telemetry_encode(void)
+{
+	const struct telemetry_record *record;
+	uint8_t payload[TELEMETRY_FRAME_MAX];
+	uint16_t tail = telemetry_state.tail;
+	uint32_t value;
+	uint8_t len = 0;
+	uint8_t sum = 0;
+	bool key;
+	int i;
+
+	if (tail == telemetry_state.head) {
+		return false;
+	}
+	TELEMETRY_BARRIER();
+
+	record = &telemetry_state.ring[tail & (TELEMETRY_RING_SIZE - 1)];
+	key = record->key || telemetry_state.since_keyframe == 0;
+
+	payload[len++] = (uint8_t)((record->seq & ~TELEMETRY_KEYFRAME) |
+				   (key ? TELEMETRY_KEYFRAME : 0));
+
+	for (i = 0; i < record->count; i++) {
+		value = (uint32_t)record->values[i];
+		if (!key) {
+			value -= (uint32_t)telemetry_state.previous[i];
+		}
+		telemetry_state.previous[i] = record->values[i];
+
+		/* Zigzag, small differences of either sign stay small. */
+		value = (value << 1) ^ (uint32_t)((int32_t)value >> 31);
+		while (value >= 0x80) {
+			payload[len++] = (uint8_t)(value | 0x80);
+			value >>= 7;
+		}
+		payload[len++] = (uint8_t)value;
+	}
+
+	for (i = 0; i < len; i++) {
+		sum += payload[i];
+	}
+	payload[len++] = (uint8_t)-sum;
+
+	TELEMETRY_BARRIER();
+	telemetry_state.tail = tail + 1;
+
+	telemetry_state.since_keyframe = key ? 1 :
+					 telemetry_state.since_keyframe + 1;
+	if (telemetry_state.since_keyframe >= TELEMETRY_KEYFRAME_INTERVAL) {
+		telemetry_state.since_keyframe = 0;
+	}
+
+	telemetry_state.frame_len = (uint8_t)cobs_encode(payload, len,
+						       telemetry_state.frame);
+	telemetry_state.frame_pos = 0;
+
+	return true;
+}
+
+/**
+ * USART send callback, hands out the frames byte by byte.
+ *
+ * @return The next byte, -1 if the ring is empty.
+ */
+int32_t telemetry_get_byte(void)
+{
+	if (telemetry_state.frame_pos == telemetry_state.frame_len &&
+	    !telemetry_encode()) {
+		/* Clear the flag before the last look at the ring, a record
+		 * written in between starts sending again.
+		 */
+		telemetry_state.sending = false;
+		TELEMETRY_BARRIER();
+		if (!telemetry_encode()) {
+			return -1;
+		}
+		telemetry_state.sending = true;
+	}
+
+	return telemetry_state.frame[telemetry_state.frame_pos++];
+}
+
+/**
+ * Get the number of records taken into the ring.
+ */
+uint32_t telemetry_get_records(void)
+{
+	return telemetry_state.records;
+}
+
+/**
+ * Get the number of samples dropped on a full ring.
+ */
+uint32_t telemetry_get_dropped(void)
+{
+	return telemetry_state.dropped;
+}
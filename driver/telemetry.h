@@ -0,0 +1,63 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Maximum number of channels in a record. */
+#define TELEMETRY_CHANNELS 8
+
+/* A record with absolute values is sent every this many records. */
+#define TELEMETRY_KEYFRAME_INTERVAL 64
+
+/* Size of the largest frame: header, channels as varints of up to five
+ * bytes, checksum, COBS overhead and delimiter.
+ */
+#define TELEMETRY_FRAME_MAX (1 + (5 * TELEMETRY_CHANNELS) + 1 + 2)
+
+/* Bit set in the frame header of records with absolute values. */
+#define TELEMETRY_KEYFRAME 0x80
+
+enum telemetry_type {
+	TELEMETRY_U8,
+	TELEMETRY_S8,
+	TELEMETRY_U16,
+	TELEMETRY_S16,
+	TELEMETRY_U32,
+	TELEMETRY_S32
+};
+
+typedef int32_t (*telemetry_getter_t)(void);
+
+void telemetry_init(void);
+int telemetry_add_raw(int slot1, int slot2);
+int telemetry_add_var(const volatile void *var, enum telemetry_type type);
+int telemetry_add_getter(telemetry_getter_t getter);
+void telemetry_clear(void);
+void telemetry_set_decimation(uint16_t decimation);
+void telemetry_start(void);
+void telemetry_stop(void);
+void telemetry_adc_callback(bool transfer_complete, uint16_t *raw_data);
+int32_t telemetry_get_byte(void);
+uint32_t telemetry_get_records(void);
+uint32_t telemetry_get_dropped(void);
+
+#endif /* __TELEMETRY_H */
@@ -32,14 +32,32 @@
 #include <libopencm3/stm32/f1/rcc.h>
 #include <libopencm3/stm32/f1/nvic.h>
 #include <libopencm3/stm32/timer.h>
+#include <libopencm3/cm3/cortex.h>
 
 #include "driver/timer.h"
+#include "driver/mcu.h"
+#include "driver/profile.h"
+#include "driver/ramfunc.h"
 
 #include "driver/led.h"
 
 /* Set timer input frequency. (resolution .25us) */
 #define TIMER_FREQUENCY 4000000
 
+#if (MCU_TIM2_CLK % TIMER_FREQUENCY) != 0
+#error "TIM2 clock is not a multiple of TIMER_FREQUENCY"
+#endif
+
+/* Timers with a compare channel of their own, OC1 to OC3. OC4 carries the
+ * earliest deadline of the virtual timers.
+ */
+#define TIMER_CHANNELS 3
+
+/* Number of virtual timers, override in the target CFLAGS if needed. */
+#ifndef TIMER_VIRTUAL_COUNT
+#define TIMER_VIRTUAL_COUNT 32
+#endif
+
 struct timer_entry {
 	volatile uint16_t next_invocation;
 	volatile uint16_t delta_ticks;
@@ -47,9 +65,32 @@ struct timer_entry {
 	volatile bool oneshot;
 };
 
+struct timer_virtual {
+	uint32_t deadline; /**< Extended TIM2 time of the next invocation */
+	uint16_t delta_ticks;
+	uint16_t heap_index; /**< Position in timer_state.heap */
+	timer_callback_t callback; /**< NULL while the timer is free */
+	bool oneshot;
+};
+
 /* Internal state. */
 struct timer_state {
-	struct timer_entry entry[4];
+	struct timer_entry entry[TIMER_CHANNELS];
+
+	/* Virtual timers, a min heap of virtual timer indices ordered by
+	 * deadline and a stack of the free ones.
+	 */
+	struct timer_virtual virt[TIMER_VIRTUAL_COUNT];
+	uint16_t heap[TIMER_VIRTUAL_COUNT];
+	uint16_t heap_size;
+	uint16_t free[TIMER_VIRTUAL_COUNT];
+	uint16_t free_count;
+
+	/* TIM2 counter wraps, the upper bits of the extended time. */
+	volatile uint32_t overflows;
+
+	/* Periods skipped because a timer was late by a full period. */
+	uint32_t overruns;
 } timer_state;
 
 /**
@@ -58,13 +99,22 @@ struct timer_state {
 void timer_init(void)
 {
 	/* Initialize state. */
-	for (int i = 0; i < 4; i++) {
+	for (int i = 0; i < TIMER_CHANNELS; i++) {
 		timer_state.entry[i].next_invocation = 0;
 		timer_state.entry[i].delta_ticks = 0;
 		timer_state.entry[i].callback = NULL;
 		timer_state.entry[i].oneshot = false;
 	}
 
+	for (int i = 0; i < TIMER_VIRTUAL_COUNT; i++) {
+		timer_state.virt[i].callback = NULL;
+		timer_state.free[i] = TIMER_VIRTUAL_COUNT - 1 - i;
+	}
+	timer_state.heap_size = 0;
+	timer_state.free_count = TIMER_VIRTUAL_COUNT;
+	timer_state.overflows = 0;
+	timer_state.overruns = 0;
+
 	/* Enable clock for TIM subsystem */
 	rcc_peripheral_enable_clock(&RCC_APB1ENR, RCC_APB1ENR_TIM2EN);
 
@@ -86,11 +136,17 @@ void timer_init(void)
 		       TIM_CR1_CMS_EDGE,
 		       TIM_CR1_DIR_UP);
 
-	timer_set_prescaler(TIM2, (64000000 / TIMER_FREQUENCY) - 1);
+	timer_set_prescaler(TIM2, (MCU_TIM2_CLK / TIMER_FREQUENCY) - 1);
 	timer_enable_preload(TIM2);
 	timer_continuous_mode(TIM2);
 	timer_set_period(TIM2, UINT16_MAX);
 
+	/* Load the prescaler now instead of on the first wrap, the extended
+	 * time counts from here. Only real wraps raise the update flag.
+	 */
+	timer_update_on_overflow(TIM2);
+	timer_generate_event(TIM2, TIM_EGR_UG);
+
 	/* -- OC1 configuration -- */
 
 	/* Disable outputs. */
@@ -172,20 +228,288 @@ void timer_init(void)
 				TIM_DIER_CC3IE |
 				TIM_DIER_CC4IE);
 
+	/* Count the counter wraps for the extended time. */
+	timer_enable_irq(TIM2, TIM_DIER_UIE);
+}
+
+/**
+ * Read the wrap count and the counter as one consistent pair.
+ *
+ * Callable from any context. A wrap that happened but was not counted yet,
+ * because the caller runs in an interrupt that keeps tim2_isr() from
+ * running, is seen through the pending update flag. A small counter value
+ * tells that the flag belongs to the wrap before the counter was read. If
+ * tim2_isr() counts a wrap in between, the read is repeated.
+ */
+static RAMFUNC_CODE void timer_read(uint32_t *overflows,
+				     uint16_t *counter)
+{
+	uint32_t high;
+	uint16_t low;
+	bool uncounted;
+
+	do {
+		high = timer_state.overflows;
+		low = timer_get_counter(TIM2);
+		uncounted = timer_get_flag(TIM2, TIM_SR_UIF) && low < 0x8000;
+	} while (high != timer_state.overflows);
+
+	*overflows = uncounted ? high + 1 : high;
+	*counter = low;
+}
+
+/**
+ * Get the extended TIM2 time in ticks (0.25us) since timer_init().
+ *
+ * Wraps after about 18 minutes, the difference of two times is right as
+ * long as they are less than that apart.
+ */
+RAMFUNC_CODE uint32_t timer_get_time(void)
+{
+	uint32_t high;
+	uint16_t low;
+
+	timer_read(&high, &low);
+
+	return (high << 16) | low;
+}
+
+/**
+ * Get the extended TIM2 time in ticks (0.25us) since timer_init(), 48
+ * significant bits, which wrap after more than two years.
+ */
+uint64_t timer_get_time64(void)
+{
+	uint32_t high;
+	uint16_t low;
+
+	timer_read(&high, &low);
+
+	return ((uint64_t)high << 16) | low;
+}
+
+static inline bool timer_virtual_before(uint16_t a, uint16_t b)
+{
+	return (int32_t)(timer_state.virt[a].deadline -
+			 timer_state.virt[b].deadline) < 0;
+}
+
+static inline void timer_virtual_place(uint16_t pos, uint16_t id)
+{
+	timer_state.heap[pos] = id;
+	timer_state.virt[id].heap_index = pos;
+}
+
+static RAMFUNC_CODE void timer_virtual_sift_up(uint16_t pos)
+{
+	uint16_t id = timer_state.heap[pos];
+	uint16_t parent;
+
+	while (pos > 0) {
+		parent = (pos - 1) / 2;
+		if (!timer_virtual_before(id, timer_state.heap[parent])) {
+			break;
+		}
+		timer_virtual_place(pos, timer_state.heap[parent]);
+		pos = parent;
+	}
+	timer_virtual_place(pos, id);
+}
+
+static RAMFUNC_CODE void timer_virtual_sift_down(uint16_t pos)
+{
+	uint16_t id = timer_state.heap[pos];
+	uint16_t child;
+
+	while ((child = (2 * pos) + 1) < timer_state.heap_size) {
+		if (child + 1 < timer_state.heap_size &&
+		    timer_virtual_before(timer_state.heap[child + 1],
+					 timer_state.heap[child])) {
+			child++;
+		}
+		if (!timer_virtual_before(timer_state.heap[child], id)) {
+			break;
+		}
+		timer_virtual_place(pos, timer_state.heap[child]);
+		pos = child;
+	}
+	timer_virtual_place(pos, id);
+}
+
+static RAMFUNC_CODE void timer_virtual_remove(uint16_t id)
+{
+	uint16_t pos = timer_state.virt[id].heap_index;
+	uint16_t last = timer_state.heap[--timer_state.heap_size];
+
+	if (last == id) {
+		return;
+	}
+
+	/* Fill the gap with the last entry and restore the heap order in
+	 * whatever direction it is violated.
+	 */
+	timer_virtual_place(pos, last);
+	if (pos > 0 && timer_virtual_before(last,
+					    timer_state.heap[(pos - 1) / 2])) {
+		timer_virtual_sift_up(pos);
+	} else {
+		timer_virtual_sift_down(pos);
+	}
+}
+
+/**
+ * Program OC4 with the earliest virtual deadline.
+ *
+ * Callers mask the interrupts while they change the heap, this enables
+ * the OC4 interrupt if a timer is pending.
+ */
+static RAMFUNC_CODE void timer_virtual_arm(void)
+{
+	uint32_t deadline;
+
+	if (timer_state.heap_size == 0) {
+		timer_disable_irq(TIM2, TIM_DIER_CC4IE);
+		return;
+	}
+
+	deadline = timer_state.virt[timer_state.heap[0]].deadline;
+	timer_set_oc_value(TIM2, TIM_OC4, (uint16_t)deadline);
+	timer_clear_flag(TIM2, TIM_SR_CC4IF);
+	timer_enable_irq(TIM2, TIM_DIER_CC4IE);
+
+	/* The counter may have passed the deadline before the compare value
+	 * was written, the match would then only come after a full wrap.
+	 */
+	if ((int32_t)(deadline - timer_get_time()) <= 0) {
+		timer_generate_event(TIM2, TIM_EGR_CC4G);
+	}
 }
 
+/* Called with the interrupts masked. */
+static int timer_virtual_register(uint16_t delta_ticks,
+				  timer_callback_t callback, bool oneshot)
+{
+	struct timer_virtual *virt;
+	uint16_t id;
+
+	if (timer_state.free_count == 0) {
+		return -1;
+	}
+
+	id = timer_state.free[--timer_state.free_count];
+	virt = &timer_state.virt[id];
+	virt->deadline = timer_get_time() + delta_ticks;
+	virt->delta_ticks = delta_ticks;
+	virt->callback = callback;
+	virt->oneshot = oneshot;
+
+	timer_state.heap_size++;
+	timer_virtual_place(timer_state.heap_size - 1, id);
+	timer_virtual_sift_up(timer_state.heap_size - 1);
+
+	return TIMER_CHANNELS + id;
+}
+
+/* Called with the interrupts masked. */
+static void timer_virtual_unregister(uint16_t id)
+{
+	/* Expired one shot timers are free already. */
+	if (timer_state.virt[id].callback) {
+		timer_state.virt[id].callback = NULL;
+		timer_virtual_remove(id);
+		timer_state.free[timer_state.free_count++] = id;
+	}
+}
+
+/**
+ * Run the virtual timers that are due, from the OC4 interrupt.
+ *
+ * The heap is only changed with the interrupts masked, handlers of a higher
+ * priority may register timers meanwhile. The callbacks run unmasked.
+ */
+static RAMFUNC_CODE void timer_virtual_dispatch(void)
+{
+	struct timer_virtual *virt;
+	timer_callback_t callback;
+	uint32_t now, primask;
+	uint16_t id, time;
+
+	primask = cm_mask_interrupts(1);
+	now = timer_get_time();
+	while (timer_state.heap_size != 0) {
+		id = timer_state.heap[0];
+		virt = &timer_state.virt[id];
+		if ((int32_t)(virt->deadline - now) > 0) {
+			break;
+		}
+
+		time = (uint16_t)virt->deadline;
+		callback = virt->callback;
+
+		/* Requeue or free the timer before the callback, it may
+		 * register or unregister timers itself.
+		 */
+		if (virt->oneshot) {
+			virt->callback = NULL;
+			timer_virtual_remove(id);
+			timer_state.free[timer_state.free_count++] = id;
+		} else {
+			/* Skip the periods missed by an overrun like the
+			 * compare channel timers do.
+			 */
+			virt->deadline += virt->delta_ticks;
+			if ((int32_t)(virt->deadline - now) <= 0) {
+				virt->deadline += ((now - virt->deadline) /
+						   virt->delta_ticks + 1) *
+						  virt->delta_ticks;
+				timer_state.overruns++;
+			}
+			timer_virtual_sift_down(0);
+		}
+
+		cm_mask_interrupts(primask);
+		callback(TIMER_CHANNELS + id, time);
+		primask = cm_mask_interrupts(1);
+
+		now = timer_get_time();
+	}
+
+	timer_virtual_arm();
+	cm_mask_interrupts(primask);
+}
+
+/**
+ * Register a soft timer.
+ *
+ * The first timers get a compare channel of their own, the following ones
+ * share OC4 as virtual timers, TIMER_VIRTUAL_COUNT of them.
+ *
+ * @param delta_ticks Delay and period in TIM2 ticks (0.25us), at least 4.
+ * @param callback Called from the TIM2 interrupt with the id and the
+ *                 scheduled TIM2 time.
+ * @param oneshot Call only once, the timer is free again afterwards.
+ *
+ * Callable from any context, the timers are claimed and the heap changed
+ * with the interrupts masked.
+ *
+ * @return Timer id, -2 if the delay is too short, -1 if no timer is free.
+ */
 int timer_register(uint16_t delta_ticks, timer_callback_t callback,
 		   bool oneshot)
 {
-	int timer_id = -1;
-	uint16_t now = timer_get_counter(TIM2);
+	uint32_t primask;
+	uint16_t now;
+	int id;
 
 	/* Too short delay, this will result in an interrupt storm? */
 	if (delta_ticks < 4) {
 		return -2;
 	}
 
-	for (int i = 0; i < 4; i++) {
+	primask = cm_mask_interrupts(1);
+	now = timer_get_counter(TIM2);
+
+	for (int i = 0; i < TIMER_CHANNELS; i++) {
 		if (!timer_state.entry[i].callback) {
 			timer_state.entry[i].callback = callback;
 			timer_state.entry[i].next_invocation = now
@@ -193,132 +517,157 @@ int timer_register(uint16_t delta_ticks, timer_callback_t callback,
 			timer_state.entry[i].delta_ticks = delta_ticks;
 			timer_state.entry[i].oneshot = oneshot;
 			timer_set_oc_value(TIM2, i * 2, now + delta_ticks);
+			/* The compare flag is set on every match, also while
+			 * the slot was unused. Clear it, otherwise the callback
+			 * fires right away.
+			 */
+			timer_clear_flag(TIM2, 1 << (i + 1));
 			timer_enable_irq(TIM2, 1 << (i + 1));
-			timer_id = i;
-			break;
+			cm_mask_interrupts(primask);
+			return i;
 		}
 	}
 
-	return timer_id;
+	id = timer_virtual_register(delta_ticks, callback, oneshot);
+	timer_virtual_arm();
+	cm_mask_interrupts(primask);
+
+	return id;
 }
 
+/**
+ * Free a soft timer, callable from any context.
+ */
 void timer_unregister(int timer_id)
 {
-	if (timer_id < 0 || timer_id > 3) {
+	uint32_t primask;
+
+	if (timer_id < 0 ||
+	    timer_id >= TIMER_CHANNELS + TIMER_VIRTUAL_COUNT) {
 		return;
 	}
 
-	timer_state.entry[timer_id].callback = NULL;
-	timer_disable_irq(TIM2, 1 << (timer_id+1));
+	primask = cm_mask_interrupts(1);
+	if (timer_id >= TIMER_CHANNELS) {
+		timer_virtual_unregister(timer_id - TIMER_CHANNELS);
+		timer_virtual_arm();
+	} else {
+		timer_state.entry[timer_id].callback = NULL;
+		timer_disable_irq(TIM2, 1 << (timer_id+1));
+	}
+	cm_mask_interrupts(primask);
 }
 
-void timer_modify_delta(int timer_id, uint16_t delta_ticks)
+/**
+ * Get the number of periods periodic timers skipped because they were late
+ * by a full period.
+ */
+uint32_t timer_get_overruns(void)
 {
-	timer_state.entry[timer_id].delta_ticks = delta_ticks;
+	return timer_state.overruns;
 }
 
 /**
- * Timer event interrupt handler
+ * Change the period of a timer, takes effect after its next invocation.
  */
-void tim2_isr(void)
+void timer_modify_delta(int timer_id, uint16_t delta_ticks)
 {
-	if (timer_get_flag(TIM2, TIM_SR_CC1IF)) {
-		timer_clear_flag(TIM2, TIM_SR_CC1IF);
-
-		/* Run callback if available. */
-		if (timer_state.entry[0].callback) {
-			timer_state.entry[0].callback(0,
-				timer_state.entry[0].next_invocation);
-		} else {
-			timer_disable_irq(TIM2, TIM_DIER_CC1IE);
-		}
-
-		if (timer_state.entry[0].oneshot) {
-			/* We are done stop interrupt. */
-			timer_disable_irq(TIM2, TIM_DIER_CC1IE);
-			timer_state.entry[0].callback = NULL;
-		} else {
-			/* Update last invocation time. */
-			timer_state.entry[0].next_invocation +=
-				timer_state.entry[0].delta_ticks;
-
-			timer_set_oc_value(TIM2, TIM_OC1,
-				timer_state.entry[0].next_invocation);
+	if (timer_id >= TIMER_CHANNELS) {
+		/* Below 4 ticks the dispatch loop would never catch up. */
+		if (delta_ticks >= 4) {
+			timer_state.virt[timer_id - TIMER_CHANNELS].delta_ticks =
+				delta_ticks;
 		}
+		return;
 	}
 
-	if (timer_get_flag(TIM2, TIM_SR_CC2IF)) {
-		timer_clear_flag(TIM2, TIM_SR_CC2IF);
+	timer_state.entry[timer_id].delta_ticks = delta_ticks;
+}
 
-		/* Run callback if available. */
-		if (timer_state.entry[1].callback) {
-			timer_state.entry[1].callback(1,
-				timer_state.entry[1].next_invocation);
-		} else {
-			timer_disable_irq(TIM2, TIM_DIER_CC2IE);
-		}
+/**
+ * Run a compare channel timer.
+ *
+ * Periodic timers are requeued before the callback runs. A timer that is
+ * already late by one period or more, because an earlier callback overran,
+ * skips the periods it missed. Otherwise the compare value would lie behind
+ * the counter and the next match only come after a full 16bit wrap.
+ */
+static RAMFUNC_CODE void timer_channel_dispatch(int i)
+{
+	struct timer_entry *entry = &timer_state.entry[i];
+	timer_callback_t callback = entry->callback;
+	uint16_t time = entry->next_invocation;
+	uint16_t delta = entry->delta_ticks;
+	uint16_t late;
+
+	if (!callback) {
+		timer_disable_irq(TIM2, TIM_DIER_CC1IE << i);
+		return;
+	}
 
-		if (timer_state.entry[1].oneshot) {
-			/* We are done stop interrupt. */
-			timer_disable_irq(TIM2, TIM_DIER_CC2IE);
-			timer_state.entry[1].callback = NULL;
+	if (entry->oneshot) {
+		/* We are done stop interrupt. The callback may register the
+		 * next one shot timer on this channel right away.
+		 */
+		timer_disable_irq(TIM2, TIM_DIER_CC1IE << i);
+		entry->callback = NULL;
+	} else {
+		late = timer_get_counter(TIM2) - time;
+		if (late >= delta) {
+			entry->next_invocation = time +
+				(((late / delta) + 1) * delta);
+			timer_state.overruns++;
 		} else {
-			/* Update last invocation time. */
-			timer_state.entry[1].next_invocation +=
-				timer_state.entry[1].delta_ticks;
-
-			timer_set_oc_value(TIM2, TIM_OC2,
-				timer_state.entry[1].next_invocation);
+			entry->next_invocation = time + delta;
 		}
+		timer_set_oc_value(TIM2, i * 2, entry->next_invocation);
 	}
 
-	if (timer_get_flag(TIM2, TIM_SR_CC3IF)) {
-		timer_clear_flag(TIM2, TIM_SR_CC3IF);
+	callback(i, time);
+}
 
-		/* Run callback if available. */
-		if (timer_state.entry[2].callback) {
-			timer_state.entry[2].callback(2,
-				timer_state.entry[2].next_invocation);
-		} else {
-			timer_disable_irq(TIM2, TIM_DIER_CC3IE);
-		}
+/**
+ * Timer event interrupt handler
+ *
+ * Reads the pending update and compare flags once and handles them from the
+ * lowest, the counter wrap first and then OC1 to OC4.
+ */
+RAMFUNC_CODE void tim2_isr(void)
+{
+	uint32_t pending, primask;
+	int channel;
 
-		if (timer_state.entry[2].oneshot) {
-			/* We are done stop interrupt. */
-			timer_disable_irq(TIM2, TIM_DIER_CC3IE);
-			timer_state.entry[2].callback = NULL;
-		} else {
-			/* Update last invocation time. */
-			timer_state.entry[2].next_invocation +=
-				timer_state.entry[2].delta_ticks;
+	PROFILE_ENTER();
 
-			timer_set_oc_value(TIM2, TIM_OC3,
-				timer_state.entry[2].next_invocation);
-		}
+	pending = TIM_SR(TIM2) & TIM_DIER(TIM2) &
+		  (TIM_SR_UIF | TIM_SR_CC1IF | TIM_SR_CC2IF | TIM_SR_CC3IF |
+		   TIM_SR_CC4IF);
+
+	/* The wrap is counted before any callback reads the time. Count and
+	 * flag change together, timer_read() in a preempting handler sees
+	 * either the pending flag or the new count, never both or none.
+	 */
+	if ((pending & TIM_SR_UIF) != 0) {
+		primask = cm_mask_interrupts(1);
+		timer_state.overflows++;
+		timer_clear_flag(TIM2, TIM_SR_UIF);
+		cm_mask_interrupts(primask);
+		pending &= ~TIM_SR_UIF;
 	}
 
-	if (timer_get_flag(TIM2, TIM_SR_CC4IF)) {
-		timer_clear_flag(TIM2, TIM_SR_CC4IF);
+	timer_clear_flag(TIM2, pending);
 
-		/* Run callback if available. */
-		if (timer_state.entry[3].callback) {
-			timer_state.entry[3].callback(3,
-				timer_state.entry[3].next_invocation);
-		} else {
-			timer_disable_irq(TIM2, TIM_DIER_CC4IE);
-		}
+	while (pending != 0) {
+		/* CC1IF is bit 1 for channel 0. */
+		channel = __builtin_ctz(pending) - 1;
+		pending &= pending - 1;
 
-		if (timer_state.entry[3].oneshot) {
-			/* We are done stop interrupt. */
-			timer_disable_irq(TIM2, TIM_DIER_CC4IE);
-			timer_state.entry[3].callback = NULL;
+		if (channel < TIMER_CHANNELS) {
+			timer_channel_dispatch(channel);
 		} else {
-			/* Update last invocation time. */
-			timer_state.entry[3].next_invocation +=
-				timer_state.entry[3].delta_ticks;
-
-			timer_set_oc_value(TIM2, TIM_OC4,
-				timer_state.entry[3].next_invocation);
+			timer_virtual_dispatch();
 		}
 	}
+
+	PROFILE_EXIT(PROFILE_TIMER);
 }
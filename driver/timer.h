@@ -29,5 +29,8 @@ int timer_register(uint16_t delta_ticks, timer_callback_t callback,
 		   bool oneshot);
 void timer_unregister(int timer_id);
 void timer_modify_delta(int timer_id, uint16_t delta_ticks);
+uint32_t timer_get_overruns(void);
+uint32_t timer_get_time(void);
+uint64_t timer_get_time64(void);
 
 #endif /* __TIMER_H */
@@ -22,42 +22,140 @@
  *
  * @brief  USART driver implementation
  *
+ * By default every received and every sent byte takes one interrupt. Built
+ * with -DUSART_DMA the driver uses DMA1 channel 5 to receive into a circular
+ * buffer and channel 4 to send from a ring buffer. The received bytes are
+ * handed over at half and full buffer and when the line goes idle, in one
+ * call of the span callback per contiguous part of the buffer if one is set
+ * with usart_set_span_callback(), otherwise byte by byte. The bytes to send
+ * are collected from the callback in blocks and sent in one transfer.
+ *
+ * The line speed is set by usart_init() and can be changed at run time with
+ * usart_change_baudrate(). The change waits until the bytes already handed
+ * to the USART are out on the line, the transmission complete interrupt
+ * then switches the baud rate and sending resumes at the new speed.
  */
 
+#include <stddef.h>
+
 #include <libopencm3/stm32/f1/rcc.h>
 #include <libopencm3/stm32/usart.h>
 #include <libopencm3/stm32/f1/gpio.h>
 #include <libopencm3/cm3/nvic.h>
+#ifdef USART_DMA
+#include <libopencm3/stm32/f1/dma.h>
+#endif
 
 #include "driver/usart.h"
+#include "driver/mcu.h"
+#include "driver/profile.h"
 
 #include "driver/led.h"
+#include "driver/log.h"
+
+/* Largest deviation of the real from the requested line speed, in 1/1000. */
+#define USART_BAUDRATE_TOLERANCE 20
 
+#ifdef USART_DMA
+/* Receive and send buffer sizes, have to be powers of two. */
+#define USART_RX_BUF_SIZE 64
+#define USART_TX_BUF_SIZE 64
+
+/**
+ * DMA transport state.
+ */
+struct usart_dma_state {
+	uint8_t rx_buf[USART_RX_BUF_SIZE]; /**< Circular DMA receive buffer */
+	uint16_t rx_tail; /**< Next rx_buf index to hand to the callback */
+	uint8_t tx_buf[USART_TX_BUF_SIZE]; /**< Send ring buffer */
+	uint16_t tx_head; /**< Next tx_buf index to fill */
+	uint16_t tx_tail; /**< Next tx_buf index to send */
+	volatile uint16_t tx_len; /**< Bytes of the running transfer */
+} usart_dma_state;
+#else
 /**
  * Data buffer used for incoming and outgoing data.
  */
 static volatile int16_t data_buf;
+#endif
 
 /**
  * Function callback used for incoming data.
  */
 usart_handle_byte_callback_t usart_handle_byte_callback;
 
+/**
+ * Function callback used for incoming data in spans, replaces the byte
+ * callback if set.
+ */
+usart_handle_span_callback_t usart_handle_span_callback;
+
 /**
  * Function callback used for outgoing data.
  */
 usart_get_byte_callback_t usart_get_byte_callback;
 
+/**
+ * Line speed state.
+ */
+static struct usart_speed_state {
+	uint32_t baudrate; /**< Current line speed */
+	volatile uint32_t pending; /**< Line speed to switch to, 0 if none */
+} usart_speed_state;
+
+/* Baud rate register value of a line speed, the APB2 clock divider rounded
+ * to the nearest. A constant for a constant line speed.
+ */
+#define USART_DIVIDER(baudrate) \
+	(((2 * MCU_PCLK2) + (baudrate)) / (2 * (baudrate)))
+
+/**
+ * Check that the APB2 clock can divide down to a line speed.
+ *
+ * The divider has to be at least 16, a mantissa of one with the 16 times
+ * oversampling, and close enough to the requested speed.
+ */
+static bool usart_baudrate_valid(uint32_t baudrate)
+{
+	uint32_t divider, actual, error;
+
+	if (baudrate == 0) {
+		return false;
+	}
+
+	divider = USART_DIVIDER(baudrate);
+	if (divider < 16 || divider > 0xffff) {
+		return false;
+	}
+
+	actual = MCU_PCLK2 / divider;
+	error = (actual > baudrate) ? actual - baudrate : baudrate - actual;
+
+	return ((uint64_t)error * 1000) <=
+	       ((uint64_t)baudrate * USART_BAUDRATE_TOLERANCE);
+}
+
 /**
  * USART driver initialization.
+ *
+ * @param baudrate Line speed, USART_DEFAULT_BAUDRATE if the clock can not
+ *                 divide down to it.
  */
 void usart_init(usart_handle_byte_callback_t handle_byte_callback,
-		usart_get_byte_callback_t get_byte_callback)
+		usart_get_byte_callback_t get_byte_callback,
+		uint32_t baudrate)
 {
 	/* initialize callback pointers */
 	usart_handle_byte_callback = handle_byte_callback;
+	usart_handle_span_callback = NULL;
 	usart_get_byte_callback = get_byte_callback;
 
+	if (!usart_baudrate_valid(baudrate)) {
+		baudrate = USART_DEFAULT_BAUDRATE;
+	}
+	usart_speed_state.baudrate = baudrate;
+	usart_speed_state.pending = 0;
+
 	/* enable clock for USART1 peripherial */
 	rcc_peripheral_enable_clock(&RCC_APB2ENR, RCC_APB2ENR_IOPBEN);
 	rcc_peripheral_enable_clock(&RCC_APB2ENR, RCC_APB2ENR_AFIOEN);
@@ -66,6 +164,49 @@ void usart_init(usart_handle_byte_callback_t handle_byte_callback,
 	/* Enable the USART1 interrupts */
 	nvic_enable_irq(NVIC_USART1_IRQ);
 
+#ifdef USART_DMA
+	usart_dma_state.rx_tail = 0;
+	usart_dma_state.tx_head = 0;
+	usart_dma_state.tx_tail = 0;
+	usart_dma_state.tx_len = 0;
+
+	rcc_peripheral_enable_clock(&RCC_AHBENR, RCC_AHBENR_DMA1EN);
+
+	/* Channel 5 reacts to USART1_RX. */
+	dma_channel_reset(DMA1, DMA_CHANNEL5);
+	dma_set_peripheral_address(DMA1, DMA_CHANNEL5,
+				   (uint32_t)&USART_DR(USART1));
+	dma_set_memory_address(DMA1, DMA_CHANNEL5,
+			       (uint32_t)usart_dma_state.rx_buf);
+	dma_set_number_of_data(DMA1, DMA_CHANNEL5, USART_RX_BUF_SIZE);
+	dma_set_read_from_peripheral(DMA1, DMA_CHANNEL5);
+	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL5);
+	dma_enable_circular_mode(DMA1, DMA_CHANNEL5);
+	dma_set_peripheral_size(DMA1, DMA_CHANNEL5, DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(DMA1, DMA_CHANNEL5, DMA_CCR_MSIZE_8BIT);
+	dma_set_priority(DMA1, DMA_CHANNEL5, DMA_CCR_PL_LOW);
+	dma_enable_half_transfer_interrupt(DMA1, DMA_CHANNEL5);
+	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL5);
+	dma_enable_channel(DMA1, DMA_CHANNEL5);
+
+	/* Channel 4 reacts to USART1_TX, set up per transfer. */
+	dma_channel_reset(DMA1, DMA_CHANNEL4);
+	dma_set_peripheral_address(DMA1, DMA_CHANNEL4,
+				   (uint32_t)&USART_DR(USART1));
+	dma_set_read_from_memory(DMA1, DMA_CHANNEL4);
+	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL4);
+	dma_set_peripheral_size(DMA1, DMA_CHANNEL4, DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(DMA1, DMA_CHANNEL4, DMA_CCR_MSIZE_8BIT);
+	dma_set_priority(DMA1, DMA_CHANNEL4, DMA_CCR_PL_LOW);
+	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL4);
+
+	/* Same priority as the USART1 interrupt, the three handlers do not
+	 * preempt each other.
+	 */
+	nvic_enable_irq(NVIC_DMA1_CHANNEL4_IRQ);
+	nvic_enable_irq(NVIC_DMA1_CHANNEL5_IRQ);
+#endif
+
 	/* enable USART1 pin software remapping */
 	AFIO_MAPR |= AFIO_MAPR_USART1_REMAP;
 
@@ -78,27 +219,292 @@ void usart_init(usart_handle_byte_callback_t handle_byte_callback,
 		      GPIO_CNF_INPUT_FLOAT, GPIO_USART1_RE_RX);
 
 	/* Initialize the usart subsystem */
-	usart_set_baudrate(USART1, 57600);
+	USART_BRR(USART1) = USART_DIVIDER(baudrate);
 	usart_set_databits(USART1, 8);
 	usart_set_stopbits(USART1, USART_STOPBITS_1);
 	usart_set_parity(USART1, USART_PARITY_NONE);
 	usart_set_flow_control(USART1, USART_FLOWCONTROL_NONE);
 	usart_set_mode(USART1, USART_MODE_RX | USART_MODE_TX);
 
+#ifdef USART_DMA
+	/* Let the DMA move the data, interrupt when the line goes idle. */
+	usart_enable_rx_dma(USART1);
+	usart_enable_tx_dma(USART1);
+	USART_CR1(USART1) |= USART_CR1_IDLEIE;
+#else
 	/* Enable USART1 Receive and Transmit interrupts */
 	USART_CR1(USART1) |= USART_CR1_RXNEIE;
 	/*USART_CR1(USART1) |= USART_CR1_TXEIE;*/
+#endif
 
 	/* Enable the USART1 */
 	usart_enable(USART1);
 }
 
 /**
- * Enable USART send interrupt.
+ * Hand the received bytes to a span callback instead of the byte callback.
+ *
+ * Call after usart_init(). With -DUSART_DMA the callback gets every
+ * contiguous run of received bytes in one call, two calls when the run
+ * wraps around the end of the receive buffer. Without it every byte is a
+ * span of its own.
+ */
+void usart_set_span_callback(usart_handle_span_callback_t span_callback)
+{
+	usart_handle_span_callback = span_callback;
+}
+
+/**
+ * Change the line speed once everything sent so far is out.
+ *
+ * No new bytes are collected from the send callback until then. The
+ * transmission complete interrupt switches the speed and resumes sending.
+ *
+ * @return false if the clock can not divide down to the line speed, the
+ *         speed is left unchanged then.
+ */
+bool usart_change_baudrate(uint32_t baudrate)
+{
+	if (!usart_baudrate_valid(baudrate)) {
+		return false;
+	}
+
+	usart_speed_state.pending = baudrate;
+#ifndef USART_DMA
+	USART_CR1(USART1) &= ~USART_CR1_TXEIE;
+#endif
+	USART_CR1(USART1) |= USART_CR1_TCIE;
+
+	return true;
+}
+
+/**
+ * Get the current line speed.
+ */
+uint32_t usart_get_baudrate(void)
+{
+	return usart_speed_state.baudrate;
+}
+
+/**
+ * Check if a line speed change is waiting for the send side to drain.
+ */
+bool usart_baudrate_pending(void)
+{
+	return usart_speed_state.pending != 0;
+}
+
+/**
+ * Switch to the pending line speed when the last byte is out.
+ */
+static void usart_speed_process(void)
+{
+	if ((USART_CR1(USART1) & USART_CR1_TCIE) == 0 ||
+	    (USART_SR(USART1) & USART_SR_TC) == 0) {
+		return;
+	}
+
+	USART_CR1(USART1) &= ~USART_CR1_TCIE;
+	if (usart_speed_state.pending == 0) {
+		return;
+	}
+
+	USART_BRR(USART1) = USART_DIVIDER(usart_speed_state.pending);
+	usart_speed_state.baudrate = usart_speed_state.pending;
+	usart_speed_state.pending = 0;
+
+	usart_enable_send();
+}
+
+#ifdef USART_DMA
+/**
+ * Hand a contiguous part of the receive buffer to the span callback.
+ */
+static void usart_rx_span(uint16_t start, uint16_t end)
+{
+	int ret;
+
+	ret = usart_handle_span_callback(&usart_dma_state.rx_buf[start],
+					 end - start);
+	if (ret != 0) {
+		LOG(LOG_ISR_NORMAL, "usart: %d bytes not taken, error %d",
+		    end - start, ret);
+	}
+}
+
+/**
+ * Hand the bytes the DMA received since the last call to the callback.
+ */
+static void usart_rx_process(void)
+{
+	uint16_t head = USART_RX_BUF_SIZE -
+			dma_get_number_of_data(DMA1, DMA_CHANNEL5);
+	uint16_t tail = usart_dma_state.rx_tail;
+	int ret;
+
+	if (head == USART_RX_BUF_SIZE) {
+		head = 0;
+	}
+
+	if (usart_handle_span_callback) {
+		/* Up to the end of the buffer and from its start. */
+		if (head < tail) {
+			usart_rx_span(tail, USART_RX_BUF_SIZE);
+			tail = 0;
+		}
+		if (tail != head) {
+			usart_rx_span(tail, head);
+		}
+		usart_dma_state.rx_tail = head;
+		return;
+	}
+
+	while (tail != head) {
+		if (usart_handle_byte_callback) {
+			ret = usart_handle_byte_callback(
+				usart_dma_state.rx_buf[tail]);
+			if (ret != 0) {
+				LOG(LOG_ISR_NORMAL, "usart: byte 0x%02x not "
+				    "taken, error %d",
+				    usart_dma_state.rx_buf[tail], ret);
+			}
+		}
+		tail = (tail + 1) & (USART_RX_BUF_SIZE - 1);
+	}
+
+	usart_dma_state.rx_tail = tail;
+}
+
+/**
+ * Fill the send ring buffer from the callback and start the next transfer
+ * if none is running.
+ */
+static void usart_tx_process(void)
+{
+	uint16_t head = usart_dma_state.tx_head;
+	uint16_t tail = usart_dma_state.tx_tail;
+	uint16_t len;
+	int32_t byte;
+
+	if (usart_get_byte_callback) {
+		while ((uint16_t)(head - tail) < USART_TX_BUF_SIZE) {
+			byte = usart_get_byte_callback();
+			if (byte < 0) {
+				break;
+			}
+			usart_dma_state.tx_buf[head & (USART_TX_BUF_SIZE - 1)] =
+				(uint8_t)byte;
+			head++;
+		}
+		usart_dma_state.tx_head = head;
+	}
+
+	if (usart_dma_state.tx_len != 0 || head == tail ||
+	    usart_speed_state.pending != 0) {
+		return;
+	}
+
+	/* One transfer up to the end of the buffer. */
+	len = head - tail;
+	if (((tail & (USART_TX_BUF_SIZE - 1)) + len) > USART_TX_BUF_SIZE) {
+		len = USART_TX_BUF_SIZE - (tail & (USART_TX_BUF_SIZE - 1));
+	}
+	usart_dma_state.tx_len = len;
+
+	dma_disable_channel(DMA1, DMA_CHANNEL4);
+	dma_set_memory_address(DMA1, DMA_CHANNEL4,
+		(uint32_t)&usart_dma_state.tx_buf[tail &
+						  (USART_TX_BUF_SIZE - 1)]);
+	dma_set_number_of_data(DMA1, DMA_CHANNEL4, len);
+	/* The DMA writes do not clear TC, it has to mark the end of this
+	 * transfer for a line speed change. The flags are rc_w0, a read
+	 * modify write would also clear the ones set meanwhile.
+	 */
+	USART_SR(USART1) = ~USART_SR_TC;
+	dma_enable_channel(DMA1, DMA_CHANNEL4);
+}
+
+/**
+ * Start sending.
+ *
+ * Pends the DMA send interrupt, that collects the bytes to send from the
+ * callback. While a transfer runs its completion interrupt does that.
  */
 void usart_enable_send(void)
 {
-	USART_CR1(USART1) |= USART_CR1_TXEIE;
+	if (usart_dma_state.tx_len == 0) {
+		nvic_set_pending_irq(NVIC_DMA1_CHANNEL4_IRQ);
+	}
+}
+
+/**
+ * Nothing to do, sending stops when the callback runs out of bytes.
+ */
+void usart_disable_send(void)
+{
+}
+
+/**
+ * DMA send interrupt handler, a transfer completed or sending was started.
+ */
+void dma1_channel4_isr(void)
+{
+	PROFILE_ENTER();
+
+	if (dma_get_interrupt_flag(DMA1, DMA_CHANNEL4, DMA_TCIF)) {
+		dma_clear_interrupt_flags(DMA1, DMA_CHANNEL4, DMA_TCIF);
+		usart_dma_state.tx_tail += usart_dma_state.tx_len;
+		usart_dma_state.tx_len = 0;
+	}
+
+	usart_tx_process();
+
+	PROFILE_EXIT(PROFILE_USART);
+}
+
+/**
+ * DMA receive interrupt handler, the receive buffer is half or completely
+ * filled.
+ */
+void dma1_channel5_isr(void)
+{
+	PROFILE_ENTER();
+
+	dma_clear_interrupt_flags(DMA1, DMA_CHANNEL5, DMA_HTIF | DMA_TCIF);
+
+	usart_rx_process();
+
+	PROFILE_EXIT(PROFILE_USART);
+}
+
+/**
+ * USART interrupt handler, the receive line went idle or the last byte
+ * before a line speed change is out.
+ */
+void usart1_isr(void)
+{
+	PROFILE_ENTER();
+
+	if ((USART_SR(USART1) & USART_SR_IDLE) != 0) {
+		/* Reading the status and the data register clears IDLE. */
+		(void)usart_recv(USART1);
+		usart_rx_process();
+	}
+
+	usart_speed_process();
+
+	PROFILE_EXIT(PROFILE_USART);
+}
+#else
+/**
+ * Enable USART send interrupt, unless a line speed change waits for the
+ * last byte to go out.
+ */
+void usart_enable_send(void)
+{
+	if (usart_speed_state.pending == 0) {
+		USART_CR1(USART1) |= USART_CR1_TXEIE;
+	}
 }
 
 /**
@@ -114,25 +520,37 @@ void usart_disable_send(void)
  */
 void usart1_isr(void)
 {
+	uint8_t byte;
+	int ret;
+
+	PROFILE_ENTER();
 
 	/* input (RX) handler */
 	if ((USART_SR(USART1) & USART_SR_RXNE) != 0) {
 		data_buf = usart_recv(USART1);
 
-		if (usart_handle_byte_callback) {
-			if (usart_handle_byte_callback((int8_t)data_buf)) {
+		if (usart_handle_span_callback) {
+			byte = (uint8_t)data_buf;
+			ret = usart_handle_span_callback(&byte, 1);
+			if (ret != 0) {
+				LOG(LOG_ISR_NORMAL, "usart: byte 0x%02x not "
+				    "taken, error %d", byte, ret);
+			}
+		} else if (usart_handle_byte_callback) {
+			ret = usart_handle_byte_callback((int8_t)data_buf);
+			if (ret != 0) {
 				/* huston we have a problem with the
 				 * parsing engine...
 				*/
-				/* TODO: report that to the error logging,
-				 * messaging, whatever engine.
-				 */
+				LOG(LOG_ISR_NORMAL, "usart: byte 0x%02x not "
+				    "taken, error %d", data_buf, ret);
 			}
 		}
 	}
 
 	/* output (TX) handler */
-	if ((USART_SR(USART1) & USART_SR_TXE) != 0) {
+	if ((USART_CR1(USART1) & USART_CR1_TXEIE) != 0 &&
+	    (USART_SR(USART1) & USART_SR_TXE) != 0) {
 		if (usart_get_byte_callback) {
 			data_buf = usart_get_byte_callback();
 			if (data_buf >= 0) {
@@ -144,4 +562,9 @@ void usart1_isr(void)
 			usart_disable_send();
 		}
 	}
+
+	usart_speed_process();
+
+	PROFILE_EXIT(PROFILE_USART);
 }
+#endif
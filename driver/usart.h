@@ -20,12 +20,23 @@
 #define __USART_H
 
 #include <stdint.h>
+#include <stdbool.h>
+
+/* Line speed the host can always reach the controller at. */
+#define USART_DEFAULT_BAUDRATE 57600
 
 typedef int (*usart_handle_byte_callback_t)(uint8_t byte);
+typedef int (*usart_handle_span_callback_t)(const uint8_t *data,
+					    uint16_t len);
 typedef int32_t (*usart_get_byte_callback_t)(void);
 
 void usart_init(usart_handle_byte_callback_t handle_byte_callback,
-		usart_get_byte_callback_t get_byte_callback);
+		usart_get_byte_callback_t get_byte_callback,
+		uint32_t baudrate);
+void usart_set_span_callback(usart_handle_span_callback_t span_callback);
+bool usart_change_baudrate(uint32_t baudrate);
+uint32_t usart_get_baudrate(void);
+bool usart_baudrate_pending(void);
 void usart_enable_send(void);
 void usart_disable_send(void);
 
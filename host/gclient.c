@@ -0,0 +1,594 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   gclient.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Host client of the governor protocol stand-in.
+ *
+ * Talks to the controller side in host/gprotc.c over a serial device or the
+ * pty of a simulated controller (host/sim_pty.c), in the frame format of
+ * host/gframe.h. Keeps a copy of the controller registers that every
+ * register frame updates, whether it answers a read or write or is a
+ * notification the controller sent on its own, and counts the frames that
+ * were malformed or are missing in the sequence.
+ *
+ * The benchmarks measure the round trip time of register reads and writes
+ * and the rate at which the controller can push register values.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host/gclient.h"
+
+/* Timeout of a benchmark request in ms. */
+#define GCLIENT_BENCH_TIMEOUT 1000
+
+/* Timeout of the requests of a profile read in ms. */
+#define GCLIENT_PROFILE_TIMEOUT 1000
+
+/* Line speeds termios knows. */
+static const struct {
+	uint32_t baudrate;
+	speed_t speed;
+} gclient_speeds[] = {
+	{ 9600, B9600 },
+	{ 19200, B19200 },
+	{ 38400, B38400 },
+	{ 57600, B57600 },
+	{ 115200, B115200 },
+	{ 230400, B230400 },
+	{ 460800, B460800 },
+	{ 500000, B500000 },
+	{ 576000, B576000 },
+	{ 921600, B921600 },
+	{ 1000000, B1000000 },
+	{ 1152000, B1152000 },
+	{ 1500000, B1500000 },
+	{ 2000000, B2000000 },
+	{ 2500000, B2500000 },
+	{ 3000000, B3000000 },
+	{ 3500000, B3500000 },
+	{ 4000000, B4000000 }
+};
+
+static double gclient_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+static int gclient_set_speed(int fd, uint32_t baudrate, bool raw)
+{
+	struct termios tio;
+	size_t i;
+
+	for (i = 0; i < sizeof(gclient_speeds) / sizeof(gclient_speeds[0]);
+	     i++) {
+		if (gclient_speeds[i].baudrate == baudrate) {
+			break;
+		}
+	}
+	if (i == sizeof(gclient_speeds) / sizeof(gclient_speeds[0])) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (tcgetattr(fd, &tio) != 0) {
+		return -1;
+	}
+	if (raw) {
+		cfmakeraw(&tio);
+		tio.c_cflag |= CLOCAL | CREAD;
+		tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+	}
+	(void)cfsetispeed(&tio, gclient_speeds[i].speed);
+	(void)cfsetospeed(&tio, gclient_speeds[i].speed);
+
+	return tcsetattr(fd, TCSADRAIN, &tio);
+}
+
+/**
+ * Open the serial device or pty of a controller, raw 8N1.
+ *
+ * @param baudrate Line speed, a pty ignores it.
+ *
+ * @return 0 on success, -1 with errno set on error.
+ */
+int gclient_open(struct gclient *gc, const char *path, uint32_t baudrate)
+{
+	memset(gc, 0, sizeof(*gc));
+
+	gc->fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (gc->fd < 0) {
+		return -1;
+	}
+
+	if (gclient_set_speed(gc->fd, baudrate, true) != 0) {
+		close(gc->fd);
+		gc->fd = -1;
+		return -1;
+	}
+	(void)tcflush(gc->fd, TCIOFLUSH);
+	gc->baudrate = baudrate;
+	gc->rx_joined = true;
+
+	return 0;
+}
+
+/**
+ * Change the line speed of the host side, after the bytes sent went out.
+ *
+ * @return 0 on success, -1 with errno set on error.
+ */
+int gclient_set_baudrate(struct gclient *gc, uint32_t baudrate)
+{
+	if (gclient_set_speed(gc->fd, baudrate, false) != 0) {
+		return -1;
+	}
+	gc->baudrate = baudrate;
+
+	return 0;
+}
+
+void gclient_close(struct gclient *gc)
+{
+	if (gc->fd >= 0) {
+		close(gc->fd);
+		gc->fd = -1;
+	}
+}
+
+static int gclient_send(struct gclient *gc, uint8_t type, uint8_t addr,
+			const uint8_t *payload, size_t len)
+{
+	uint8_t frame[GFRAME_SIZE_MAX];
+	uint8_t wire[GFRAME_WIRE_MAX];
+	struct pollfd pfd;
+	size_t size, pos = 0;
+	ssize_t n;
+
+	if (len > GFRAME_PAYLOAD_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	frame[0] = type;
+	frame[1] = gc->tx_seq++;
+	frame[2] = addr;
+	memcpy(&frame[GFRAME_HEADER], payload, len);
+	size = gframe_encode(wire, frame, GFRAME_HEADER + len);
+
+	while (pos < size) {
+		n = write(gc->fd, &wire[pos], size - pos);
+		if (n > 0) {
+			pos += (size_t)n;
+			continue;
+		}
+		if (n < 0 && errno != EAGAIN) {
+			return -1;
+		}
+		pfd.fd = gc->fd;
+		pfd.events = POLLOUT;
+		(void)poll(&pfd, 1, 100);
+	}
+
+	return 0;
+}
+
+/**
+ * Ask for count registers from first on.
+ */
+int gclient_send_read(struct gclient *gc, uint8_t first, uint8_t count)
+{
+	return gclient_send(gc, GFRAME_READ, first, &count, 1);
+}
+
+/**
+ * Write count registers from first on, up to GFRAME_PAYLOAD_MAX / 2.
+ */
+int gclient_send_write(struct gclient *gc, uint8_t first, uint8_t count,
+		       const uint16_t *values)
+{
+	uint8_t payload[GFRAME_PAYLOAD_MAX];
+	size_t i;
+
+	if (count > GFRAME_PAYLOAD_MAX / 2) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		payload[2 * i] = (uint8_t)values[i];
+		payload[(2 * i) + 1] = (uint8_t)(values[i] >> 8);
+	}
+
+	return gclient_send(gc, GFRAME_WRITE, first, payload, 2 * count);
+}
+
+/**
+ * Ask for the version strings, they collect in gc->version.
+ */
+int gclient_send_version(struct gclient *gc)
+{
+	return gclient_send(gc, GFRAME_VERSION, 0, NULL, 0);
+}
+
+static void gclient_handle_frame(struct gclient *gc, const uint8_t *frame,
+				 size_t len)
+{
+	const uint8_t *payload = &frame[GFRAME_HEADER];
+	size_t count = len - GFRAME_HEADER;
+	size_t i;
+	uint8_t addr = frame[2];
+
+	if (gc->rx_synced && frame[1] != gc->rx_seq) {
+		gc->counters.lost += (uint8_t)(frame[1] - gc->rx_seq);
+	}
+	gc->rx_seq = frame[1] + 1;
+	gc->rx_synced = true;
+	gc->counters.frames++;
+
+	switch (frame[0]) {
+	case GFRAME_REG:
+		for (i = 0; i + 1 < count && addr < GFRAME_REGS;
+		     i += 2, addr++) {
+			gc->regs[addr] = (uint16_t)(payload[i] |
+						    (payload[i + 1] << 8));
+			gc->updates[addr]++;
+			gc->counters.regs++;
+		}
+		break;
+	case GFRAME_STRING:
+		for (i = 0; i < count &&
+			    gc->version_len < sizeof(gc->version) - 1; i++) {
+			if (payload[i] != 0) {
+				gc->version[gc->version_len++] =
+					(char)payload[i];
+			}
+		}
+		gc->version[gc->version_len] = '\0';
+		break;
+	default:
+		gc->counters.bad++;
+		break;
+	}
+}
+
+static void gclient_handle_byte(struct gclient *gc, uint8_t byte)
+{
+	size_t len;
+
+	if (byte != 0) {
+		if (gc->rx_len < sizeof(gc->rx_buf)) {
+			gc->rx_buf[gc->rx_len++] = byte;
+		} else {
+			gc->rx_overflow = true;
+		}
+		return;
+	}
+
+	len = gc->rx_overflow ? 0 : gframe_decode(gc->rx_buf, gc->rx_len);
+	if (len != 0) {
+		gclient_handle_frame(gc, gc->rx_buf, len);
+	} else if (!gc->rx_joined && (gc->rx_len != 0 || gc->rx_overflow)) {
+		gc->counters.bad++;
+	}
+	gc->rx_len = 0;
+	gc->rx_overflow = false;
+	gc->rx_joined = false;
+}
+
+/**
+ * Wait for bytes from the controller and process the frames they complete.
+ *
+ * @param timeout_ms Time to wait for the first byte, -1 waits forever.
+ *
+ * @return Number of bytes processed, 0 on timeout, -1 on error.
+ */
+int gclient_poll(struct gclient *gc, int timeout_ms)
+{
+	uint8_t buf[1024];
+	struct pollfd pfd;
+	ssize_t n, i;
+	int ret;
+
+	pfd.fd = gc->fd;
+	pfd.events = POLLIN;
+	ret = poll(&pfd, 1, timeout_ms);
+	if (ret <= 0) {
+		return (ret < 0 && errno != EINTR) ? -1 : 0;
+	}
+
+	n = read(gc->fd, buf, sizeof(buf));
+	if (n < 0) {
+		return (errno == EAGAIN) ? 0 : -1;
+	}
+
+	gc->counters.bytes += (uint32_t)n;
+	for (i = 0; i < n; i++) {
+		gclient_handle_byte(gc, buf[i]);
+	}
+
+	return (int)n;
+}
+
+/**
+ * Wait until every register of a range was received since marks.
+ */
+static int gclient_wait(struct gclient *gc, uint8_t first, uint8_t count,
+			const uint32_t *marks, int timeout_ms)
+{
+	double deadline = gclient_now() + (timeout_ms / 1000.0);
+	double left;
+	uint8_t i;
+
+	for (i = 0; i < count; i++) {
+		while (gc->updates[first + i] == marks[i]) {
+			left = deadline - gclient_now();
+			if (left <= 0.0 ||
+			    gclient_poll(gc, (int)(left * 1000.0) + 1) < 0) {
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Read count registers from first on.
+ *
+ * @param values Gets the values, may be NULL.
+ *
+ * @return 0 on success, -1 on error or timeout.
+ */
+int gclient_read(struct gclient *gc, uint8_t first, uint8_t count,
+		 uint16_t *values, int timeout_ms)
+{
+	uint32_t marks[GFRAME_REGS];
+
+	if (count == 0 || (uint16_t)first + count > GFRAME_REGS) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memcpy(marks, &gc->updates[first], count * sizeof(marks[0]));
+	if (gclient_send_read(gc, first, count) != 0 ||
+	    gclient_wait(gc, first, count, marks, timeout_ms) != 0) {
+		return -1;
+	}
+
+	if (values != NULL) {
+		memcpy(values, &gc->regs[first], count * sizeof(values[0]));
+	}
+
+	return 0;
+}
+
+/**
+ * Write count registers from first on and wait until the controller sent
+ * them back. gc->regs then has the values it kept.
+ *
+ * @return 0 on success, -1 on error or timeout.
+ */
+int gclient_write(struct gclient *gc, uint8_t first, uint8_t count,
+		  const uint16_t *values, int timeout_ms)
+{
+	uint32_t marks[GFRAME_REGS];
+
+	if (count == 0 || (uint16_t)first + count > GFRAME_REGS) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memcpy(marks, &gc->updates[first], count * sizeof(marks[0]));
+	if (gclient_send_write(gc, first, count, values) != 0 ||
+	    gclient_wait(gc, first, count, marks, timeout_ms) != 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Switch both sides of the link to a new line speed. The controller takes
+ * the speed in units of 100 baud in speed_reg and switches once the bytes
+ * it has on the way are out, it has to see a write of confirm_reg at the new
+ * speed in time or it falls back to its default speed. On a serial device
+ * the acknowledge of speed_reg can come at either speed and may count as a
+ * bad frame.
+ *
+ * @return 0 on success, -1 if the controller did not switch.
+ */
+int gclient_negotiate(struct gclient *gc, uint32_t baudrate,
+		      uint8_t speed_reg, uint8_t confirm_reg)
+{
+	uint32_t old = gc->baudrate;
+	uint16_t value = (uint16_t)(baudrate / 100);
+	uint16_t confirm = 1;
+	double deadline;
+
+	if (gclient_send_write(gc, speed_reg, 1, &value) != 0) {
+		return -1;
+	}
+
+	/* Let the controller drain and switch. */
+	deadline = gclient_now() + 0.02;
+	while (gclient_now() < deadline) {
+		(void)gclient_poll(gc, 1);
+	}
+
+	if (gclient_set_baudrate(gc, baudrate) != 0) {
+		return -1;
+	}
+
+	if (gclient_write(gc, confirm_reg, 1, &confirm, 200) != 0 ||
+	    gclient_read(gc, speed_reg, 1, NULL, 200) != 0 ||
+	    gc->regs[speed_reg] != value) {
+		(void)gclient_set_baudrate(gc, old);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Read the profile of an interrupt handler. Writing the handler to
+ * select_reg has the controller load its statistics into the eight
+ * registers from data_reg on.
+ *
+ * @return 0 on success, -1 if the controller did not answer.
+ */
+int gclient_read_profile(struct gclient *gc, uint8_t select_reg,
+			 uint8_t data_reg, uint16_t isr,
+			 struct gclient_profile *profile)
+{
+	uint16_t data[8];
+
+	if (gclient_write(gc, select_reg, 1, &isr, GCLIENT_PROFILE_TIMEOUT) != 0 ||
+	    gclient_read(gc, data_reg, 8, data, GCLIENT_PROFILE_TIMEOUT) != 0) {
+		return -1;
+	}
+
+	profile->count = data[0] | ((uint32_t)data[1] << 16);
+	profile->min = data[2];
+	profile->max = data[3];
+	profile->mean = data[4];
+	profile->preempted = data[5];
+	profile->load = data[6] / 10000.0;
+	profile->total_load = data[7] / 10000.0;
+
+	return 0;
+}
+
+static int gclient_compare(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * Measure the round trip time of n register reads or writes. Writes put
+ * back the values read before.
+ *
+ * @return 0 on success, -1 if the registers could not be read at all.
+ */
+int gclient_bench_latency(struct gclient *gc, bool write, uint8_t first,
+			  uint8_t count, uint32_t n,
+			  struct gclient_latency *lat)
+{
+	uint16_t values[GFRAME_REGS];
+	double *rtt, start, sum = 0.0;
+	uint32_t i;
+	int ret;
+
+	memset(lat, 0, sizeof(*lat));
+
+	if (gclient_read(gc, first, count, values,
+			 GCLIENT_BENCH_TIMEOUT) != 0) {
+		return -1;
+	}
+
+	rtt = malloc(n * sizeof(rtt[0]));
+	if (rtt == NULL) {
+		return -1;
+	}
+
+	for (i = 0; i < n; i++) {
+		start = gclient_now();
+		if (write) {
+			ret = gclient_write(gc, first, count, values,
+					    GCLIENT_BENCH_TIMEOUT);
+		} else {
+			ret = gclient_read(gc, first, count, NULL,
+					   GCLIENT_BENCH_TIMEOUT);
+		}
+		if (ret != 0) {
+			lat->timeouts++;
+			continue;
+		}
+		rtt[lat->count] = (gclient_now() - start) * 1e6;
+		sum += rtt[lat->count++];
+	}
+
+	if (lat->count != 0) {
+		qsort(rtt, lat->count, sizeof(rtt[0]), gclient_compare);
+		lat->min = rtt[0];
+		lat->mean = sum / lat->count;
+		lat->p99 = rtt[(lat->count * 99) / 100];
+		lat->max = rtt[lat->count - 1];
+	}
+
+	free(rtt);
+
+	return 0;
+}
+
+/**
+ * Have the controller send all registers back to back for a while and
+ * count what arrives.
+ */
+void gclient_bench_throughput(struct gclient *gc, uint32_t ms,
+			     struct gclient_throughput *tp)
+{
+	struct gclient_counters start = gc->counters;
+	double begin = gclient_now();
+
+	memset(tp, 0, sizeof(*tp));
+
+	do {
+		if (gclient_read(gc, 0, GFRAME_REGS, NULL,
+				 GCLIENT_BENCH_TIMEOUT) != 0) {
+			tp->timeouts++;
+		}
+		tp->seconds = gclient_now() - begin;
+	} while (tp->seconds * 1000.0 < ms);
+
+	tp->regs = gc->counters.regs - start.regs;
+	tp->bytes = gc->counters.bytes - start.bytes;
+	tp->lost = gc->counters.lost - start.lost;
+	tp->bad = gc->counters.bad - start.bad;
+}
+
+/**
+ * Print the link statistics.
+ */
+void gclient_report(struct gclient *gc, FILE *out)
+{
+	fprintf(out, "gclient: %lu frames, %lu bytes, %lu register values, "
+		"%lu lost, %lu bad\n", (unsigned long)gc->counters.frames,
+		(unsigned long)gc->counters.bytes,
+		(unsigned long)gc->counters.regs,
+		(unsigned long)gc->counters.lost,
+		(unsigned long)gc->counters.bad);
+}
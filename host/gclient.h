@@ -0,0 +1,121 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GCLIENT_H
+#define __GCLIENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "host/gframe.h"
+
+/**
+ * Link statistics, counted from gclient_open() on.
+ */
+struct gclient_counters {
+	uint32_t frames; /**< Good frames received */
+	uint32_t bytes; /**< Bytes received */
+	uint32_t regs; /**< Register values received */
+	uint32_t lost; /**< Frames missing in the sequence */
+	uint32_t bad; /**< Malformed frames */
+};
+
+/**
+ * Connection to a controller.
+ */
+struct gclient {
+	int fd;
+	uint32_t baudrate;
+	uint8_t rx_buf[GFRAME_WIRE_MAX];
+	size_t rx_len;
+	bool rx_overflow;
+	bool rx_joined; /**< First frame, may have started before open */
+	uint8_t tx_seq;
+	uint8_t rx_seq; /**< Next expected sequence number */
+	bool rx_synced;
+	uint16_t regs[GFRAME_REGS]; /**< Last values received */
+	uint32_t updates[GFRAME_REGS]; /**< Values received per register */
+	char version[256]; /**< Version strings received */
+	size_t version_len;
+	struct gclient_counters counters;
+};
+
+/**
+ * Round trip times of a latency benchmark in us.
+ */
+struct gclient_latency {
+	uint32_t count;
+	uint32_t timeouts;
+	double min;
+	double mean;
+	double p99;
+	double max;
+};
+
+/**
+ * Result of a throughput benchmark.
+ */
+struct gclient_throughput {
+	double seconds;
+	uint32_t regs; /**< Register values received */
+	uint32_t bytes; /**< Bytes received */
+	uint32_t lost; /**< Frames lost */
+	uint32_t bad; /**< Malformed frames */
+	uint32_t timeouts; /**< Reads not answered in time */
+};
+
+/**
+ * Interrupt handler profile of the controller.
+ */
+struct gclient_profile {
+	uint32_t count; /**< Invocations */
+	uint16_t min; /**< Cycles, saturated at 65535 */
+	uint16_t max;
+	uint16_t mean;
+	uint16_t preempted; /**< Mean cycles of preempting handlers */
+	double load; /**< Share of the cycles in the handler */
+	double total_load; /**< Share of the cycles in all handlers */
+};
+
+int gclient_open(struct gclient *gc, const char *path, uint32_t baudrate);
+void gclient_close(struct gclient *gc);
+int gclient_set_baudrate(struct gclient *gc, uint32_t baudrate);
+int gclient_send_read(struct gclient *gc, uint8_t first, uint8_t count);
+int gclient_send_write(struct gclient *gc, uint8_t first, uint8_t count,
+		       const uint16_t *values);
+int gclient_send_version(struct gclient *gc);
+int gclient_poll(struct gclient *gc, int timeout_ms);
+int gclient_read(struct gclient *gc, uint8_t first, uint8_t count,
+		 uint16_t *values, int timeout_ms);
+int gclient_write(struct gclient *gc, uint8_t first, uint8_t count,
+		  const uint16_t *values, int timeout_ms);
+int gclient_negotiate(struct gclient *gc, uint32_t baudrate,
+		      uint8_t speed_reg, uint8_t confirm_reg);
+int gclient_read_profile(struct gclient *gc, uint8_t select_reg,
+			 uint8_t data_reg, uint16_t isr,
+			 struct gclient_profile *profile);
+int gclient_bench_latency(struct gclient *gc, bool write, uint8_t first,
+			  uint8_t count, uint32_t n,
+			  struct gclient_latency *lat);
+void gclient_bench_throughput(struct gclient *gc, uint32_t ms,
+			      struct gclient_throughput *tp);
+void gclient_report(struct gclient *gc, FILE *out);
+
+#endif /* __GCLIENT_H */
@@ -0,0 +1,295 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   gclient_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Command line client of the governor protocol stand-in.
+ *
+ * Talks to the governor test firmware on a serial device or on the pty of
+ * host_governor:
+ *
+ *   host_gclient [options] device version
+ *   host_gclient [options] device read
+ *   host_gclient [options] device write value...
+ *   host_gclient [options] device monitor
+ *   host_gclient [options] device bench
+ *   host_gclient [options] device profile [reset]
+ *
+ * Options:
+ *   -b baud   line speed the controller is at, 57600 by default
+ *   -s baud   negotiate this line speed first
+ *   -f first  first register, 0 by default
+ *   -c count  number of registers, 1 by default
+ *   -n rounds round trips per latency benchmark, 1000 by default
+ *   -t ms     version timeout, monitor and throughput benchmark time,
+ *             1000 by default
+ *
+ * bench measures the round trip time of reads and writes of the register
+ * range and the register throughput of back to back reads of all
+ * registers. profile prints the cycles and CPU load of the interrupt
+ * handlers of a firmware built with -DPROFILE, or resets them.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host/gclient.h"
+
+/* Line speed negotiation registers of the governor test firmware. */
+#define GCLIENT_SPEED_REG 30
+#define GCLIENT_CONFIRM_REG 31
+
+/* Interrupt profile registers of the governor test firmware. */
+#define GCLIENT_PROFILE_SELECT_REG 16
+#define GCLIENT_PROFILE_DATA_REG 8
+
+/* Default line speed of the controller. */
+#define GCLIENT_DEFAULT_BAUDRATE 57600
+
+/* Timeout of a request in ms. */
+#define GCLIENT_TIMEOUT 1000
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b baud] [-s baud] [-f first] "
+		"[-c count] [-n rounds] [-t ms] device "
+		"version|read|write value...|monitor|bench|profile [reset]\n",
+		name);
+}
+
+static void print_latency(const char *what, uint8_t count,
+			  const struct gclient_latency *lat)
+{
+	printf("%s of %u registers: %lu round trips, min %.0fus mean %.0fus "
+	       "p99 %.0fus max %.0fus, %lu timeouts\n", what, count,
+	       (unsigned long)lat->count, lat->min, lat->mean, lat->p99,
+	       lat->max, (unsigned long)lat->timeouts);
+}
+
+static int bench(struct gclient *gc, uint8_t first, uint8_t count,
+		 uint32_t rounds, uint32_t ms)
+{
+	struct gclient_latency lat;
+	struct gclient_throughput tp;
+
+	if (gclient_bench_latency(gc, false, first, count, rounds,
+				  &lat) != 0) {
+		return -1;
+	}
+	print_latency("read", count, &lat);
+
+	if (gclient_bench_latency(gc, true, first, count, rounds,
+				  &lat) != 0) {
+		return -1;
+	}
+	print_latency("write", count, &lat);
+
+	gclient_bench_throughput(gc, ms, &tp);
+	printf("throughput: %.0f registers/s, %.0f bytes/s, line %.0f%% "
+	       "used, %lu lost, %lu bad, %lu timeouts\n",
+	       tp.regs / tp.seconds, tp.bytes / tp.seconds,
+	       100.0 * tp.bytes * 10.0 / (gc->baudrate * tp.seconds),
+	       (unsigned long)tp.lost, (unsigned long)tp.bad,
+	       (unsigned long)tp.timeouts);
+
+	return 0;
+}
+
+/**
+ * Print the profile of the handlers in the order of enum profile_isr, or
+ * reset it.
+ */
+static int profile(struct gclient *gc, bool reset)
+{
+	static const char *const names[] = {
+		"tim1_trg_com_isr", "adc", "tim2_isr", "usart", "sys_tick"
+	};
+	struct gclient_profile p;
+	uint16_t i, count = sizeof(names) / sizeof(names[0]);
+
+	if (reset) {
+		return gclient_write(gc, GCLIENT_PROFILE_SELECT_REG, 1, &count,
+				     GCLIENT_TIMEOUT);
+	}
+
+	printf("%-18s %10s %9s %9s %9s %9s %7s\n", "isr", "count",
+	       "min[cyc]", "mean[cyc]", "max[cyc]", "preempt", "load");
+	for (i = 0; i < count; i++) {
+		if (gclient_read_profile(gc, GCLIENT_PROFILE_SELECT_REG,
+					 GCLIENT_PROFILE_DATA_REG, i,
+					 &p) != 0) {
+			return -1;
+		}
+		printf("%-18s %10lu %9u %9u %9u %9u %6.2f%%\n", names[i],
+		       (unsigned long)p.count, p.min, p.mean, p.max,
+		       p.preempted, 100.0 * p.load);
+	}
+	printf("all handlers %.2f%% of the cycles\n", 100.0 * p.total_load);
+
+	return 0;
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((double)ts.tv_sec * 1e3) + ((double)ts.tv_nsec / 1e6);
+}
+
+/**
+ * Ask for the version strings, wait until they stopped coming.
+ */
+static void version(struct gclient *gc, uint32_t ms)
+{
+	double end = now_ms() + ms, last = 0.0;
+	size_t len = 0;
+
+	(void)gclient_send_version(gc);
+	while (now_ms() < end && (len == 0 || now_ms() < last + 100.0)) {
+		(void)gclient_poll(gc, 10);
+		if (gc->version_len != len) {
+			len = gc->version_len;
+			last = now_ms();
+		}
+	}
+
+	printf("%s", gc->version);
+}
+
+static void monitor(struct gclient *gc, uint32_t ms)
+{
+	uint32_t seen[GFRAME_REGS];
+	double end = now_ms() + ms;
+	int i;
+
+	memcpy(seen, gc->updates, sizeof(seen));
+	while (now_ms() < end) {
+		(void)gclient_poll(gc, 10);
+		for (i = 0; i < GFRAME_REGS; i++) {
+			if (gc->updates[i] != seen[i]) {
+				seen[i] = gc->updates[i];
+				printf("%2d: %u\n", i, gc->regs[i]);
+			}
+		}
+	}
+}
+
+/**
+ * Governor client main function
+ */
+int main(int argc, char *argv[])
+{
+	struct gclient gc;
+	uint16_t values[GFRAME_REGS];
+	uint32_t baudrate = GCLIENT_DEFAULT_BAUDRATE, speed = 0;
+	uint32_t rounds = 1000, ms = 1000;
+	uint8_t first = 0, count = 1;
+	const char *command;
+	int opt, i, ret = 0;
+
+	while ((opt = getopt(argc, argv, "b:s:f:c:n:t:")) != -1) {
+		switch (opt) {
+		case 'b':
+			baudrate = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			speed = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			first = (uint8_t)strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			count = (uint8_t)strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			rounds = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			ms = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (argc - optind < 2 || count == 0 ||
+	    (uint16_t)first + count > GFRAME_REGS) {
+		usage(argv[0]);
+		return 1;
+	}
+	command = argv[optind + 1];
+
+	if (gclient_open(&gc, argv[optind], baudrate) != 0) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	if (speed != 0 && gclient_negotiate(&gc, speed, GCLIENT_SPEED_REG,
+					     GCLIENT_CONFIRM_REG) != 0) {
+		fprintf(stderr, "controller did not switch to %lu baud\n",
+			(unsigned long)speed);
+		gclient_close(&gc);
+		return 1;
+	}
+
+	if (strcmp(command, "version") == 0) {
+		version(&gc, ms);
+	} else if (strcmp(command, "read") == 0) {
+		ret = gclient_read(&gc, first, count, values,
+				   GCLIENT_TIMEOUT);
+		for (i = 0; ret == 0 && i < count; i++) {
+			printf("%2d: %u\n", first + i, values[i]);
+		}
+	} else if (strcmp(command, "write") == 0 &&
+		   argc - optind - 2 == count) {
+		for (i = 0; i < count; i++) {
+			values[i] = (uint16_t)strtoul(argv[optind + 2 + i],
+						      NULL, 0);
+		}
+		ret = gclient_write(&gc, first, count, values,
+				    GCLIENT_TIMEOUT);
+	} else if (strcmp(command, "monitor") == 0) {
+		monitor(&gc, ms);
+	} else if (strcmp(command, "bench") == 0) {
+		ret = bench(&gc, first, count, rounds, ms);
+	} else if (strcmp(command, "profile") == 0) {
+		ret = profile(&gc, argc - optind > 2 &&
+			      strcmp(argv[optind + 2], "reset") == 0);
+	} else {
+		usage(argv[0]);
+		gclient_close(&gc);
+		return 1;
+	}
+
+	if (ret != 0) {
+		fprintf(stderr, "no answer from the controller\n");
+	}
+	gclient_report(&gc, stdout);
+	gclient_close(&gc);
+
+	return (ret != 0) ? 1 : 0;
+}
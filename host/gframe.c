@@ -0,0 +1,90 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   gframe.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Frame encoding shared by the simulated controller and the host
+ *         client.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "host/gframe.h"
+
+#include "driver/cobs.h"
+
+/**
+ * Append the checksum to a frame and COBS encode it.
+ *
+ * @param wire Gets the encoded frame with delimiter, GFRAME_WIRE_MAX bytes.
+ * @param frame Type, sequence number, address and payload.
+ * @param len Length of frame, at most GFRAME_SIZE_MAX - 1.
+ *
+ * @return Number of bytes in wire.
+ */
+size_t gframe_encode(uint8_t *wire, const uint8_t *frame, size_t len)
+{
+	uint8_t buf[GFRAME_SIZE_MAX];
+	uint8_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = frame[i];
+		sum += frame[i];
+	}
+	buf[len] = (uint8_t)(0 - sum);
+
+	return cobs_encode(buf, len + 1, wire);
+}
+
+/**
+ * COBS decode a frame in place and check it.
+ *
+ * @param buf Frame without the delimiter.
+ * @param len Length of buf.
+ *
+ * @return Length of the frame without checksum, 0 if it is malformed.
+ */
+size_t gframe_decode(uint8_t *buf, size_t len)
+{
+	size_t in = 0, out = 0;
+	uint8_t code, i, sum = 0;
+
+	while (in < len) {
+		code = buf[in++];
+		if (code == 0 || in + code - 1 > len) {
+			return 0;
+		}
+		for (i = 1; i < code; i++) {
+			sum += buf[in];
+			buf[out++] = buf[in++];
+		}
+		if (code < 0xff && in < len) {
+			buf[out++] = 0;
+		}
+	}
+
+	if (out < GFRAME_HEADER + 1 || sum != 0) {
+		return 0;
+	}
+
+	return out - 1;
+}
@@ -0,0 +1,61 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GFRAME_H
+#define __GFRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Frame format between host/gprotc.c on the simulated controller and
+ * host/gclient.c on the host:
+ *
+ *   type, sequence number, register address, payload, checksum
+ *
+ * The checksum makes the sum of all bytes zero. Frames are COBS encoded
+ * and end with a zero byte. Every sender counts its own sequence numbers,
+ * a gap tells the receiver how many frames were lost.
+ */
+
+/* Number of registers. */
+#define GFRAME_REGS 32
+
+/* Bytes in front of the payload. */
+#define GFRAME_HEADER 3
+
+/* Largest payload, 16 registers or 32 characters. */
+#define GFRAME_PAYLOAD_MAX 32
+
+/* Largest frame, decoded and on the wire with COBS overhead and
+ * delimiter.
+ */
+#define GFRAME_SIZE_MAX (GFRAME_HEADER + GFRAME_PAYLOAD_MAX + 1)
+#define GFRAME_WIRE_MAX (GFRAME_SIZE_MAX + 2)
+
+enum gframe_type {
+	GFRAME_READ = 1, /**< Host: send count registers, payload count */
+	GFRAME_WRITE = 2, /**< Host: set registers, payload values */
+	GFRAME_VERSION = 3, /**< Host: send the version strings */
+	GFRAME_REG = 4, /**< Controller: registers from address on */
+	GFRAME_STRING = 5 /**< Controller: characters of a string */
+};
+
+size_t gframe_encode(uint8_t *wire, const uint8_t *frame, size_t len);
+size_t gframe_decode(uint8_t *buf, size_t len);
+
+#endif /* __GFRAME_H */
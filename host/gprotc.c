@@ -0,0 +1,305 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   gprotc.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Host stand-in of the libgovernor controller side.
+ *
+ * Lets the governor test firmware run in the host simulation against
+ * host/gclient.c, with the frame format of host/gframe.h instead of the
+ * libgovernor one. Registers are sent when they are touched or the host
+ * reads them, consecutive touched registers share a frame. A register the
+ * host wrote goes back to it after the register changed callback ran, with
+ * the value the firmware kept, which acknowledges the write.
+ *
+ * gpc_handle_byte() and gpc_pickup_byte() run in the usart interrupt,
+ * gpc_register_touched() and gpc_send_string() anywhere.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <libopencm3/cm3/cortex.h>
+
+#include <lg/gpdef.h>
+#include <lg/gprotc.h>
+
+#include "host/gframe.h"
+
+/* Size of the string ring buffer, a power of two. */
+#define GPC_STRING_BUF_SIZE 512
+
+/* Internal state. */
+static struct {
+	gpc_trigger_output_callback_t trigger_output;
+	void *trigger_data;
+	gpc_register_changed_callback_t register_changed;
+	void *changed_data;
+	gpc_get_version_callback_t get_version;
+	void *version_data;
+	u16 *regs[GFRAME_REGS];
+	volatile u32 touched; /**< Registers waiting to be sent */
+	u8 rx_buf[GFRAME_WIRE_MAX];
+	size_t rx_len;
+	bool rx_overflow;
+	u8 tx_buf[GFRAME_WIRE_MAX];
+	size_t tx_pos;
+	size_t tx_len;
+	u8 tx_seq;
+	char str_buf[GPC_STRING_BUF_SIZE];
+	volatile u16 str_head;
+	volatile u16 str_tail;
+} gpc;
+
+/**
+ * Initialize the protocol.
+ *
+ * @param trigger_output Called when there is something to send.
+ * @param register_changed Called after the host wrote a register.
+ *
+ * @return 0
+ */
+int gpc_init(gpc_trigger_output_callback_t trigger_output, void *trigger_data,
+	     gpc_register_changed_callback_t register_changed,
+	     void *changed_data)
+{
+	int i;
+
+	gpc.trigger_output = trigger_output;
+	gpc.trigger_data = trigger_data;
+	gpc.register_changed = register_changed;
+	gpc.changed_data = changed_data;
+	gpc.get_version = NULL;
+	gpc.version_data = NULL;
+	for (i = 0; i < GFRAME_REGS; i++) {
+		gpc.regs[i] = NULL;
+	}
+	gpc.touched = 0;
+	gpc.rx_len = 0;
+	gpc.rx_overflow = false;
+	gpc.tx_pos = 0;
+	gpc.tx_len = 0;
+	gpc.tx_seq = 0;
+	gpc.str_head = 0;
+	gpc.str_tail = 0;
+
+	return 0;
+}
+
+/**
+ * Set the callback run when the host asks for the version strings.
+ *
+ * @return 0
+ */
+int gpc_set_get_version_callback(gpc_get_version_callback_t get_version,
+				 void *data)
+{
+	gpc.get_version = get_version;
+	gpc.version_data = data;
+
+	return 0;
+}
+
+/**
+ * Back a register address with a variable.
+ *
+ * @return 0 on success, -1 if the address does not exist.
+ */
+int gpc_setup_reg(u8 addr, u16 *reg)
+{
+	if (addr >= GFRAME_REGS) {
+		return -1;
+	}
+
+	gpc.regs[addr] = reg;
+
+	return 0;
+}
+
+/**
+ * Have a register sent to the host. Touching it again before it went out
+ * sends it only once, with the latest value.
+ *
+ * @return 0 on success, -1 if the register is not set up.
+ */
+int gpc_register_touched(u8 addr)
+{
+	if (addr >= GFRAME_REGS || gpc.regs[addr] == NULL) {
+		return -1;
+	}
+
+	cm_disable_interrupts();
+	gpc.touched |= (u32)1 << addr;
+	cm_enable_interrupts();
+
+	gpc.trigger_output(gpc.trigger_data);
+
+	return 0;
+}
+
+/**
+ * Queue a string for the host.
+ *
+ * @return 0 on success, -1 if it does not fit into the buffer.
+ */
+int gpc_send_string(const char *str, int len)
+{
+	u16 head = gpc.str_head;
+	int i;
+
+	if (len < 0 || (u16)(head - gpc.str_tail) + (u16)len >
+		       GPC_STRING_BUF_SIZE) {
+		return -1;
+	}
+
+	for (i = 0; i < len; i++) {
+		gpc.str_buf[(head + i) & (GPC_STRING_BUF_SIZE - 1)] = str[i];
+	}
+	gpc.str_head = head + (u16)len;
+
+	gpc.trigger_output(gpc.trigger_data);
+
+	return 0;
+}
+
+/**
+ * Run a frame from the host.
+ */
+static int gpc_handle_frame(const u8 *frame, size_t len)
+{
+	const u8 *payload = &frame[GFRAME_HEADER];
+	size_t count = len - GFRAME_HEADER;
+	u8 addr = frame[2];
+	size_t i;
+
+	switch (frame[0]) {
+	case GFRAME_READ:
+		count = (count != 0) ? payload[0] : 1;
+		for (i = 0; i < count && addr + i < GFRAME_REGS; i++) {
+			(void)gpc_register_touched((u8)(addr + i));
+		}
+		return 0;
+	case GFRAME_WRITE:
+		for (i = 0; i + 1 < count; i += 2, addr++) {
+			if (addr >= GFRAME_REGS || gpc.regs[addr] == NULL) {
+				return -1;
+			}
+			*gpc.regs[addr] = (u16)(payload[i] |
+						(payload[i + 1] << 8));
+			gpc.register_changed(gpc.changed_data, addr);
+			(void)gpc_register_touched(addr);
+		}
+		return 0;
+	case GFRAME_VERSION:
+		if (gpc.get_version != NULL) {
+			gpc.get_version(gpc.version_data);
+		}
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+/**
+ * Feed a byte received from the host.
+ *
+ * @return 0, -1 if it completed a malformed frame.
+ */
+int gpc_handle_byte(u8 byte)
+{
+	size_t len;
+
+	if (byte != 0) {
+		if (gpc.rx_len < sizeof(gpc.rx_buf)) {
+			gpc.rx_buf[gpc.rx_len++] = byte;
+		} else {
+			gpc.rx_overflow = true;
+		}
+		return 0;
+	}
+
+	len = gpc.rx_overflow ? 0 : gframe_decode(gpc.rx_buf, gpc.rx_len);
+	gpc.rx_len = 0;
+	gpc.rx_overflow = false;
+	if (len == 0) {
+		return -1;
+	}
+
+	return gpc_handle_frame(gpc.rx_buf, len);
+}
+
+/**
+ * Build the next frame, touched registers first.
+ *
+ * @return false if there is nothing to send.
+ */
+static bool gpc_next_frame(void)
+{
+	u8 frame[GFRAME_SIZE_MAX];
+	size_t len = GFRAME_HEADER;
+	u32 touched = gpc.touched;
+	u16 value;
+	u8 addr;
+
+	if (touched != 0) {
+		addr = (u8)__builtin_ctz(touched);
+		frame[0] = GFRAME_REG;
+		frame[2] = addr;
+		while (addr < GFRAME_REGS && (touched & ((u32)1 << addr)) &&
+		       len + 2 <= GFRAME_HEADER + GFRAME_PAYLOAD_MAX) {
+			gpc.touched &= ~((u32)1 << addr);
+			value = *gpc.regs[addr++];
+			frame[len++] = (u8)value;
+			frame[len++] = (u8)(value >> 8);
+		}
+	} else if (gpc.str_head != gpc.str_tail) {
+		frame[0] = GFRAME_STRING;
+		frame[2] = 0;
+		while (gpc.str_tail != gpc.str_head &&
+		       len < GFRAME_HEADER + GFRAME_PAYLOAD_MAX) {
+			frame[len++] = (u8)gpc.str_buf[gpc.str_tail &
+						       (GPC_STRING_BUF_SIZE - 1)];
+			gpc.str_tail++;
+		}
+	} else {
+		return false;
+	}
+
+	frame[1] = gpc.tx_seq++;
+	gpc.tx_len = gframe_encode(gpc.tx_buf, frame, len);
+	gpc.tx_pos = 0;
+
+	return true;
+}
+
+/**
+ * Get the next byte for the host.
+ *
+ * @return The byte, -1 if there is nothing to send.
+ */
+s32 gpc_pickup_byte(void)
+{
+	if (gpc.tx_pos == gpc.tx_len && !gpc_next_frame()) {
+		return -1;
+	}
+
+	return gpc.tx_buf[gpc.tx_pos++];
+}
@@ -0,0 +1,49 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010-2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Host stand-in of the libgovernor controller side.
+ *
+ * Implements the controller API the firmware uses on top of the frame
+ * format in host/gprot.h, which host/gclient.c speaks on the other end.
+ * It lets the governor test firmware run in the simulation against a host
+ * client. The wire format is not the one of libgovernor.
+ */
+
+#ifndef LG_GPROTC_H
+#define LG_GPROTC_H
+
+#include <lg/gpdef.h>
+
+typedef void (*gpc_trigger_output_callback_t)(void *data);
+typedef void (*gpc_register_changed_callback_t)(void *data, u8 addr);
+typedef void (*gpc_get_version_callback_t)(void *data);
+
+int gpc_init(gpc_trigger_output_callback_t trigger_output, void *trigger_data,
+	     gpc_register_changed_callback_t register_changed,
+	     void *changed_data);
+int gpc_set_get_version_callback(gpc_get_version_callback_t get_version,
+				 void *data);
+int gpc_setup_reg(u8 addr, u16 *reg);
+int gpc_register_touched(u8 addr);
+int gpc_send_string(const char *str, int len);
+int gpc_handle_byte(u8 byte);
+s32 gpc_pickup_byte(void);
+
+#endif /* LG_GPROTC_H */
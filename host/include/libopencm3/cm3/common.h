@@ -0,0 +1,78 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host backend of the libopencm3 common definitions.
+ *
+ * Instead of dereferencing the peripheral address directly MMIO32() maps the
+ * address into the simulated register file of host/sim.c. Every access is
+ * counted so that the host benchmarks can report the bus traffic of a piece
+ * of driver code. Reading the DWT cycle counter has the simulator update it
+ * first.
+ */
+
+#ifndef LIBOPENCM3_CM3_COMMON_H
+#define LIBOPENCM3_CM3_COMMON_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+/* Simulated peripheral (0x4000_0000) and private peripheral (0xE000_0000)
+ * register windows.
+ */
+#define SIM_PERIPH_BASE		0x40000000U
+#define SIM_PERIPH_SIZE		0x00024000U
+#define SIM_PPB_BASE		0xE0000000U
+#define SIM_PPB_SIZE		0x00010000U
+
+/* DWT cycle counter, kept by the simulator. */
+#define SIM_DWT_CYCCNT		0xE0001004U
+
+extern volatile uint32_t sim_periph_regs[SIM_PERIPH_SIZE / 4];
+extern volatile uint32_t sim_ppb_regs[SIM_PPB_SIZE / 4];
+extern uint64_t sim_mmio_accesses;
+
+void sim_dwt_update(void);
+
+static inline volatile uint32_t *sim_mmio32(uint32_t addr)
+{
+	sim_mmio_accesses++;
+
+	if (addr >= SIM_PPB_BASE) {
+		if (addr == SIM_DWT_CYCCNT) {
+			sim_dwt_update();
+		}
+		return &sim_ppb_regs[(addr - SIM_PPB_BASE) >> 2];
+	}
+
+	return &sim_periph_regs[(addr - SIM_PERIPH_BASE) >> 2];
+}
+
+#define MMIO32(addr)		(*sim_mmio32(addr))
+
+#endif /* LIBOPENCM3_CM3_COMMON_H */
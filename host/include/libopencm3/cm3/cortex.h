@@ -0,0 +1,62 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2010-2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Host backend of the libopencm3 Cortex core helpers.
+ *
+ * The simulation dispatches interrupts only between two quanta of
+ * sim_run(), code outside of the handlers is never interrupted. Masking the
+ * interrupts has nothing to do here. Waiting for an interrupt runs the
+ * simulation until a handler was called. PRIMASK is only kept to hand it
+ * back to cm_mask_interrupts().
+ */
+
+#ifndef LIBOPENCM3_CM3_CORTEX_H
+#define LIBOPENCM3_CM3_CORTEX_H
+
+#include <stdint.h>
+
+extern uint32_t sim_primask;
+
+void sim_wait_for_interrupt(void);
+
+static inline void cm_enable_interrupts(void)
+{
+	sim_primask = 0;
+}
+
+static inline void cm_disable_interrupts(void)
+{
+	sim_primask = 1;
+}
+
+static inline uint32_t cm_mask_interrupts(uint32_t mask)
+{
+	uint32_t old = sim_primask;
+
+	sim_primask = mask;
+	return old;
+}
+
+static inline void __WFI(void)
+{
+	sim_wait_for_interrupt();
+}
+
+#endif /* LIBOPENCM3_CM3_CORTEX_H */
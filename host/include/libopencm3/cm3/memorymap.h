@@ -0,0 +1,30 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_CM3_MEMORYMAP_H
+#define LIBOPENCM3_CM3_MEMORYMAP_H
+
+/* Private peripheral bus (Cortex-M3 core peripherals) */
+#define PPBI_BASE		0xE0000000U
+#define DWT_BASE		(PPBI_BASE + 0x1000)
+#define SCS_BASE		(PPBI_BASE + 0xE000)
+#define SYS_TICK_BASE		(SCS_BASE + 0x0010)
+#define NVIC_BASE		(SCS_BASE + 0x0100)
+#define SCB_BASE		(SCS_BASE + 0x0D00)
+
+#endif /* LIBOPENCM3_CM3_MEMORYMAP_H */
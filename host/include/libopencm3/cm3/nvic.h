@@ -0,0 +1,45 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_NVIC_H
+#define LIBOPENCM3_NVIC_H
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/cm3/memorymap.h>
+#include <libopencm3/stm32/f1/nvic.h>
+
+/* --- NVIC registers ------------------------------------------------------ */
+
+#define NVIC_ISER(iser_id)	MMIO32(NVIC_BASE + 0x000 + ((iser_id) * 4))
+#define NVIC_ICER(icer_id)	MMIO32(NVIC_BASE + 0x080 + ((icer_id) * 4))
+#define NVIC_ISPR(ispr_id)	MMIO32(NVIC_BASE + 0x100 + ((ispr_id) * 4))
+#define NVIC_ICPR(icpr_id)	MMIO32(NVIC_BASE + 0x180 + ((icpr_id) * 4))
+#define NVIC_IPR(ipr_id)	MMIO32(NVIC_BASE + 0x300 + ((ipr_id) & ~3))
+
+/* --- NVIC functions ------------------------------------------------------ */
+
+void nvic_enable_irq(u8 irqn);
+void nvic_disable_irq(u8 irqn);
+u8 nvic_get_pending_irq(u8 irqn);
+void nvic_set_pending_irq(u8 irqn);
+void nvic_clear_pending_irq(u8 irqn);
+u8 nvic_get_irq_enabled(u8 irqn);
+void nvic_set_priority(u8 irqn, u8 priority);
+u8 nvic_get_priority(u8 irqn);
+
+#endif /* LIBOPENCM3_NVIC_H */
@@ -0,0 +1,38 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_SCS_H
+#define LIBOPENCM3_SCS_H
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/cm3/memorymap.h>
+
+/* --- Debug exception and monitor control --------------------------------- */
+
+#define SCS_DEMCR		MMIO32(SCS_BASE + 0xDFC)
+
+#define SCS_DEMCR_TRCENA	(1 << 24)
+
+/* --- Data watchpoint and trace unit -------------------------------------- */
+
+#define SCS_DWT_CTRL		MMIO32(DWT_BASE + 0x00)
+#define SCS_DWT_CYCCNT		MMIO32(DWT_BASE + 0x04)
+
+#define SCS_DWT_CTRL_CYCCNTENA	(1 << 0)
+
+#endif /* LIBOPENCM3_SCS_H */
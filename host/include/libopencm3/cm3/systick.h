@@ -0,0 +1,56 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_SYSTICK_H
+#define LIBOPENCM3_SYSTICK_H
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/cm3/memorymap.h>
+
+/* --- SYSTICK registers --------------------------------------------------- */
+
+#define STK_CTRL		MMIO32(SYS_TICK_BASE + 0x00)
+#define STK_LOAD		MMIO32(SYS_TICK_BASE + 0x04)
+#define STK_VAL			MMIO32(SYS_TICK_BASE + 0x08)
+#define STK_CALIB		MMIO32(SYS_TICK_BASE + 0x0C)
+
+/* --- STK_CTRL values ----------------------------------------------------- */
+
+#define STK_CTRL_COUNTFLAG		(1 << 16)
+#define STK_CTRL_CLKSOURCE_LSB		2
+#define STK_CTRL_CLKSOURCE		(1 << STK_CTRL_CLKSOURCE_LSB)
+#define STK_CTRL_CLKSOURCE_AHB_DIV8	0
+#define STK_CTRL_CLKSOURCE_AHB		1
+#define STK_CTRL_TICKINT		(1 << 1)
+#define STK_CTRL_ENABLE			(1 << 0)
+
+#define STK_LOAD_RELOAD			0x00FFFFFF
+
+/* --- Function prototypes ------------------------------------------------- */
+
+void systick_set_reload(u32 value);
+u32 systick_get_reload(void);
+u32 systick_get_value(void);
+void systick_set_clocksource(u8 clocksource);
+void systick_interrupt_enable(void);
+void systick_interrupt_disable(void);
+void systick_counter_enable(void);
+void systick_counter_disable(void);
+u8 systick_get_countflag(void);
+
+#endif /* LIBOPENCM3_SYSTICK_H */
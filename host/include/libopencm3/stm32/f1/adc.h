@@ -0,0 +1,173 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_ADC_H
+#define LIBOPENCM3_ADC_H
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/stm32/memorymap.h>
+
+/* --- ADC registers ------------------------------------------------------- */
+
+#define ADC1			ADC1_BASE
+#define ADC2			ADC2_BASE
+
+#define ADC_SR(block)		MMIO32((block) + 0x00)
+#define ADC_CR1(block)		MMIO32((block) + 0x04)
+#define ADC_CR2(block)		MMIO32((block) + 0x08)
+#define ADC_SMPR1(block)	MMIO32((block) + 0x0c)
+#define ADC_SMPR2(block)	MMIO32((block) + 0x10)
+#define ADC_JOFR1(block)	MMIO32((block) + 0x14)
+#define ADC_JOFR2(block)	MMIO32((block) + 0x18)
+#define ADC_JOFR3(block)	MMIO32((block) + 0x1c)
+#define ADC_JOFR4(block)	MMIO32((block) + 0x20)
+#define ADC_HTR(block)		MMIO32((block) + 0x24)
+#define ADC_LTR(block)		MMIO32((block) + 0x28)
+#define ADC_SQR1(block)		MMIO32((block) + 0x2c)
+#define ADC_SQR2(block)		MMIO32((block) + 0x30)
+#define ADC_SQR3(block)		MMIO32((block) + 0x34)
+#define ADC_JSQR(block)		MMIO32((block) + 0x38)
+#define ADC_JDR1(block)		MMIO32((block) + 0x3c)
+#define ADC_JDR2(block)		MMIO32((block) + 0x40)
+#define ADC_JDR3(block)		MMIO32((block) + 0x44)
+#define ADC_JDR4(block)		MMIO32((block) + 0x48)
+#define ADC_DR(block)		MMIO32((block) + 0x4c)
+
+#define ADC1_SR			ADC_SR(ADC1)
+#define ADC1_CR1		ADC_CR1(ADC1)
+#define ADC1_CR2		ADC_CR2(ADC1)
+#define ADC1_JDR1		ADC_JDR1(ADC1)
+#define ADC1_DR			ADC_DR(ADC1)
+#define ADC2_DR			ADC_DR(ADC2)
+
+/* --- ADC_SR values ------------------------------------------------------- */
+
+#define ADC_SR_STRT		(1 << 4)
+#define ADC_SR_JSTRT		(1 << 3)
+#define ADC_SR_JEOC		(1 << 2)
+#define ADC_SR_EOC		(1 << 1)
+#define ADC_SR_AWD		(1 << 0)
+
+/* --- ADC_CR1 values ------------------------------------------------------ */
+
+#define ADC_CR1_AWDEN		(1 << 23)
+#define ADC_CR1_JAWDEN		(1 << 22)
+#define ADC_CR1_DUALMOD_IND	(0x0 << 16)
+#define ADC_CR1_DUALMOD_CRSISM	(0x1 << 16)
+#define ADC_CR1_DUALMOD_CRSATM	(0x2 << 16)
+#define ADC_CR1_DUALMOD_CFRSLM	(0x3 << 16)
+#define ADC_CR1_DUALMOD_CSRSLM	(0x4 << 16)
+#define ADC_CR1_DUALMOD_ISM	(0x5 << 16)
+#define ADC_CR1_DUALMOD_RSM	(0x6 << 16)
+#define ADC_CR1_DUALMOD_FIM	(0x7 << 16)
+#define ADC_CR1_DUALMOD_SIM	(0x8 << 16)
+#define ADC_CR1_DUALMOD_ATM	(0x9 << 16)
+#define ADC_CR1_DUALMOD_MASK	(0xf << 16)
+#define ADC_CR1_JDISCEN		(1 << 12)
+#define ADC_CR1_DISCEN		(1 << 11)
+#define ADC_CR1_JAUTO		(1 << 10)
+#define ADC_CR1_AWDSGL		(1 << 9)
+#define ADC_CR1_SCAN		(1 << 8)
+#define ADC_CR1_JEOCIE		(1 << 7)
+#define ADC_CR1_AWDIE		(1 << 6)
+#define ADC_CR1_EOCIE		(1 << 5)
+
+/* --- ADC_CR2 values ------------------------------------------------------ */
+
+#define ADC_CR2_TSVREFE			(1 << 23)
+#define ADC_CR2_SWSTART			(1 << 22)
+#define ADC_CR2_JSWSTART		(1 << 21)
+#define ADC_CR2_EXTTRIG			(1 << 20)
+#define ADC_CR2_EXTSEL_TIM1_CC1		(0x0 << 17)
+#define ADC_CR2_EXTSEL_TIM1_CC2		(0x1 << 17)
+#define ADC_CR2_EXTSEL_TIM1_CC3		(0x2 << 17)
+#define ADC_CR2_EXTSEL_TIM2_CC2		(0x3 << 17)
+#define ADC_CR2_EXTSEL_TIM3_TRGO	(0x4 << 17)
+#define ADC_CR2_EXTSEL_TIM4_CC4		(0x5 << 17)
+#define ADC_CR2_EXTSEL_EXTI11		(0x6 << 17)
+#define ADC_CR2_EXTSEL_SWSTART		(0x7 << 17)
+#define ADC_CR2_EXTSEL_MASK		(0x7 << 17)
+#define ADC_CR2_JEXTTRIG		(1 << 15)
+#define ADC_CR2_JEXTSEL_TIM1_TRGO	(0x0 << 12)
+#define ADC_CR2_JEXTSEL_TIM1_CC4	(0x1 << 12)
+#define ADC_CR2_JEXTSEL_TIM2_TRGO	(0x2 << 12)
+#define ADC_CR2_JEXTSEL_TIM2_CC1	(0x3 << 12)
+#define ADC_CR2_JEXTSEL_TIM3_CC4	(0x4 << 12)
+#define ADC_CR2_JEXTSEL_TIM4_TRGO	(0x5 << 12)
+#define ADC_CR2_JEXTSEL_EXTI15		(0x6 << 12)
+#define ADC_CR2_JEXTSEL_JSWSTART	(0x7 << 12)
+#define ADC_CR2_JEXTSEL_MASK		(0x7 << 12)
+#define ADC_CR2_ALIGN			(1 << 11)
+#define ADC_CR2_DMA			(1 << 8)
+#define ADC_CR2_RSTCAL			(1 << 3)
+#define ADC_CR2_CAL			(1 << 2)
+#define ADC_CR2_CONT			(1 << 1)
+#define ADC_CR2_ADON			(1 << 0)
+
+/* --- ADC_SMPRx values ---------------------------------------------------- */
+
+#define ADC_SMPR_SMP_1DOT5CYC		0x0
+#define ADC_SMPR_SMP_7DOT5CYC		0x1
+#define ADC_SMPR_SMP_13DOT5CYC		0x2
+#define ADC_SMPR_SMP_28DOT5CYC		0x3
+#define ADC_SMPR_SMP_41DOT5CYC		0x4
+#define ADC_SMPR_SMP_55DOT5CYC		0x5
+#define ADC_SMPR_SMP_71DOT5CYC		0x6
+#define ADC_SMPR_SMP_239DOT5CYC		0x7
+
+/* --- ADC_SQR1/ADC_JSQR values -------------------------------------------- */
+
+#define ADC_SQR1_L_LSB			20
+#define ADC_SQR1_L_MSK			(0xf << ADC_SQR1_L_LSB)
+#define ADC_JSQR_JL_LSB			20
+#define ADC_JSQR_JL_MSK			(0x3 << ADC_JSQR_JL_LSB)
+
+#define ADC_INJECTED_REGISTER_1		0x3c
+#define ADC_INJECTED_REGISTER_2		0x40
+#define ADC_INJECTED_REGISTER_3		0x44
+#define ADC_INJECTED_REGISTER_4		0x48
+
+/* --- Function prototypes ------------------------------------------------- */
+
+void adc_power_on(u32 adc);
+void adc_off(u32 adc);
+void adc_enable_scan_mode(u32 adc);
+void adc_disable_scan_mode(u32 adc);
+void adc_set_continuous_conversion_mode(u32 adc);
+void adc_set_single_conversion_mode(u32 adc);
+void adc_set_right_aligned(u32 adc);
+void adc_enable_external_trigger_regular(u32 adc, u32 trigger);
+void adc_disable_external_trigger_regular(u32 adc);
+void adc_enable_external_trigger_injected(u32 adc, u32 trigger);
+void adc_disable_external_trigger_injected(u32 adc);
+void adc_enable_eoc_interrupt_injected(u32 adc);
+void adc_disable_eoc_interrupt_injected(u32 adc);
+void adc_set_sample_time_on_all_channels(u32 adc, u8 time);
+void adc_enable_dma(u32 adc);
+void adc_disable_dma(u32 adc);
+void adc_reset_calibration(u32 adc);
+void adc_calibration(u32 adc);
+void adc_set_regular_sequence(u32 adc, u8 length, u8 channel[]);
+void adc_set_injected_sequence(u32 adc, u8 length, u8 channel[]);
+void adc_set_dual_mode(u32 mode);
+void adc_start_conversion_regular(u32 adc);
+void adc_start_conversion_injected(u32 adc);
+bool adc_eoc_injected(u32 adc);
+u32 adc_read_injected(u32 adc, u8 reg);
+
+#endif /* LIBOPENCM3_ADC_H */
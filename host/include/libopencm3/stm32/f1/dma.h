@@ -0,0 +1,112 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_DMA_H
+#define LIBOPENCM3_DMA_H
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/stm32/memorymap.h>
+
+/* --- DMA registers ------------------------------------------------------- */
+
+#define DMA1			DMA1_BASE
+
+#define DMA_ISR(dma_base)	MMIO32((dma_base) + 0x00)
+#define DMA_IFCR(dma_base)	MMIO32((dma_base) + 0x04)
+
+#define DMA_CCR(dma_base, channel) \
+	MMIO32((dma_base) + 0x08 + (0x14 * ((channel) - 1)))
+#define DMA_CNDTR(dma_base, channel) \
+	MMIO32((dma_base) + 0x0C + (0x14 * ((channel) - 1)))
+#define DMA_CPAR(dma_base, channel) \
+	MMIO32((dma_base) + 0x10 + (0x14 * ((channel) - 1)))
+#define DMA_CMAR(dma_base, channel) \
+	MMIO32((dma_base) + 0x14 + (0x14 * ((channel) - 1)))
+
+#define DMA_CHANNEL1		1
+#define DMA_CHANNEL2		2
+#define DMA_CHANNEL3		3
+#define DMA_CHANNEL4		4
+#define DMA_CHANNEL5		5
+#define DMA_CHANNEL6		6
+#define DMA_CHANNEL7		7
+
+/* --- DMA_ISR/DMA_IFCR values --------------------------------------------- */
+
+#define DMA_GIF			(1 << 0)
+#define DMA_TCIF		(1 << 1)
+#define DMA_HTIF		(1 << 2)
+#define DMA_TEIF		(1 << 3)
+#define DMA_FLAGS		(DMA_GIF | DMA_TCIF | DMA_HTIF | DMA_TEIF)
+#define DMA_FLAG_OFFSET(channel) (4 * ((channel) - 1))
+
+/* --- DMA_CCRx values ----------------------------------------------------- */
+
+#define DMA_CCR_MEM2MEM		(1 << 14)
+#define DMA_CCR_PL_LOW		(0x0 << 12)
+#define DMA_CCR_PL_MEDIUM	(0x1 << 12)
+#define DMA_CCR_PL_HIGH		(0x2 << 12)
+#define DMA_CCR_PL_VERY_HIGH	(0x3 << 12)
+#define DMA_CCR_PL_MASK		(0x3 << 12)
+#define DMA_CCR_MSIZE_8BIT	(0x0 << 10)
+#define DMA_CCR_MSIZE_16BIT	(0x1 << 10)
+#define DMA_CCR_MSIZE_32BIT	(0x2 << 10)
+#define DMA_CCR_MSIZE_MASK	(0x3 << 10)
+#define DMA_CCR_PSIZE_8BIT	(0x0 << 8)
+#define DMA_CCR_PSIZE_16BIT	(0x1 << 8)
+#define DMA_CCR_PSIZE_32BIT	(0x2 << 8)
+#define DMA_CCR_PSIZE_MASK	(0x3 << 8)
+#define DMA_CCR_MINC		(1 << 7)
+#define DMA_CCR_PINC		(1 << 6)
+#define DMA_CCR_CIRC		(1 << 5)
+#define DMA_CCR_DIR		(1 << 4)
+#define DMA_CCR_TEIE		(1 << 3)
+#define DMA_CCR_HTIE		(1 << 2)
+#define DMA_CCR_TCIE		(1 << 1)
+#define DMA_CCR_EN		(1 << 0)
+
+/* --- Function prototypes ------------------------------------------------- */
+
+void dma_channel_reset(u32 dma, u8 channel);
+void dma_clear_interrupt_flags(u32 dma, u8 channel, u32 interrupts);
+bool dma_get_interrupt_flag(u32 dma, u8 channel, u32 interrupts);
+void dma_enable_mem2mem_mode(u32 dma, u8 channel);
+void dma_set_priority(u32 dma, u8 channel, u32 prio);
+void dma_set_memory_size(u32 dma, u8 channel, u32 mem_size);
+void dma_set_peripheral_size(u32 dma, u8 channel, u32 peripheral_size);
+void dma_enable_memory_increment_mode(u32 dma, u8 channel);
+void dma_disable_memory_increment_mode(u32 dma, u8 channel);
+void dma_enable_peripheral_increment_mode(u32 dma, u8 channel);
+void dma_disable_peripheral_increment_mode(u32 dma, u8 channel);
+void dma_enable_circular_mode(u32 dma, u8 channel);
+void dma_set_read_from_peripheral(u32 dma, u8 channel);
+void dma_set_read_from_memory(u32 dma, u8 channel);
+void dma_enable_transfer_error_interrupt(u32 dma, u8 channel);
+void dma_disable_transfer_error_interrupt(u32 dma, u8 channel);
+void dma_enable_half_transfer_interrupt(u32 dma, u8 channel);
+void dma_disable_half_transfer_interrupt(u32 dma, u8 channel);
+void dma_enable_transfer_complete_interrupt(u32 dma, u8 channel);
+void dma_disable_transfer_complete_interrupt(u32 dma, u8 channel);
+void dma_enable_channel(u32 dma, u8 channel);
+void dma_disable_channel(u32 dma, u8 channel);
+void dma_set_peripheral_address(u32 dma, u8 channel, u32 address);
+void dma_set_memory_address(u32 dma, u8 channel, u32 address);
+u16 dma_get_number_of_data(u32 dma, u8 channel);
+void dma_set_number_of_data(u32 dma, u8 channel, u16 number);
+
+#endif /* LIBOPENCM3_DMA_H */
@@ -0,0 +1,106 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_GPIO_H
+#define LIBOPENCM3_GPIO_H
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/stm32/memorymap.h>
+
+/* --- GPIO port and pin identifiers --------------------------------------- */
+
+#define GPIOA			GPIO_PORT_A_BASE
+#define GPIOB			GPIO_PORT_B_BASE
+#define GPIOC			GPIO_PORT_C_BASE
+
+#define GPIO0			(1 << 0)
+#define GPIO1			(1 << 1)
+#define GPIO2			(1 << 2)
+#define GPIO3			(1 << 3)
+#define GPIO4			(1 << 4)
+#define GPIO5			(1 << 5)
+#define GPIO6			(1 << 6)
+#define GPIO7			(1 << 7)
+#define GPIO8			(1 << 8)
+#define GPIO9			(1 << 9)
+#define GPIO10			(1 << 10)
+#define GPIO11			(1 << 11)
+#define GPIO12			(1 << 12)
+#define GPIO13			(1 << 13)
+#define GPIO14			(1 << 14)
+#define GPIO15			(1 << 15)
+#define GPIO_ALL		0xffff
+
+/* Alternate function pins used by Open-BLDC */
+#define GPIO_TIM1_CH1		GPIO8		/* PA8 */
+#define GPIO_TIM1_CH2		GPIO9		/* PA9 */
+#define GPIO_TIM1_CH3		GPIO10		/* PA10 */
+#define GPIO_TIM1_CH1N		GPIO13		/* PB13 */
+#define GPIO_TIM1_CH2N		GPIO14		/* PB14 */
+#define GPIO_TIM1_CH3N		GPIO15		/* PB15 */
+#define GPIO_USART1_RE_TX	GPIO6		/* PB6 */
+#define GPIO_USART1_RE_RX	GPIO7		/* PB7 */
+
+/* --- GPIO registers ------------------------------------------------------ */
+
+#define GPIO_CRL(port)		MMIO32((port) + 0x00)
+#define GPIO_CRH(port)		MMIO32((port) + 0x04)
+#define GPIO_IDR(port)		MMIO32((port) + 0x08)
+#define GPIO_ODR(port)		MMIO32((port) + 0x0c)
+#define GPIO_BSRR(port)		MMIO32((port) + 0x10)
+#define GPIO_BRR(port)		MMIO32((port) + 0x14)
+#define GPIO_LCKR(port)		MMIO32((port) + 0x18)
+
+/* --- GPIO_CRL/GPIO_CRH values -------------------------------------------- */
+
+#define GPIO_MODE_INPUT			0x00
+#define GPIO_MODE_OUTPUT_10_MHZ		0x01
+#define GPIO_MODE_OUTPUT_2_MHZ		0x02
+#define GPIO_MODE_OUTPUT_50_MHZ		0x03
+
+#define GPIO_CNF_INPUT_ANALOG		0x00
+#define GPIO_CNF_INPUT_FLOAT		0x01
+#define GPIO_CNF_INPUT_PULL_UPDOWN	0x02
+
+#define GPIO_CNF_OUTPUT_PUSHPULL	0x00
+#define GPIO_CNF_OUTPUT_OPENDRAIN	0x01
+#define GPIO_CNF_OUTPUT_ALTFN_PUSHPULL	0x02
+#define GPIO_CNF_OUTPUT_ALTFN_OPENDRAIN	0x03
+
+/* --- AFIO registers ------------------------------------------------------ */
+
+#define AFIO_EVCR		MMIO32(AFIO_BASE + 0x00)
+#define AFIO_MAPR		MMIO32(AFIO_BASE + 0x04)
+
+/* --- AFIO_MAPR values ---------------------------------------------------- */
+
+#define AFIO_MAPR_SWJ_CFG_FULL_SWJ		(0x0 << 24)
+#define AFIO_MAPR_SWJ_CFG_FULL_SWJ_NO_JNTRST	(0x1 << 24)
+#define AFIO_MAPR_SWJ_CFG_JTAG_OFF_SW_ON	(0x2 << 24)
+#define AFIO_MAPR_SWJ_CFG_JTAG_OFF_SW_OFF	(0x4 << 24)
+#define AFIO_MAPR_USART1_REMAP			(1 << 2)
+
+/* --- Function prototypes ------------------------------------------------- */
+
+void gpio_set_mode(u32 gpioport, u8 mode, u8 cnf, u16 gpios);
+void gpio_set(u32 gpioport, u16 gpios);
+void gpio_clear(u32 gpioport, u16 gpios);
+u16 gpio_get(u32 gpioport, u16 gpios);
+void gpio_toggle(u32 gpioport, u16 gpios);
+
+#endif /* LIBOPENCM3_GPIO_H */
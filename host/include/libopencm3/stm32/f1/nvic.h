@@ -0,0 +1,62 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_STM32_F1_NVIC_H
+#define LIBOPENCM3_STM32_F1_NVIC_H
+
+#include <libopencm3/cm3/common.h>
+
+/* STM32F1 user interrupts (subset used by Open-BLDC) */
+#define NVIC_DMA1_CHANNEL1_IRQ	11
+#define NVIC_DMA1_CHANNEL2_IRQ	12
+#define NVIC_DMA1_CHANNEL3_IRQ	13
+#define NVIC_DMA1_CHANNEL4_IRQ	14
+#define NVIC_DMA1_CHANNEL5_IRQ	15
+#define NVIC_DMA1_CHANNEL6_IRQ	16
+#define NVIC_DMA1_CHANNEL7_IRQ	17
+#define NVIC_ADC1_2_IRQ		18
+#define NVIC_TIM1_BRK_IRQ	24
+#define NVIC_TIM1_UP_IRQ	25
+#define NVIC_TIM1_TRG_COM_IRQ	26
+#define NVIC_TIM1_CC_IRQ	27
+#define NVIC_TIM2_IRQ		28
+#define NVIC_TIM3_IRQ		29
+#define NVIC_TIM4_IRQ		30
+#define NVIC_USART1_IRQ		37
+
+#define NVIC_IRQ_COUNT		68
+
+/* Interrupt service routines the simulator knows how to raise. */
+void sys_tick_handler(void);
+void dma1_channel1_isr(void);
+void dma1_channel2_isr(void);
+void dma1_channel3_isr(void);
+void dma1_channel4_isr(void);
+void dma1_channel5_isr(void);
+void dma1_channel6_isr(void);
+void dma1_channel7_isr(void);
+void adc1_2_isr(void);
+void tim1_up_isr(void);
+void tim1_trg_com_isr(void);
+void tim1_cc_isr(void);
+void tim2_isr(void);
+void usart1_isr(void);
+
+#include <libopencm3/cm3/nvic.h>
+
+#endif /* LIBOPENCM3_STM32_F1_NVIC_H */
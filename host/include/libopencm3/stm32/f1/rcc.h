@@ -0,0 +1,78 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_RCC_H
+#define LIBOPENCM3_RCC_H
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/stm32/memorymap.h>
+
+/* --- RCC registers ------------------------------------------------------- */
+
+#define RCC_CR			MMIO32(RCC_BASE + 0x00)
+#define RCC_CFGR		MMIO32(RCC_BASE + 0x04)
+#define RCC_CIR			MMIO32(RCC_BASE + 0x08)
+#define RCC_APB2RSTR		MMIO32(RCC_BASE + 0x0c)
+#define RCC_APB1RSTR		MMIO32(RCC_BASE + 0x10)
+#define RCC_AHBENR		MMIO32(RCC_BASE + 0x14)
+#define RCC_APB2ENR		MMIO32(RCC_BASE + 0x18)
+#define RCC_APB1ENR		MMIO32(RCC_BASE + 0x1c)
+
+/* --- RCC_CFGR values ----------------------------------------------------- */
+
+#define RCC_CFGR_ADCPRE_LSB		14
+#define RCC_CFGR_ADCPRE_PCLK2_DIV2	0x0
+#define RCC_CFGR_ADCPRE_PCLK2_DIV4	0x1
+#define RCC_CFGR_ADCPRE_PCLK2_DIV6	0x2
+#define RCC_CFGR_ADCPRE_PCLK2_DIV8	0x3
+
+/* --- RCC_AHBENR values --------------------------------------------------- */
+
+#define RCC_AHBENR_DMA1EN		(1 << 0)
+
+/* --- RCC_APB2ENR values -------------------------------------------------- */
+
+#define RCC_APB2ENR_AFIOEN		(1 << 0)
+#define RCC_APB2ENR_IOPAEN		(1 << 2)
+#define RCC_APB2ENR_IOPBEN		(1 << 3)
+#define RCC_APB2ENR_IOPCEN		(1 << 4)
+#define RCC_APB2ENR_ADC1EN		(1 << 9)
+#define RCC_APB2ENR_ADC2EN		(1 << 10)
+#define RCC_APB2ENR_TIM1EN		(1 << 11)
+#define RCC_APB2ENR_USART1EN		(1 << 14)
+
+/* --- RCC_APB1ENR values -------------------------------------------------- */
+
+#define RCC_APB1ENR_TIM2EN		(1 << 0)
+#define RCC_APB1ENR_TIM3EN		(1 << 1)
+#define RCC_APB1ENR_TIM4EN		(1 << 2)
+
+/* --- Variables ----------------------------------------------------------- */
+
+extern u32 rcc_ppre1_frequency;
+extern u32 rcc_ppre2_frequency;
+
+/* --- Function prototypes ------------------------------------------------- */
+
+void rcc_peripheral_enable_clock(volatile u32 *reg, u32 en);
+void rcc_peripheral_disable_clock(volatile u32 *reg, u32 en);
+void rcc_set_adcpre(u32 adcpre);
+void rcc_clock_setup_in_hsi_out_64mhz(void);
+void rcc_clock_setup_in_hse_12mhz_out_72mhz(void);
+
+#endif /* LIBOPENCM3_RCC_H */
@@ -0,0 +1,50 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_STM32_MEMORYMAP_H
+#define LIBOPENCM3_STM32_MEMORYMAP_H
+
+#include <libopencm3/cm3/memorymap.h>
+
+/* STM32F1 peripheral memory map (subset used by Open-BLDC) */
+#define PERIPH_BASE		0x40000000U
+#define PERIPH_BASE_APB1	(PERIPH_BASE + 0x00000)
+#define PERIPH_BASE_APB2	(PERIPH_BASE + 0x10000)
+#define PERIPH_BASE_AHB		(PERIPH_BASE + 0x18000)
+
+/* APB1 */
+#define TIM2_BASE		(PERIPH_BASE_APB1 + 0x0000)
+#define TIM3_BASE		(PERIPH_BASE_APB1 + 0x0400)
+#define TIM4_BASE		(PERIPH_BASE_APB1 + 0x0800)
+
+/* APB2 */
+#define AFIO_BASE		(PERIPH_BASE_APB2 + 0x0000)
+#define GPIO_PORT_A_BASE	(PERIPH_BASE_APB2 + 0x0800)
+#define GPIO_PORT_B_BASE	(PERIPH_BASE_APB2 + 0x0C00)
+#define GPIO_PORT_C_BASE	(PERIPH_BASE_APB2 + 0x1000)
+#define ADC1_BASE		(PERIPH_BASE_APB2 + 0x2400)
+#define ADC2_BASE		(PERIPH_BASE_APB2 + 0x2800)
+#define TIM1_BASE		(PERIPH_BASE_APB2 + 0x2C00)
+#define USART1_BASE		(PERIPH_BASE_APB2 + 0x3800)
+
+/* AHB */
+#define DMA1_BASE		(PERIPH_BASE_AHB + 0x08000)
+#define RCC_BASE		(PERIPH_BASE_AHB + 0x09000)
+#define FLASH_MEM_INTERFACE_BASE (PERIPH_BASE_AHB + 0x0A000)
+
+#endif /* LIBOPENCM3_STM32_MEMORYMAP_H */
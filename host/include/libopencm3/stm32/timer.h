@@ -0,0 +1,327 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_TIMER_H
+#define LIBOPENCM3_TIMER_H
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/stm32/memorymap.h>
+
+/* --- Timer registers ----------------------------------------------------- */
+
+#define TIM1			TIM1_BASE
+#define TIM2			TIM2_BASE
+#define TIM3			TIM3_BASE
+#define TIM4			TIM4_BASE
+
+#define TIM_CR1(tim_base)	MMIO32((tim_base) + 0x00)
+#define TIM_CR2(tim_base)	MMIO32((tim_base) + 0x04)
+#define TIM_SMCR(tim_base)	MMIO32((tim_base) + 0x08)
+#define TIM_DIER(tim_base)	MMIO32((tim_base) + 0x0C)
+#define TIM_SR(tim_base)	MMIO32((tim_base) + 0x10)
+#define TIM_EGR(tim_base)	MMIO32((tim_base) + 0x14)
+#define TIM_CCMR1(tim_base)	MMIO32((tim_base) + 0x18)
+#define TIM_CCMR2(tim_base)	MMIO32((tim_base) + 0x1C)
+#define TIM_CCER(tim_base)	MMIO32((tim_base) + 0x20)
+#define TIM_CNT(tim_base)	MMIO32((tim_base) + 0x24)
+#define TIM_PSC(tim_base)	MMIO32((tim_base) + 0x28)
+#define TIM_ARR(tim_base)	MMIO32((tim_base) + 0x2C)
+#define TIM_RCR(tim_base)	MMIO32((tim_base) + 0x30)
+#define TIM_CCR1(tim_base)	MMIO32((tim_base) + 0x34)
+#define TIM_CCR2(tim_base)	MMIO32((tim_base) + 0x38)
+#define TIM_CCR3(tim_base)	MMIO32((tim_base) + 0x3C)
+#define TIM_CCR4(tim_base)	MMIO32((tim_base) + 0x40)
+#define TIM_BDTR(tim_base)	MMIO32((tim_base) + 0x44)
+#define TIM_DCR(tim_base)	MMIO32((tim_base) + 0x48)
+#define TIM_DMAR(tim_base)	MMIO32((tim_base) + 0x4C)
+
+/* --- TIMx_CR1 values ----------------------------------------------------- */
+
+#define TIM_CR1_CKD_CK_INT		(0x0 << 8)
+#define TIM_CR1_CKD_CK_INT_MUL_2	(0x1 << 8)
+#define TIM_CR1_CKD_CK_INT_MUL_4	(0x2 << 8)
+#define TIM_CR1_CKD_CK_INT_MASK		(0x3 << 8)
+#define TIM_CR1_ARPE			(1 << 7)
+#define TIM_CR1_CMS_EDGE		(0x0 << 5)
+#define TIM_CR1_CMS_CENTER_1		(0x1 << 5)
+#define TIM_CR1_CMS_CENTER_2		(0x2 << 5)
+#define TIM_CR1_CMS_CENTER_3		(0x3 << 5)
+#define TIM_CR1_CMS_MASK		(0x3 << 5)
+#define TIM_CR1_DIR_UP			(0 << 4)
+#define TIM_CR1_DIR_DOWN		(1 << 4)
+#define TIM_CR1_OPM			(1 << 3)
+#define TIM_CR1_URS			(1 << 2)
+#define TIM_CR1_UDIS			(1 << 1)
+#define TIM_CR1_CEN			(1 << 0)
+
+/* --- TIMx_CR2 values ----------------------------------------------------- */
+
+#define TIM_CR2_OIS4			(1 << 14)
+#define TIM_CR2_OIS3N			(1 << 13)
+#define TIM_CR2_OIS3			(1 << 12)
+#define TIM_CR2_OIS2N			(1 << 11)
+#define TIM_CR2_OIS2			(1 << 10)
+#define TIM_CR2_OIS1N			(1 << 9)
+#define TIM_CR2_OIS1			(1 << 8)
+#define TIM_CR2_OIS_MASK		(0x7f << 8)
+#define TIM_CR2_TI1S			(1 << 7)
+#define TIM_CR2_MMS_RESET		(0x0 << 4)
+#define TIM_CR2_MMS_ENABLE		(0x1 << 4)
+#define TIM_CR2_MMS_UPDATE		(0x2 << 4)
+#define TIM_CR2_MMS_COMPARE_PULSE	(0x3 << 4)
+#define TIM_CR2_MMS_COMPARE_OC1REF	(0x4 << 4)
+#define TIM_CR2_MMS_COMPARE_OC2REF	(0x5 << 4)
+#define TIM_CR2_MMS_COMPARE_OC3REF	(0x6 << 4)
+#define TIM_CR2_MMS_COMPARE_OC4REF	(0x7 << 4)
+#define TIM_CR2_MMS_MASK		(0x7 << 4)
+#define TIM_CR2_CCDS			(1 << 3)
+#define TIM_CR2_CCUS			(1 << 2)
+#define TIM_CR2_CCPC			(1 << 0)
+
+/* --- TIMx_SMCR values ---------------------------------------------------- */
+
+#define TIM_SMCR_TS_ITR0		(0x0 << 4)
+#define TIM_SMCR_TS_ITR1		(0x1 << 4)
+#define TIM_SMCR_TS_ITR2		(0x2 << 4)
+#define TIM_SMCR_TS_ITR3		(0x3 << 4)
+#define TIM_SMCR_TS_MASK		(0x7 << 4)
+#define TIM_SMCR_SMS_OFF		(0x0 << 0)
+#define TIM_SMCR_SMS_RM			(0x4 << 0)
+#define TIM_SMCR_SMS_GM			(0x5 << 0)
+#define TIM_SMCR_SMS_TM			(0x6 << 0)
+#define TIM_SMCR_SMS_ECM1		(0x7 << 0)
+#define TIM_SMCR_SMS_MASK		(0x7 << 0)
+
+/* --- TIMx_DIER values ---------------------------------------------------- */
+
+#define TIM_DIER_TDE			(1 << 14)
+#define TIM_DIER_COMDE			(1 << 13)
+#define TIM_DIER_CC4DE			(1 << 12)
+#define TIM_DIER_CC3DE			(1 << 11)
+#define TIM_DIER_CC2DE			(1 << 10)
+#define TIM_DIER_CC1DE			(1 << 9)
+#define TIM_DIER_UDE			(1 << 8)
+#define TIM_DIER_BIE			(1 << 7)
+#define TIM_DIER_TIE			(1 << 6)
+#define TIM_DIER_COMIE			(1 << 5)
+#define TIM_DIER_CC4IE			(1 << 4)
+#define TIM_DIER_CC3IE			(1 << 3)
+#define TIM_DIER_CC2IE			(1 << 2)
+#define TIM_DIER_CC1IE			(1 << 1)
+#define TIM_DIER_UIE			(1 << 0)
+
+/* --- TIMx_SR values ------------------------------------------------------ */
+
+#define TIM_SR_CC4OF			(1 << 12)
+#define TIM_SR_CC3OF			(1 << 11)
+#define TIM_SR_CC2OF			(1 << 10)
+#define TIM_SR_CC1OF			(1 << 9)
+#define TIM_SR_BIF			(1 << 7)
+#define TIM_SR_TIF			(1 << 6)
+#define TIM_SR_COMIF			(1 << 5)
+#define TIM_SR_CC4IF			(1 << 4)
+#define TIM_SR_CC3IF			(1 << 3)
+#define TIM_SR_CC2IF			(1 << 2)
+#define TIM_SR_CC1IF			(1 << 1)
+#define TIM_SR_UIF			(1 << 0)
+
+/* --- TIMx_EGR values ----------------------------------------------------- */
+
+#define TIM_EGR_BG			(1 << 7)
+#define TIM_EGR_TG			(1 << 6)
+#define TIM_EGR_COMG			(1 << 5)
+#define TIM_EGR_CC4G			(1 << 4)
+#define TIM_EGR_CC3G			(1 << 3)
+#define TIM_EGR_CC2G			(1 << 2)
+#define TIM_EGR_CC1G			(1 << 1)
+#define TIM_EGR_UG			(1 << 0)
+
+/* --- TIMx_CCMR1/2 values (output compare mode) --------------------------- */
+
+#define TIM_CCMR1_OC2CE			(1 << 15)
+#define TIM_CCMR1_OC2M_FROZEN		(0x0 << 12)
+#define TIM_CCMR1_OC2M_ACTIVE		(0x1 << 12)
+#define TIM_CCMR1_OC2M_INACTIVE		(0x2 << 12)
+#define TIM_CCMR1_OC2M_TOGGLE		(0x3 << 12)
+#define TIM_CCMR1_OC2M_FORCE_LOW	(0x4 << 12)
+#define TIM_CCMR1_OC2M_FORCE_HIGH	(0x5 << 12)
+#define TIM_CCMR1_OC2M_PWM1		(0x6 << 12)
+#define TIM_CCMR1_OC2M_PWM2		(0x7 << 12)
+#define TIM_CCMR1_OC2M_MASK		(0x7 << 12)
+#define TIM_CCMR1_OC2PE			(1 << 11)
+#define TIM_CCMR1_OC2FE			(1 << 10)
+#define TIM_CCMR1_CC2S_OUT		(0x0 << 8)
+#define TIM_CCMR1_CC2S_MASK		(0x3 << 8)
+#define TIM_CCMR1_OC1CE			(1 << 7)
+#define TIM_CCMR1_OC1M_FROZEN		(0x0 << 4)
+#define TIM_CCMR1_OC1M_ACTIVE		(0x1 << 4)
+#define TIM_CCMR1_OC1M_INACTIVE		(0x2 << 4)
+#define TIM_CCMR1_OC1M_TOGGLE		(0x3 << 4)
+#define TIM_CCMR1_OC1M_FORCE_LOW	(0x4 << 4)
+#define TIM_CCMR1_OC1M_FORCE_HIGH	(0x5 << 4)
+#define TIM_CCMR1_OC1M_PWM1		(0x6 << 4)
+#define TIM_CCMR1_OC1M_PWM2		(0x7 << 4)
+#define TIM_CCMR1_OC1M_MASK		(0x7 << 4)
+#define TIM_CCMR1_OC1PE			(1 << 3)
+#define TIM_CCMR1_OC1FE			(1 << 2)
+#define TIM_CCMR1_CC1S_OUT		(0x0 << 0)
+#define TIM_CCMR1_CC1S_MASK		(0x3 << 0)
+
+#define TIM_CCMR2_OC4CE			(1 << 15)
+#define TIM_CCMR2_OC4M_FROZEN		(0x0 << 12)
+#define TIM_CCMR2_OC4M_ACTIVE		(0x1 << 12)
+#define TIM_CCMR2_OC4M_INACTIVE		(0x2 << 12)
+#define TIM_CCMR2_OC4M_TOGGLE		(0x3 << 12)
+#define TIM_CCMR2_OC4M_FORCE_LOW	(0x4 << 12)
+#define TIM_CCMR2_OC4M_FORCE_HIGH	(0x5 << 12)
+#define TIM_CCMR2_OC4M_PWM1		(0x6 << 12)
+#define TIM_CCMR2_OC4M_PWM2		(0x7 << 12)
+#define TIM_CCMR2_OC4M_MASK		(0x7 << 12)
+#define TIM_CCMR2_OC4PE			(1 << 11)
+#define TIM_CCMR2_OC4FE			(1 << 10)
+#define TIM_CCMR2_CC4S_OUT		(0x0 << 8)
+#define TIM_CCMR2_CC4S_MASK		(0x3 << 8)
+#define TIM_CCMR2_OC3CE			(1 << 7)
+#define TIM_CCMR2_OC3M_FROZEN		(0x0 << 4)
+#define TIM_CCMR2_OC3M_ACTIVE		(0x1 << 4)
+#define TIM_CCMR2_OC3M_INACTIVE		(0x2 << 4)
+#define TIM_CCMR2_OC3M_TOGGLE		(0x3 << 4)
+#define TIM_CCMR2_OC3M_FORCE_LOW	(0x4 << 4)
+#define TIM_CCMR2_OC3M_FORCE_HIGH	(0x5 << 4)
+#define TIM_CCMR2_OC3M_PWM1		(0x6 << 4)
+#define TIM_CCMR2_OC3M_PWM2		(0x7 << 4)
+#define TIM_CCMR2_OC3M_MASK		(0x7 << 4)
+#define TIM_CCMR2_OC3PE			(1 << 3)
+#define TIM_CCMR2_OC3FE			(1 << 2)
+#define TIM_CCMR2_CC3S_OUT		(0x0 << 0)
+#define TIM_CCMR2_CC3S_MASK		(0x3 << 0)
+
+/* --- TIMx_CCER values ---------------------------------------------------- */
+
+#define TIM_CCER_CC4P			(1 << 13)
+#define TIM_CCER_CC4E			(1 << 12)
+#define TIM_CCER_CC3NP			(1 << 11)
+#define TIM_CCER_CC3NE			(1 << 10)
+#define TIM_CCER_CC3P			(1 << 9)
+#define TIM_CCER_CC3E			(1 << 8)
+#define TIM_CCER_CC2NP			(1 << 7)
+#define TIM_CCER_CC2NE			(1 << 6)
+#define TIM_CCER_CC2P			(1 << 5)
+#define TIM_CCER_CC2E			(1 << 4)
+#define TIM_CCER_CC1NP			(1 << 3)
+#define TIM_CCER_CC1NE			(1 << 2)
+#define TIM_CCER_CC1P			(1 << 1)
+#define TIM_CCER_CC1E			(1 << 0)
+
+/* --- TIMx_BDTR values ---------------------------------------------------- */
+
+#define TIM_BDTR_MOE			(1 << 15)
+#define TIM_BDTR_AOE			(1 << 14)
+#define TIM_BDTR_BKP			(1 << 13)
+#define TIM_BDTR_BKE			(1 << 12)
+#define TIM_BDTR_OSSR			(1 << 11)
+#define TIM_BDTR_OSSI			(1 << 10)
+#define TIM_BDTR_LOCK_OFF		(0x0 << 8)
+#define TIM_BDTR_LOCK_LEVEL_1		(0x1 << 8)
+#define TIM_BDTR_LOCK_LEVEL_2		(0x2 << 8)
+#define TIM_BDTR_LOCK_LEVEL_3		(0x3 << 8)
+#define TIM_BDTR_LOCK_MASK		(0x3 << 8)
+#define TIM_BDTR_DTG_MASK		0x00FF
+
+/* --- Output compare identifiers and modes -------------------------------- */
+
+enum tim_oc_id {
+	TIM_OC1 = 0,
+	TIM_OC1N,
+	TIM_OC2,
+	TIM_OC2N,
+	TIM_OC3,
+	TIM_OC3N,
+	TIM_OC4,
+};
+
+enum tim_oc_mode {
+	TIM_OCM_FROZEN,
+	TIM_OCM_ACTIVE,
+	TIM_OCM_INACTIVE,
+	TIM_OCM_TOGGLE,
+	TIM_OCM_FORCE_LOW,
+	TIM_OCM_FORCE_HIGH,
+	TIM_OCM_PWM1,
+	TIM_OCM_PWM2,
+};
+
+/* --- Function prototypes ------------------------------------------------- */
+
+void timer_reset(u32 timer_peripheral);
+void timer_enable_irq(u32 timer_peripheral, u32 irq);
+void timer_disable_irq(u32 timer_peripheral, u32 irq);
+bool timer_get_flag(u32 timer_peripheral, u32 flag);
+void timer_clear_flag(u32 timer_peripheral, u32 flag);
+void timer_set_mode(u32 timer_peripheral, u32 clock_div,
+		    u32 alignment, u32 direction);
+void timer_set_prescaler(u32 timer_peripheral, u32 value);
+void timer_set_repetition_counter(u32 timer_peripheral, u32 value);
+void timer_enable_preload(u32 timer_peripheral);
+void timer_disable_preload(u32 timer_peripheral);
+void timer_continuous_mode(u32 timer_peripheral);
+void timer_update_on_any(u32 timer_peripheral);
+void timer_update_on_overflow(u32 timer_peripheral);
+void timer_one_shot_mode(u32 timer_peripheral);
+void timer_set_period(u32 timer_peripheral, u32 period);
+void timer_enable_counter(u32 timer_peripheral);
+void timer_disable_counter(u32 timer_peripheral);
+void timer_set_master_mode(u32 timer_peripheral, u32 mode);
+void timer_enable_preload_complementry_enable_bits(u32 timer_peripheral);
+void timer_disable_preload_complementry_enable_bits(u32 timer_peripheral);
+void timer_enable_oc_output(u32 timer_peripheral, enum tim_oc_id oc_id);
+void timer_disable_oc_output(u32 timer_peripheral, enum tim_oc_id oc_id);
+void timer_enable_oc_clear(u32 timer_peripheral, enum tim_oc_id oc_id);
+void timer_disable_oc_clear(u32 timer_peripheral, enum tim_oc_id oc_id);
+void timer_enable_oc_preload(u32 timer_peripheral, enum tim_oc_id oc_id);
+void timer_disable_oc_preload(u32 timer_peripheral, enum tim_oc_id oc_id);
+void timer_set_oc_fast_mode(u32 timer_peripheral, enum tim_oc_id oc_id);
+void timer_set_oc_slow_mode(u32 timer_peripheral, enum tim_oc_id oc_id);
+void timer_set_oc_mode(u32 timer_peripheral, enum tim_oc_id oc_id,
+		       enum tim_oc_mode oc_mode);
+void timer_set_oc_polarity_high(u32 timer_peripheral, enum tim_oc_id oc_id);
+void timer_set_oc_polarity_low(u32 timer_peripheral, enum tim_oc_id oc_id);
+void timer_set_oc_idle_state_set(u32 timer_peripheral, enum tim_oc_id oc_id);
+void timer_set_oc_idle_state_unset(u32 timer_peripheral,
+				   enum tim_oc_id oc_id);
+void timer_set_oc_value(u32 timer_peripheral, enum tim_oc_id oc_id,
+			u32 value);
+void timer_enable_break_main_output(u32 timer_peripheral);
+void timer_disable_break_main_output(u32 timer_peripheral);
+void timer_enable_break_automatic_output(u32 timer_peripheral);
+void timer_disable_break_automatic_output(u32 timer_peripheral);
+void timer_set_break_polarity_high(u32 timer_peripheral);
+void timer_set_break_polarity_low(u32 timer_peripheral);
+void timer_enable_break(u32 timer_peripheral);
+void timer_disable_break(u32 timer_peripheral);
+void timer_set_enabled_off_state_in_run_mode(u32 timer_peripheral);
+void timer_set_disabled_off_state_in_run_mode(u32 timer_peripheral);
+void timer_set_enabled_off_state_in_idle_mode(u32 timer_peripheral);
+void timer_set_disabled_off_state_in_idle_mode(u32 timer_peripheral);
+void timer_set_break_lock(u32 timer_peripheral, u32 lock);
+void timer_set_deadtime(u32 timer_peripheral, u32 deadtime);
+void timer_generate_event(u32 timer_peripheral, u32 event);
+u32 timer_get_counter(u32 timer_peripheral);
+void timer_set_counter(u32 timer_peripheral, u32 count);
+
+#endif /* LIBOPENCM3_TIMER_H */
@@ -0,0 +1,117 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_USART_H
+#define LIBOPENCM3_USART_H
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/stm32/memorymap.h>
+
+/* --- USART registers ----------------------------------------------------- */
+
+#define USART1			USART1_BASE
+
+#define USART_SR(usart_base)	MMIO32((usart_base) + 0x00)
+#define USART_DR(usart_base)	MMIO32((usart_base) + 0x04)
+#define USART_BRR(usart_base)	MMIO32((usart_base) + 0x08)
+#define USART_CR1(usart_base)	MMIO32((usart_base) + 0x0c)
+#define USART_CR2(usart_base)	MMIO32((usart_base) + 0x10)
+#define USART_CR3(usart_base)	MMIO32((usart_base) + 0x14)
+#define USART_GTPR(usart_base)	MMIO32((usart_base) + 0x18)
+
+/* --- USART_SR values ----------------------------------------------------- */
+
+#define USART_SR_TXE		(1 << 7)
+#define USART_SR_TC		(1 << 6)
+#define USART_SR_RXNE		(1 << 5)
+#define USART_SR_IDLE		(1 << 4)
+#define USART_SR_ORE		(1 << 3)
+#define USART_SR_NE		(1 << 2)
+#define USART_SR_FE		(1 << 1)
+#define USART_SR_PE		(1 << 0)
+
+/* --- USART_CR1 values ---------------------------------------------------- */
+
+#define USART_CR1_UE		(1 << 13)
+#define USART_CR1_M		(1 << 12)
+#define USART_CR1_PCE		(1 << 10)
+#define USART_CR1_PS		(1 << 9)
+#define USART_CR1_PEIE		(1 << 8)
+#define USART_CR1_TXEIE		(1 << 7)
+#define USART_CR1_TCIE		(1 << 6)
+#define USART_CR1_RXNEIE	(1 << 5)
+#define USART_CR1_IDLEIE	(1 << 4)
+#define USART_CR1_TE		(1 << 3)
+#define USART_CR1_RE		(1 << 2)
+
+/* --- USART_CR2 values ---------------------------------------------------- */
+
+#define USART_CR2_STOPBITS_1	(0x0 << 12)
+#define USART_CR2_STOPBITS_0_5	(0x1 << 12)
+#define USART_CR2_STOPBITS_2	(0x2 << 12)
+#define USART_CR2_STOPBITS_1_5	(0x3 << 12)
+#define USART_CR2_STOPBITS_MASK	(0x3 << 12)
+
+/* --- USART_CR3 values ---------------------------------------------------- */
+
+#define USART_CR3_CTSE		(1 << 9)
+#define USART_CR3_RTSE		(1 << 8)
+#define USART_CR3_DMAT		(1 << 7)
+#define USART_CR3_DMAR		(1 << 6)
+
+/* --- Convenience defines ------------------------------------------------- */
+
+#define USART_STOPBITS_1	USART_CR2_STOPBITS_1
+#define USART_STOPBITS_0_5	USART_CR2_STOPBITS_0_5
+#define USART_STOPBITS_2	USART_CR2_STOPBITS_2
+#define USART_STOPBITS_1_5	USART_CR2_STOPBITS_1_5
+
+#define USART_PARITY_NONE	0x00
+#define USART_PARITY_EVEN	USART_CR1_PCE
+#define USART_PARITY_ODD	(USART_CR1_PS | USART_CR1_PCE)
+#define USART_PARITY_MASK	(USART_CR1_PS | USART_CR1_PCE)
+
+#define USART_MODE_RX		USART_CR1_RE
+#define USART_MODE_TX		USART_CR1_TE
+#define USART_MODE_TX_RX	(USART_CR1_RE | USART_CR1_TE)
+#define USART_MODE_MASK		(USART_CR1_RE | USART_CR1_TE)
+
+#define USART_FLOWCONTROL_NONE		0x00
+#define USART_FLOWCONTROL_RTS		USART_CR3_RTSE
+#define USART_FLOWCONTROL_CTS		USART_CR3_CTSE
+#define USART_FLOWCONTROL_RTS_CTS	(USART_CR3_RTSE | USART_CR3_CTSE)
+#define USART_FLOWCONTROL_MASK		(USART_CR3_RTSE | USART_CR3_CTSE)
+
+/* --- Function prototypes ------------------------------------------------- */
+
+void usart_set_baudrate(u32 usart, u32 baud);
+void usart_set_databits(u32 usart, u32 bits);
+void usart_set_stopbits(u32 usart, u32 stopbits);
+void usart_set_parity(u32 usart, u32 parity);
+void usart_set_mode(u32 usart, u32 mode);
+void usart_set_flow_control(u32 usart, u32 flowcontrol);
+void usart_enable(u32 usart);
+void usart_disable(u32 usart);
+void usart_send(u32 usart, u16 data);
+u16 usart_recv(u32 usart);
+void usart_enable_rx_dma(u32 usart);
+void usart_disable_rx_dma(u32 usart);
+void usart_enable_tx_dma(u32 usart);
+void usart_disable_tx_dma(u32 usart);
+
+#endif /* LIBOPENCM3_USART_H */
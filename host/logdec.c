@@ -0,0 +1,332 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   logdec.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Host decoder of the deferred binary log.
+ *
+ * Reads the LOG() format strings from the .log_strings section of the
+ * firmware ELF file, 32 bit for the controller or 64 bit for a host
+ * simulation build, decodes the frames log_get_byte() sends and puts the
+ * messages together. The sequence numbers tell how many records were
+ * dropped on the controller or lost on the way.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host/logdec.h"
+
+/* Section of the format strings. */
+#define LOGDEC_SECTION ".log_strings"
+
+/**
+ * Find the format string section in an ELF file of either class.
+ *
+ * @return 0 on success, -1 if the file is no ELF file or has no strings.
+ */
+static int logdec_find(struct logdec *ld, const uint8_t *elf, size_t len)
+{
+	const Elf32_Ehdr *eh32 = (const Elf32_Ehdr *)elf;
+	const Elf64_Ehdr *eh64 = (const Elf64_Ehdr *)elf;
+	uint64_t shoff, names_off = 0, off, size, addr, name;
+	size_t shentsize, shnum, shstrndx, i;
+	bool is64;
+
+	if (len < sizeof(Elf64_Ehdr) ||
+	    memcmp(elf, ELFMAG, SELFMAG) != 0 ||
+	    elf[EI_DATA] != ELFDATA2LSB) {
+		return -1;
+	}
+
+	is64 = elf[EI_CLASS] == ELFCLASS64;
+	shoff = is64 ? eh64->e_shoff : eh32->e_shoff;
+	shentsize = is64 ? eh64->e_shentsize : eh32->e_shentsize;
+	shnum = is64 ? eh64->e_shnum : eh32->e_shnum;
+	shstrndx = is64 ? eh64->e_shstrndx : eh32->e_shstrndx;
+
+	if (shoff + (shnum * shentsize) > len || shstrndx >= shnum) {
+		return -1;
+	}
+
+	for (i = 0; i <= shnum; i++) {
+		/* The section names first, then the section we look for. */
+		const uint8_t *sh = elf + shoff +
+				    (((i == 0) ? shstrndx : i - 1) * shentsize);
+
+		if (is64) {
+			const Elf64_Shdr *s = (const Elf64_Shdr *)sh;
+
+			name = s->sh_name;
+			off = s->sh_offset;
+			size = s->sh_size;
+			addr = s->sh_addr;
+		} else {
+			const Elf32_Shdr *s = (const Elf32_Shdr *)sh;
+
+			name = s->sh_name;
+			off = s->sh_offset;
+			size = s->sh_size;
+			addr = s->sh_addr;
+		}
+
+		if (off + size > len) {
+			return -1;
+		}
+		if (i == 0) {
+			names_off = off;
+			continue;
+		}
+
+		if (names_off + name + sizeof(LOGDEC_SECTION) <= len &&
+		    memcmp(elf + names_off + name, LOGDEC_SECTION,
+			   sizeof(LOGDEC_SECTION)) == 0) {
+			ld->strings = malloc(size + 1);
+			if (ld->strings == NULL) {
+				return -1;
+			}
+			memcpy(ld->strings, elf + off, size);
+			ld->strings[size] = '\0';
+			ld->size = size;
+			ld->addr = addr;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * Load the format strings of a firmware.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int logdec_load(struct logdec *ld, const char *path)
+{
+	uint8_t *elf;
+	FILE *file;
+	long len;
+	int ret = -1;
+
+	memset(ld, 0, sizeof(*ld));
+
+	file = fopen(path, "rb");
+	if (file == NULL) {
+		return -1;
+	}
+
+	if (fseek(file, 0, SEEK_END) == 0 && (len = ftell(file)) > 0 &&
+	    fseek(file, 0, SEEK_SET) == 0) {
+		elf = malloc((size_t)len);
+		if (elf != NULL) {
+			if (fread(elf, 1, (size_t)len, file) == (size_t)len) {
+				ret = logdec_find(ld, elf, (size_t)len);
+			}
+			free(elf);
+		}
+	}
+
+	fclose(file);
+
+	return ret;
+}
+
+void logdec_free(struct logdec *ld)
+{
+	free(ld->strings);
+	ld->strings = NULL;
+	ld->size = 0;
+}
+
+/**
+ * Get the format string of a message id.
+ *
+ * @return The string, NULL if the id is not in the section.
+ */
+const char *logdec_string(const struct logdec *ld, uint32_t id)
+{
+	if (id < ld->addr || id - ld->addr >= ld->size) {
+		return NULL;
+	}
+
+	return (const char *)&ld->strings[id - ld->addr];
+}
+
+/**
+ * Put the message of a record together.
+ *
+ * @return Length of the message, -1 if the id is unknown.
+ */
+int logdec_format(const struct logdec *ld, const struct log_record *record,
+		  char *out, size_t size)
+{
+	const char *fmt = logdec_string(ld, record->id);
+	char spec[16];
+	size_t pos = 0, n;
+	int arg = 0, len;
+
+	if (fmt == NULL || size == 0) {
+		return -1;
+	}
+
+	while (*fmt != '\0' && pos + 1 < size) {
+		if (*fmt != '%') {
+			out[pos++] = *fmt++;
+			continue;
+		}
+
+		/* Flags, width and precision go to snprintf as they are,
+		 * length modifiers are dropped, the arguments are 32 bit.
+		 */
+		n = 0;
+		spec[n++] = *fmt++;
+		while (*fmt != '\0' && strchr("-+ #0123456789.", *fmt) &&
+		       n < sizeof(spec) - 2) {
+			spec[n++] = *fmt++;
+		}
+		while (*fmt != '\0' && strchr("hlLqjzt", *fmt)) {
+			fmt++;
+		}
+		if (*fmt == '\0') {
+			break;
+		}
+		spec[n++] = *fmt;
+		spec[n] = '\0';
+
+		if (*fmt == '%') {
+			len = snprintf(&out[pos], size - pos, "%%");
+		} else if (arg >= LOG_ARGS || *fmt == 's') {
+			len = snprintf(&out[pos], size - pos, "?");
+		} else if (*fmt == 'd' || *fmt == 'i' || *fmt == 'c') {
+			len = snprintf(&out[pos], size - pos, spec,
+				       (int)(int32_t)record->args[arg++]);
+		} else if (*fmt == 'p') {
+			len = snprintf(&out[pos], size - pos, "0x%08x",
+				       (unsigned int)record->args[arg++]);
+		} else {
+			len = snprintf(&out[pos], size - pos, spec,
+				       (unsigned int)record->args[arg++]);
+		}
+		fmt++;
+
+		if (len > 0) {
+			pos += ((size_t)len < size - pos) ? (size_t)len :
+							    size - pos - 1;
+		}
+	}
+
+	out[pos] = '\0';
+
+	return (int)pos;
+}
+
+/**
+ * Decode a frame, COBS and checksum.
+ *
+ * @return Length of the payload without checksum, 0 if it is malformed.
+ */
+static size_t logdec_decode(uint8_t *buf, size_t len)
+{
+	size_t in = 0, out = 0;
+	uint8_t code, i, sum = 0;
+
+	while (in < len) {
+		code = buf[in++];
+		if (code == 0 || in + code - 1 > len) {
+			return 0;
+		}
+		for (i = 1; i < code; i++) {
+			sum += buf[in];
+			buf[out++] = buf[in++];
+		}
+		if (code < 0xff && in < len) {
+			buf[out++] = 0;
+		}
+	}
+
+	if (out < 7 || sum != 0 || ((out - 7) % 4) != 0) {
+		return 0;
+	}
+
+	return out - 1;
+}
+
+/**
+ * Feed a byte of the stream.
+ *
+ * @param record Gets the record a frame completed.
+ *
+ * @return true if the byte completed a record.
+ */
+bool logdec_feed(struct logdec *ld, uint8_t byte, struct log_record *record)
+{
+	size_t len, i;
+	uint16_t seq;
+
+	if (byte != 0) {
+		if (ld->len < sizeof(ld->buf)) {
+			ld->buf[ld->len++] = byte;
+		} else {
+			ld->overflow = true;
+		}
+		return false;
+	}
+
+	len = ld->overflow ? 0 : logdec_decode(ld->buf, ld->len);
+	ld->len = 0;
+	ld->overflow = false;
+	if (len == 0) {
+		ld->bad++;
+		return false;
+	}
+
+	memset(record, 0, sizeof(*record));
+	for (i = 0; i < 4; i++) {
+		record->id |= (uint32_t)ld->buf[i] << (8 * i);
+	}
+	seq = (uint16_t)(ld->buf[4] | (ld->buf[5] << 8));
+	for (i = 0; i < len - 6; i++) {
+		record->args[i / 4] |= (uint32_t)ld->buf[6 + i] <<
+				       (8 * (i % 4));
+	}
+
+	/* Extend the sequence number, a record that overtook an older one
+	 * comes back as a small step backwards.
+	 */
+	if (!ld->synced) {
+		ld->seq = seq;
+		ld->synced = true;
+	}
+	record->seq = ld->seq + (uint32_t)(int16_t)(seq - (uint16_t)ld->seq);
+	if ((int32_t)(record->seq - ld->seq) >= 0) {
+		ld->lost += record->seq - ld->seq;
+		ld->seq = record->seq + 1;
+	} else if (ld->lost != 0) {
+		ld->lost--;
+	}
+
+	ld->records++;
+
+	return true;
+}
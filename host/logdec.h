@@ -0,0 +1,52 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LOGDEC_H
+#define __LOGDEC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "driver/log.h"
+
+/**
+ * Decoder state, the format strings of a firmware and the stream position.
+ */
+struct logdec {
+	uint8_t *strings; /**< Contents of the .log_strings section */
+	size_t size;
+	uint64_t addr; /**< Address of the section, the id of its start */
+	uint8_t buf[LOG_FRAME_MAX];
+	size_t len;
+	bool overflow;
+	bool synced;
+	uint32_t seq; /**< Next expected sequence number */
+	uint32_t records; /**< Records decoded */
+	uint32_t lost; /**< Records missing in the sequence */
+	uint32_t bad; /**< Malformed frames */
+};
+
+int logdec_load(struct logdec *ld, const char *path);
+void logdec_free(struct logdec *ld);
+const char *logdec_string(const struct logdec *ld, uint32_t id);
+int logdec_format(const struct logdec *ld, const struct log_record *record,
+		  char *out, size_t size);
+bool logdec_feed(struct logdec *ld, uint8_t byte, struct log_record *record);
+
+#endif /* __LOGDEC_H */
@@ -0,0 +1,101 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   logdec_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Command line decoder of the deferred binary log.
+ *
+ * Prints the messages of a log stream, read from a file, a serial device
+ * set up with stty or stdin:
+ *
+ *   logdec firmware.elf [stream]
+ *
+ * Every message is prefixed with its sequence number, records that were
+ * dropped on the controller or lost on the way are reported as gaps.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host/logdec.h"
+
+/* Longest message put together. */
+#define LOGDEC_MESSAGE_MAX 256
+
+int main(int argc, char *argv[])
+{
+	struct logdec ld;
+	struct log_record record;
+	char message[LOGDEC_MESSAGE_MAX];
+	uint32_t lost = 0;
+	FILE *stream = stdin;
+	int c;
+
+	if (argc < 2 || argc > 3) {
+		fprintf(stderr, "usage: %s firmware.elf [stream]\n", argv[0]);
+		return 1;
+	}
+
+	if (logdec_load(&ld, argv[1]) != 0) {
+		fprintf(stderr, "%s: no log strings found\n", argv[1]);
+		return 1;
+	}
+
+	if (argc > 2) {
+		stream = fopen(argv[2], "rb");
+		if (stream == NULL) {
+			perror(argv[2]);
+			logdec_free(&ld);
+			return 1;
+		}
+	}
+
+	while ((c = fgetc(stream)) != EOF) {
+		if (!logdec_feed(&ld, (uint8_t)c, &record)) {
+			continue;
+		}
+		if (ld.lost != lost) {
+			printf("--- %lu records lost\n",
+			       (unsigned long)(ld.lost - lost));
+			lost = ld.lost;
+		}
+		if (logdec_format(&ld, &record, message,
+				  sizeof(message)) < 0) {
+			printf("%lu: unknown id 0x%08lx\n",
+			       (unsigned long)record.seq,
+			       (unsigned long)record.id);
+		} else {
+			printf("%lu: %s\n", (unsigned long)record.seq,
+			       message);
+		}
+		fflush(stdout);
+	}
+
+	fprintf(stderr, "%lu records, %lu lost, %lu malformed frames\n",
+		(unsigned long)ld.records, (unsigned long)ld.lost,
+		(unsigned long)ld.bad);
+
+	if (stream != stdin) {
+		fclose(stream);
+	}
+	logdec_free(&ld);
+
+	return 0;
+}
@@ -0,0 +1,572 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   motor.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Three phase BLDC motor plant for the host simulation.
+ *
+ * The plant reads the TIM1 output pins every simulation quantum and decodes
+ * them the way the half bridge drivers on the Open-BLDC board do: OCx is the
+ * driver input (high or low side) and OCxN is the active low shutdown line
+ * (phase floating when low). Floating phases keep conducting through the
+ * body diodes until their current decayed to zero.
+ *
+ * The windings are modelled as star connected R/L branches with a
+ * trapezoidal or sinusoidal back EMF. The rotor is a rigid body with inertia,
+ * viscous friction and a constant load torque. All equations are integrated
+ * with the forward Euler method once per quantum, which at 64MHz is 0.25us
+ * and far below the electrical time constant of any real motor.
+ *
+ * The ADC model samples the plant through motor_adc_sample(), so the phase
+ * voltages, the supply voltage and the supply current end up in the
+ * raw_data slots of driver/adc.c exactly like on the target.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <libopencm3/stm32/timer.h>
+
+#include "host/sim.h"
+#include "host/motor.h"
+
+#define MOTOR_PI 3.14159265358979323846
+
+/* Number of phases. */
+#define MOTOR_PHASES 3
+
+/* Longest time the plant is not integrated while the gates do not change, in
+ * core clock cycles.
+ */
+#define MOTOR_MAX_CYCLES 256
+
+/* ADC channels the board routes the plant signals to. */
+#define MOTOR_ADC_CHAN_U_VOLTAGE 0
+#define MOTOR_ADC_CHAN_V_BATT 3
+#define MOTOR_ADC_CHAN_CURRENT 4
+
+/* Internal state. */
+struct motor {
+	struct motor_params params;
+	struct motor_state state;
+	struct motor_stats stats;
+	bool driven[MOTOR_PHASES]; /**< Phase enabled by its driver */
+	bool open[MOTOR_PHASES]; /**< Phase neither driven nor conducting */
+	bool was_open[MOTOR_PHASES]; /**< Open state of the last quantum */
+	double shape[MOTOR_PHASES]; /**< Back EMF shape of the last quantum */
+	int floating; /**< The only undriven phase, -1 if none or several */
+	bool zc_seen; /**< Zero crossing since the last commutation */
+	double zc_theta; /**< Electrical angle of the last zero crossing */
+	uint32_t gates; /**< TIM1 output levels the state was decoded from */
+	uint32_t pending; /**< Cycles elapsed since the last integration */
+} motor;
+
+/**
+ * Fill in the parameters of a small 12V outrunner style motor.
+ */
+void motor_default_params(struct motor_params *params)
+{
+	params->r = 0.5;
+	params->l = 50e-6;
+	params->ke = 0.005;
+	params->pole_pairs = 7;
+	params->j = 1e-5;
+	params->b = 1e-6;
+	params->load = 0.0;
+	params->v_bus = 12.0;
+	params->sinusoidal = false;
+	/* 10k/1k dividers on the voltage inputs, +-20A hall sensor. */
+	params->adc_v_full_scale = 3.3 * 11.0;
+	params->adc_i_full_scale = 20.0;
+}
+
+/**
+ * Normalized back EMF shape of a phase.
+ *
+ * @param deg Electrical angle of the phase in degrees, [0, 360).
+ */
+static double motor_bemf_shape(double deg)
+{
+	if (motor.params.sinusoidal) {
+		return sin(deg * MOTOR_PI / 180.0);
+	}
+
+	if (deg < 30.0) {
+		return deg / 30.0;
+	} else if (deg < 150.0) {
+		return 1.0;
+	} else if (deg < 210.0) {
+		return (180.0 - deg) / 30.0;
+	} else if (deg < 330.0) {
+		return -1.0;
+	}
+
+	return (deg - 360.0) / 30.0;
+}
+
+/**
+ * Calculate the terminal voltages of the phases that are not driven but
+ * still conduct through one of the body diodes.
+ */
+static void motor_freewheel(void)
+{
+	struct motor_state *s = &motor.state;
+	int k;
+
+	for (k = 0; k < MOTOR_PHASES; k++) {
+		motor.open[k] = false;
+		if (motor.driven[k]) {
+			continue;
+		}
+
+		if (s->i[k] > 0.0) {
+			s->v[k] = 0.0;
+		} else if (s->i[k] < 0.0) {
+			s->v[k] = motor.params.v_bus;
+		} else {
+			motor.open[k] = true;
+		}
+	}
+}
+
+/**
+ * Calculate the star point and the terminal voltages of the open phases from
+ * the last back EMF values.
+ */
+static void motor_open_voltages(void)
+{
+	struct motor_state *s = &motor.state;
+	double sum = 0.0;
+	int k, conducting = 0;
+
+	for (k = 0; k < MOTOR_PHASES; k++) {
+		if (!motor.open[k]) {
+			sum += s->v[k] - s->e[k];
+			conducting++;
+		}
+	}
+
+	if (conducting >= 2) {
+		s->vn = sum / conducting;
+	} else {
+		s->vn = -(s->e[0] + s->e[1] + s->e[2]) / MOTOR_PHASES;
+	}
+
+	for (k = 0; k < MOTOR_PHASES; k++) {
+		if (motor.open[k]) {
+			s->v[k] = fmin(fmax(s->vn + s->e[k], 0.0),
+				       motor.params.v_bus);
+		}
+	}
+}
+
+/**
+ * Decode the gate signals and calculate the terminal voltages of all
+ * phases.
+ *
+ * @param out TIM1 output levels as returned by sim_timer_get_outputs().
+ */
+static void motor_gates(uint32_t out)
+{
+	struct motor_state *s = &motor.state;
+	int k, floating = -1, undriven = 0;
+
+	motor.gates = out;
+
+	for (k = 0; k < MOTOR_PHASES; k++) {
+		motor.driven[k] = (out & (1 << (TIM_OC1N + (k * 2)))) != 0;
+		if (motor.driven[k]) {
+			s->v[k] = (out & (1 << (TIM_OC1 + (k * 2)))) ?
+				  motor.params.v_bus : 0.0;
+		} else {
+			floating = k;
+			undriven++;
+		}
+	}
+
+	motor_freewheel();
+
+	/* The ADC may sample the open phases before the next integration. */
+	motor_open_voltages();
+
+	floating = (undriven == 1) ? floating : -1;
+
+	/* A change of the single floating phase is a commutation. The all
+	 * floating idle step between two commutations is ignored.
+	 */
+	if (floating >= 0 && motor.floating >= 0 &&
+	    floating != motor.floating) {
+		motor.stats.commutations++;
+		if (motor.zc_seen) {
+			double delay = (s->theta_e - motor.zc_theta) *
+				       180.0 / MOTOR_PI;
+
+			if (delay < 0.0) {
+				delay += 360.0;
+			}
+			if (motor.stats.delays == 0 ||
+			    delay < motor.stats.delay_min) {
+				motor.stats.delay_min = delay;
+			}
+			if (motor.stats.delays == 0 ||
+			    delay > motor.stats.delay_max) {
+				motor.stats.delay_max = delay;
+			}
+			motor.stats.delay_sum += delay;
+			motor.stats.delays++;
+			motor.zc_seen = false;
+		}
+	}
+	if (floating >= 0) {
+		motor.floating = floating;
+	}
+}
+
+/**
+ * Initialize the plant state.
+ *
+ * @param params Motor parameters, NULL for motor_default_params().
+ */
+void motor_init(const struct motor_params *params)
+{
+	memset(&motor, 0, sizeof(motor));
+
+	if (params != NULL) {
+		motor.params = *params;
+	} else {
+		motor_default_params(&motor.params);
+	}
+
+	motor.floating = -1;
+	motor_gates(0);
+	motor_reset_stats();
+}
+
+/**
+ * Connect the plant to the simulated TIM1 outputs and ADC inputs.
+ */
+void motor_attach(void)
+{
+	sim_set_step_callback(motor_step);
+	sim_set_adc_sample_callback(motor_adc_sample);
+}
+
+/**
+ * Integrate the plant over the given amount of core clock cycles with the
+ * current gate state.
+ */
+static void motor_integrate(uint32_t cycles)
+{
+	struct motor_params *p = &motor.params;
+	struct motor_state *s = &motor.state;
+	double dt = (double)cycles / (double)sim_get_sysclk();
+	double shape[MOTOR_PHASES];
+	double e[MOTOR_PHASES];
+	double i_mid[MOTOR_PHASES];
+	double di, sum, residual, load, torque, power, copper, omega, deg;
+	int k, conducting, clamped;
+	bool stopped[MOTOR_PHASES];
+
+	/* Phases V and W lag U by 120 and 240 degrees. */
+	deg = s->theta_e * 180.0 / MOTOR_PI;
+	for (k = 0; k < MOTOR_PHASES; k++) {
+		shape[k] = motor_bemf_shape(deg);
+		e[k] = p->ke * s->omega * shape[k];
+		s->e[k] = e[k];
+		deg = (deg < 120.0) ? deg + 240.0 : deg - 120.0;
+	}
+
+	motor_freewheel();
+
+	/* The currents of the conducting phases sum up to zero, which makes
+	 * the star point the mean of their voltages minus the back EMF.
+	 */
+	conducting = 0;
+	sum = 0.0;
+	for (k = 0; k < MOTOR_PHASES; k++) {
+		if (!motor.open[k]) {
+			sum += s->v[k] - e[k];
+			conducting++;
+		}
+	}
+
+	if (conducting >= 2) {
+		s->vn = sum / conducting;
+	} else {
+		s->vn = -(e[0] + e[1] + e[2]) / MOTOR_PHASES;
+		conducting = 0;
+	}
+
+	clamped = 0;
+	residual = 0.0;
+	for (k = 0; k < MOTOR_PHASES; k++) {
+		i_mid[k] = s->i[k];
+		stopped[k] = false;
+		if (motor.open[k] || conducting == 0) {
+			s->i[k] = 0.0;
+			motor.open[k] = true;
+			continue;
+		}
+		di = (s->v[k] - (p->r * s->i[k]) - e[k] - s->vn) / p->l * dt;
+		/* A diode stops conducting when its current reaches zero. */
+		if (!motor.driven[k] &&
+		    ((s->i[k] > 0.0 && s->i[k] + di <= 0.0) ||
+		     (s->i[k] < 0.0 && s->i[k] + di >= 0.0))) {
+			s->i[k] = 0.0;
+			stopped[k] = true;
+			clamped++;
+			continue;
+		}
+		s->i[k] += di;
+		residual += s->i[k];
+	}
+
+	/* Keep Kirchhoff's current law when a diode turned off. */
+	if (conducting - clamped > 0) {
+		residual /= conducting - clamped;
+		for (k = 0; k < MOTOR_PHASES; k++) {
+			if (!motor.open[k] && !stopped[k]) {
+				s->i[k] -= residual;
+			}
+		}
+	}
+
+	/* Torque, supply current and losses use the mean current of the
+	 * quantum, which keeps the energy balance exact for the PWM ripple.
+	 */
+	torque = 0.0;
+	copper = 0.0;
+	s->i_bus = 0.0;
+	for (k = 0; k < MOTOR_PHASES; k++) {
+		i_mid[k] = (i_mid[k] + s->i[k]) / 2.0;
+		torque += p->ke * shape[k] * i_mid[k];
+		copper += p->r * i_mid[k] * i_mid[k];
+		if (!motor.open[k] && s->v[k] >= p->v_bus) {
+			s->i_bus += i_mid[k];
+		}
+	}
+	s->torque = torque;
+	power = p->v_bus * s->i_bus;
+
+	/* Open phases follow the star point plus their back EMF. */
+	for (k = 0; k < MOTOR_PHASES; k++) {
+		if (motor.open[k] || stopped[k]) {
+			s->v[k] = fmin(fmax(s->vn + e[k], 0.0), p->v_bus);
+		}
+	}
+
+	/* Zero crossings of the back EMF on an open phase. */
+	for (k = 0; k < MOTOR_PHASES; k++) {
+		bool open = motor.open[k] || stopped[k];
+
+		if (open && motor.was_open[k] && k == motor.floating &&
+		    (shape[k] >= 0.0) != (motor.shape[k] >= 0.0)) {
+			motor.stats.zero_crossings++;
+			motor.zc_seen = true;
+			motor.zc_theta = s->theta_e;
+		}
+		motor.was_open[k] = open;
+		motor.shape[k] = shape[k];
+	}
+
+	/* Mechanics, the load torque acts like dry friction. */
+	load = p->load;
+	if (s->omega > 0.0) {
+		load = -load;
+	} else if (s->omega == 0.0) {
+		load = (fabs(torque) <= load) ? -torque :
+		       ((torque > 0.0) ? -load : load);
+	}
+	omega = s->omega + ((torque - (p->b * s->omega) + load) / p->j * dt);
+	if ((s->omega > 0.0 && omega < 0.0) ||
+	    (s->omega < 0.0 && omega > 0.0)) {
+		omega = 0.0;
+	}
+	s->omega = omega;
+
+	s->theta_e = fmod(s->theta_e + (s->omega * p->pole_pairs * dt),
+			  2.0 * MOTOR_PI);
+	if (s->theta_e < 0.0) {
+		s->theta_e += 2.0 * MOTOR_PI;
+	}
+
+	/* Statistics. */
+	motor.stats.time += dt;
+	motor.stats.energy_in += power * dt;
+	motor.stats.energy_copper += copper * dt;
+	motor.stats.energy_mech += torque * s->omega * dt;
+	motor.stats.torque_sum += torque;
+	motor.stats.torque_sumsq += torque * torque;
+	if (motor.stats.samples == 0 || torque < motor.stats.torque_min) {
+		motor.stats.torque_min = torque;
+	}
+	if (motor.stats.samples == 0 || torque > motor.stats.torque_max) {
+		motor.stats.torque_max = torque;
+	}
+	motor.stats.samples++;
+}
+
+/**
+ * Advance the plant by the given amount of core clock cycles.
+ *
+ * The equations are only integrated when the gate signals change or
+ * MOTOR_MAX_CYCLES elapsed, the terminal voltages are piecewise constant in
+ * between anyways.
+ */
+void motor_step(uint32_t cycles)
+{
+	uint32_t out = sim_timer_get_outputs(TIM1);
+
+	if (out != motor.gates) {
+		if (motor.pending != 0) {
+			motor_integrate(motor.pending);
+			motor.pending = 0;
+		}
+		motor_gates(out);
+	}
+
+	motor.pending += cycles;
+	if (motor.pending >= MOTOR_MAX_CYCLES) {
+		motor_integrate(motor.pending);
+		motor.pending = 0;
+	}
+}
+
+/**
+ * Instantaneous supply current, the sum of the currents of the phases that
+ * are switched high. The i_bus of the state is the mean of the last
+ * integration step, which ends at the last gate change.
+ */
+static double motor_bus_current(void)
+{
+	struct motor_state *s = &motor.state;
+	double i_bus = 0.0;
+	int k;
+
+	for (k = 0; k < MOTOR_PHASES; k++) {
+		if (!motor.open[k] && s->v[k] >= motor.params.v_bus) {
+			i_bus += s->i[k];
+		}
+	}
+
+	return i_bus;
+}
+
+/**
+ * ADC sample source of the plant.
+ *
+ * Channels 0 to 2 are the phase voltages, 3 the supply voltage and 4 the
+ * supply current with the zero point at half scale.
+ */
+uint16_t motor_adc_sample(int channel)
+{
+	struct motor_params *p = &motor.params;
+	double value;
+
+	switch (channel) {
+	case MOTOR_ADC_CHAN_U_VOLTAGE:
+	case MOTOR_ADC_CHAN_U_VOLTAGE + 1:
+	case MOTOR_ADC_CHAN_U_VOLTAGE + 2:
+		value = motor.state.v[channel - MOTOR_ADC_CHAN_U_VOLTAGE] /
+			p->adc_v_full_scale * 4095.0;
+		break;
+	case MOTOR_ADC_CHAN_V_BATT:
+		value = p->v_bus / p->adc_v_full_scale * 4095.0;
+		break;
+	case MOTOR_ADC_CHAN_CURRENT:
+		value = 2048.0 + (motor_bus_current() / p->adc_i_full_scale *
+				  2047.0);
+		break;
+	default:
+		return 0;
+	}
+
+	return (uint16_t)fmin(fmax(value + 0.5, 0.0), 4095.0);
+}
+
+/**
+ * Change the load torque.
+ *
+ * @param load Load torque in Nm.
+ */
+void motor_set_load(double load)
+{
+	motor.params.load = load;
+}
+
+/**
+ * Get the instantaneous plant state.
+ */
+const struct motor_state *motor_get_state(void)
+{
+	return &motor.state;
+}
+
+/**
+ * Get the statistics accumulated since the last motor_reset_stats().
+ */
+const struct motor_stats *motor_get_stats(void)
+{
+	return &motor.stats;
+}
+
+/**
+ * Clear the accumulated statistics.
+ */
+void motor_reset_stats(void)
+{
+	memset(&motor.stats, 0, sizeof(motor.stats));
+	motor.zc_seen = false;
+}
+
+/**
+ * Print speed, efficiency, torque ripple and commutation timing.
+ */
+void motor_report(FILE *out)
+{
+	const struct motor_stats *st = &motor.stats;
+	double mean = 0.0, rms = 0.0, sd = 0.0;
+	double rpm = motor.state.omega * 60.0 / (2.0 * MOTOR_PI);
+
+	if (st->samples != 0) {
+		mean = st->torque_sum / st->samples;
+		rms = sqrt(st->torque_sumsq / st->samples);
+		sd = sqrt(fmax((rms * rms) - (mean * mean), 0.0));
+	}
+
+	fprintf(out, "motor: %.0frpm, %.2fA bus\n", rpm,
+		(st->time > 0.0) ? st->energy_in / st->time /
+				   motor.params.v_bus : 0.0);
+	fprintf(out, "energy: in %.3fJ, copper %.3fJ, mech %.3fJ, "
+		"efficiency %.1f%%\n", st->energy_in, st->energy_copper,
+		st->energy_mech, (st->energy_in > 0.0) ?
+				 100.0 * st->energy_mech / st->energy_in : 0.0);
+	fprintf(out, "torque: mean %.5fNm, min %.5fNm, max %.5fNm, "
+		"ripple %.1f%% p-p %.1f%% rms\n", mean, st->torque_min,
+		st->torque_max,
+		(mean != 0.0) ? 100.0 * (st->torque_max - st->torque_min) /
+				fabs(mean) : 0.0,
+		(mean != 0.0) ? 100.0 * sd / fabs(mean) : 0.0);
+	fprintf(out, "commutation: %lu, zero crossings %lu, delay min %.1f "
+		"mean %.1f max %.1f deg\n", (unsigned long)st->commutations,
+		(unsigned long)st->zero_crossings, st->delay_min,
+		(st->delays != 0) ? st->delay_sum / st->delays : 0.0,
+		st->delay_max);
+}
@@ -0,0 +1,90 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MOTOR_H
+#define __MOTOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/**
+ * Electrical and mechanical parameters of the simulated motor and of the
+ * power stage it is connected to.
+ */
+struct motor_params {
+	double r; /**< Phase resistance in Ohm */
+	double l; /**< Phase inductance in Henry */
+	double ke; /**< Phase back EMF constant in V/(rad/s) mechanical */
+	int pole_pairs; /**< Number of pole pairs */
+	double j; /**< Rotor inertia in kg*m^2 */
+	double b; /**< Viscous friction in Nm/(rad/s) */
+	double load; /**< Constant load torque in Nm */
+	double v_bus; /**< Supply voltage in V */
+	bool sinusoidal; /**< Sinusoidal instead of trapezoidal back EMF */
+	double adc_v_full_scale; /**< Voltage at ADC full scale in V */
+	double adc_i_full_scale; /**< Current at ADC full scale in A */
+};
+
+/**
+ * Instantaneous motor state.
+ */
+struct motor_state {
+	double i[3]; /**< Phase currents into the motor in A */
+	double v[3]; /**< Phase terminal voltages in V */
+	double vn; /**< Star point voltage in V */
+	double e[3]; /**< Phase back EMF in V */
+	double omega; /**< Mechanical speed in rad/s */
+	double theta_e; /**< Electrical angle in rad, [0, 2pi) */
+	double torque; /**< Electromagnetic torque in Nm */
+	double i_bus; /**< Supply current in A */
+};
+
+/**
+ * Accumulated measurements since the last motor_reset_stats().
+ */
+struct motor_stats {
+	double time; /**< Simulated time in s */
+	double energy_in; /**< Energy taken from the supply in J */
+	double energy_copper; /**< Energy lost in the windings in J */
+	double energy_mech; /**< Electromagnetic shaft energy in J */
+	double torque_sum; /**< Sum of the torque samples */
+	double torque_sumsq; /**< Sum of the squared torque samples */
+	double torque_min; /**< Smallest torque sample */
+	double torque_max; /**< Largest torque sample */
+	uint64_t samples; /**< Number of torque samples */
+	uint32_t commutations; /**< Commutations seen at the gates */
+	uint32_t zero_crossings; /**< Back EMF zero crossings on open phases */
+	double delay_sum; /**< Zero crossing to commutation delay sum */
+	double delay_min; /**< Shortest delay in electrical degrees */
+	double delay_max; /**< Longest delay in electrical degrees */
+	uint32_t delays; /**< Number of measured delays */
+};
+
+void motor_default_params(struct motor_params *params);
+void motor_init(const struct motor_params *params);
+void motor_attach(void);
+void motor_step(uint32_t cycles);
+uint16_t motor_adc_sample(int channel);
+void motor_set_load(double load);
+const struct motor_state *motor_get_state(void);
+const struct motor_stats *motor_get_stats(void);
+void motor_reset_stats(void);
+void motor_report(FILE *out);
+
+#endif /* __MOTOR_H */
@@ -0,0 +1,1020 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   opencm3.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Host implementation of the libopencm3 functions used by Open-BLDC.
+ *
+ * The functions follow the libopencm3 implementations and operate on the
+ * simulated register file. Registers with write one to clear or write to
+ * trigger semantics on the target are modelled with a direct read modify
+ * write on the status register, the peripheral models in sim.c take care of
+ * the rest. Functions that busy wait for hardware on the target return
+ * immediately.
+ */
+
+#include <libopencm3/stm32/f1/rcc.h>
+#include <libopencm3/stm32/f1/gpio.h>
+#include <libopencm3/stm32/f1/dma.h>
+#include <libopencm3/stm32/f1/adc.h>
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/stm32/usart.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/systick.h>
+
+#include "host/sim.h"
+
+/* -- RCC ------------------------------------------------------------------ */
+
+u32 rcc_ppre1_frequency = 8000000;
+u32 rcc_ppre2_frequency = 8000000;
+
+void rcc_peripheral_enable_clock(volatile u32 *reg, u32 en)
+{
+	sim_mmio_accesses++;
+	*reg |= en;
+}
+
+void rcc_peripheral_disable_clock(volatile u32 *reg, u32 en)
+{
+	sim_mmio_accesses++;
+	*reg &= ~en;
+}
+
+void rcc_set_adcpre(u32 adcpre)
+{
+	RCC_CFGR = (RCC_CFGR & ~(0x3 << RCC_CFGR_ADCPRE_LSB)) |
+		   (adcpre << RCC_CFGR_ADCPRE_LSB);
+}
+
+void rcc_clock_setup_in_hsi_out_64mhz(void)
+{
+	/* ADC max 14MHz: 64MHz / 8 = 8MHz */
+	rcc_set_adcpre(RCC_CFGR_ADCPRE_PCLK2_DIV8);
+
+	rcc_ppre1_frequency = 32000000;
+	rcc_ppre2_frequency = 64000000;
+	sim_set_sysclk(64000000);
+}
+
+void rcc_clock_setup_in_hse_12mhz_out_72mhz(void)
+{
+	/* ADC max 14MHz: 72MHz / 6 = 12MHz */
+	rcc_set_adcpre(RCC_CFGR_ADCPRE_PCLK2_DIV6);
+
+	rcc_ppre1_frequency = 36000000;
+	rcc_ppre2_frequency = 72000000;
+	sim_set_sysclk(72000000);
+}
+
+/* -- GPIO ----------------------------------------------------------------- */
+
+void gpio_set_mode(u32 gpioport, u8 mode, u8 cnf, u16 gpios)
+{
+	u32 crl = GPIO_CRL(gpioport);
+	u32 crh = GPIO_CRH(gpioport);
+	u32 offset;
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		if (((gpios >> i) & 1) == 0) {
+			continue;
+		}
+
+		offset = (i < 8) ? (i * 4) : ((i - 8) * 4);
+
+		if (i < 8) {
+			crl &= ~(0xf << offset);
+			crl |= (mode << offset) | (cnf << (offset + 2));
+		} else {
+			crh &= ~(0xf << offset);
+			crh |= (mode << offset) | (cnf << (offset + 2));
+		}
+	}
+
+	GPIO_CRL(gpioport) = crl;
+	GPIO_CRH(gpioport) = crh;
+}
+
+void gpio_set(u32 gpioport, u16 gpios)
+{
+	GPIO_ODR(gpioport) |= gpios;
+	GPIO_IDR(gpioport) |= gpios;
+}
+
+void gpio_clear(u32 gpioport, u16 gpios)
+{
+	GPIO_ODR(gpioport) &= ~gpios;
+	GPIO_IDR(gpioport) &= ~gpios;
+}
+
+u16 gpio_get(u32 gpioport, u16 gpios)
+{
+	return GPIO_IDR(gpioport) & gpios;
+}
+
+void gpio_toggle(u32 gpioport, u16 gpios)
+{
+	GPIO_ODR(gpioport) ^= gpios;
+	GPIO_IDR(gpioport) ^= gpios;
+}
+
+/* -- NVIC ----------------------------------------------------------------- */
+
+void nvic_enable_irq(u8 irqn)
+{
+	NVIC_ISER(irqn / 32) |= (1 << (irqn % 32));
+}
+
+void nvic_disable_irq(u8 irqn)
+{
+	NVIC_ISER(irqn / 32) &= ~(1 << (irqn % 32));
+}
+
+u8 nvic_get_pending_irq(u8 irqn)
+{
+	return (NVIC_ISPR(irqn / 32) & (1 << (irqn % 32))) ? 1 : 0;
+}
+
+void nvic_set_pending_irq(u8 irqn)
+{
+	NVIC_ISPR(irqn / 32) |= (1 << (irqn % 32));
+}
+
+void nvic_clear_pending_irq(u8 irqn)
+{
+	NVIC_ISPR(irqn / 32) &= ~(1 << (irqn % 32));
+}
+
+u8 nvic_get_irq_enabled(u8 irqn)
+{
+	return (NVIC_ISER(irqn / 32) & (1 << (irqn % 32))) ? 1 : 0;
+}
+
+void nvic_set_priority(u8 irqn, u8 priority)
+{
+	u32 shift = (irqn % 4) * 8;
+
+	NVIC_IPR(irqn) = (NVIC_IPR(irqn) & ~(0xff << shift)) |
+			 ((u32)priority << shift);
+}
+
+u8 nvic_get_priority(u8 irqn)
+{
+	return (NVIC_IPR(irqn) >> ((irqn % 4) * 8)) & 0xff;
+}
+
+/* -- SysTick -------------------------------------------------------------- */
+
+void systick_set_reload(u32 value)
+{
+	STK_LOAD = value & STK_LOAD_RELOAD;
+}
+
+u32 systick_get_reload(void)
+{
+	return STK_LOAD & STK_LOAD_RELOAD;
+}
+
+u32 systick_get_value(void)
+{
+	return STK_VAL & STK_LOAD_RELOAD;
+}
+
+void systick_set_clocksource(u8 clocksource)
+{
+	STK_CTRL = (STK_CTRL & ~STK_CTRL_CLKSOURCE) |
+		   ((clocksource << STK_CTRL_CLKSOURCE_LSB) &
+		    STK_CTRL_CLKSOURCE);
+}
+
+void systick_interrupt_enable(void)
+{
+	STK_CTRL |= STK_CTRL_TICKINT;
+}
+
+void systick_interrupt_disable(void)
+{
+	STK_CTRL &= ~STK_CTRL_TICKINT;
+}
+
+void systick_counter_enable(void)
+{
+	STK_CTRL |= STK_CTRL_ENABLE;
+}
+
+void systick_counter_disable(void)
+{
+	STK_CTRL &= ~STK_CTRL_ENABLE;
+}
+
+u8 systick_get_countflag(void)
+{
+	u32 ctrl = STK_CTRL;
+
+	/* COUNTFLAG clears on read. */
+	STK_CTRL = ctrl & ~STK_CTRL_COUNTFLAG;
+
+	return (ctrl & STK_CTRL_COUNTFLAG) ? 1 : 0;
+}
+
+/* -- Timers --------------------------------------------------------------- */
+
+static inline u32 timer_oc_channel(enum tim_oc_id oc_id)
+{
+	return oc_id / 2;
+}
+
+static inline bool timer_oc_complementary(enum tim_oc_id oc_id)
+{
+	return (oc_id & 1) != 0;
+}
+
+static inline volatile u32 *timer_ccmr(u32 timer_peripheral,
+				       enum tim_oc_id oc_id)
+{
+	return (timer_oc_channel(oc_id) < 2) ? &TIM_CCMR1(timer_peripheral) :
+					       &TIM_CCMR2(timer_peripheral);
+}
+
+static inline u32 timer_ccmr_shift(enum tim_oc_id oc_id)
+{
+	return (timer_oc_channel(oc_id) & 1) * 8;
+}
+
+static inline u32 timer_ccer_shift(enum tim_oc_id oc_id)
+{
+	return (timer_oc_channel(oc_id) * 4) +
+	       (timer_oc_complementary(oc_id) ? 2 : 0);
+}
+
+void timer_reset(u32 timer_peripheral)
+{
+	sim_peripheral_reset(timer_peripheral);
+}
+
+void timer_enable_irq(u32 timer_peripheral, u32 irq)
+{
+	TIM_DIER(timer_peripheral) |= irq;
+}
+
+void timer_disable_irq(u32 timer_peripheral, u32 irq)
+{
+	TIM_DIER(timer_peripheral) &= ~irq;
+}
+
+bool timer_get_flag(u32 timer_peripheral, u32 flag)
+{
+	return (TIM_SR(timer_peripheral) & flag) != 0;
+}
+
+void timer_clear_flag(u32 timer_peripheral, u32 flag)
+{
+	TIM_SR(timer_peripheral) &= ~flag;
+}
+
+void timer_set_mode(u32 timer_peripheral, u32 clock_div,
+		    u32 alignment, u32 direction)
+{
+	u32 cr1 = TIM_CR1(timer_peripheral);
+
+	cr1 &= ~(TIM_CR1_CKD_CK_INT_MASK | TIM_CR1_CMS_MASK |
+		 TIM_CR1_DIR_DOWN);
+	cr1 |= clock_div | alignment | direction;
+
+	TIM_CR1(timer_peripheral) = cr1;
+}
+
+void timer_set_prescaler(u32 timer_peripheral, u32 value)
+{
+	TIM_PSC(timer_peripheral) = value;
+}
+
+void timer_set_repetition_counter(u32 timer_peripheral, u32 value)
+{
+	TIM_RCR(timer_peripheral) = value;
+}
+
+void timer_enable_preload(u32 timer_peripheral)
+{
+	TIM_CR1(timer_peripheral) |= TIM_CR1_ARPE;
+}
+
+void timer_disable_preload(u32 timer_peripheral)
+{
+	TIM_CR1(timer_peripheral) &= ~TIM_CR1_ARPE;
+}
+
+void timer_continuous_mode(u32 timer_peripheral)
+{
+	TIM_CR1(timer_peripheral) &= ~TIM_CR1_OPM;
+}
+
+void timer_update_on_any(u32 timer_peripheral)
+{
+	TIM_CR1(timer_peripheral) &= ~TIM_CR1_URS;
+}
+
+void timer_update_on_overflow(u32 timer_peripheral)
+{
+	TIM_CR1(timer_peripheral) |= TIM_CR1_URS;
+}
+
+void timer_one_shot_mode(u32 timer_peripheral)
+{
+	TIM_CR1(timer_peripheral) |= TIM_CR1_OPM;
+}
+
+void timer_set_period(u32 timer_peripheral, u32 period)
+{
+	TIM_ARR(timer_peripheral) = period;
+}
+
+void timer_enable_counter(u32 timer_peripheral)
+{
+	TIM_CR1(timer_peripheral) |= TIM_CR1_CEN;
+}
+
+void timer_disable_counter(u32 timer_peripheral)
+{
+	TIM_CR1(timer_peripheral) &= ~TIM_CR1_CEN;
+}
+
+void timer_set_master_mode(u32 timer_peripheral, u32 mode)
+{
+	TIM_CR2(timer_peripheral) = (TIM_CR2(timer_peripheral) &
+				     ~TIM_CR2_MMS_MASK) | mode;
+}
+
+void timer_enable_preload_complementry_enable_bits(u32 timer_peripheral)
+{
+	TIM_CR2(timer_peripheral) |= TIM_CR2_CCPC;
+}
+
+void timer_disable_preload_complementry_enable_bits(u32 timer_peripheral)
+{
+	TIM_CR2(timer_peripheral) &= ~TIM_CR2_CCPC;
+}
+
+void timer_enable_oc_output(u32 timer_peripheral, enum tim_oc_id oc_id)
+{
+	TIM_CCER(timer_peripheral) |= TIM_CCER_CC1E << timer_ccer_shift(oc_id);
+}
+
+void timer_disable_oc_output(u32 timer_peripheral, enum tim_oc_id oc_id)
+{
+	TIM_CCER(timer_peripheral) &=
+		~(TIM_CCER_CC1E << timer_ccer_shift(oc_id));
+}
+
+void timer_enable_oc_clear(u32 timer_peripheral, enum tim_oc_id oc_id)
+{
+	if (timer_oc_complementary(oc_id)) {
+		return;
+	}
+	sim_mmio_accesses++;
+	*timer_ccmr(timer_peripheral, oc_id) |=
+		TIM_CCMR1_OC1CE << timer_ccmr_shift(oc_id);
+}
+
+void timer_disable_oc_clear(u32 timer_peripheral, enum tim_oc_id oc_id)
+{
+	if (timer_oc_complementary(oc_id)) {
+		return;
+	}
+	sim_mmio_accesses++;
+	*timer_ccmr(timer_peripheral, oc_id) &=
+		~(TIM_CCMR1_OC1CE << timer_ccmr_shift(oc_id));
+}
+
+void timer_enable_oc_preload(u32 timer_peripheral, enum tim_oc_id oc_id)
+{
+	if (timer_oc_complementary(oc_id)) {
+		return;
+	}
+	sim_mmio_accesses++;
+	*timer_ccmr(timer_peripheral, oc_id) |=
+		TIM_CCMR1_OC1PE << timer_ccmr_shift(oc_id);
+}
+
+void timer_disable_oc_preload(u32 timer_peripheral, enum tim_oc_id oc_id)
+{
+	if (timer_oc_complementary(oc_id)) {
+		return;
+	}
+	sim_mmio_accesses++;
+	*timer_ccmr(timer_peripheral, oc_id) &=
+		~(TIM_CCMR1_OC1PE << timer_ccmr_shift(oc_id));
+}
+
+void timer_set_oc_fast_mode(u32 timer_peripheral, enum tim_oc_id oc_id)
+{
+	if (timer_oc_complementary(oc_id)) {
+		return;
+	}
+	sim_mmio_accesses++;
+	*timer_ccmr(timer_peripheral, oc_id) |=
+		TIM_CCMR1_OC1FE << timer_ccmr_shift(oc_id);
+}
+
+void timer_set_oc_slow_mode(u32 timer_peripheral, enum tim_oc_id oc_id)
+{
+	if (timer_oc_complementary(oc_id)) {
+		return;
+	}
+	sim_mmio_accesses++;
+	*timer_ccmr(timer_peripheral, oc_id) &=
+		~(TIM_CCMR1_OC1FE << timer_ccmr_shift(oc_id));
+}
+
+void timer_set_oc_mode(u32 timer_peripheral, enum tim_oc_id oc_id,
+		       enum tim_oc_mode oc_mode)
+{
+	volatile u32 *ccmr;
+	u32 shift;
+
+	/* The output mode applies to the whole channel. */
+	if (timer_oc_complementary(oc_id)) {
+		return;
+	}
+
+	ccmr = timer_ccmr(timer_peripheral, oc_id);
+	shift = timer_ccmr_shift(oc_id);
+
+	sim_mmio_accesses++;
+	*ccmr = (*ccmr & ~((TIM_CCMR1_CC1S_MASK | TIM_CCMR1_OC1M_MASK) <<
+			   shift)) |
+		((u32)oc_mode << (shift + 4));
+}
+
+void timer_set_oc_polarity_high(u32 timer_peripheral, enum tim_oc_id oc_id)
+{
+	TIM_CCER(timer_peripheral) &=
+		~(TIM_CCER_CC1P << timer_ccer_shift(oc_id));
+}
+
+void timer_set_oc_polarity_low(u32 timer_peripheral, enum tim_oc_id oc_id)
+{
+	TIM_CCER(timer_peripheral) |= TIM_CCER_CC1P << timer_ccer_shift(oc_id);
+}
+
+void timer_set_oc_idle_state_set(u32 timer_peripheral, enum tim_oc_id oc_id)
+{
+	TIM_CR2(timer_peripheral) |= TIM_CR2_OIS1 << oc_id;
+}
+
+void timer_set_oc_idle_state_unset(u32 timer_peripheral,
+				   enum tim_oc_id oc_id)
+{
+	TIM_CR2(timer_peripheral) &= ~(TIM_CR2_OIS1 << oc_id);
+}
+
+void timer_set_oc_value(u32 timer_peripheral, enum tim_oc_id oc_id,
+			u32 value)
+{
+	/* The compare value applies to the whole channel. */
+	if (timer_oc_complementary(oc_id)) {
+		return;
+	}
+
+	MMIO32(timer_peripheral + 0x34 + (timer_oc_channel(oc_id) * 4)) =
+		value;
+}
+
+void timer_enable_break_main_output(u32 timer_peripheral)
+{
+	TIM_BDTR(timer_peripheral) |= TIM_BDTR_MOE;
+}
+
+void timer_disable_break_main_output(u32 timer_peripheral)
+{
+	TIM_BDTR(timer_peripheral) &= ~TIM_BDTR_MOE;
+}
+
+void timer_enable_break_automatic_output(u32 timer_peripheral)
+{
+	TIM_BDTR(timer_peripheral) |= TIM_BDTR_AOE;
+}
+
+void timer_disable_break_automatic_output(u32 timer_peripheral)
+{
+	TIM_BDTR(timer_peripheral) &= ~TIM_BDTR_AOE;
+}
+
+void timer_set_break_polarity_high(u32 timer_peripheral)
+{
+	TIM_BDTR(timer_peripheral) |= TIM_BDTR_BKP;
+}
+
+void timer_set_break_polarity_low(u32 timer_peripheral)
+{
+	TIM_BDTR(timer_peripheral) &= ~TIM_BDTR_BKP;
+}
+
+void timer_enable_break(u32 timer_peripheral)
+{
+	TIM_BDTR(timer_peripheral) |= TIM_BDTR_BKE;
+}
+
+void timer_disable_break(u32 timer_peripheral)
+{
+	TIM_BDTR(timer_peripheral) &= ~TIM_BDTR_BKE;
+}
+
+void timer_set_enabled_off_state_in_run_mode(u32 timer_peripheral)
+{
+	TIM_BDTR(timer_peripheral) |= TIM_BDTR_OSSR;
+}
+
+void timer_set_disabled_off_state_in_run_mode(u32 timer_peripheral)
+{
+	TIM_BDTR(timer_peripheral) &= ~TIM_BDTR_OSSR;
+}
+
+void timer_set_enabled_off_state_in_idle_mode(u32 timer_peripheral)
+{
+	TIM_BDTR(timer_peripheral) |= TIM_BDTR_OSSI;
+}
+
+void timer_set_disabled_off_state_in_idle_mode(u32 timer_peripheral)
+{
+	TIM_BDTR(timer_peripheral) &= ~TIM_BDTR_OSSI;
+}
+
+void timer_set_break_lock(u32 timer_peripheral, u32 lock)
+{
+	TIM_BDTR(timer_peripheral) = (TIM_BDTR(timer_peripheral) &
+				      ~TIM_BDTR_LOCK_MASK) | lock;
+}
+
+void timer_set_deadtime(u32 timer_peripheral, u32 deadtime)
+{
+	TIM_BDTR(timer_peripheral) = (TIM_BDTR(timer_peripheral) &
+				      ~TIM_BDTR_DTG_MASK) |
+				     (deadtime & TIM_BDTR_DTG_MASK);
+}
+
+void timer_generate_event(u32 timer_peripheral, u32 event)
+{
+	TIM_EGR(timer_peripheral) |= event;
+}
+
+u32 timer_get_counter(u32 timer_peripheral)
+{
+	return TIM_CNT(timer_peripheral);
+}
+
+void timer_set_counter(u32 timer_peripheral, u32 count)
+{
+	TIM_CNT(timer_peripheral) = count;
+}
+
+/* -- DMA ------------------------------------------------------------------ */
+
+void dma_channel_reset(u32 dma, u8 channel)
+{
+	DMA_CCR(dma, channel) = 0;
+	DMA_CNDTR(dma, channel) = 0;
+	DMA_CPAR(dma, channel) = 0;
+	DMA_CMAR(dma, channel) = 0;
+	DMA_ISR(dma) &= ~(DMA_FLAGS << DMA_FLAG_OFFSET(channel));
+}
+
+void dma_clear_interrupt_flags(u32 dma, u8 channel, u32 interrupts)
+{
+	DMA_ISR(dma) &= ~(interrupts << DMA_FLAG_OFFSET(channel));
+}
+
+bool dma_get_interrupt_flag(u32 dma, u8 channel, u32 interrupts)
+{
+	return ((DMA_ISR(dma) >> DMA_FLAG_OFFSET(channel)) & interrupts) != 0;
+}
+
+void dma_enable_mem2mem_mode(u32 dma, u8 channel)
+{
+	DMA_CCR(dma, channel) |= DMA_CCR_MEM2MEM;
+	DMA_CCR(dma, channel) &= ~DMA_CCR_CIRC;
+}
+
+void dma_set_priority(u32 dma, u8 channel, u32 prio)
+{
+	DMA_CCR(dma, channel) = (DMA_CCR(dma, channel) & ~DMA_CCR_PL_MASK) |
+				prio;
+}
+
+void dma_set_memory_size(u32 dma, u8 channel, u32 mem_size)
+{
+	DMA_CCR(dma, channel) = (DMA_CCR(dma, channel) &
+				 ~DMA_CCR_MSIZE_MASK) | mem_size;
+}
+
+void dma_set_peripheral_size(u32 dma, u8 channel, u32 peripheral_size)
+{
+	DMA_CCR(dma, channel) = (DMA_CCR(dma, channel) &
+				 ~DMA_CCR_PSIZE_MASK) | peripheral_size;
+}
+
+void dma_enable_memory_increment_mode(u32 dma, u8 channel)
+{
+	DMA_CCR(dma, channel) |= DMA_CCR_MINC;
+}
+
+void dma_disable_memory_increment_mode(u32 dma, u8 channel)
+{
+	DMA_CCR(dma, channel) &= ~DMA_CCR_MINC;
+}
+
+void dma_enable_peripheral_increment_mode(u32 dma, u8 channel)
+{
+	DMA_CCR(dma, channel) |= DMA_CCR_PINC;
+}
+
+void dma_disable_peripheral_increment_mode(u32 dma, u8 channel)
+{
+	DMA_CCR(dma, channel) &= ~DMA_CCR_PINC;
+}
+
+void dma_enable_circular_mode(u32 dma, u8 channel)
+{
+	DMA_CCR(dma, channel) |= DMA_CCR_CIRC;
+	DMA_CCR(dma, channel) &= ~DMA_CCR_MEM2MEM;
+}
+
+void dma_set_read_from_peripheral(u32 dma, u8 channel)
+{
+	DMA_CCR(dma, channel) &= ~DMA_CCR_DIR;
+}
+
+void dma_set_read_from_memory(u32 dma, u8 channel)
+{
+	DMA_CCR(dma, channel) |= DMA_CCR_DIR;
+}
+
+void dma_enable_transfer_error_interrupt(u32 dma, u8 channel)
+{
+	DMA_CCR(dma, channel) |= DMA_CCR_TEIE;
+}
+
+void dma_disable_transfer_error_interrupt(u32 dma, u8 channel)
+{
+	DMA_CCR(dma, channel) &= ~DMA_CCR_TEIE;
+}
+
+void dma_enable_half_transfer_interrupt(u32 dma, u8 channel)
+{
+	DMA_CCR(dma, channel) |= DMA_CCR_HTIE;
+}
+
+void dma_disable_half_transfer_interrupt(u32 dma, u8 channel)
+{
+	DMA_CCR(dma, channel) &= ~DMA_CCR_HTIE;
+}
+
+void dma_enable_transfer_complete_interrupt(u32 dma, u8 channel)
+{
+	DMA_CCR(dma, channel) |= DMA_CCR_TCIE;
+}
+
+void dma_disable_transfer_complete_interrupt(u32 dma, u8 channel)
+{
+	DMA_CCR(dma, channel) &= ~DMA_CCR_TCIE;
+}
+
+void dma_enable_channel(u32 dma, u8 channel)
+{
+	DMA_CCR(dma, channel) |= DMA_CCR_EN;
+}
+
+void dma_disable_channel(u32 dma, u8 channel)
+{
+	DMA_CCR(dma, channel) &= ~DMA_CCR_EN;
+}
+
+void dma_set_peripheral_address(u32 dma, u8 channel, u32 address)
+{
+	if ((DMA_CCR(dma, channel) & DMA_CCR_EN) == 0) {
+		DMA_CPAR(dma, channel) = address;
+	}
+}
+
+void dma_set_memory_address(u32 dma, u8 channel, u32 address)
+{
+	if ((DMA_CCR(dma, channel) & DMA_CCR_EN) == 0) {
+		DMA_CMAR(dma, channel) = address;
+	}
+}
+
+u16 dma_get_number_of_data(u32 dma, u8 channel)
+{
+	return DMA_CNDTR(dma, channel) & 0xffff;
+}
+
+void dma_set_number_of_data(u32 dma, u8 channel, u16 number)
+{
+	DMA_CNDTR(dma, channel) = number;
+}
+
+/* -- ADC ------------------------------------------------------------------ */
+
+void adc_power_on(u32 adc)
+{
+	ADC_CR2(adc) |= ADC_CR2_ADON;
+}
+
+void adc_off(u32 adc)
+{
+	ADC_CR2(adc) &= ~ADC_CR2_ADON;
+}
+
+void adc_enable_scan_mode(u32 adc)
+{
+	ADC_CR1(adc) |= ADC_CR1_SCAN;
+}
+
+void adc_disable_scan_mode(u32 adc)
+{
+	ADC_CR1(adc) &= ~ADC_CR1_SCAN;
+}
+
+void adc_set_continuous_conversion_mode(u32 adc)
+{
+	ADC_CR2(adc) |= ADC_CR2_CONT;
+}
+
+void adc_set_single_conversion_mode(u32 adc)
+{
+	ADC_CR2(adc) &= ~ADC_CR2_CONT;
+}
+
+void adc_set_right_aligned(u32 adc)
+{
+	ADC_CR2(adc) &= ~ADC_CR2_ALIGN;
+}
+
+void adc_enable_external_trigger_regular(u32 adc, u32 trigger)
+{
+	ADC_CR2(adc) = (ADC_CR2(adc) & ~ADC_CR2_EXTSEL_MASK) | trigger |
+		       ADC_CR2_EXTTRIG;
+}
+
+void adc_disable_external_trigger_regular(u32 adc)
+{
+	ADC_CR2(adc) &= ~ADC_CR2_EXTTRIG;
+}
+
+void adc_enable_external_trigger_injected(u32 adc, u32 trigger)
+{
+	ADC_CR2(adc) = (ADC_CR2(adc) & ~ADC_CR2_JEXTSEL_MASK) | trigger |
+		       ADC_CR2_JEXTTRIG;
+}
+
+void adc_disable_external_trigger_injected(u32 adc)
+{
+	ADC_CR2(adc) &= ~ADC_CR2_JEXTTRIG;
+}
+
+void adc_enable_eoc_interrupt_injected(u32 adc)
+{
+	ADC_CR1(adc) |= ADC_CR1_JEOCIE;
+}
+
+void adc_disable_eoc_interrupt_injected(u32 adc)
+{
+	ADC_CR1(adc) &= ~ADC_CR1_JEOCIE;
+}
+
+void adc_set_sample_time_on_all_channels(u32 adc, u8 time)
+{
+	u32 smpr1 = 0;
+	u32 smpr2 = 0;
+	int i;
+
+	for (i = 0; i < 10; i++) {
+		smpr2 |= (u32)(time & 0x7) << (i * 3);
+	}
+	for (i = 0; i < 8; i++) {
+		smpr1 |= (u32)(time & 0x7) << (i * 3);
+	}
+
+	ADC_SMPR1(adc) = smpr1;
+	ADC_SMPR2(adc) = smpr2;
+}
+
+void adc_enable_dma(u32 adc)
+{
+	ADC_CR2(adc) |= ADC_CR2_DMA;
+}
+
+void adc_disable_dma(u32 adc)
+{
+	ADC_CR2(adc) &= ~ADC_CR2_DMA;
+}
+
+void adc_reset_calibration(u32 adc)
+{
+	/* Calibration reset completes immediately. */
+	ADC_CR2(adc) &= ~ADC_CR2_RSTCAL;
+}
+
+void adc_calibration(u32 adc)
+{
+	/* Calibration completes immediately. */
+	ADC_CR2(adc) &= ~ADC_CR2_CAL;
+}
+
+void adc_set_regular_sequence(u32 adc, u8 length, u8 channel[])
+{
+	u32 sqr1 = 0;
+	u32 sqr2 = 0;
+	u32 sqr3 = 0;
+	int i;
+
+	if (length == 0 || length > 16) {
+		return;
+	}
+
+	for (i = 0; i < length; i++) {
+		if (i < 6) {
+			sqr3 |= (u32)channel[i] << (i * 5);
+		} else if (i < 12) {
+			sqr2 |= (u32)channel[i] << ((i - 6) * 5);
+		} else {
+			sqr1 |= (u32)channel[i] << ((i - 12) * 5);
+		}
+	}
+	sqr1 |= (u32)(length - 1) << ADC_SQR1_L_LSB;
+
+	ADC_SQR1(adc) = sqr1;
+	ADC_SQR2(adc) = sqr2;
+	ADC_SQR3(adc) = sqr3;
+}
+
+void adc_set_injected_sequence(u32 adc, u8 length, u8 channel[])
+{
+	u32 jsqr = 0;
+	int i;
+
+	if (length == 0 || length > 4) {
+		return;
+	}
+
+	/* Shorter sequences occupy the upper JSQx fields. */
+	for (i = 0; i < length; i++) {
+		jsqr |= (u32)channel[i] << ((4 - length + i) * 5);
+	}
+	jsqr |= (u32)(length - 1) << ADC_JSQR_JL_LSB;
+
+	ADC_JSQR(adc) = jsqr;
+}
+
+void adc_set_dual_mode(u32 mode)
+{
+	ADC1_CR1 = (ADC1_CR1 & ~ADC_CR1_DUALMOD_MASK) | mode;
+}
+
+void adc_start_conversion_regular(u32 adc)
+{
+	ADC_CR2(adc) |= ADC_CR2_SWSTART;
+}
+
+void adc_start_conversion_injected(u32 adc)
+{
+	ADC_CR2(adc) |= ADC_CR2_JSWSTART;
+}
+
+bool adc_eoc_injected(u32 adc)
+{
+	return (ADC_SR(adc) & ADC_SR_JEOC) != 0;
+}
+
+u32 adc_read_injected(u32 adc, u8 reg)
+{
+	switch (reg) {
+	case 1:
+		return ADC_JDR1(adc);
+	case 2:
+		return ADC_JDR2(adc);
+	case 3:
+		return ADC_JDR3(adc);
+	case 4:
+		return ADC_JDR4(adc);
+	}
+
+	return 0;
+}
+
+/* -- USART ---------------------------------------------------------------- */
+
+void usart_set_baudrate(u32 usart, u32 baud)
+{
+	u32 clock = (usart == USART1) ? rcc_ppre2_frequency :
+					rcc_ppre1_frequency;
+
+	USART_BRR(usart) = ((2 * clock) + baud) / (2 * baud);
+}
+
+void usart_set_databits(u32 usart, u32 bits)
+{
+	if (bits == 8) {
+		USART_CR1(usart) &= ~USART_CR1_M;
+	} else {
+		USART_CR1(usart) |= USART_CR1_M;
+	}
+}
+
+void usart_set_stopbits(u32 usart, u32 stopbits)
+{
+	USART_CR2(usart) = (USART_CR2(usart) & ~USART_CR2_STOPBITS_MASK) |
+			   stopbits;
+}
+
+void usart_set_parity(u32 usart, u32 parity)
+{
+	USART_CR1(usart) = (USART_CR1(usart) & ~USART_PARITY_MASK) | parity;
+}
+
+void usart_set_mode(u32 usart, u32 mode)
+{
+	USART_CR1(usart) = (USART_CR1(usart) & ~USART_MODE_MASK) | mode;
+}
+
+void usart_set_flow_control(u32 usart, u32 flowcontrol)
+{
+	USART_CR3(usart) = (USART_CR3(usart) & ~USART_FLOWCONTROL_MASK) |
+			   flowcontrol;
+}
+
+void usart_enable(u32 usart)
+{
+	USART_CR1(usart) |= USART_CR1_UE;
+}
+
+void usart_disable(u32 usart)
+{
+	USART_CR1(usart) &= ~USART_CR1_UE;
+}
+
+void usart_send(u32 usart, u16 data)
+{
+	/* Writing the data register clears TXE, and TC after the status
+	 * register was read.
+	 */
+	USART_DR(usart) = data & 0x1ff;
+	USART_SR(usart) &= ~(USART_SR_TXE | USART_SR_TC);
+}
+
+u16 usart_recv(u32 usart)
+{
+	/* Reading the data register clears RXNE and a pending overrun. */
+	USART_SR(usart) &= ~(USART_SR_RXNE | USART_SR_ORE | USART_SR_IDLE);
+	return USART_DR(usart) & 0x1ff;
+}
+
+void usart_enable_rx_dma(u32 usart)
+{
+	USART_CR3(usart) |= USART_CR3_DMAR;
+}
+
+void usart_disable_rx_dma(u32 usart)
+{
+	USART_CR3(usart) &= ~USART_CR3_DMAR;
+}
+
+void usart_enable_tx_dma(u32 usart)
+{
+	USART_CR3(usart) |= USART_CR3_DMAT;
+}
+
+void usart_disable_tx_dma(u32 usart)
+{
+	USART_CR3(usart) &= ~USART_CR3_DMAT;
+}
+
+/* -- Startup -------------------------------------------------------------- */
+
+/* Stand-ins of the src/stm32.ld symbols mcu_init() uses with -DRAMFUNC. The
+ * host loader already put the SRAM code where it runs, the section is empty
+ * for the copy. The flash vector table is all zero, the simulation calls the
+ * handlers by name.
+ */
+uint32_t _ramfunc_loadaddr;
+extern uint32_t _ramfunc __attribute__((alias("_ramfunc_loadaddr")));
+extern uint32_t _eramfunc __attribute__((alias("_ramfunc_loadaddr")));
+const uint32_t _flash_vectors[16 + NVIC_IRQ_COUNT];
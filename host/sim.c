@@ -0,0 +1,1781 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   sim.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Host simulation of the STM32F103 peripherals used by Open-BLDC.
+ *
+ * The drivers are compiled against the host libopencm3 headers in
+ * host/include. Those map every register into the register file defined
+ * here. This file advances the peripheral models (TIM1, TIM2, SysTick,
+ * ADC1/2, DMA1 and USART1) in steps of SIM_QUANTUM core cycles and calls the
+ * driver interrupt service routines when a peripheral raises an enabled
+ * interrupt, the same way the NVIC would do it on the target.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include <libopencm3/stm32/f1/rcc.h>
+#include <libopencm3/stm32/f1/dma.h>
+#include <libopencm3/stm32/f1/adc.h>
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/stm32/usart.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/systick.h>
+#include <libopencm3/cm3/scs.h>
+#include <libopencm3/cm3/scb.h>
+
+#include "host/sim.h"
+
+/* The peripheral models access the register file without going through the
+ * access counter, only the driver accesses are of interest.
+ */
+#undef MMIO32
+#define MMIO32(addr)		(*sim_reg(addr))
+
+static inline volatile uint32_t *sim_reg(uint32_t addr)
+{
+	if (addr >= SIM_PPB_BASE) {
+		return &sim_ppb_regs[(addr - SIM_PPB_BASE) >> 2];
+	}
+
+	return &sim_periph_regs[(addr - SIM_PERIPH_BASE) >> 2];
+}
+
+/* Register file. */
+volatile uint32_t sim_periph_regs[SIM_PERIPH_SIZE / 4];
+volatile uint32_t sim_ppb_regs[SIM_PPB_SIZE / 4];
+uint64_t sim_mmio_accesses;
+
+/* Interrupt mask of the Cortex core helpers. */
+uint32_t sim_primask;
+
+/* Default interrupt handlers, the drivers override the ones they use. */
+static void null_handler(void)
+{
+}
+
+#pragma weak sys_tick_handler = null_handler
+#pragma weak dma1_channel1_isr = null_handler
+#pragma weak dma1_channel2_isr = null_handler
+#pragma weak dma1_channel3_isr = null_handler
+#pragma weak dma1_channel4_isr = null_handler
+#pragma weak dma1_channel5_isr = null_handler
+#pragma weak dma1_channel6_isr = null_handler
+#pragma weak dma1_channel7_isr = null_handler
+#pragma weak adc1_2_isr = null_handler
+#pragma weak tim1_up_isr = null_handler
+#pragma weak tim1_trg_com_isr = null_handler
+#pragma weak tim1_cc_isr = null_handler
+#pragma weak tim2_isr = null_handler
+#pragma weak usart1_isr = null_handler
+
+/**
+ * Interrupt lines that are driven by the peripheral models.
+ */
+static const struct {
+	uint8_t irqn;
+	const char *name;
+	void (*isr)(void);
+} sim_irq_table[] = {
+	{ NVIC_DMA1_CHANNEL1_IRQ, "dma1_channel1_isr", dma1_channel1_isr },
+	{ NVIC_DMA1_CHANNEL2_IRQ, "dma1_channel2_isr", dma1_channel2_isr },
+	{ NVIC_DMA1_CHANNEL3_IRQ, "dma1_channel3_isr", dma1_channel3_isr },
+	{ NVIC_DMA1_CHANNEL4_IRQ, "dma1_channel4_isr", dma1_channel4_isr },
+	{ NVIC_DMA1_CHANNEL5_IRQ, "dma1_channel5_isr", dma1_channel5_isr },
+	{ NVIC_DMA1_CHANNEL6_IRQ, "dma1_channel6_isr", dma1_channel6_isr },
+	{ NVIC_DMA1_CHANNEL7_IRQ, "dma1_channel7_isr", dma1_channel7_isr },
+	{ NVIC_ADC1_2_IRQ, "adc1_2_isr", adc1_2_isr },
+	{ NVIC_TIM1_UP_IRQ, "tim1_up_isr", tim1_up_isr },
+	{ NVIC_TIM1_TRG_COM_IRQ, "tim1_trg_com_isr", tim1_trg_com_isr },
+	{ NVIC_TIM1_CC_IRQ, "tim1_cc_isr", tim1_cc_isr },
+	{ NVIC_TIM2_IRQ, "tim2_isr", tim2_isr },
+	{ NVIC_USART1_IRQ, "usart1_isr", usart1_isr },
+};
+
+#define SIM_IRQ_TABLE_SIZE (sizeof(sim_irq_table) / sizeof(sim_irq_table[0]))
+
+/**
+ * Timer model state that is not visible in the register file.
+ */
+struct sim_timer {
+	uint32_t base; /**< Peripheral base address */
+	bool advanced; /**< TIM1 style timer with complementary outputs */
+	bool down; /**< Center aligned mode counting direction */
+	uint32_t psc_cnt; /**< Prescaler counter */
+	uint32_t psc; /**< Active prescaler value */
+	uint32_t rep; /**< Repetition down counter */
+	uint32_t ccr[4]; /**< Active compare values */
+	uint32_t ccmr[2]; /**< Active output compare modes */
+	uint32_t ccer; /**< Active output enable bits */
+	uint32_t ref; /**< OCxREF levels of the match driven output modes */
+	uint32_t events; /**< SIM_TIM_EV_* events of the last step */
+};
+
+/* Timer events that can trigger other peripherals. */
+#define SIM_TIM_EV_CC(i) (1 << (i)) /**< Compare match on channel i */
+#define SIM_TIM_EV_REF(i) (1 << (4 + (i))) /**< OCxREF rising edge */
+#define SIM_TIM_EV_UPDATE (1 << 8)
+
+/**
+ * ADC model state.
+ */
+struct sim_adc {
+	bool reg_active; /**< Regular sequence is converting */
+	int pos; /**< Regular sequence position */
+	bool inj_active; /**< Injected sequence is converting */
+	int jpos; /**< Injected sequence position */
+	uint32_t budget; /**< Cycles spent on the current conversion */
+	uint32_t conv; /**< Length of the current conversion, 0 if unknown */
+	uint32_t sample; /**< Length of its sampling phase */
+	bool injected; /**< The current conversion is an injected one */
+	bool held; /**< The input was sampled, the result is in data */
+	uint16_t data[2]; /**< Sampled input, of ADC2 too in dual mode */
+};
+
+/**
+ * DMA channel model state.
+ */
+struct sim_dma_channel {
+	bool enabled;
+	uint16_t ndtr_reload; /**< Number of data programmed on enable */
+	uint16_t ndtr_last; /**< Number of data after the last transfer */
+};
+
+/**
+ * USART model state.
+ */
+#define SIM_USART_RX_FIFO_SIZE 4096
+
+struct sim_usart {
+	uint8_t rx_fifo[SIM_USART_RX_FIFO_SIZE];
+	size_t rx_head;
+	size_t rx_tail;
+	uint32_t rx_budget;
+	bool rx_idle_pending;
+	bool tx_busy;
+	uint8_t tx_byte;
+	bool tdr_full; /**< tdr holds a byte waiting for the shift register */
+	uint8_t tdr;
+	uint32_t tx_budget;
+	sim_usart_tx_callback_t tx_callback;
+};
+
+/* Simulator state. */
+static uint64_t sim_cycles;
+static sim_step_callback_t sim_step_callback;
+static uint64_t sim_stats_start;
+static uint64_t sim_sleep_cycles;
+static uint32_t sim_sysclk;
+static bool sim_systick_pending;
+static uint32_t sim_systick_prescaler;
+static struct sim_timer sim_tim1;
+static struct sim_timer sim_tim2;
+static struct sim_adc sim_adc[2];
+static struct sim_dma_channel sim_dma[8];
+static struct sim_usart sim_usart;
+static uint16_t sim_adc_input[18];
+static sim_adc_sample_callback_t sim_adc_sample_callback;
+static struct sim_isr_stats sim_isr_stats[SIM_ISR_SLOTS];
+static struct sim_cycle_model sim_cycle_model;
+static uint64_t sim_isr_cycles; /**< Modeled cycles of all handlers run */
+static uint64_t sim_isr_stats_cycles; /**< sim_isr_cycles at the reset */
+static uint64_t sim_clock_ns; /**< Cost of reading the host clock */
+static bool sim_isr_running;
+static bool sim_isr_ram; /**< Running handler is in SRAM */
+static uint64_t sim_isr_start_ns;
+static uint64_t sim_isr_start_mmio;
+
+/* Bounds of the handlers and functions built to run from SRAM, no section
+ * without -DRAMFUNC.
+ */
+extern const char __start_ramfunc[] __attribute__((weak));
+extern const char __stop_ramfunc[] __attribute__((weak));
+
+/* -- Helpers -------------------------------------------------------------- */
+
+static inline uint32_t sim_min(uint32_t a, uint32_t b)
+{
+	return a < b ? a : b;
+}
+
+static inline uint64_t sim_min64(uint64_t a, uint64_t b)
+{
+	return a < b ? a : b;
+}
+
+static uint64_t sim_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Cycles of handler code that ran for ns on the host and accessed mmio
+ * registers, without the exception entry and return.
+ */
+static uint64_t sim_model_cycles(uint64_t ns, uint64_t mmio)
+{
+	uint64_t access = sim_cycle_model.mmio;
+
+	ns = (ns > sim_clock_ns) ? ns - sim_clock_ns : 0;
+	if (!sim_isr_ram) {
+		access += sim_cycle_model.flash_wait;
+	}
+
+	return (mmio * access) +
+	       (uint64_t)((double)ns * sim_cycle_model.host_ns);
+}
+
+/**
+ * Is the vector table at the flash alias at 0 or in flash?
+ */
+static bool sim_vectors_in_flash(void)
+{
+	uint32_t vtor = SCB_VTOR;
+
+	return vtor == 0 || (vtor & 0xff000000U) == 0x08000000U;
+}
+
+/**
+ * Cycles of the exception entry and return, with the vector fetch from
+ * flash unless the vector table was moved to SRAM.
+ */
+static uint64_t sim_exception_cycles(void)
+{
+	if (sim_vectors_in_flash()) {
+		return sim_cycle_model.exception + sim_cycle_model.flash_wait;
+	}
+	return sim_cycle_model.exception;
+}
+
+/* Status registers software can only clear flags in, by writing zero to
+ * them (rc_w0) or by a read sequence. The register file keeps what the
+ * drivers wrote, sim_status_sync() folds it into the flags the models set.
+ * A write of the inverted mask so only clears its flag, like on the chip.
+ */
+static const uint32_t sim_status_addr[] = {
+	USART1 + 0x00, /* USART_SR */
+	ADC1 + 0x00, /* ADC_SR */
+	ADC2 + 0x00
+};
+
+static uint32_t sim_status_last[sizeof(sim_status_addr) /
+				sizeof(sim_status_addr[0])];
+
+/**
+ * Apply the driver writes since the last call, they may clear flags but not
+ * set them.
+ */
+static void sim_status_sync(void)
+{
+	volatile uint32_t *reg;
+	size_t i;
+
+	for (i = 0; i < sizeof(sim_status_addr) / sizeof(sim_status_addr[0]);
+	     i++) {
+		reg = sim_reg(sim_status_addr[i]);
+		*reg &= sim_status_last[i];
+		sim_status_last[i] = *reg;
+	}
+}
+
+/**
+ * Take the flags the peripheral models set as the new reference.
+ */
+static void sim_status_latch(void)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(sim_status_addr) / sizeof(sim_status_addr[0]);
+	     i++) {
+		sim_status_last[i] = *sim_reg(sim_status_addr[i]);
+	}
+}
+
+static void sim_call_isr(int slot, const char *name, void (*isr)(void))
+{
+	struct sim_isr_stats *stats = &sim_isr_stats[slot];
+	uint64_t mmio = sim_mmio_accesses;
+	uint64_t start = sim_now_ns();
+	uint64_t ns, cycles;
+
+	sim_isr_running = true;
+	sim_isr_ram = (const char *)isr >= __start_ramfunc &&
+		      (const char *)isr < __stop_ramfunc;
+	sim_isr_start_ns = start;
+	sim_isr_start_mmio = mmio;
+
+	isr();
+	sim_status_sync();
+
+	ns = sim_now_ns() - start;
+	mmio = sim_mmio_accesses - mmio;
+	cycles = sim_exception_cycles() + sim_model_cycles(ns, mmio);
+	sim_isr_running = false;
+	sim_isr_cycles += cycles;
+
+	stats->name = name;
+	stats->count++;
+	stats->mmio += mmio;
+	stats->ns_total += ns;
+	stats->cycles_total += cycles;
+	stats->ram = sim_isr_ram;
+	if (stats->count == 1 || ns < stats->ns_min) {
+		stats->ns_min = ns;
+	}
+	if (ns > stats->ns_max) {
+		stats->ns_max = ns;
+	}
+	if (stats->count == 1 || cycles < stats->cycles_min) {
+		stats->cycles_min = cycles;
+	}
+	if (cycles > stats->cycles_max) {
+		stats->cycles_max = cycles;
+	}
+}
+
+/* -- DMA1 ----------------------------------------------------------------- */
+
+static void sim_dma_sync(void)
+{
+	int ch;
+	bool enabled;
+
+	for (ch = DMA_CHANNEL1; ch <= DMA_CHANNEL7; ch++) {
+		enabled = (DMA_CCR(DMA1, ch) & DMA_CCR_EN) != 0;
+		if (enabled && !sim_dma[ch].enabled) {
+			sim_dma[ch].ndtr_reload = DMA_CNDTR(DMA1, ch) & 0xffff;
+			sim_dma[ch].ndtr_last = sim_dma[ch].ndtr_reload;
+		}
+		sim_dma[ch].enabled = enabled;
+	}
+}
+
+static void sim_dma_advance(int ch, uint32_t ccr, uint32_t cndtr)
+{
+	uint32_t reload = sim_dma[ch].ndtr_reload;
+	uint32_t offset = DMA_FLAG_OFFSET(ch);
+
+	cndtr--;
+
+	if ((reload - cndtr) == (reload / 2)) {
+		DMA_ISR(DMA1) |= (DMA_HTIF | DMA_GIF) << offset;
+	}
+
+	if (cndtr == 0) {
+		DMA_ISR(DMA1) |= (DMA_TCIF | DMA_GIF) << offset;
+		if ((ccr & DMA_CCR_CIRC) != 0) {
+			cndtr = reload;
+		}
+	}
+
+	DMA_CNDTR(DMA1, ch) = cndtr;
+	sim_dma[ch].ndtr_last = (uint16_t)cndtr;
+}
+
+static uintptr_t sim_dma_memory(int ch, uint32_t ccr, uint32_t cndtr,
+				uint32_t *size)
+{
+	uint32_t index;
+
+	/* A channel disabled, reprogrammed and enabled again within one
+	 * quantum is seen by its new number of data.
+	 */
+	if (cndtr != sim_dma[ch].ndtr_last) {
+		sim_dma[ch].ndtr_reload = (uint16_t)cndtr;
+	}
+	index = sim_dma[ch].ndtr_reload - cndtr;
+
+	*size = 1U << ((ccr & DMA_CCR_MSIZE_MASK) >> 10);
+
+	if ((ccr & DMA_CCR_MINC) == 0) {
+		index = 0;
+	}
+
+	return (uintptr_t)DMA_CMAR(DMA1, ch) + index * *size;
+}
+
+/**
+ * Peripheral to memory transfer of one data item.
+ */
+static bool sim_dma_write(int ch, uint32_t value)
+{
+	uint32_t ccr = DMA_CCR(DMA1, ch);
+	uint32_t cndtr = DMA_CNDTR(DMA1, ch) & 0xffff;
+	uint32_t size;
+	uintptr_t addr;
+
+	if ((ccr & DMA_CCR_EN) == 0 || cndtr == 0) {
+		return false;
+	}
+
+	addr = sim_dma_memory(ch, ccr, cndtr, &size);
+	memcpy((void *)addr, &value, size);
+	sim_dma_advance(ch, ccr, cndtr);
+
+	return true;
+}
+
+/**
+ * Memory to peripheral transfer of one data item.
+ */
+static bool sim_dma_read(int ch, uint32_t *value)
+{
+	uint32_t ccr = DMA_CCR(DMA1, ch);
+	uint32_t cndtr = DMA_CNDTR(DMA1, ch) & 0xffff;
+	uint32_t size;
+	uintptr_t addr;
+
+	if ((ccr & DMA_CCR_EN) == 0 || cndtr == 0) {
+		return false;
+	}
+
+	addr = sim_dma_memory(ch, ccr, cndtr, &size);
+	*value = 0;
+	memcpy(value, (const void *)addr, size);
+	sim_dma_advance(ch, ccr, cndtr);
+
+	return true;
+}
+
+/* -- TIM1/TIM2 ------------------------------------------------------------ */
+
+/* Bits of CCER and CCMRx that are preloaded when CR2_CCPC is set. */
+#define SIM_TIM_CCER_PRELOAD (TIM_CCER_CC1E | TIM_CCER_CC1NE | \
+			      TIM_CCER_CC2E | TIM_CCER_CC2NE | \
+			      TIM_CCER_CC3E | TIM_CCER_CC3NE)
+#define SIM_TIM_CCMR1_PRELOAD (TIM_CCMR1_OC1M_MASK | TIM_CCMR1_OC2M_MASK)
+#define SIM_TIM_CCMR2_PRELOAD (TIM_CCMR2_OC3M_MASK)
+
+static inline volatile uint32_t *sim_timer_ccr(struct sim_timer *t, int i)
+{
+	return &MMIO32(t->base + 0x34 + (i * 4));
+}
+
+static bool sim_timer_ccr_preload(struct sim_timer *t, int i)
+{
+	uint32_t ccmr = (i < 2) ? TIM_CCMR1(t->base) : TIM_CCMR2(t->base);
+
+	return (ccmr & ((i & 1) ? TIM_CCMR1_OC2PE : TIM_CCMR1_OC1PE)) != 0;
+}
+
+/* Active output compare mode of channel i, as TIM_CCMR1_OC1M_* value. */
+static inline uint32_t sim_timer_oc_mode(struct sim_timer *t, int i)
+{
+	return (t->ccmr[i >> 1] >> ((i & 1) ? 8 : 0)) & TIM_CCMR1_OC1M_MASK;
+}
+
+/* Output compare reference level of channel i. */
+static bool sim_timer_oc_ref(struct sim_timer *t, int i, uint32_t cnt)
+{
+	switch (sim_timer_oc_mode(t, i)) {
+	case TIM_CCMR1_OC1M_FORCE_LOW:
+		return false;
+	case TIM_CCMR1_OC1M_FORCE_HIGH:
+		return true;
+	case TIM_CCMR1_OC1M_PWM1:
+		return cnt < t->ccr[i];
+	case TIM_CCMR1_OC1M_PWM2:
+		return cnt >= t->ccr[i];
+	default:
+		return (t->ref & (1 << i)) != 0;
+	}
+}
+
+static void sim_timer_reset(struct sim_timer *t)
+{
+	uint32_t base = t->base;
+	bool advanced = t->advanced;
+
+	memset(t, 0, sizeof(*t));
+	t->base = base;
+	t->advanced = advanced;
+}
+
+static void sim_timer_com_event(struct sim_timer *t)
+{
+	t->ccmr[0] = TIM_CCMR1(t->base);
+	t->ccmr[1] = TIM_CCMR2(t->base);
+	t->ccer = TIM_CCER(t->base);
+	TIM_SR(t->base) |= TIM_SR_COMIF;
+}
+
+static void sim_timer_update_event(struct sim_timer *t, bool flag)
+{
+	int i;
+
+	if ((TIM_CR1(t->base) & TIM_CR1_UDIS) != 0) {
+		return;
+	}
+
+	if (t->advanced) {
+		if (t->rep != 0) {
+			t->rep--;
+			return;
+		}
+		t->rep = TIM_RCR(t->base) & 0xff;
+	}
+
+	t->psc = TIM_PSC(t->base) & 0xffff;
+	for (i = 0; i < 4; i++) {
+		if (sim_timer_ccr_preload(t, i)) {
+			t->ccr[i] = *sim_timer_ccr(t, i) & 0xffff;
+		}
+	}
+
+	t->events |= SIM_TIM_EV_UPDATE;
+	if (flag) {
+		TIM_SR(t->base) |= TIM_SR_UIF;
+	}
+}
+
+/**
+ * Transfer all non preloaded settings and handle software generated events.
+ */
+static void sim_timer_sync(struct sim_timer *t)
+{
+	uint32_t egr = TIM_EGR(t->base);
+	uint32_t ccmr1 = TIM_CCMR1(t->base);
+	uint32_t ccmr2 = TIM_CCMR2(t->base);
+	uint32_t ccer = TIM_CCER(t->base);
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		if ((((i < 2) ? ccmr1 : ccmr2) &
+		     ((i & 1) ? TIM_CCMR1_OC2PE : TIM_CCMR1_OC1PE)) == 0) {
+			t->ccr[i] = *sim_timer_ccr(t, i) & 0xffff;
+		}
+	}
+
+	if (t->advanced && (TIM_CR2(t->base) & TIM_CR2_CCPC) != 0) {
+		t->ccmr[0] = (t->ccmr[0] & SIM_TIM_CCMR1_PRELOAD) |
+			     (ccmr1 & ~SIM_TIM_CCMR1_PRELOAD);
+		t->ccmr[1] = (t->ccmr[1] & SIM_TIM_CCMR2_PRELOAD) |
+			     (ccmr2 & ~SIM_TIM_CCMR2_PRELOAD);
+		t->ccer = (t->ccer & SIM_TIM_CCER_PRELOAD) |
+			  (ccer & ~SIM_TIM_CCER_PRELOAD);
+	} else {
+		t->ccmr[0] = ccmr1;
+		t->ccmr[1] = ccmr2;
+		t->ccer = ccer;
+	}
+
+	if (egr == 0) {
+		return;
+	}
+	TIM_EGR(t->base) = 0;
+
+	if ((egr & TIM_EGR_UG) != 0) {
+		TIM_CNT(t->base) = 0;
+		t->psc_cnt = 0;
+		t->down = false;
+		t->rep = 0;
+		/* With URS set only counter over- and underflows raise the
+		 * update flag.
+		 */
+		sim_timer_update_event(t,
+			(TIM_CR1(t->base) & TIM_CR1_URS) == 0);
+	}
+
+	if ((egr & TIM_EGR_COMG) != 0 && t->advanced) {
+		sim_timer_com_event(t);
+	}
+
+	TIM_SR(t->base) |= egr & (TIM_SR_CC1IF | TIM_SR_CC2IF |
+				  TIM_SR_CC3IF | TIM_SR_CC4IF | TIM_SR_TIF);
+}
+
+/**
+ * Compare the counter values visited in [from, to] against the active
+ * compare values.
+ */
+static void sim_timer_compare(struct sim_timer *t, uint32_t from, uint32_t to,
+			      bool down)
+{
+	uint32_t cms = TIM_CR1(t->base) & TIM_CR1_CMS_MASK;
+	int i;
+
+	/* The output reference follows every match, independent of the
+	 * direction the flags are generated in.
+	 */
+	for (i = 0; i < 4; i++) {
+		if (t->ccr[i] < from || t->ccr[i] > to) {
+			continue;
+		}
+		t->events |= SIM_TIM_EV_CC(i);
+		switch (sim_timer_oc_mode(t, i)) {
+		case TIM_CCMR1_OC1M_ACTIVE:
+			if ((t->ref & (1 << i)) == 0) {
+				t->events |= SIM_TIM_EV_REF(i);
+			}
+			t->ref |= 1 << i;
+			break;
+		case TIM_CCMR1_OC1M_INACTIVE:
+			t->ref &= ~(1 << i);
+			break;
+		case TIM_CCMR1_OC1M_TOGGLE:
+			if ((t->ref & (1 << i)) == 0) {
+				t->events |= SIM_TIM_EV_REF(i);
+			}
+			t->ref ^= 1 << i;
+			break;
+		case TIM_CCMR1_OC1M_PWM1:
+			/* Active below the compare value. */
+			if (down) {
+				t->events |= SIM_TIM_EV_REF(i);
+			}
+			break;
+		case TIM_CCMR1_OC1M_PWM2:
+			if (!down) {
+				t->events |= SIM_TIM_EV_REF(i);
+			}
+			break;
+		}
+	}
+
+	/* In center aligned mode 1 and 2 the compare flags are only set while
+	 * counting down or up respectively.
+	 */
+	if ((cms == TIM_CR1_CMS_CENTER_1 && !down) ||
+	    (cms == TIM_CR1_CMS_CENTER_2 && down)) {
+		return;
+	}
+
+	for (i = 0; i < 4; i++) {
+		if (t->ccr[i] >= from && t->ccr[i] <= to) {
+			TIM_SR(t->base) |= TIM_SR_CC1IF << i;
+		}
+	}
+}
+
+static void sim_timer_step(struct sim_timer *t, uint32_t cycles)
+{
+	uint32_t cr1, arr, cnt, ticks, step, div;
+
+	t->events = 0;
+	sim_timer_sync(t);
+
+	cr1 = TIM_CR1(t->base);
+	arr = TIM_ARR(t->base) & 0xffff;
+	if ((cr1 & TIM_CR1_CEN) == 0 || arr == 0) {
+		return;
+	}
+
+	div = t->psc + 1;
+	t->psc_cnt += cycles;
+	ticks = t->psc_cnt / div;
+	t->psc_cnt -= ticks * div;
+
+	cnt = TIM_CNT(t->base) & 0xffff;
+
+	while (ticks != 0) {
+		if ((cr1 & TIM_CR1_CMS_MASK) == TIM_CR1_CMS_EDGE) {
+			if (cnt >= arr) {
+				cnt = 0;
+				ticks--;
+				sim_timer_update_event(t, true);
+				sim_timer_compare(t, 0, 0, false);
+				if ((cr1 & TIM_CR1_OPM) != 0) {
+					TIM_CR1(t->base) &= ~TIM_CR1_CEN;
+					break;
+				}
+				continue;
+			}
+			step = sim_min(ticks, arr - cnt);
+			sim_timer_compare(t, cnt + 1, cnt + step, false);
+			cnt += step;
+			ticks -= step;
+		} else if (!t->down) {
+			if (cnt >= arr) {
+				t->down = true;
+				continue;
+			}
+			step = sim_min(ticks, arr - cnt);
+			sim_timer_compare(t, cnt + 1, cnt + step, false);
+			cnt += step;
+			ticks -= step;
+			if (cnt == arr) {
+				t->down = true;
+				sim_timer_update_event(t, true);
+			}
+		} else {
+			if (cnt == 0) {
+				t->down = false;
+				continue;
+			}
+			step = sim_min(ticks, cnt);
+			sim_timer_compare(t, cnt - step, cnt - 1, true);
+			cnt -= step;
+			ticks -= step;
+			if (cnt == 0) {
+				t->down = false;
+				sim_timer_update_event(t, true);
+			}
+		}
+	}
+
+	TIM_CNT(t->base) = cnt;
+
+	if ((cr1 & TIM_CR1_CMS_MASK) != TIM_CR1_CMS_EDGE) {
+		if (t->down) {
+			TIM_CR1(t->base) |= TIM_CR1_DIR_DOWN;
+		} else {
+			TIM_CR1(t->base) &= ~TIM_CR1_DIR_DOWN;
+		}
+	}
+}
+
+/* Trigger output (TRGO) pulse of the last step, see TIM_CR2_MMS_*. */
+static bool sim_timer_trgo(struct sim_timer *t)
+{
+	uint32_t mms = TIM_CR2(t->base) & TIM_CR2_MMS_MASK;
+
+	switch (mms) {
+	case TIM_CR2_MMS_UPDATE:
+		return (t->events & SIM_TIM_EV_UPDATE) != 0;
+	case TIM_CR2_MMS_COMPARE_PULSE:
+		return (t->events & SIM_TIM_EV_CC(0)) != 0;
+	case TIM_CR2_MMS_COMPARE_OC1REF:
+	case TIM_CR2_MMS_COMPARE_OC2REF:
+	case TIM_CR2_MMS_COMPARE_OC3REF:
+	case TIM_CR2_MMS_COMPARE_OC4REF:
+		return (t->events &
+			SIM_TIM_EV_REF((mms - TIM_CR2_MMS_COMPARE_OC1REF) >>
+				       4)) != 0;
+	default:
+		/* Reset and enable are not modelled. */
+		return false;
+	}
+}
+
+/* -- SysTick -------------------------------------------------------------- */
+
+static void sim_systick_step(uint32_t cycles)
+{
+	uint32_t ctrl = STK_CTRL;
+	uint32_t load = STK_LOAD & STK_LOAD_RELOAD;
+	uint32_t val = STK_VAL & STK_LOAD_RELOAD;
+	uint32_t ticks, step;
+
+	if ((ctrl & STK_CTRL_ENABLE) == 0) {
+		return;
+	}
+
+	if ((ctrl & STK_CTRL_CLKSOURCE) != 0) {
+		ticks = cycles;
+	} else {
+		sim_systick_prescaler += cycles;
+		ticks = sim_systick_prescaler / 8;
+		sim_systick_prescaler %= 8;
+	}
+
+	while (ticks != 0) {
+		if (val == 0) {
+			if (load == 0) {
+				break;
+			}
+			val = load;
+			ticks--;
+			continue;
+		}
+		step = sim_min(ticks, val);
+		val -= step;
+		ticks -= step;
+		if (val == 0) {
+			STK_CTRL |= STK_CTRL_COUNTFLAG;
+			if ((ctrl & STK_CTRL_TICKINT) != 0) {
+				sim_systick_pending = true;
+			}
+		}
+	}
+
+	STK_VAL = val;
+}
+
+/* -- ADC1/ADC2 ------------------------------------------------------------ */
+
+/* Sample times in half ADC clock cycles indexed by ADC_SMPR_SMP_*. */
+static const uint16_t sim_adc_sample_half_cycles[8] = {
+	3, 15, 27, 57, 83, 111, 143, 479
+};
+
+static inline uint32_t sim_adc_base(int unit)
+{
+	return unit ? ADC2 : ADC1;
+}
+
+static uint16_t sim_adc_sample(int channel)
+{
+	if (sim_adc_sample_callback) {
+		return sim_adc_sample_callback(channel) & 0xfff;
+	}
+
+	return sim_adc_input[channel] & 0xfff;
+}
+
+static uint32_t sim_adc_conversion_cycles(uint32_t base, int channel,
+					  uint32_t *sample)
+{
+	static const uint8_t adcpre_div[4] = { 2, 4, 6, 8 };
+	uint32_t smp;
+	uint32_t div;
+
+	if (channel < 10) {
+		smp = (ADC_SMPR2(base) >> (channel * 3)) & 0x7;
+	} else {
+		smp = (ADC_SMPR1(base) >> ((channel - 10) * 3)) & 0x7;
+	}
+
+	div = adcpre_div[(RCC_CFGR >> RCC_CFGR_ADCPRE_LSB) & 0x3];
+
+	/* Sample time plus 12.5 ADC clock cycles of conversion time. */
+	*sample = (sim_adc_sample_half_cycles[smp] * div) / 2;
+	return ((sim_adc_sample_half_cycles[smp] + 25) * div) / 2;
+}
+
+static int sim_adc_regular_length(uint32_t base)
+{
+	if ((ADC_CR1(base) & ADC_CR1_SCAN) == 0) {
+		return 1;
+	}
+
+	return ((ADC_SQR1(base) & ADC_SQR1_L_MSK) >> ADC_SQR1_L_LSB) + 1;
+}
+
+static int sim_adc_regular_channel(uint32_t base, int pos)
+{
+	if (pos < 6) {
+		return (ADC_SQR3(base) >> (pos * 5)) & 0x1f;
+	} else if (pos < 12) {
+		return (ADC_SQR2(base) >> ((pos - 6) * 5)) & 0x1f;
+	}
+
+	return (ADC_SQR1(base) >> ((pos - 12) * 5)) & 0x1f;
+}
+
+static int sim_adc_injected_length(uint32_t base)
+{
+	return ((ADC_JSQR(base) & ADC_JSQR_JL_MSK) >> ADC_JSQR_JL_LSB) + 1;
+}
+
+static int sim_adc_injected_channel(uint32_t base, int jpos)
+{
+	/* If JL < 3 the sequence starts at JSQ(4 - JL). */
+	int jsq = 4 - sim_adc_injected_length(base) + jpos;
+
+	return (ADC_JSQR(base) >> (jsq * 5)) & 0x1f;
+}
+
+static bool sim_adc_dual(void)
+{
+	return (ADC_CR1(ADC1) & ADC_CR1_DUALMOD_MASK) != ADC_CR1_DUALMOD_IND;
+}
+
+/**
+ * Sample the input of the current conversion at the end of its sampling
+ * phase, in dual mode the input of ADC2 as well.
+ */
+static void sim_adc_hold(int unit)
+{
+	struct sim_adc *a = &sim_adc[unit];
+	uint32_t base = sim_adc_base(unit);
+	bool dual = (unit == 0) && sim_adc_dual();
+
+	if (a->injected) {
+		a->data[0] = sim_adc_sample(sim_adc_injected_channel(base,
+								     a->jpos));
+		if (dual) {
+			a->data[1] = sim_adc_sample(
+				sim_adc_injected_channel(ADC2, a->jpos));
+		}
+	} else {
+		a->data[0] = sim_adc_sample(sim_adc_regular_channel(base,
+								    a->pos));
+		if (dual) {
+			a->data[1] = sim_adc_sample(
+				sim_adc_regular_channel(ADC2, a->pos));
+		}
+	}
+
+	a->held = true;
+}
+
+static void sim_adc_complete_regular(int unit)
+{
+	struct sim_adc *a = &sim_adc[unit];
+	uint32_t base = sim_adc_base(unit);
+	uint32_t value;
+	uint32_t slave;
+
+	value = a->data[0];
+
+	/* In dual mode ADC2 converts its sequence simultaneously and the
+	 * result shows up in the upper half of ADC1_DR.
+	 */
+	if (unit == 0 && sim_adc_dual()) {
+		slave = a->data[1];
+		ADC_DR(ADC2) = slave;
+		ADC_SR(ADC2) |= ADC_SR_EOC | ADC_SR_STRT;
+		value |= slave << 16;
+	}
+
+	ADC_DR(base) = value;
+	ADC_SR(base) |= ADC_SR_EOC | ADC_SR_STRT;
+
+	/* DMA reads the data register and with that clears EOC. */
+	if (unit == 0 && (ADC_CR2(base) & ADC_CR2_DMA) != 0 &&
+	    sim_dma_write(DMA_CHANNEL1, value)) {
+		ADC_SR(base) &= ~ADC_SR_EOC;
+	}
+
+	a->pos++;
+	if (a->pos >= sim_adc_regular_length(base)) {
+		a->pos = 0;
+		if ((ADC_CR2(base) & ADC_CR2_CONT) == 0) {
+			a->reg_active = false;
+		}
+	}
+}
+
+static void sim_adc_complete_injected(int unit)
+{
+	struct sim_adc *a = &sim_adc[unit];
+	uint32_t base = sim_adc_base(unit);
+	bool dual = (unit == 0) && sim_adc_dual();
+
+	MMIO32(base + ADC_INJECTED_REGISTER_1 + (a->jpos * 4)) = a->data[0];
+	if (dual) {
+		MMIO32(ADC2 + ADC_INJECTED_REGISTER_1 + (a->jpos * 4)) =
+			a->data[1];
+	}
+
+	a->jpos++;
+	if (a->jpos >= sim_adc_injected_length(base)) {
+		a->jpos = 0;
+		a->inj_active = false;
+		ADC_SR(base) |= ADC_SR_JEOC | ADC_SR_JSTRT;
+		if (dual) {
+			ADC_SR(ADC2) |= ADC_SR_JEOC | ADC_SR_JSTRT;
+		}
+	}
+}
+
+/* External trigger of the regular sequence in the last step. */
+static bool sim_adc_regular_trigger(uint32_t cr2)
+{
+	if ((cr2 & ADC_CR2_EXTTRIG) == 0) {
+		return false;
+	}
+
+	switch (cr2 & ADC_CR2_EXTSEL_MASK) {
+	case ADC_CR2_EXTSEL_TIM1_CC1:
+		return (sim_tim1.events & SIM_TIM_EV_CC(0)) != 0;
+	case ADC_CR2_EXTSEL_TIM1_CC2:
+		return (sim_tim1.events & SIM_TIM_EV_CC(1)) != 0;
+	case ADC_CR2_EXTSEL_TIM1_CC3:
+		return (sim_tim1.events & SIM_TIM_EV_CC(2)) != 0;
+	case ADC_CR2_EXTSEL_TIM2_CC2:
+		return (sim_tim2.events & SIM_TIM_EV_CC(1)) != 0;
+	default:
+		return false;
+	}
+}
+
+/* External trigger of the injected sequence in the last step. */
+static bool sim_adc_injected_trigger(uint32_t cr2)
+{
+	if ((cr2 & ADC_CR2_JEXTTRIG) == 0) {
+		return false;
+	}
+
+	switch (cr2 & ADC_CR2_JEXTSEL_MASK) {
+	case ADC_CR2_JEXTSEL_TIM1_TRGO:
+		return sim_timer_trgo(&sim_tim1);
+	case ADC_CR2_JEXTSEL_TIM1_CC4:
+		return (sim_tim1.events & SIM_TIM_EV_CC(3)) != 0;
+	case ADC_CR2_JEXTSEL_TIM2_TRGO:
+		return sim_timer_trgo(&sim_tim2);
+	case ADC_CR2_JEXTSEL_TIM2_CC1:
+		return (sim_tim2.events & SIM_TIM_EV_CC(0)) != 0;
+	default:
+		return false;
+	}
+}
+
+static void sim_adc_unit_step(int unit, uint32_t cycles)
+{
+	struct sim_adc *a = &sim_adc[unit];
+	uint32_t base = sim_adc_base(unit);
+	uint32_t cr2 = ADC_CR2(base);
+	int channel;
+
+	if ((cr2 & ADC_CR2_ADON) == 0) {
+		a->reg_active = false;
+		a->inj_active = false;
+		a->budget = 0;
+		a->conv = 0;
+		return;
+	}
+
+	/* Triggers that arrive while a sequence converts are lost. */
+	if ((cr2 & ADC_CR2_SWSTART) != 0 || sim_adc_regular_trigger(cr2)) {
+		ADC_CR2(base) &= ~ADC_CR2_SWSTART;
+		if (!a->reg_active) {
+			a->reg_active = true;
+			a->pos = 0;
+		}
+	}
+
+	if ((cr2 & ADC_CR2_JSWSTART) != 0 || sim_adc_injected_trigger(cr2)) {
+		ADC_CR2(base) &= ~ADC_CR2_JSWSTART;
+		if (!a->inj_active) {
+			a->inj_active = true;
+			a->jpos = 0;
+			a->conv = 0;
+		}
+	}
+
+	if (!a->reg_active && !a->inj_active) {
+		a->budget = 0;
+		a->conv = 0;
+		return;
+	}
+
+	a->budget += cycles;
+
+	/* Injected conversions take priority over the regular sequence. The
+	 * conversion length is only looked up once per conversion. The input
+	 * is sampled at the end of the sampling phase, not when the result
+	 * is ready.
+	 */
+	while (a->reg_active || a->inj_active) {
+		if (a->conv == 0) {
+			a->injected = a->inj_active;
+			if (a->injected) {
+				channel = sim_adc_injected_channel(base,
+								   a->jpos);
+			} else {
+				channel = sim_adc_regular_channel(base, a->pos);
+			}
+			a->conv = sim_adc_conversion_cycles(base, channel,
+							    &a->sample);
+			a->held = false;
+		}
+
+		if (!a->held) {
+			if (a->budget < a->sample) {
+				break;
+			}
+			sim_adc_hold(unit);
+		}
+
+		if (a->budget < a->conv) {
+			break;
+		}
+		a->budget -= a->conv;
+		a->conv = 0;
+
+		if (a->injected) {
+			sim_adc_complete_injected(unit);
+		} else {
+			sim_adc_complete_regular(unit);
+		}
+	}
+}
+
+static void sim_adc_step(uint32_t cycles)
+{
+	sim_adc_unit_step(0, cycles);
+
+	/* In dual mode ADC2 is slaved to ADC1. */
+	if (!sim_adc_dual()) {
+		sim_adc_unit_step(1, cycles);
+	}
+}
+
+/* -- USART1 --------------------------------------------------------------- */
+
+static void sim_usart_tx_load(void)
+{
+	sim_usart.tx_byte = sim_usart.tdr;
+	sim_usart.tdr_full = false;
+	sim_usart.tx_busy = true;
+	USART_SR(USART1) |= USART_SR_TXE;
+	USART_SR(USART1) &= ~USART_SR_TC;
+}
+
+static void sim_usart_step(uint32_t cycles)
+{
+	uint32_t cr1 = USART_CR1(USART1);
+	uint32_t frame = 10 * (USART_BRR(USART1) & 0xffff);
+	uint32_t value;
+	uint8_t byte;
+
+	if ((cr1 & USART_CR1_UE) == 0 || frame == 0) {
+		return;
+	}
+
+	/* The data register model is shared by both directions, take a byte
+	 * written for sending out before a received one overwrites it.
+	 */
+	if ((USART_SR(USART1) & USART_SR_TXE) == 0 && !sim_usart.tdr_full) {
+		sim_usart.tdr = (uint8_t)USART_DR(USART1);
+		sim_usart.tdr_full = true;
+	}
+
+	/* Receiver */
+	if ((cr1 & USART_CR1_RE) != 0) {
+		if (sim_usart.rx_head != sim_usart.rx_tail) {
+			sim_usart.rx_budget += cycles;
+			if (sim_usart.rx_budget >= frame) {
+				sim_usart.rx_budget -= frame;
+				byte = sim_usart.rx_fifo[sim_usart.rx_tail];
+				sim_usart.rx_tail = (sim_usart.rx_tail + 1) %
+						    SIM_USART_RX_FIFO_SIZE;
+				sim_usart.rx_idle_pending = true;
+
+				if ((USART_SR(USART1) & USART_SR_RXNE) != 0) {
+					USART_SR(USART1) |= USART_SR_ORE;
+				} else {
+					USART_DR(USART1) = byte;
+					USART_SR(USART1) |= USART_SR_RXNE;
+				}
+
+				if ((USART_CR3(USART1) & USART_CR3_DMAR) &&
+				    sim_dma_write(DMA_CHANNEL5, byte)) {
+					USART_SR(USART1) &= ~USART_SR_RXNE;
+				}
+			}
+		} else if (sim_usart.rx_idle_pending) {
+			sim_usart.rx_budget += cycles;
+			if (sim_usart.rx_budget >= frame) {
+				USART_SR(USART1) |= USART_SR_IDLE;
+				sim_usart.rx_idle_pending = false;
+				sim_usart.rx_budget = 0;
+			}
+		} else {
+			sim_usart.rx_budget = 0;
+		}
+	}
+
+	/* Transmitter */
+	if ((cr1 & USART_CR1_TE) == 0) {
+		return;
+	}
+
+	if ((USART_CR3(USART1) & USART_CR3_DMAT) != 0 &&
+	    (USART_SR(USART1) & USART_SR_TXE) != 0 &&
+	    sim_dma_read(DMA_CHANNEL4, &value)) {
+		sim_usart.tdr = (uint8_t)value;
+		sim_usart.tdr_full = true;
+		USART_SR(USART1) &= ~USART_SR_TXE;
+	}
+
+	if (!sim_usart.tx_busy && sim_usart.tdr_full) {
+		sim_usart_tx_load();
+	}
+
+	if (sim_usart.tx_busy) {
+		sim_usart.tx_budget += cycles;
+		if (sim_usart.tx_budget >= frame) {
+			sim_usart.tx_budget -= frame;
+			sim_usart.tx_busy = false;
+			if (sim_usart.tx_callback) {
+				sim_usart.tx_callback(sim_usart.tx_byte);
+			}
+			if (sim_usart.tdr_full) {
+				sim_usart_tx_load();
+			} else {
+				USART_SR(USART1) |= USART_SR_TC;
+				sim_usart.tx_budget = 0;
+			}
+		}
+	}
+}
+
+/* -- NVIC ----------------------------------------------------------------- */
+
+static bool sim_irq_raised(int irqn)
+{
+	uint32_t flags;
+	uint32_t cr1;
+	int ch;
+
+	switch (irqn) {
+	case NVIC_DMA1_CHANNEL1_IRQ:
+	case NVIC_DMA1_CHANNEL2_IRQ:
+	case NVIC_DMA1_CHANNEL3_IRQ:
+	case NVIC_DMA1_CHANNEL4_IRQ:
+	case NVIC_DMA1_CHANNEL5_IRQ:
+	case NVIC_DMA1_CHANNEL6_IRQ:
+	case NVIC_DMA1_CHANNEL7_IRQ:
+		ch = irqn - NVIC_DMA1_CHANNEL1_IRQ + DMA_CHANNEL1;
+		flags = (DMA_ISR(DMA1) >> DMA_FLAG_OFFSET(ch)) & DMA_FLAGS;
+		/* TCIE/HTIE/TEIE share the bit positions of the flags. */
+		return (flags & DMA_CCR(DMA1, ch) &
+			(DMA_TCIF | DMA_HTIF | DMA_TEIF)) != 0;
+	case NVIC_ADC1_2_IRQ:
+		for (ch = 0; ch < 2; ch++) {
+			flags = ADC_SR(sim_adc_base(ch));
+			cr1 = ADC_CR1(sim_adc_base(ch));
+			if (((flags & ADC_SR_EOC) && (cr1 & ADC_CR1_EOCIE)) ||
+			    ((flags & ADC_SR_JEOC) &&
+			     (cr1 & ADC_CR1_JEOCIE))) {
+				return true;
+			}
+		}
+		return false;
+	case NVIC_TIM1_UP_IRQ:
+		return (TIM_SR(TIM1) & TIM_DIER(TIM1) & TIM_SR_UIF) != 0;
+	case NVIC_TIM1_TRG_COM_IRQ:
+		return (TIM_SR(TIM1) & TIM_DIER(TIM1) &
+			(TIM_SR_COMIF | TIM_SR_TIF)) != 0;
+	case NVIC_TIM1_CC_IRQ:
+		return (TIM_SR(TIM1) & TIM_DIER(TIM1) &
+			(TIM_SR_CC1IF | TIM_SR_CC2IF |
+			 TIM_SR_CC3IF | TIM_SR_CC4IF)) != 0;
+	case NVIC_TIM2_IRQ:
+		return (TIM_SR(TIM2) & TIM_DIER(TIM2) &
+			(TIM_SR_UIF | TIM_SR_CC1IF | TIM_SR_CC2IF |
+			 TIM_SR_CC3IF | TIM_SR_CC4IF | TIM_SR_TIF)) != 0;
+	case NVIC_USART1_IRQ:
+		flags = USART_SR(USART1);
+		cr1 = USART_CR1(USART1);
+		return ((flags & (USART_SR_RXNE | USART_SR_ORE)) &&
+			(cr1 & USART_CR1_RXNEIE)) ||
+		       ((flags & USART_SR_TXE) && (cr1 & USART_CR1_TXEIE)) ||
+		       ((flags & USART_SR_TC) && (cr1 & USART_CR1_TCIE)) ||
+		       ((flags & USART_SR_IDLE) && (cr1 & USART_CR1_IDLEIE));
+	default:
+		return false;
+	}
+}
+
+/**
+ * Call the pending and enabled interrupt handlers in priority order. Every
+ * interrupt is serviced at most once per quantum, so a handler that does not
+ * clear its flag does not lock up the simulation.
+ *
+ * @return true if a handler was called.
+ */
+static bool sim_dispatch(void)
+{
+	bool served[SIM_IRQ_TABLE_SIZE];
+	uint32_t enabled[3], pending[3];
+	unsigned int i;
+	int best;
+	uint8_t irqn, prio, best_prio;
+	bool called = false;
+
+	if (sim_systick_pending) {
+		sim_systick_pending = false;
+		sim_call_isr(SIM_ISR_SYSTICK, "sys_tick_handler",
+			     sys_tick_handler);
+		called = true;
+	}
+
+	memset(served, 0, sizeof(served));
+
+	while (true) {
+		best = -1;
+		best_prio = 0xff;
+
+		/* Handlers may change the NVIC state, so take a snapshot of
+		 * the enable and pending words once per pass instead of once
+		 * per interrupt line.
+		 */
+		for (i = 0; i < 3; i++) {
+			enabled[i] = NVIC_ISER(i);
+			pending[i] = NVIC_ISPR(i);
+		}
+
+		for (i = 0; i < SIM_IRQ_TABLE_SIZE; i++) {
+			irqn = sim_irq_table[i].irqn;
+			if (served[i] ||
+			    (enabled[irqn / 32] & (1 << (irqn % 32))) == 0) {
+				continue;
+			}
+			if ((pending[irqn / 32] & (1 << (irqn % 32))) == 0 &&
+			    !sim_irq_raised(irqn)) {
+				continue;
+			}
+			prio = nvic_get_priority(irqn);
+			if (best < 0 || prio < best_prio) {
+				best = (int)i;
+				best_prio = prio;
+			}
+		}
+
+		if (best < 0) {
+			break;
+		}
+
+		served[best] = true;
+		nvic_clear_pending_irq(sim_irq_table[best].irqn);
+		sim_call_isr(sim_irq_table[best].irqn,
+			     sim_irq_table[best].name,
+			     sim_irq_table[best].isr);
+		called = true;
+	}
+
+	return called;
+}
+
+/**
+ * Advance all peripheral models and the plant by one quantum or less.
+ */
+static void sim_step(uint32_t step)
+{
+	sim_status_sync();
+	sim_dma_sync();
+	sim_timer_step(&sim_tim1, step);
+	sim_timer_step(&sim_tim2, step);
+	if (sim_step_callback != NULL) {
+		sim_step_callback(step);
+	}
+	sim_systick_step(step);
+	sim_adc_step(step);
+	sim_usart_step(step);
+	sim_status_latch();
+
+	sim_cycles += step;
+}
+
+/* -- Public API ----------------------------------------------------------- */
+
+/**
+ * Reset the register file, all peripheral models and the statistics.
+ */
+void sim_init(void)
+{
+	uint64_t start;
+	size_t i;
+
+	for (i = 0; i < SIM_PERIPH_SIZE / 4; i++) {
+		sim_periph_regs[i] = 0;
+	}
+	for (i = 0; i < SIM_PPB_SIZE / 4; i++) {
+		sim_ppb_regs[i] = 0;
+	}
+	sim_primask = 0;
+
+	sim_cycles = 0;
+	sim_sleep_cycles = 0;
+	sim_sysclk = 8000000; /* HSI after reset */
+	sim_systick_pending = false;
+	sim_systick_prescaler = 0;
+
+	sim_tim1.base = TIM1;
+	sim_tim1.advanced = true;
+	sim_timer_reset(&sim_tim1);
+	sim_tim2.base = TIM2;
+	sim_tim2.advanced = false;
+	sim_timer_reset(&sim_tim2);
+
+	memset(sim_adc, 0, sizeof(sim_adc));
+	memset(sim_dma, 0, sizeof(sim_dma));
+	memset(&sim_usart, 0, sizeof(sim_usart));
+	USART_SR(USART1) = USART_SR_TXE | USART_SR_TC;
+	sim_status_latch();
+
+	memset(sim_adc_input, 0, sizeof(sim_adc_input));
+	sim_adc_sample_callback = NULL;
+	sim_step_callback = NULL;
+
+	/* Cortex-M3 exception entry and return, a register access with the
+	 * APB bridge and the code around it, two flash wait states above
+	 * 48MHz. The host run time is left out, it is too noisy to compare
+	 * handlers by default.
+	 */
+	sim_cycle_model.exception = 24;
+	sim_cycle_model.mmio = 6;
+	sim_cycle_model.flash_wait = 2;
+	sim_cycle_model.host_ns = 0.0;
+	sim_isr_cycles = 0;
+	sim_isr_running = false;
+	sim_clock_ns = UINT64_MAX;
+	for (i = 0; i < 16; i++) {
+		start = sim_now_ns();
+		sim_clock_ns = sim_min64(sim_clock_ns, sim_now_ns() - start);
+	}
+
+	sim_reset_isr_stats();
+}
+
+/**
+ * Called by the peripheral reset functions of the host libopencm3 backend.
+ */
+void sim_peripheral_reset(uint32_t base)
+{
+	uint32_t i;
+
+	for (i = 0; i < 0x400; i += 4) {
+		MMIO32(base + i) = 0;
+	}
+
+	if (base == TIM1) {
+		sim_timer_reset(&sim_tim1);
+	} else if (base == TIM2) {
+		sim_timer_reset(&sim_tim2);
+	} else if (base == ADC1) {
+		memset(&sim_adc[0], 0, sizeof(sim_adc[0]));
+	} else if (base == ADC2) {
+		memset(&sim_adc[1], 0, sizeof(sim_adc[1]));
+	} else if (base == USART1) {
+		sim_usart.rx_head = sim_usart.rx_tail = 0;
+		sim_usart.tx_busy = false;
+		sim_usart.tdr_full = false;
+		USART_SR(USART1) = USART_SR_TXE | USART_SR_TC;
+	}
+	sim_status_latch();
+}
+
+/**
+ * Advance the simulation.
+ *
+ * @param cycles Number of core clock cycles to simulate.
+ */
+void sim_run(uint64_t cycles)
+{
+	uint32_t step;
+
+	while (cycles != 0) {
+		step = (cycles < SIM_QUANTUM) ? (uint32_t)cycles : SIM_QUANTUM;
+
+		sim_step(step);
+		cycles -= step;
+
+		sim_dispatch();
+	}
+}
+
+/**
+ * Advance the peripherals without dispatching interrupts, as if the core
+ * was busy. Called from an interrupt handler it models a handler that runs
+ * for the given time, the interrupts raised meanwhile are served after the
+ * handler returned.
+ *
+ * @param cycles Number of core clock cycles to stall.
+ */
+void sim_stall(uint64_t cycles)
+{
+	uint32_t step;
+
+	while (cycles != 0) {
+		step = (cycles < SIM_QUANTUM) ? (uint32_t)cycles : SIM_QUANTUM;
+
+		sim_step(step);
+		cycles -= step;
+	}
+}
+
+/**
+ * Advance the simulation until an interrupt handler ran, like the core
+ * sleeping in WFI. The time slept is added to the sleep statistics.
+ *
+ * Only to be called from outside of the interrupt handlers.
+ */
+void sim_wait_for_interrupt(void)
+{
+	uint64_t start = sim_cycles;
+
+	do {
+		sim_step(SIM_QUANTUM);
+	} while (!sim_dispatch());
+
+	sim_sleep_cycles += sim_cycles - start;
+}
+
+/**
+ * Get the core clock cycles spent in sim_wait_for_interrupt() since the
+ * statistics were reset.
+ */
+uint64_t sim_get_sleep_cycles(void)
+{
+	return sim_sleep_cycles;
+}
+
+/**
+ * Register a function that is called every simulation quantum after the
+ * timers advanced and before the ADC samples its inputs. Used to attach
+ * plant models to the simulated outputs.
+ *
+ * @param callback Function to call or NULL to detach.
+ */
+void sim_set_step_callback(sim_step_callback_t callback)
+{
+	sim_step_callback = callback;
+}
+
+/**
+ * Get the output pin levels of a timer.
+ *
+ * @param timer TIM1 or TIM2.
+ *
+ * @return Bit mask with bit (1 << TIM_OCx) set if the pin is driven high.
+ */
+uint32_t sim_timer_get_outputs(uint32_t timer)
+{
+	struct sim_timer *t = (timer == TIM1) ? &sim_tim1 : &sim_tim2;
+	uint32_t cnt = TIM_CNT(t->base) & 0xffff;
+	uint32_t bdtr = TIM_BDTR(t->base);
+	uint32_t ccer, p, np, out = 0;
+	bool ref, e, ne;
+	int i;
+
+	if (t->advanced && (bdtr & TIM_BDTR_MOE) == 0) {
+		return 0;
+	}
+
+	for (i = 0; i < 4; i++) {
+		ccer = t->ccer >> (i * 4);
+		e = (ccer & TIM_CCER_CC1E) != 0;
+		ne = t->advanced && i < 3 && (ccer & TIM_CCER_CC1NE) != 0;
+		p = (ccer & TIM_CCER_CC1P) ? 1 : 0;
+		np = (ccer & TIM_CCER_CC1NP) ? 1 : 0;
+		ref = sim_timer_oc_ref(t, i, cnt);
+
+		if (!e && !ne) {
+			continue;
+		}
+
+		/* With OSSR set a disabled output of an enabled pair is
+		 * driven to its inactive level.
+		 */
+		if (e) {
+			out |= ((ref ? 1 : 0) ^ p) << (i * 2);
+		} else if (bdtr & TIM_BDTR_OSSR) {
+			out |= p << (i * 2);
+		}
+		if (ne) {
+			out |= ((e ? !ref : ref) ^ np) << (i * 2 + 1);
+		} else if (t->advanced && i < 3 && (bdtr & TIM_BDTR_OSSR)) {
+			out |= np << (i * 2 + 1);
+		}
+	}
+
+	return out;
+}
+
+/**
+ * Set the cycle cost model of the interrupt service routines.
+ */
+void sim_set_cycle_model(const struct sim_cycle_model *model)
+{
+	sim_cycle_model = *model;
+}
+
+/**
+ * Get the cycle cost model of the interrupt service routines.
+ */
+const struct sim_cycle_model *sim_get_cycle_model(void)
+{
+	return &sim_cycle_model;
+}
+
+/**
+ * Get the modeled core clock cycles of all interrupt service routines run
+ * since the statistics were reset.
+ */
+uint64_t sim_get_isr_cycles(void)
+{
+	return sim_isr_cycles - sim_isr_stats_cycles;
+}
+
+/**
+ * Update the DWT cycle counter, called when the drivers read it. It counts
+ * the simulated time and the modeled cycles of the interrupt service
+ * routines, in a routine up to the read, if DEMCR.TRCENA and
+ * DWT_CTRL.CYCCNTENA are set.
+ */
+void sim_dwt_update(void)
+{
+	uint64_t cycles = sim_cycles + sim_isr_cycles;
+
+	if ((SCS_DEMCR & SCS_DEMCR_TRCENA) == 0 ||
+	    (SCS_DWT_CTRL & SCS_DWT_CTRL_CYCCNTENA) == 0) {
+		return;
+	}
+
+	if (sim_isr_running) {
+		cycles += (sim_exception_cycles() / 2) +
+			  sim_model_cycles(sim_now_ns() - sim_isr_start_ns,
+					   sim_mmio_accesses -
+					   sim_isr_start_mmio);
+	}
+
+	SCS_DWT_CYCCNT = (uint32_t)cycles;
+}
+
+/**
+ * Get the simulated time in core clock cycles.
+ */
+uint64_t sim_get_cycles(void)
+{
+	return sim_cycles;
+}
+
+/**
+ * Get the simulated core clock frequency.
+ */
+uint32_t sim_get_sysclk(void)
+{
+	return sim_sysclk;
+}
+
+/**
+ * Set the simulated core clock frequency, called by the rcc clock setup.
+ */
+void sim_set_sysclk(uint32_t sysclk)
+{
+	sim_sysclk = sysclk;
+}
+
+/**
+ * Set a constant input voltage on an ADC channel.
+ *
+ * @param channel ADC input channel.
+ * @param value 12bit value the conversion should return.
+ */
+void sim_set_adc_input(int channel, uint16_t value)
+{
+	sim_adc_input[channel] = value;
+}
+
+/**
+ * Install a callback that provides the ADC conversion results.
+ */
+void sim_set_adc_sample_callback(sim_adc_sample_callback_t callback)
+{
+	sim_adc_sample_callback = callback;
+}
+
+/**
+ * Queue bytes on the USART1 RX line. They arrive at the configured baud rate.
+ *
+ * @return Number of bytes queued, less than len if the queue is full.
+ */
+size_t sim_usart_receive(const uint8_t *data, size_t len)
+{
+	size_t next;
+	size_t count = 0;
+
+	while (len-- != 0) {
+		next = (sim_usart.rx_head + 1) % SIM_USART_RX_FIFO_SIZE;
+		if (next == sim_usart.rx_tail) {
+			break;
+		}
+		sim_usart.rx_fifo[sim_usart.rx_head] = *data++;
+		sim_usart.rx_head = next;
+		count++;
+	}
+
+	return count;
+}
+
+/**
+ * Install a callback receiving every byte sent out on USART1 TX.
+ */
+void sim_set_usart_tx_callback(sim_usart_tx_callback_t callback)
+{
+	sim_usart.tx_callback = callback;
+}
+
+/**
+ * Check that USART1 has no byte shifting out or waiting for the shift
+ * register.
+ */
+bool sim_usart_tx_idle(void)
+{
+	return !sim_usart.tx_busy && !sim_usart.tdr_full;
+}
+
+/**
+ * Get the execution statistics of one interrupt service routine.
+ *
+ * @param slot NVIC interrupt number or SIM_ISR_SYSTICK.
+ */
+const struct sim_isr_stats *sim_get_isr_stats(int slot)
+{
+	return &sim_isr_stats[slot];
+}
+
+/**
+ * Clear all interrupt execution statistics.
+ */
+void sim_reset_isr_stats(void)
+{
+	sim_stats_start = sim_cycles;
+	sim_isr_stats_cycles = sim_isr_cycles;
+	sim_sleep_cycles = 0;
+	memset(sim_isr_stats, 0, sizeof(sim_isr_stats));
+}
+
+/**
+ * Print the interrupt execution statistics.
+ */
+void sim_report(FILE *out)
+{
+	const struct sim_isr_stats *s;
+	uint64_t cycles = sim_cycles - sim_stats_start;
+	double seconds = (double)cycles / (double)sim_sysclk;
+	int i;
+
+	fprintf(out, "simulated %.3fs (%llu cycles @ %luHz)\n", seconds,
+		(unsigned long long)cycles, (unsigned long)sim_sysclk);
+	if (sim_sleep_cycles != 0) {
+		fprintf(out, "asleep in wfi %.1f%%\n",
+			100.0 * (double)sim_sleep_cycles / (double)cycles);
+	}
+	fprintf(out, "interrupts %.1f%% of the cycles (cycle model)\n",
+		100.0 * (double)sim_get_isr_cycles() /
+		(double)(cycles + sim_get_isr_cycles()));
+	fprintf(out, "vector table in %s, %u flash wait states (cycle model)\n",
+		sim_vectors_in_flash() ? "flash" : "sram",
+		(unsigned)sim_cycle_model.flash_wait);
+	fprintf(out, "%-20s %10s %10s %9s %9s %9s %7s %7s %5s\n", "isr",
+		"count", "rate[Hz]", "min[ns]", "mean[ns]", "max[ns]", "mmio",
+		"cycles", "from");
+
+	for (i = 0; i < SIM_ISR_SLOTS; i++) {
+		s = &sim_isr_stats[i];
+		if (s->count == 0) {
+			continue;
+		}
+		fprintf(out, "%-20s %10llu %10.0f %9llu %9llu %9llu %7.1f "
+			"%7llu %5s\n",
+			s->name, (unsigned long long)s->count,
+			(double)s->count / seconds,
+			(unsigned long long)s->ns_min,
+			(unsigned long long)(s->ns_total / s->count),
+			(unsigned long long)s->ns_max,
+			(double)s->mmio / (double)s->count,
+			(unsigned long long)(s->cycles_total / s->count),
+			s->ram ? "sram" : "flash");
+	}
+}
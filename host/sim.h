@@ -0,0 +1,128 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SIM_H
+#define __SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * Simulation time quantum in core clock cycles. All peripheral models are
+ * advanced in steps of this size and interrupts are dispatched in between.
+ * 16 cycles is one TIM2 tick (0.25us) at 64MHz.
+ */
+#define SIM_QUANTUM 16
+
+/**
+ * Number of interrupt statistic slots. The first NVIC_IRQ_COUNT slots are the
+ * NVIC interrupts, the last one is the SysTick exception.
+ */
+#define SIM_ISR_SLOTS (68 + 1)
+#define SIM_ISR_SYSTICK 68
+
+/**
+ * Per interrupt service routine execution statistics.
+ */
+struct sim_isr_stats {
+	const char *name; /**< ISR symbol name */
+	uint64_t count; /**< Number of invocations */
+	uint64_t mmio; /**< Register accesses done inside the ISR */
+	uint64_t ns_total; /**< Host time spent in the ISR */
+	uint64_t ns_min; /**< Fastest invocation */
+	uint64_t ns_max; /**< Slowest invocation */
+	uint64_t cycles_total; /**< Core clock cycles of the cycle model */
+	uint64_t cycles_min;
+	uint64_t cycles_max;
+	bool ram; /**< Handler runs from SRAM (-DRAMFUNC) */
+};
+
+/**
+ * Cycle cost model of the interrupt service routines.
+ *
+ * The handlers run in zero simulated time, the model estimates what they
+ * would take on the target from what they did on the host. By default it
+ * only counts the register accesses, which makes it deterministic, host_ns
+ * adds the host run time for handlers that mostly compute. The DWT cycle
+ * counter runs on by the estimate while a handler executes, so code that
+ * profiles itself with it sees the same figures as the statistics here.
+ *
+ * Handlers run from flash pay the flash wait states on the literal pool
+ * load of the register address that comes with every register access, and
+ * the exception entry pays them on the vector fetch while the vector table
+ * is in flash.
+ */
+struct sim_cycle_model {
+	uint32_t exception; /**< Exception entry and return */
+	uint32_t mmio; /**< Per peripheral register access */
+	uint32_t flash_wait; /**< Flash wait states per flash access */
+	double host_ns; /**< Per ns of host run time */
+};
+
+/**
+ * ADC sample source callback.
+ *
+ * @param channel ADC input channel that is being converted.
+ *
+ * @return 12bit conversion result.
+ */
+typedef uint16_t (*sim_adc_sample_callback_t)(int channel);
+
+/**
+ * USART transmit sink callback, called once per byte on the wire.
+ */
+typedef void (*sim_usart_tx_callback_t)(uint8_t byte);
+
+/**
+ * Plant model callback, called once per simulation quantum.
+ *
+ * @param cycles Core clock cycles that elapsed since the last call.
+ */
+typedef void (*sim_step_callback_t)(uint32_t cycles);
+
+void sim_init(void);
+void sim_run(uint64_t cycles);
+void sim_stall(uint64_t cycles);
+void sim_wait_for_interrupt(void);
+uint64_t sim_get_sleep_cycles(void);
+uint64_t sim_get_cycles(void);
+uint32_t sim_get_sysclk(void);
+void sim_set_sysclk(uint32_t sysclk);
+void sim_peripheral_reset(uint32_t base);
+void sim_set_step_callback(sim_step_callback_t callback);
+uint32_t sim_timer_get_outputs(uint32_t timer);
+
+void sim_set_adc_input(int channel, uint16_t value);
+void sim_set_adc_sample_callback(sim_adc_sample_callback_t callback);
+
+size_t sim_usart_receive(const uint8_t *data, size_t len);
+void sim_set_usart_tx_callback(sim_usart_tx_callback_t callback);
+bool sim_usart_tx_idle(void);
+
+void sim_set_cycle_model(const struct sim_cycle_model *model);
+const struct sim_cycle_model *sim_get_cycle_model(void);
+uint64_t sim_get_isr_cycles(void);
+void sim_dwt_update(void);
+
+const struct sim_isr_stats *sim_get_isr_stats(int slot);
+void sim_reset_isr_stats(void);
+void sim_report(FILE *out);
+
+#endif /* __SIM_H */
@@ -0,0 +1,229 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   sim_pty.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Pseudo terminal attached to the simulated USART1.
+ *
+ * Everything the simulated USART sends out comes out of the pseudo
+ * terminal and everything written to it goes to the USART receive line,
+ * at the baud rate the firmware set. Host programs open the slave side
+ * like the serial device of a real controller.
+ *
+ * sim_pty_attach() moves the bytes every SIM_PTY_STEP_US of simulated time,
+ * from the simulation step, so it works with any code running the
+ * simulation, also a firmware main loop sleeping in WFI. In real time mode
+ * it sleeps whenever the simulation is ahead of the wall clock, latencies
+ * measured on the host side are then those of the simulated link, plus up to
+ * a step each way. A simulation slower than real time only stretches them,
+ * it does not make up the time in a burst.
+ */
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host/sim.h"
+#include "host/sim_pty.h"
+
+/* Size of the send and receive buffers. */
+#define SIM_PTY_BUF_SIZE 4096
+
+/* Internal state. */
+static struct {
+	int fd;
+	bool realtime;
+	uint32_t step; /**< Core clock cycles between two transfers */
+	uint32_t budget;
+	uint64_t sim_start; /**< Simulated and wall clock time at attach */
+	double wall_start;
+	uint8_t tx_buf[SIM_PTY_BUF_SIZE]; /**< Sent by the USART */
+	size_t tx_len;
+	uint8_t rx_buf[SIM_PTY_BUF_SIZE]; /**< Read from the pty */
+	size_t rx_pos;
+	size_t rx_len;
+} sim_pty;
+
+static void sim_pty_tx(uint8_t byte)
+{
+	if (sim_pty.tx_len < sizeof(sim_pty.tx_buf)) {
+		sim_pty.tx_buf[sim_pty.tx_len++] = byte;
+	}
+}
+
+static double sim_pty_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+/**
+ * Create a pseudo terminal in raw mode.
+ *
+ * @param name Gets the path of the slave side.
+ * @param size Size of name.
+ *
+ * @return File descriptor of the master side, -1 on error.
+ */
+int sim_pty_open(char *name, size_t size)
+{
+	struct termios tio;
+	const char *slave;
+	int fd;
+
+	fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (fd < 0) {
+		return -1;
+	}
+
+	if (grantpt(fd) != 0 || unlockpt(fd) != 0 ||
+	    (slave = ptsname(fd)) == NULL || strlen(slave) >= size) {
+		close(fd);
+		return -1;
+	}
+	strcpy(name, slave);
+
+	/* No line discipline on the way, the bytes go through as they are. */
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		(void)tcsetattr(fd, TCSANOW, &tio);
+	}
+	(void)fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	return fd;
+}
+
+/**
+ * Write out what the USART sent. Waits a little for a slow reader, drops
+ * the bytes when nobody reads, like a wire.
+ */
+static void sim_pty_flush(void)
+{
+	struct pollfd pfd;
+	size_t pos = 0;
+	ssize_t n;
+
+	while (pos < sim_pty.tx_len) {
+		n = write(sim_pty.fd, &sim_pty.tx_buf[pos],
+			  sim_pty.tx_len - pos);
+		if (n > 0) {
+			pos += (size_t)n;
+			continue;
+		}
+
+		pfd.fd = sim_pty.fd;
+		pfd.events = POLLOUT;
+		if (n == 0 || errno != EAGAIN || poll(&pfd, 1, 10) <= 0) {
+			break;
+		}
+	}
+
+	sim_pty.tx_len = 0;
+}
+
+/**
+ * Hand the bytes read from the pty to the USART receive line, as many as
+ * its queue takes.
+ */
+static void sim_pty_receive(void)
+{
+	ssize_t n;
+
+	if (sim_pty.rx_pos == sim_pty.rx_len) {
+		sim_pty.rx_pos = 0;
+		sim_pty.rx_len = 0;
+		n = read(sim_pty.fd, sim_pty.rx_buf, sizeof(sim_pty.rx_buf));
+		if (n > 0) {
+			sim_pty.rx_len = (size_t)n;
+		}
+	}
+
+	sim_pty.rx_pos += sim_usart_receive(&sim_pty.rx_buf[sim_pty.rx_pos],
+					    sim_pty.rx_len - sim_pty.rx_pos);
+}
+
+/**
+ * Sleep until the wall clock caught up with the simulated time. Up to a
+ * step the simulation fell behind, like a sleep that took too long, is made
+ * up, more is not, the link never runs much faster than its line speed.
+ */
+static void sim_pty_pace(void)
+{
+	struct timespec ts;
+	double ahead;
+
+	ahead = ((double)(sim_get_cycles() - sim_pty.sim_start) /
+		 sim_get_sysclk()) - (sim_pty_now() - sim_pty.wall_start);
+	if (ahead < -SIM_PTY_STEP_US / 1e6) {
+		sim_pty.wall_start -= ahead + (SIM_PTY_STEP_US / 1e6);
+	} else if (ahead > 0.0) {
+		ts.tv_sec = (time_t)ahead;
+		ts.tv_nsec = (long)((ahead - (double)ts.tv_sec) * 1e9);
+		(void)nanosleep(&ts, NULL);
+	}
+}
+
+static void sim_pty_step(uint32_t cycles)
+{
+	sim_pty.budget += cycles;
+	if (sim_pty.budget < sim_pty.step) {
+		return;
+	}
+	sim_pty.budget -= sim_pty.step;
+
+	if (sim_pty.realtime) {
+		sim_pty_pace();
+	}
+
+	sim_pty_flush();
+	sim_pty_receive();
+}
+
+/**
+ * Connect the USART to a pty from sim_pty_open(). Takes the simulation step
+ * callback and the USART send callback.
+ *
+ * @param fd Master side of the pty.
+ * @param realtime Keep the simulated time from running ahead of the wall
+ *                 clock.
+ */
+void sim_pty_attach(int fd, bool realtime)
+{
+	memset(&sim_pty, 0, sizeof(sim_pty));
+	sim_pty.fd = fd;
+	sim_pty.realtime = realtime;
+	sim_pty.step = sim_get_sysclk() / 1000000 * SIM_PTY_STEP_US;
+	sim_pty.sim_start = sim_get_cycles();
+	sim_pty.wall_start = sim_pty_now();
+
+	sim_set_usart_tx_callback(sim_pty_tx);
+	sim_set_step_callback(sim_pty_step);
+}
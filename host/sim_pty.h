@@ -0,0 +1,31 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SIM_PTY_H
+#define __SIM_PTY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Simulated time between two byte transfers in us. */
+#define SIM_PTY_STEP_US 100
+
+int sim_pty_open(char *name, size_t size);
+void sim_pty_attach(int fd, bool realtime);
+
+#endif /* __SIM_PTY_H */
@@ -0,0 +1,371 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   bemf.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Sensorless back EMF zero crossing commutation engine.
+ *
+ * The engine watches the floating phase in the ADC DMA half and full
+ * transfer callbacks. A zero crossing is detected when the floating phase
+ * voltage passes the virtual neutral point, the mean of all three phase
+ * voltages. The next commutation is then scheduled 30 degrees later,
+ * half the measured step period, with a one shot TIM2 soft timer.
+ *
+ * As there is no back EMF at standstill the motor is started with an open
+ * loop ramp of forced commutations. The engine switches to closed loop
+ * operation as soon as it saw BEMF_SYNC_STEPS zero crossings in a row.
+ *
+ * Pass bemf_adc_callback() as both callbacks to adc_init().
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "src/bemf.h"
+
+#include "driver/adc.h"
+#include "driver/pwm.h"
+#include "driver/timer.h"
+#include "driver/ramfunc.h"
+
+/* Rotor alignment on the first step, BEMF_ALIGN_STEPS times
+ * BEMF_RAMP_START_TICKS.
+ */
+#define BEMF_ALIGN_STEPS 8
+
+/* Open loop ramp step periods in TIM2 ticks (0.25us). The period shrinks
+ * by 1/2^BEMF_RAMP_SHIFT each step.
+ */
+#define BEMF_RAMP_START_TICKS 40000
+#define BEMF_RAMP_END_TICKS 4000
+#define BEMF_RAMP_SHIFT 5
+
+/* Consecutive zero crossings needed to close the loop. */
+#define BEMF_SYNC_STEPS 6
+
+/* Consecutive samples past the neutral point to accept a zero crossing.
+ * Samples taken in the middle of the active vector are free of switching
+ * noise and come only once per PWM period, one is enough then.
+ */
+#ifdef ADC_PWM_TRIGGER
+#define BEMF_ZC_FILTER 1
+#else
+#define BEMF_ZC_FILTER 2
+#endif
+
+/* Blanking after commutation as fraction of the step period. Skips the
+ * demagnetization spike of the phase that was just switched off.
+ */
+#define BEMF_BLANK_SHIFT 2
+
+/* Consecutive steps without zero crossing before the engine gives up. */
+#define BEMF_MAX_TIMEOUTS 12
+
+/* Phase indices. */
+#define BEMF_U 0
+#define BEMF_V 1
+#define BEMF_W 2
+
+/* Floating phase and back EMF slope in each commutation step. */
+static const struct {
+	uint8_t phase;
+	bool rising;
+} bemf_floating[6] RAMFUNC_DATA = {
+	{ BEMF_U, true },
+	{ BEMF_W, false },
+	{ BEMF_V, true },
+	{ BEMF_U, false },
+	{ BEMF_W, true },
+	{ BEMF_V, false }
+};
+
+/* raw_data slots of the two U, V and W samples in each DMA half. */
+static const uint8_t bemf_slots[2][3][2] RAMFUNC_DATA = {
+	{
+		{ ADC_RAW_A1_UV1, ADC_RAW_A2_UV1 },
+		{ ADC_RAW_A1_VV1, ADC_RAW_A2_VV1 },
+		{ ADC_RAW_A1_WV1, ADC_RAW_A2_WV1 }
+	},
+	{
+		{ ADC_RAW_A1_UV2, ADC_RAW_A2_UV2 },
+		{ ADC_RAW_A1_VV2, ADC_RAW_A2_VV2 },
+		{ ADC_RAW_A1_WV2, ADC_RAW_A2_WV2 }
+	}
+};
+
+/* Internal state. */
+struct bemf_state {
+	volatile enum bemf_mode mode;
+	volatile int step; /**< Step the pwm driver is in */
+	/* Extended TIM2 times, the counter wraps within a slow step. */
+	volatile uint32_t comm_time; /**< TIM2 time of the last commutation */
+	volatile uint32_t zc_time; /**< TIM2 time of the last zero crossing */
+	volatile uint16_t period; /**< Filtered step period in TIM2 ticks */
+	volatile bool armed; /**< Waiting for the zero crossing of this step */
+	volatile int filter; /**< Samples seen past the neutral point */
+	volatile int sync; /**< Consecutive zero crossings during the ramp */
+	volatile int misses; /**< Consecutive steps without zero crossing */
+	volatile int align; /**< Remaining alignment periods */
+	volatile uint32_t zero_crossings;
+	volatile uint32_t timeouts;
+} bemf_state;
+
+static void bemf_comm_callback(int timer_id, uint16_t time);
+
+/**
+ * Extend a TIM2 counter stamp from the recent past to the 32bit time.
+ */
+static inline uint32_t bemf_extend(uint16_t time)
+{
+	uint32_t now = timer_get_time();
+
+	return now - (uint16_t)((uint16_t)now - time);
+}
+
+/**
+ * Switch the driver to the next step and arm the zero crossing detection.
+ */
+static RAMFUNC_CODE void bemf_commutate(uint32_t now)
+{
+	pwm_comm();
+
+	/* A ramp step without zero crossing breaks the synchronization. */
+	if (bemf_state.armed) {
+		bemf_state.sync = 0;
+	}
+
+	bemf_state.step = (bemf_state.step == 5) ? 0 : bemf_state.step + 1;
+	bemf_state.comm_time = now;
+	bemf_state.armed = true;
+	bemf_state.filter = 0;
+}
+
+/**
+ * Schedule the next commutation, commutate right away if it is due.
+ */
+static RAMFUNC_CODE void bemf_schedule(uint16_t delay)
+{
+	if (delay < 4 ||
+	    timer_register(delay, bemf_comm_callback, true) < 0) {
+		bemf_commutate(timer_get_time());
+	}
+}
+
+static RAMFUNC_CODE void bemf_comm_callback(int timer_id,
+					     uint16_t time)
+{
+	(void)timer_id;
+
+	if (bemf_state.mode == BEMF_STOPPED) {
+		return;
+	}
+
+	if (bemf_state.align > 0) {
+		bemf_state.align--;
+		bemf_schedule(bemf_state.period);
+		return;
+	}
+
+	bemf_commutate(bemf_extend(time));
+
+	if (bemf_state.mode == BEMF_RAMP) {
+		if (bemf_state.sync >= BEMF_SYNC_STEPS &&
+		    bemf_state.period <= BEMF_RAMP_END_TICKS) {
+			/* Close the loop, the next commutation is scheduled
+			 * by the zero crossing of this step.
+			 */
+			bemf_state.mode = BEMF_RUN;
+			bemf_state.misses = 0;
+			return;
+		}
+		if (bemf_state.period > BEMF_RAMP_END_TICKS) {
+			bemf_state.period -= bemf_state.period >>
+				BEMF_RAMP_SHIFT;
+		}
+		bemf_schedule(bemf_state.period);
+	}
+}
+
+/**
+ * Initialize the internal state.
+ */
+void bemf_init(void)
+{
+	bemf_state.mode = BEMF_STOPPED;
+	bemf_state.step = 0;
+	bemf_state.comm_time = 0;
+	bemf_state.zc_time = 0;
+	bemf_state.period = BEMF_RAMP_START_TICKS;
+	bemf_state.armed = false;
+	bemf_state.filter = 0;
+	bemf_state.sync = 0;
+	bemf_state.misses = 0;
+	bemf_state.align = 0;
+	bemf_state.zero_crossings = 0;
+	bemf_state.timeouts = 0;
+}
+
+/**
+ * Start the motor with the open loop ramp.
+ *
+ * The pwm driver has to be in its initial state and the duty cycle set.
+ */
+void bemf_start(void)
+{
+	if (bemf_state.mode != BEMF_STOPPED) {
+		return;
+	}
+
+	bemf_state.period = BEMF_RAMP_START_TICKS;
+	bemf_state.sync = 0;
+	bemf_state.misses = 0;
+	bemf_state.align = BEMF_ALIGN_STEPS;
+	bemf_state.mode = BEMF_RAMP;
+
+	/* Switch to the first step and let the rotor settle on it. */
+	bemf_commutate(timer_get_time());
+	bemf_state.armed = false;
+	bemf_schedule(bemf_state.period);
+}
+
+/**
+ * Stop commutating and switch all phases to floating.
+ */
+void bemf_stop(void)
+{
+	bemf_state.mode = BEMF_STOPPED;
+	bemf_state.armed = false;
+	pwm_off();
+}
+
+/**
+ * ADC DMA transfer callback, runs the zero crossing detection.
+ */
+RAMFUNC_CODE void bemf_adc_callback(bool transfer_complete,
+				    uint16_t *raw_data)
+{
+	const uint8_t (*slots)[2] = bemf_slots[transfer_complete ? 1 : 0];
+	int32_t v[3], diff;
+	uint32_t now, elapsed, interval;
+	uint16_t delay;
+	int phase;
+
+	if (!bemf_state.armed) {
+		return;
+	}
+
+	/* The 16bit counter wraps within the slow ramp steps, compare in
+	 * the extended time.
+	 */
+	now = timer_get_time();
+	elapsed = now - bemf_state.comm_time;
+
+	/* No zero crossing within two step periods, we lost the rotor. */
+	if (elapsed > (uint32_t)bemf_state.period * 2) {
+		bemf_state.armed = false;
+		bemf_state.sync = 0;
+		bemf_state.timeouts++;
+		if (bemf_state.mode == BEMF_RUN) {
+			if (++bemf_state.misses >= BEMF_MAX_TIMEOUTS) {
+				bemf_stop();
+				return;
+			}
+			bemf_commutate(now);
+		}
+		return;
+	}
+
+	if (elapsed < (uint32_t)(bemf_state.period >> BEMF_BLANK_SHIFT)) {
+		return;
+	}
+
+	v[BEMF_U] = raw_data[slots[BEMF_U][0]] + raw_data[slots[BEMF_U][1]];
+	v[BEMF_V] = raw_data[slots[BEMF_V][0]] + raw_data[slots[BEMF_V][1]];
+	v[BEMF_W] = raw_data[slots[BEMF_W][0]] + raw_data[slots[BEMF_W][1]];
+
+	/* Floating phase against the virtual neutral point, scaled by 3. */
+	phase = bemf_floating[bemf_state.step].phase;
+	diff = (3 * v[phase]) - (v[BEMF_U] + v[BEMF_V] + v[BEMF_W]);
+
+	if (bemf_floating[bemf_state.step].rising ? (diff <= 0) :
+						    (diff >= 0)) {
+		bemf_state.filter = 0;
+		return;
+	}
+
+	if (++bemf_state.filter < BEMF_ZC_FILTER) {
+		return;
+	}
+
+	bemf_state.armed = false;
+	bemf_state.zero_crossings++;
+	bemf_state.misses = 0;
+
+	if (bemf_state.mode == BEMF_RAMP) {
+		bemf_state.sync++;
+		bemf_state.zc_time = now;
+		return;
+	}
+
+	/* Step period from zero crossing to zero crossing. */
+	interval = now - bemf_state.zc_time;
+	if (interval > UINT16_MAX) {
+		interval = UINT16_MAX;
+	}
+	bemf_state.period = ((3 * (uint32_t)bemf_state.period) +
+			     interval) >> 2;
+	bemf_state.zc_time = now;
+
+	/* Commutate 30 degrees after the zero crossing. */
+	delay = bemf_state.period >> 1;
+	bemf_schedule(delay);
+}
+
+enum bemf_mode bemf_get_mode(void)
+{
+	return bemf_state.mode;
+}
+
+/**
+ * Get the commutation step the pwm driver is in.
+ */
+int bemf_get_step(void)
+{
+	return bemf_state.step;
+}
+
+/**
+ * Get the filtered commutation step period in TIM2 ticks (0.25us).
+ */
+uint16_t bemf_get_period(void)
+{
+	return bemf_state.period;
+}
+
+uint32_t bemf_get_zero_crossings(void)
+{
+	return bemf_state.zero_crossings;
+}
+
+uint32_t bemf_get_timeouts(void)
+{
+	return bemf_state.timeouts;
+}
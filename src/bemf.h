@@ -0,0 +1,41 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BEMF_H
+#define __BEMF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+enum bemf_mode {
+	BEMF_STOPPED,
+	BEMF_RAMP,
+	BEMF_RUN
+};
+
+void bemf_init(void);
+void bemf_start(void);
+void bemf_stop(void);
+void bemf_adc_callback(bool transfer_complete, uint16_t *raw_data);
+enum bemf_mode bemf_get_mode(void);
+int bemf_get_step(void);
+uint16_t bemf_get_period(void);
+uint32_t bemf_get_zero_crossings(void);
+uint32_t bemf_get_timeouts(void);
+
+#endif /* __BEMF_H */
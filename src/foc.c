@@ -0,0 +1,668 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   foc.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Field oriented control in Q15 fixed point.
+ *
+ * Runs once per pwm period in the ADC callback. The d and q current are
+ * solved from the sampled phase currents, two PI regulators control them
+ * and the resulting voltage vector is transformed back into the phase
+ * voltages (inverse Park and inverse Clarke) and modulated with space
+ * vector pwm into the three compare registers. Everything is integer math
+ * with saturation, the Cortex-M3 has no FPU.
+ *
+ * The board only measures the supply current. While exactly one phase is
+ * high, or exactly one is low, the supply current is the current of that
+ * phase. The engine moves the ADC trigger into one of these two windows of
+ * the up counting half of the next pwm period, alternating between them.
+ * If both windows are too short, at low modulation, the lowest or highest
+ * phase is moved to open a window and moved back by the same amount in the
+ * following period.
+ *
+ * So only one phase current is sampled per period, and the samples of two
+ * phases are taken at different rotor angles, up to a few pwm periods
+ * apart. There is no forward Clarke and Park transform, foc_solve() takes
+ * the newest sample and the newest one of another phase, each with its
+ * rotor angle, and solves the two equations for the d and q current,
+ * assuming both stay constant in between.
+ *
+ * The rotor angle comes from the outside through foc_set_angle() and is
+ * advanced by the given speed every period.
+ *
+ * Needs the pwm triggered ADC conversion, build with -DADC_PWM_TRIGGER.
+ * Pass foc_adc_callback() as both callbacks to adc_init().
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "src/foc.h"
+
+#include "driver/mcu.h"
+#include "driver/adc.h"
+#include "driver/pwm.h"
+
+#ifndef ADC_PWM_TRIGGER
+#error "The FOC engine needs the pwm triggered ADC, add -DADC_PWM_TRIGGER"
+#endif
+
+/* ADC reading at zero current. */
+#define FOC_CURRENT_ZERO 2048
+
+/* Pwm counter ticks per ADC clock cycle, 8 at 64MHz. */
+#define FOC_ADC_CYCLE_TICKS (MCU_TIM1_CLK / MCU_ADC_CLK)
+
+/* Pwm counter ticks from a phase switching to the start of the current
+ * sampling, lets the shunt signal settle for 0.75us.
+ */
+#define FOC_SHUNT_SETTLE ((3 * (MCU_TIM1_CLK / 1000000)) / 4)
+
+/* Pwm counter ticks the current sampling takes, 7.5 ADC clock cycles plus
+ * the trigger latency.
+ */
+#define FOC_SHUNT_SAMPLE (((15 * FOC_ADC_CYCLE_TICKS) / 2) + 20)
+
+/* Shortest window a phase current can be measured in. */
+#define FOC_SHUNT_WINDOW (FOC_SHUNT_SETTLE + FOC_SHUNT_SAMPLE)
+
+/* Trigger that centers the sampling on the counter center. */
+#define FOC_SHUNT_CENTER ((PWM_DUTY_MAX / 2) - (FOC_SHUNT_SAMPLE / 2))
+
+/* Pwm periods a phase current sample is used together with newer ones. */
+#define FOC_SHUNT_MAX_AGE 4
+
+/* TIM1 counter ticks of one pwm period, the counter runs up and down. */
+#define FOC_PWM_PERIOD (2 * PWM_DUTY_MAX)
+
+/* TIM1 counter ticks from the ADC trigger to the callback, four conversions
+ * of 20 ADC clock cycles.
+ */
+#define FOC_ADC_TICKS (4 * 20 * FOC_ADC_CYCLE_TICKS)
+
+/* Shortest determinant of the d and q current solution, sin(30deg). Two
+ * samples of different phases are 120deg apart, less the rotation between
+ * them.
+ */
+#define FOC_DET_MIN 16384
+
+/* Voltage vector limit, a bit below the 1/sqrt(3) of the supply voltage
+ * the space vector modulation reaches without clipping.
+ */
+#define FOC_V_MAX 18000
+
+/* Half the supply voltage. */
+#define FOC_V_HALF 16384
+
+/* sqrt(3)/2. */
+#define FOC_SQRT3_2 28378
+
+/* Phase indices. */
+#define FOC_U 0
+#define FOC_V 1
+#define FOC_W 2
+#define FOC_NONE (-1)
+
+/* Angle of the phase axes. */
+static const uint16_t foc_phase_angle[3] = { 0, 21845, 43691 };
+
+/* First quarter of a sine wave, sin(i * 90deg / 256). */
+static const int16_t foc_sine_table[257] = {
+	0, 201, 402, 603, 804, 1005, 1206, 1407,
+	1608, 1809, 2009, 2210, 2410, 2611, 2811, 3012,
+	3212, 3412, 3612, 3811, 4011, 4210, 4410, 4609,
+	4808, 5007, 5205, 5404, 5602, 5800, 5998, 6195,
+	6393, 6590, 6786, 6983, 7179, 7375, 7571, 7767,
+	7962, 8157, 8351, 8545, 8739, 8933, 9126, 9319,
+	9512, 9704, 9896, 10087, 10278, 10469, 10659, 10849,
+	11039, 11228, 11417, 11605, 11793, 11980, 12167, 12353,
+	12539, 12725, 12910, 13094, 13279, 13462, 13645, 13828,
+	14010, 14191, 14372, 14553, 14732, 14912, 15090, 15269,
+	15446, 15623, 15800, 15976, 16151, 16325, 16499, 16673,
+	16846, 17018, 17189, 17360, 17530, 17700, 17869, 18037,
+	18204, 18371, 18537, 18703, 18868, 19032, 19195, 19357,
+	19519, 19680, 19841, 20000, 20159, 20317, 20475, 20631,
+	20787, 20942, 21096, 21250, 21403, 21554, 21705, 21856,
+	22005, 22154, 22301, 22448, 22594, 22739, 22884, 23027,
+	23170, 23311, 23452, 23592, 23731, 23870, 24007, 24143,
+	24279, 24413, 24547, 24680, 24811, 24942, 25072, 25201,
+	25329, 25456, 25582, 25708, 25832, 25955, 26077, 26198,
+	26319, 26438, 26556, 26674, 26790, 26905, 27019, 27133,
+	27245, 27356, 27466, 27575, 27683, 27790, 27896, 28001,
+	28105, 28208, 28310, 28411, 28510, 28609, 28706, 28803,
+	28898, 28992, 29085, 29177, 29268, 29358, 29447, 29534,
+	29621, 29706, 29791, 29874, 29956, 30037, 30117, 30195,
+	30273, 30349, 30424, 30498, 30571, 30643, 30714, 30783,
+	30852, 30919, 30985, 31050, 31113, 31176, 31237, 31297,
+	31356, 31414, 31470, 31526, 31580, 31633, 31685, 31736,
+	31785, 31833, 31880, 31926, 31971, 32014, 32057, 32098,
+	32137, 32176, 32213, 32250, 32285, 32318, 32351, 32382,
+	32412, 32441, 32469, 32495, 32521, 32545, 32567, 32589,
+	32609, 32628, 32646, 32663, 32678, 32692, 32705, 32717,
+	32728, 32737, 32745, 32752, 32757, 32761, 32765, 32766,
+	32767
+};
+
+/* PI regulator. */
+struct foc_pi {
+	int16_t kp; /**< Proportional gain, Q12 */
+	int16_t ki; /**< Integral gain per pwm period, Q12 */
+	int32_t integral; /**< Integrator, Q27 */
+};
+
+/* Internal state. */
+struct foc_state {
+	volatile bool on;
+	volatile uint16_t angle; /**< Rotor angle of this period */
+	volatile int16_t speed; /**< Angle increment per period */
+	volatile int16_t id_ref;
+	volatile int16_t iq_ref;
+	struct foc_pi pi_d;
+	struct foc_pi pi_q;
+	int16_t i[3]; /**< Newest phase current samples */
+	uint16_t i_angle[3]; /**< Rotor angle of the samples */
+	uint32_t stamp[3]; /**< Period the samples were taken in */
+	uint16_t trigger; /**< ADC trigger of the running period */
+	int shunt_phase; /**< Phase of the sample taken in the next period */
+	bool shunt_negate; /**< The sample is the negative phase current */
+	bool shunt_high; /**< The sample is taken while one phase is high */
+	uint16_t shunt_angle; /**< Rotor angle of the sample */
+	int16_t comp[3]; /**< Compare value correction for the next period */
+	volatile int16_t id;
+	volatile int16_t iq;
+	volatile int16_t vd;
+	volatile int16_t vq;
+	volatile uint32_t periods;
+	volatile uint32_t samples; /**< Current samples taken */
+	volatile uint32_t updates; /**< Current regulator updates */
+} foc_state;
+
+/**
+ * Saturate to the symmetric Q15 range.
+ */
+static inline int16_t foc_sat(int32_t x)
+{
+	if (x > INT16_MAX) {
+		return INT16_MAX;
+	} else if (x < -INT16_MAX) {
+		return -INT16_MAX;
+	}
+
+	return (int16_t)x;
+}
+
+static inline int32_t foc_clamp(int32_t x, int32_t min, int32_t max)
+{
+	if (x > max) {
+		return max;
+	} else if (x < min) {
+		return min;
+	}
+
+	return x;
+}
+
+/**
+ * Rotor angle advance over the given part of a pwm period.
+ *
+ * The division by the constant period compiles to a multiplication.
+ */
+static inline int32_t foc_advance(int16_t speed, int32_t ticks)
+{
+	return ((int32_t)speed * ticks) / FOC_PWM_PERIOD;
+}
+
+/**
+ * Q15 sine, linear interpolation of the quarter wave table.
+ */
+static int16_t foc_sin(uint16_t angle)
+{
+	uint16_t x = angle & 0x3FFF;
+	int32_t s;
+
+	/* Second and fourth quarter mirror the first and third. */
+	if ((angle & 0x4000) != 0) {
+		x = 0x4000 - x;
+	}
+
+	s = foc_sine_table[x >> 6];
+	if ((x & 0x3F) != 0) {
+		s += ((foc_sine_table[(x >> 6) + 1] - s) * (x & 0x3F)) >> 6;
+	}
+
+	return ((angle & 0x8000) != 0) ? (int16_t)-s : (int16_t)s;
+}
+
+/**
+ * Integer square root.
+ */
+static uint16_t foc_sqrt(uint32_t x)
+{
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+
+	while (bit > x) {
+		bit >>= 2;
+	}
+
+	while (bit != 0) {
+		if (x >= root + bit) {
+			x -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return (uint16_t)root;
+}
+
+/**
+ * Run one PI regulator step, the integrator is clamped to the output limit.
+ */
+static int16_t foc_pi_run(struct foc_pi *pi, int16_t error, int16_t limit)
+{
+	int32_t max = (int32_t)limit << 12;
+	int32_t out;
+
+	pi->integral = foc_clamp(pi->integral + ((int32_t)pi->ki * error),
+				 -max, max);
+	out = (((int32_t)pi->kp * error) + pi->integral) >> 12;
+
+	return (int16_t)foc_clamp(out, -limit, limit);
+}
+
+/**
+ * Pick the current sampling window of the next period and set the ADC
+ * trigger, see the description at the top.
+ *
+ * @param ccr Compare values of the next period, modified if a window has to
+ *            be opened or the one of the last period closed again.
+ * @param start Rotor angle at the start of the next period.
+ */
+static void foc_shunt(uint16_t *ccr, uint16_t start)
+{
+	int lo = FOC_U, mid = FOC_V, hi = FOC_W;
+	int k, t;
+	bool high, moved = false;
+	int32_t value;
+
+	/* Move the phase back that opened the window in the last period, no
+	 * sample in this one. Otherwise the narrow window the move back opens
+	 * would always measure the same phase.
+	 */
+	for (k = 0; k < 3; k++) {
+		if (foc_state.comp[k] != 0) {
+			ccr[k] = (uint16_t)foc_clamp(ccr[k] + foc_state.comp[k],
+						     0, PWM_DUTY_MAX);
+			foc_state.comp[k] = 0;
+			moved = true;
+		}
+	}
+	if (moved) {
+		foc_state.shunt_phase = FOC_NONE;
+		return;
+	}
+
+	if (ccr[lo] > ccr[mid]) {
+		t = lo;
+		lo = mid;
+		mid = t;
+	}
+	if (ccr[mid] > ccr[hi]) {
+		t = mid;
+		mid = hi;
+		hi = t;
+	}
+	if (ccr[lo] > ccr[mid]) {
+		t = lo;
+		lo = mid;
+		mid = t;
+	}
+
+	/* Alternate between the window of the highest phase alone high and
+	 * the one of the lowest phase alone low.
+	 */
+	high = !foc_state.shunt_high;
+	if ((high ? ccr[hi] - ccr[mid] : ccr[mid] - ccr[lo]) <
+	    FOC_SHUNT_WINDOW) {
+		if ((high ? ccr[mid] - ccr[lo] : ccr[hi] - ccr[mid]) >=
+		    FOC_SHUNT_WINDOW) {
+			high = !high;
+		} else if (high) {
+			value = ccr[mid] + FOC_SHUNT_WINDOW;
+			if (value > PWM_DUTY_MAX) {
+				foc_state.shunt_phase = FOC_NONE;
+				return;
+			}
+			foc_state.comp[hi] = ccr[hi] - value;
+			ccr[hi] = (uint16_t)value;
+		} else {
+			value = ccr[mid] - FOC_SHUNT_WINDOW;
+			if (value < 0) {
+				foc_state.shunt_phase = FOC_NONE;
+				return;
+			}
+			foc_state.comp[lo] = ccr[lo] - value;
+			ccr[lo] = (uint16_t)value;
+		}
+	}
+
+	/* The ripple of the phase currents is about symmetric around the
+	 * middle of the active vectors, the counter center with min max
+	 * injection. Sample as close to it as the window allows.
+	 */
+	foc_state.shunt_high = high;
+	if (high) {
+		foc_state.shunt_phase = hi;
+		foc_state.shunt_negate = false;
+		value = foc_clamp(FOC_SHUNT_CENTER, ccr[mid] + FOC_SHUNT_SETTLE,
+				  ccr[hi] - FOC_SHUNT_SAMPLE);
+	} else {
+		foc_state.shunt_phase = lo;
+		foc_state.shunt_negate = true;
+		value = foc_clamp(FOC_SHUNT_CENTER, ccr[lo] + FOC_SHUNT_SETTLE,
+				  ccr[mid] - FOC_SHUNT_SAMPLE);
+	}
+	foc_state.trigger = (uint16_t)value;
+	foc_state.shunt_angle = start +
+		foc_advance(foc_state.speed,
+			    foc_state.trigger + (FOC_SHUNT_SAMPLE / 2));
+	pwm_set_adc_trigger(foc_state.trigger);
+}
+
+/**
+ * Solve the d and q current from the newest sample and the newest one of
+ * another phase.
+ *
+ * The current of phase k at rotor angle t is
+ * id * cos(t - a_k) - iq * sin(t - a_k), a_k being the angle of the phase
+ * axis. Two samples give two equations.
+ *
+ * @return false if there is no usable pair of samples.
+ */
+static bool foc_solve(int p, int16_t *id, int16_t *iq)
+{
+	int16_t c1, s1, c2, s2, det;
+	int32_t m1, m2;
+	uint16_t a1, a2;
+	int q, k;
+
+	q = (p == FOC_W) ? FOC_U : p + 1;
+	k = (q == FOC_W) ? FOC_U : q + 1;
+	if ((int32_t)(foc_state.stamp[k] - foc_state.stamp[q]) > 0) {
+		q = k;
+	}
+	if (foc_state.periods - foc_state.stamp[q] > FOC_SHUNT_MAX_AGE) {
+		return false;
+	}
+
+	a1 = foc_state.i_angle[p] - foc_phase_angle[p];
+	a2 = foc_state.i_angle[q] - foc_phase_angle[q];
+
+	/* Determinant sin(a1 - a2). */
+	det = foc_sin(a1 - a2);
+	if (det < FOC_DET_MIN && det > -FOC_DET_MIN) {
+		return false;
+	}
+
+	c1 = foc_sin(a1 + 0x4000);
+	s1 = foc_sin(a1);
+	c2 = foc_sin(a2 + 0x4000);
+	s2 = foc_sin(a2);
+	m1 = foc_state.i[p];
+	m2 = foc_state.i[q];
+
+	/* Cramer's rule, the numerators are Q29 to not overflow and the
+	 * determinant is halved to get Q15 results.
+	 */
+	det >>= 1;
+	*id = foc_sat(((((int32_t)s1 * m2) >> 1) - (((int32_t)s2 * m1) >> 1)) /
+		      det);
+	*iq = foc_sat(((((int32_t)c1 * m2) >> 1) - (((int32_t)c2 * m1) >> 1)) /
+		      det);
+
+	return true;
+}
+
+/**
+ * Initialize the internal state.
+ */
+void foc_init(void)
+{
+	foc_state.on = false;
+	foc_state.angle = 0;
+	foc_state.speed = 0;
+	foc_state.id_ref = 0;
+	foc_state.iq_ref = 0;
+	foc_state.pi_d.kp = FOC_DEFAULT_KP;
+	foc_state.pi_d.ki = FOC_DEFAULT_KI;
+	foc_state.pi_q.kp = FOC_DEFAULT_KP;
+	foc_state.pi_q.ki = FOC_DEFAULT_KI;
+	foc_state.periods = 0;
+	foc_state.samples = 0;
+	foc_state.updates = 0;
+}
+
+/**
+ * Switch all half bridges on and start regulating the current.
+ */
+void foc_start(void)
+{
+	int k;
+
+	if (foc_state.on) {
+		return;
+	}
+
+	foc_state.pi_d.integral = 0;
+	foc_state.pi_q.integral = 0;
+	for (k = 0; k < 3; k++) {
+		foc_state.i[k] = 0;
+		foc_state.stamp[k] = foc_state.periods -
+				     (FOC_SHUNT_MAX_AGE + 1);
+		foc_state.comp[k] = 0;
+	}
+	foc_state.trigger = PWM_DUTY_MAX / 2;
+	foc_state.shunt_phase = FOC_NONE;
+	foc_state.shunt_high = false;
+	foc_state.id = 0;
+	foc_state.iq = 0;
+	foc_state.vd = 0;
+	foc_state.vq = 0;
+
+	pwm_set_adc_trigger(foc_state.trigger);
+	pwm_all_on();
+	foc_state.on = true;
+}
+
+/**
+ * Stop regulating and switch all phases to floating.
+ */
+void foc_stop(void)
+{
+	foc_state.on = false;
+	pwm_off();
+}
+
+/**
+ * Set the d and q current references, Q15 of the current full scale.
+ */
+void foc_set_current(int16_t id, int16_t iq)
+{
+	foc_state.id_ref = id;
+	foc_state.iq_ref = iq;
+}
+
+/**
+ * Set the rotor angle of the current pwm period.
+ *
+ * @param angle Electrical angle, 65536 is one turn.
+ * @param speed Angle increment per pwm period, the engine keeps advancing
+ *              the angle by it until the next call.
+ */
+void foc_set_angle(uint16_t angle, int16_t speed)
+{
+	foc_state.angle = angle;
+	foc_state.speed = speed;
+}
+
+/**
+ * Set the gains of both current regulators, Q12.
+ */
+void foc_set_gains(int16_t kp, int16_t ki)
+{
+	foc_state.pi_d.kp = kp;
+	foc_state.pi_d.ki = ki;
+	foc_state.pi_q.kp = kp;
+	foc_state.pi_q.ki = ki;
+}
+
+/**
+ * ADC callback, runs one control period.
+ */
+void foc_adc_callback(bool transfer_complete, uint16_t *raw_data)
+{
+	int32_t v[3], vmax, vmin, offset;
+	uint16_t ccr[3];
+	uint16_t angle, start;
+	int16_t s, c, id, iq, vd, vq, va, vb;
+	int p, k;
+
+	if (!foc_state.on) {
+		return;
+	}
+
+	foc_state.periods++;
+	angle = foc_state.angle;
+
+	/* Rotor angle at the start of the next period. */
+	start = angle + foc_advance(foc_state.speed,
+				    FOC_PWM_PERIOD - foc_state.trigger -
+				    FOC_ADC_TICKS);
+
+	/* Phase current sampled in this period. */
+	p = foc_state.shunt_phase;
+	if (p != FOC_NONE) {
+		int16_t i = foc_sat(((int32_t)raw_data[transfer_complete ?
+					ADC_RAW_A2_CU2 : ADC_RAW_A2_CU1] -
+				     FOC_CURRENT_ZERO) << 4);
+
+		foc_state.i[p] = foc_state.shunt_negate ? -i : i;
+		foc_state.i_angle[p] = foc_state.shunt_angle;
+		foc_state.stamp[p] = foc_state.periods;
+		foc_state.samples++;
+	}
+
+	if (p != FOC_NONE && foc_solve(p, &id, &iq)) {
+		/* Current regulators, d has priority on the voltage. */
+		vd = foc_pi_run(&foc_state.pi_d,
+				foc_sat((int32_t)foc_state.id_ref - id),
+				FOC_V_MAX);
+		vq = foc_pi_run(&foc_state.pi_q,
+				foc_sat((int32_t)foc_state.iq_ref - iq),
+				foc_sqrt(((int32_t)FOC_V_MAX * FOC_V_MAX) -
+					 ((int32_t)vd * vd)));
+
+		foc_state.id = id;
+		foc_state.iq = iq;
+		foc_state.vd = vd;
+		foc_state.vq = vq;
+		foc_state.updates++;
+	} else {
+		vd = foc_state.vd;
+		vq = foc_state.vq;
+	}
+
+	foc_state.angle = angle + foc_state.speed;
+
+	/* The voltages are applied around the middle of the next period. */
+	angle = start + (foc_state.speed / 2);
+	s = foc_sin(angle);
+	c = foc_sin(angle + 0x4000);
+
+	/* Inverse Park. */
+	va = foc_sat((((int32_t)vd * c) - ((int32_t)vq * s)) >> 15);
+	vb = foc_sat((((int32_t)vd * s) + ((int32_t)vq * c)) >> 15);
+
+	/* Inverse Clarke. */
+	v[FOC_U] = va;
+	v[FOC_V] = ((-(int32_t)va * FOC_V_HALF) +
+		    ((int32_t)vb * FOC_SQRT3_2)) >> 15;
+	v[FOC_W] = ((-(int32_t)va * FOC_V_HALF) -
+		    ((int32_t)vb * FOC_SQRT3_2)) >> 15;
+
+	/* Space vector modulation by min max injection, centers the three
+	 * phase voltages in the supply range.
+	 */
+	vmax = v[FOC_U];
+	vmin = v[FOC_U];
+	for (k = FOC_V; k <= FOC_W; k++) {
+		if (v[k] > vmax) {
+			vmax = v[k];
+		}
+		if (v[k] < vmin) {
+			vmin = v[k];
+		}
+	}
+	offset = FOC_V_HALF - ((vmax + vmin) >> 1);
+
+	for (k = 0; k < 3; k++) {
+		ccr[k] = (uint16_t)((foc_clamp(v[k] + offset, 0, INT16_MAX) *
+				     PWM_DUTY_MAX) >> 15);
+	}
+
+	foc_shunt(ccr, start);
+	pwm_set_duty(ccr[FOC_U], ccr[FOC_V], ccr[FOC_W]);
+}
+
+/**
+ * Get the measured d and q current of the last regulator update.
+ */
+void foc_get_current(int16_t *id, int16_t *iq)
+{
+	*id = foc_state.id;
+	*iq = foc_state.iq;
+}
+
+/**
+ * Get the d and q voltage of the last regulator update.
+ */
+void foc_get_voltage(int16_t *vd, int16_t *vq)
+{
+	*vd = foc_state.vd;
+	*vq = foc_state.vq;
+}
+
+uint32_t foc_get_periods(void)
+{
+	return foc_state.periods;
+}
+
+uint32_t foc_get_samples(void)
+{
+	return foc_state.samples;
+}
+
+uint32_t foc_get_updates(void)
+{
+	return foc_state.updates;
+}
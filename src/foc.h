@@ -0,0 +1,50 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FOC_H
+#define __FOC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Units of the FOC interface:
+ * - currents are Q15 of the ADC current full scale, 32767 is +full scale
+ * - voltages are Q15 of the supply voltage
+ * - angles are electrical, 65536 is one turn, 0 is the rotor d axis on the
+ *   phase U axis
+ * - gains are Q12, 4096 is 1.0
+ */
+
+/* Default current controller gains. */
+#define FOC_DEFAULT_KP 1073
+#define FOC_DEFAULT_KI 686
+
+void foc_init(void);
+void foc_start(void);
+void foc_stop(void);
+void foc_set_current(int16_t id, int16_t iq);
+void foc_set_angle(uint16_t angle, int16_t speed);
+void foc_set_gains(int16_t kp, int16_t ki);
+void foc_adc_callback(bool transfer_complete, uint16_t *raw_data);
+void foc_get_current(int16_t *id, int16_t *iq);
+void foc_get_voltage(int16_t *vd, int16_t *vq);
+uint32_t foc_get_periods(void);
+uint32_t foc_get_samples(void);
+uint32_t foc_get_updates(void);
+
+#endif /* __FOC_H */
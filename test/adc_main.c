@@ -39,6 +39,22 @@ uint32_t uv, vv, wv;
  */
 void adc_transfer_callback(bool transfer_complete, uint16_t *raw_data)
 {
+#ifdef ADC_PWM_TRIGGER
+	/* The samples are taken at the same quiet point of every pwm period,
+	 * averaging the ADC1 and ADC2 sample is all the filtering needed.
+	 */
+	if (transfer_complete) {
+		OFF(LED_RED);
+		uv = (raw_data[ADC_RAW_A1_UV2] + raw_data[ADC_RAW_A2_UV2]) / 2;
+		vv = (raw_data[ADC_RAW_A1_VV2] + raw_data[ADC_RAW_A2_VV2]) / 2;
+		wv = (raw_data[ADC_RAW_A1_WV2] + raw_data[ADC_RAW_A2_WV2]) / 2;
+	} else {
+		ON(LED_RED);
+		uv = (raw_data[ADC_RAW_A1_UV1] + raw_data[ADC_RAW_A2_UV1]) / 2;
+		vv = (raw_data[ADC_RAW_A1_VV1] + raw_data[ADC_RAW_A2_VV1]) / 2;
+		wv = (raw_data[ADC_RAW_A1_WV1] + raw_data[ADC_RAW_A2_WV1]) / 2;
+	}
+#else
 	if (transfer_complete) {
 		OFF(LED_RED);
 		/* Simple IIR filter on the three phase voltage measurements. */
@@ -58,6 +74,7 @@ void adc_transfer_callback(bool transfer_complete, uint16_t *raw_data)
 		wv = ((wv << 2) + raw_data[ADC_RAW_A1_VV2]
 				+ raw_data[ADC_RAW_A2_VV2])/6;
 	}
+#endif
 }
 
 /**
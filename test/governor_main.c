@@ -33,20 +33,60 @@
 #include "driver/led.h"
 #include "test/gprot_test_governor.h"
 #include "driver/usart.h"
+#include "driver/event.h"
+#include "driver/sys_tick.h"
+#include "driver/sched.h"
+#include "driver/pwm.h"
+#include "driver/adc.h"
+#include "driver/scope.h"
+#include "driver/regblock.h"
+#include "driver/regnotify.h"
+#include "driver/profile.h"
+
+/* Period of the test counter task in us. */
+#define COUNTER_PERIOD 1000
+
+/* Period of the register notification task in us. */
+#define NOTIFY_PERIOD 10000
+
+static u16 test_counter;
+static u32 test_uptime;
 
 /**
- * Crude delay implementation.
- *
- * Burn some MCU cycles.
- *
- * @param delay "time" delay
+ * Increment the test counters and mark their registers changed.
+ */
+static void counter_task(void)
+{
+	test_counter++;
+	test_uptime += COUNTER_PERIOD / 1000;
+	(void)regblock_snapshot(5, 3);
+	regnotify_touch(5);
+	regnotify_touch(6);
+	regnotify_touch(7);
+}
+
+/**
+ * Send the changed registers at their update rate.
  */
-static void my_delay(unsigned long delay)
+static void notify_task(void)
 {
+	(void)regnotify_flush();
+}
+
+/**
+ * Feed a span of received bytes to the governor protocol parser.
+ */
+static int governor_handle_span(const uint8_t *data, uint16_t len)
+{
+	int ret = 0;
 
-	while (delay != 0) {
-		delay--;
+	while (len-- > 0) {
+		if (gpc_handle_byte(*data++) != 0) {
+			ret = -1;
+		}
 	}
+
+	return ret;
 }
 
 /**
@@ -54,20 +94,37 @@ static void my_delay(unsigned long delay)
  */
 int main(void)
 {
-	u16 test_counter;
-
 	mcu_init();
 	led_init();
+	profile_init();
+	event_init();
+	sys_tick_init();
+	sched_init();
 	gprot_init();
-	usart_init(gpc_handle_byte, gpc_pickup_byte);
+	usart_init(gpc_handle_byte, gpc_pickup_byte,
+		   USART_DEFAULT_BAUDRATE);
+	usart_set_span_callback(governor_handle_span);
+
+	/* Phase voltages and current for the scope registers. */
+	scope_init();
+	(void)scope_add_raw(ADC_RAW_A1_UV1, ADC_RAW_A1_UV2);
+	(void)scope_add_raw(ADC_RAW_A1_VV1, ADC_RAW_A1_VV2);
+	(void)scope_add_raw(ADC_RAW_A1_WV1, ADC_RAW_A1_WV2);
+	(void)scope_add_raw(ADC_RAW_A2_CU1, ADC_RAW_A2_CU2);
+	adc_init(scope_adc_callback, scope_adc_callback);
+	pwm_init(); /* Initializing pwm to make sure the phases are floating. */
 
+	/* Register 5 is the counter, 6 and 7 the uptime in ms. */
 	test_counter = 0;
-	(void)gpc_setup_reg(5, &test_counter);
+	test_uptime = 0;
+	(void)regblock_map(5, &test_counter, REGBLOCK_U16, false);
+	(void)regblock_map(6, &test_uptime, REGBLOCK_U32, false);
 
-	while (true) {
-		gprot_get_version_process();
-		my_delay(500000);
-		test_counter++;
-		(void)gpc_register_touched(5);
-	}
+	(void)sched_task_register(counter_task, COUNTER_PERIOD);
+	(void)sched_task_register(notify_task, NOTIFY_PERIOD);
+
+	/* Runs the version requests posted by the usart interrupt, the
+	 * counter and the notification task, sleeps in between.
+	 */
+	sched_run();
 }
@@ -34,12 +34,18 @@
 #include "gprot_test_governor.h"
 #include "driver/led.h"
 #include "driver/usart.h"
+#include "driver/event.h"
+#include "driver/link.h"
+#include "driver/scope.h"
+#include "driver/regblock.h"
+#include "driver/regnotify.h"
+#include "driver/profile.h"
 
 static void gprot_trigger_output(void *data);
 static void gprot_register_changed(void *data, u8 addr);
 static void gprot_get_version(void *data);
-
-static bool gprot_get_version_triggered;
+static void gprot_send_version(uint32_t data);
+static void gprot_touch(uint8_t addr);
 
 #ifndef PROJECT_NAME
 #define PROJECT_NAME "null"
@@ -74,6 +80,46 @@ static bool gprot_get_version_triggered;
 #define FIRMWARE_COPYRIGHT COPYRIGHT "\n"
 #define FIRMWARE_LICENSE LICENSE "\n"
 
+/* Shortest interval between two updates of a register on the link in us. */
+#define GPROT_NOTIFY_INTERVAL 50000
+
+/* Block access registers. Writing 1 to the control register sends a
+ * consistent snapshot of count registers from first on in one burst,
+ * writing 2 applies the registers of that range the host wrote before all
+ * at once.
+ */
+#define GPROT_BLOCK_FIRST_REG 17
+#define GPROT_BLOCK_COUNT_REG 18
+#define GPROT_BLOCK_CTRL_REG 19
+
+/* Scope registers. Writing 1 to the control register arms the scope with
+ * the pre trigger samples and the trigger of the registers following it, 2
+ * triggers it, 0 stops it. Writing a sample index loads the scope mode and
+ * the samples of all channels at that index into the registers after it.
+ */
+#define GPROT_SCOPE_CTRL_REG 20
+#define GPROT_SCOPE_PRE_REG 21
+#define GPROT_SCOPE_TRIGGER_REG 22 /* trigger << 8 | channel */
+#define GPROT_SCOPE_LEVEL_REG 23
+#define GPROT_SCOPE_INDEX_REG 24
+#define GPROT_SCOPE_MODE_REG 25
+#define GPROT_SCOPE_DATA_REG 26 /* to 29 */
+
+/* Interrupt profile registers. Writing a handler, enum profile_isr, to the
+ * select register loads its statistics into the eight registers of the data
+ * window, writing PROFILE_ISRS resets the statistics. The handlers are only
+ * profiled in firmware built with -DPROFILE.
+ */
+#define GPROT_PROFILE_DATA_REG 8 /* to 15 */
+#define GPROT_PROFILE_SELECT_REG 16
+
+/* Line speed negotiation registers. The host writes the line speed in
+ * units of 100 baud, switches its side once the controller went quiet and
+ * writes anything to the confirm register at the new speed.
+ */
+#define GPROT_LINK_SPEED_REG 30
+#define GPROT_LINK_CONFIRM_REG 31
+
 /**
  * Test governor registers.
  */
@@ -90,8 +136,6 @@ void gprot_init()
 	(void)gpc_init(gprot_trigger_output, 0, gprot_register_changed, 0);
 	(void)gpc_set_get_version_callback(gprot_get_version, 0);
 
-	gprot_get_version_triggered = false;
-
 	for (i = 0; i < 32; i++) {
 		test_regs[i] = (uint16_t)(i * 3);
 		if (gpc_setup_reg((uint8_t)i, &test_regs[i]) != 0) {
@@ -99,6 +143,11 @@ void gprot_init()
 		}
 	}
 
+	regblock_init(test_regs, 32, gprot_touch);
+	regnotify_init(gprot_touch, GPROT_NOTIFY_INTERVAL);
+
+	test_regs[GPROT_LINK_SPEED_REG] = USART_DEFAULT_BAUDRATE / 100;
+	link_init();
 }
 
 /**
@@ -115,6 +164,96 @@ void gprot_trigger_output(void *data)
 	usart_enable_send();
 }
 
+/**
+ * Have libgovernor send a register of a block.
+ *
+ * @param addr Address of the register.
+ */
+static void gprot_touch(uint8_t addr)
+{
+	(void)gpc_register_touched(addr);
+}
+
+/**
+ * Run a scope control register command.
+ */
+static void gprot_scope_control(u16 command)
+{
+	u16 trigger = test_regs[GPROT_SCOPE_TRIGGER_REG];
+
+	switch (command) {
+	case 1:
+		scope_set_trigger(trigger & 0xff,
+				  (enum scope_trigger)(trigger >> 8),
+				  (int16_t)test_regs[GPROT_SCOPE_LEVEL_REG]);
+		if (!scope_arm(test_regs[GPROT_SCOPE_PRE_REG])) {
+			ON(LED_RED);
+		}
+		break;
+	case 2:
+		scope_trigger();
+		break;
+	default:
+		scope_stop();
+		break;
+	}
+}
+
+/**
+ * Load a sample of the scope capture into the data registers.
+ */
+static void gprot_scope_read(u16 index)
+{
+	int i;
+
+	test_regs[GPROT_SCOPE_MODE_REG] = (u16)scope_get_mode();
+	(void)gpc_register_touched(GPROT_SCOPE_MODE_REG);
+
+	for (i = 0; i < SCOPE_CHANNELS; i++) {
+		test_regs[GPROT_SCOPE_DATA_REG + i] = (u16)scope_read(index, i);
+		(void)gpc_register_touched((u8)(GPROT_SCOPE_DATA_REG + i));
+	}
+}
+
+static u16 gprot_saturate(uint64_t value)
+{
+	return (value > 0xffff) ? 0xffff : (u16)value;
+}
+
+/**
+ * Load the profile of a handler into the data registers: count low and
+ * high half, min, max and mean cycles, mean cycles of the handlers that
+ * preempted it, its load and the load of all handlers in 0.01%.
+ */
+static void gprot_profile_read(u16 isr)
+{
+	struct profile_stats stats;
+	u16 *data = &test_regs[GPROT_PROFILE_DATA_REG];
+	int i;
+
+	if (isr >= PROFILE_ISRS) {
+		profile_reset();
+		return;
+	}
+
+	profile_get((enum profile_isr)isr, &stats);
+
+	data[0] = (u16)stats.count;
+	data[1] = (u16)(stats.count >> 16);
+	data[2] = gprot_saturate(stats.min);
+	data[3] = gprot_saturate(stats.max);
+	data[4] = gprot_saturate((stats.count != 0) ?
+				 stats.total / stats.count : 0);
+	data[5] = gprot_saturate((stats.count != 0) ?
+				 stats.preempted / stats.count : 0);
+	data[6] = profile_get_load((enum profile_isr)isr);
+	data[7] = profile_get_load(PROFILE_ISRS);
+
+	for (i = 0; i < 8; i++) {
+		(void)gpc_register_touched((u8)(GPROT_PROFILE_DATA_REG + i));
+	}
+}
+
 /**
  * Callback from libgovernor indicating a change in a register.
  *
@@ -124,30 +263,68 @@ void gprot_trigger_output(void *data)
 void gprot_register_changed(void *data, u8 addr)
 {
 	data = data;
-	addr = addr;
+
+	switch (addr) {
+	case GPROT_LINK_SPEED_REG:
+		if (!link_request((uint32_t)test_regs[addr] * 100)) {
+			/* Tell the host the speed it stays at. */
+			test_regs[addr] = (u16)(usart_get_baudrate() / 100);
+			(void)gpc_register_touched(addr);
+		}
+		break;
+	case GPROT_LINK_CONFIRM_REG:
+		link_confirm();
+		break;
+	case GPROT_BLOCK_CTRL_REG:
+		if (test_regs[addr] == 1) {
+			(void)regblock_read(
+				(uint8_t)test_regs[GPROT_BLOCK_FIRST_REG],
+				(uint8_t)test_regs[GPROT_BLOCK_COUNT_REG]);
+		} else if (test_regs[addr] == 2) {
+			(void)regblock_write(
+				(uint8_t)test_regs[GPROT_BLOCK_FIRST_REG],
+				(uint8_t)test_regs[GPROT_BLOCK_COUNT_REG]);
+		}
+		break;
+	case GPROT_SCOPE_CTRL_REG:
+		gprot_scope_control(test_regs[addr]);
+		break;
+	case GPROT_SCOPE_INDEX_REG:
+		gprot_scope_read(test_regs[addr]);
+		break;
+	case GPROT_PROFILE_SELECT_REG:
+		gprot_profile_read(test_regs[addr]);
+		break;
+	default:
+		break;
+	}
 }
 
 /**
  * Callback from libgovernor indicating a get version event.
  *
+ * Runs in the usart interrupt, the version strings are sent from the main
+ * loop.
+ *
  * @param data Passthrough data to the callback.
  */
 void gprot_get_version(void *data)
 {
 	data = data;
 
-	gprot_get_version_triggered = true;
+	(void)event_post(EVENT_PRIORITY_LOW, gprot_send_version, 0);
 }
 
 /**
- * Userspace process handling the get version event.
+ * Event handler sending the version strings.
+ *
+ * @param data Event data. (ignored here)
  */
-void gprot_get_version_process(void)
+void gprot_send_version(uint32_t data)
 {
-	if (gprot_get_version_triggered) {
-		gprot_get_version_triggered = false;
-		gpc_send_string(FIRMWARE_VERSION, sizeof(FIRMWARE_VERSION));
-		gpc_send_string(FIRMWARE_COPYRIGHT, sizeof(FIRMWARE_COPYRIGHT));
-		gpc_send_string(FIRMWARE_LICENSE, sizeof(FIRMWARE_LICENSE));
-	}
+	(void)data;
+
+	gpc_send_string(FIRMWARE_VERSION, sizeof(FIRMWARE_VERSION));
+	gpc_send_string(FIRMWARE_COPYRIGHT, sizeof(FIRMWARE_COPYRIGHT));
+	gpc_send_string(FIRMWARE_LICENSE, sizeof(FIRMWARE_LICENSE));
 }
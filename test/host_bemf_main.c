@@ -0,0 +1,130 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   host_bemf_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Sensorless commutation engine against the simulated motor.
+ *
+ * Starts the simulated motor with the back EMF zero crossing engine and
+ * checks that it closes the loop, keeps the rotor in sync and commutates
+ * close to 30 degrees after every zero crossing. The dma1_channel1_isr line
+ * of the report is the cost of the zero crossing detection.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libopencm3/stm32/f1/nvic.h>
+
+#include "host/sim.h"
+#include "host/motor.h"
+
+#include "driver/mcu.h"
+#include "driver/led.h"
+#include "driver/pwm.h"
+#include "driver/adc.h"
+#include "driver/timer.h"
+
+#include "src/bemf.h"
+
+/**
+ * Host sensorless commutation test main function
+ *
+ * @param argc Argument count.
+ * @param argv Optional simulated run time in seconds.
+ */
+int main(int argc, char *argv[])
+{
+	const struct motor_stats *st;
+	struct motor_params params;
+	uint32_t seconds = 2;
+	uint32_t ms;
+	uint64_t sysclk;
+	double rpm, delay;
+	int errors = 0;
+
+	if (argc > 1) {
+		seconds = (uint32_t)strtoul(argv[1], NULL, 0);
+	}
+
+	sim_init();
+	motor_default_params(&params);
+	params.load = 0.002;
+	motor_init(&params);
+	motor_attach();
+
+	mcu_init();
+	led_init();
+	pwm_init();
+	pwm_set(INT16_MAX / 4);
+	adc_init(bemf_adc_callback, bemf_adc_callback);
+	timer_init();
+	bemf_init();
+
+	sysclk = sim_get_sysclk();
+
+	/* Let TIM2 pick up its prescaler before starting the ramp. */
+	sim_run(sysclk / 100);
+	bemf_start();
+
+	/* Ramp up and settle. */
+	sim_run(sysclk / 2);
+	motor_reset_stats();
+	sim_reset_isr_stats();
+
+	for (ms = 0; ms < seconds * 1000; ms++) {
+		sim_run(sysclk / 1000);
+	}
+
+	motor_report(stdout);
+	sim_report(stdout);
+
+	st = motor_get_stats();
+	rpm = motor_get_state()->omega * 60.0 / (2.0 * 3.14159265358979);
+	delay = (st->delays != 0) ? st->delay_sum / st->delays : 0.0;
+
+	printf("bemf: mode %d, period %u ticks, %lu zero crossings, "
+	       "%lu timeouts\n", (int)bemf_get_mode(),
+	       (unsigned int)bemf_get_period(),
+	       (unsigned long)bemf_get_zero_crossings(),
+	       (unsigned long)bemf_get_timeouts());
+
+	if (bemf_get_mode() != BEMF_RUN) {
+		fprintf(stderr, "engine did not close the loop\n");
+		errors++;
+	}
+	if (rpm < 1000.0) {
+		fprintf(stderr, "motor did not spin up: %.0frpm\n", rpm);
+		errors++;
+	}
+	if (delay < 20.0 || delay > 40.0) {
+		fprintf(stderr, "zero crossing to commutation delay %.1f\n",
+			delay);
+		errors++;
+	}
+
+	if (errors != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
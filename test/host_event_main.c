@@ -0,0 +1,271 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   host_event_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Interrupt to main loop event queue test.
+ *
+ * The usart receive interrupt posts every byte to the high priority queue,
+ * a TIM2 soft timer posts a sequence number to the normal and a Sys Tick
+ * soft timer to the low priority queue. The main loop drains the queues
+ * every millisecond and checks that no event is lost or reordered and that
+ * the higher priority events run first. Then the main loop stops draining
+ * for a while, the events that do not fit have to be dropped and counted.
+ * Exits non zero on any mismatch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host/sim.h"
+
+#include "driver/mcu.h"
+#include "driver/led.h"
+#include "driver/timer.h"
+#include "driver/sys_tick.h"
+#include "driver/usart.h"
+#include "driver/event.h"
+
+/* TIM2 soft timer period in ticks (0.25us), 10kHz. */
+#define TEST_TIMER_TICKS 400
+
+/* Sys Tick soft timer period in us. */
+#define TEST_SYS_TICK_US 1000
+
+/* Bytes received per millisecond, less than the usart can take. */
+#define TEST_BURST 4
+
+/* Milliseconds the main loop does not drain the queues. */
+#define TEST_STALL_MS 10
+
+/* Events per queue, matches the default EVENT_QUEUE_SIZE. */
+#define TEST_QUEUE_SIZE 32
+
+struct test_stream {
+	uint32_t posted; /**< Next sequence number to post */
+	uint32_t expected; /**< Next sequence number to process */
+	uint32_t processed;
+	uint32_t gaps; /**< Sequence numbers skipped */
+	uint32_t errors; /**< Sequence numbers out of order */
+};
+
+static struct test_stream test_streams[EVENT_PRIORITIES];
+
+/* Priority of the last event run in the current event_process() call. */
+static int test_last_priority;
+static uint32_t test_order_errors;
+
+static void test_handle(enum event_priority priority, uint32_t data)
+{
+	struct test_stream *stream = &test_streams[priority];
+
+	if ((int)priority < test_last_priority) {
+		test_order_errors++;
+	}
+	test_last_priority = (int)priority;
+
+	if (data < stream->expected) {
+		stream->errors++;
+	} else {
+		stream->gaps += data - stream->expected;
+	}
+	stream->expected = data + 1;
+	stream->processed++;
+}
+
+static void test_high_handler(uint32_t data)
+{
+	test_handle(EVENT_PRIORITY_HIGH, data);
+}
+
+static void test_normal_handler(uint32_t data)
+{
+	test_handle(EVENT_PRIORITY_NORMAL, data);
+}
+
+static void test_low_handler(uint32_t data)
+{
+	test_handle(EVENT_PRIORITY_LOW, data);
+}
+
+/**
+ * Usart receive callback, the bytes count up modulo 256.
+ */
+static int test_usart_handle_byte(uint8_t byte)
+{
+	struct test_stream *stream = &test_streams[EVENT_PRIORITY_HIGH];
+
+	/* Extend the byte to the full sequence number. */
+	if (byte != (uint8_t)stream->posted) {
+		stream->errors++;
+	}
+	(void)event_post(EVENT_PRIORITY_HIGH, test_high_handler,
+			 stream->posted++);
+
+	return 0;
+}
+
+static int32_t test_usart_get_byte(void)
+{
+	return -1;
+}
+
+static void test_timer_callback(int timer_id, uint16_t time)
+{
+	(void)timer_id;
+	(void)time;
+
+	(void)event_post(EVENT_PRIORITY_NORMAL, test_normal_handler,
+			 test_streams[EVENT_PRIORITY_NORMAL].posted++);
+}
+
+static void test_sys_tick_callback(int id)
+{
+	(void)id;
+
+	(void)event_post(EVENT_PRIORITY_LOW, test_low_handler,
+			 test_streams[EVENT_PRIORITY_LOW].posted++);
+}
+
+static void test_receive(void)
+{
+	uint8_t burst[TEST_BURST];
+	uint32_t i, next = test_streams[EVENT_PRIORITY_HIGH].posted;
+	static uint32_t sent;
+
+	/* Continue the byte sequence after the bytes still in flight. */
+	if (sent > next) {
+		next = sent;
+	}
+	for (i = 0; i < TEST_BURST; i++) {
+		burst[i] = (uint8_t)(next + i);
+	}
+	sent = next + TEST_BURST;
+	sim_usart_receive(burst, sizeof(burst));
+}
+
+static int test_drain(void)
+{
+	test_last_priority = 0;
+	return event_process();
+}
+
+/**
+ * Host event queue test main function
+ *
+ * @param argc Argument count.
+ * @param argv Optional simulated run time in seconds.
+ */
+int main(int argc, char *argv[])
+{
+	uint32_t seconds = 1;
+	uint32_t ms, i, dropped[EVENT_PRIORITIES];
+	uint64_t sysclk;
+	int errors = 0;
+
+	if (argc > 1) {
+		seconds = (uint32_t)strtoul(argv[1], NULL, 0);
+	}
+
+	sim_init();
+	mcu_init();
+	led_init();
+	event_init();
+	timer_init();
+	sys_tick_init();
+	usart_init(test_usart_handle_byte, test_usart_get_byte,
+		   USART_DEFAULT_BAUDRATE);
+
+	sysclk = sim_get_sysclk();
+
+	/* Let TIM2 pick up its prescaler on the first update event. */
+	sim_run(sysclk / 100);
+
+	(void)timer_register(TEST_TIMER_TICKS, test_timer_callback, false);
+	(void)sys_tick_timer_register(test_sys_tick_callback,
+				      TEST_SYS_TICK_US);
+	sim_reset_isr_stats();
+
+	for (ms = 0; ms < seconds * 1000; ms++) {
+		test_receive();
+		sim_run(sysclk / 1000);
+		(void)test_drain();
+	}
+
+	for (i = 0; i < EVENT_PRIORITIES; i++) {
+		if (event_get_dropped((enum event_priority)i) != 0 ||
+		    test_streams[i].gaps != 0) {
+			fprintf(stderr, "queue %lu lost events while "
+				"drained\n", (unsigned long)i);
+			errors++;
+		}
+	}
+
+	/* The timer posts 10 events per millisecond, the queue overflows. */
+	sim_run(sysclk * TEST_STALL_MS / 1000);
+	(void)test_drain();
+	sim_run(sysclk / 1000);
+	(void)test_drain();
+
+	sim_report(stdout);
+
+	for (i = 0; i < EVENT_PRIORITIES; i++) {
+		dropped[i] = event_get_dropped((enum event_priority)i);
+		printf("event: queue %lu posted %lu, processed %lu, dropped "
+		       "%lu\n", (unsigned long)i,
+		       (unsigned long)test_streams[i].posted,
+		       (unsigned long)test_streams[i].processed,
+		       (unsigned long)dropped[i]);
+		if (test_streams[i].processed + dropped[i] !=
+		    test_streams[i].posted ||
+		    test_streams[i].gaps != dropped[i] ||
+		    test_streams[i].errors != 0) {
+			fprintf(stderr, "queue %lu lost or reordered events\n",
+				(unsigned long)i);
+			errors++;
+		}
+	}
+
+	if (dropped[EVENT_PRIORITY_NORMAL] !=
+	    (TEST_STALL_MS * 4000 / TEST_TIMER_TICKS) - TEST_QUEUE_SIZE) {
+		fprintf(stderr, "expected %d dropped timer events\n",
+			(TEST_STALL_MS * 4000 / TEST_TIMER_TICKS) -
+			TEST_QUEUE_SIZE);
+		errors++;
+	}
+	if (test_order_errors != 0) {
+		fprintf(stderr, "%lu events ran before higher priority ones\n",
+			(unsigned long)test_order_errors);
+		errors++;
+	}
+	if (test_streams[EVENT_PRIORITY_HIGH].processed <
+	    (seconds * 1000 * TEST_BURST) - TEST_BURST) {
+		fprintf(stderr, "too few usart bytes received\n");
+		errors++;
+	}
+
+	if (errors != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
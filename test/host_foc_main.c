@@ -0,0 +1,247 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   host_foc_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Field oriented control against the simulated motor.
+ *
+ * Runs the FOC engine in src/foc.c on the simulated STM32 with a sinusoidal
+ * motor plant. The rotor angle is taken from the plant every pwm period,
+ * like from an ideal position sensor. Compares the d and q current the plant
+ * really carries against the references and reports the cost of one control
+ * period, in the simulated interrupt and in a loop calling the callback
+ * directly. Exits non zero if the motor does not spin up or the currents
+ * are not regulated.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include <libopencm3/stm32/f1/nvic.h>
+
+#include "host/sim.h"
+#include "host/motor.h"
+
+#include "driver/mcu.h"
+#include "driver/led.h"
+#include "driver/pwm.h"
+#include "driver/adc.h"
+
+#include "src/foc.h"
+
+#define FOC_PI 3.14159265358979
+
+/* Current references in A. */
+#define FOC_ID_REF 0.0
+#define FOC_IQ_REF 1.5
+
+/* Core clock cycles of one center aligned pwm period. */
+#define FOC_PWM_CYCLES (2 * PWM_DUTY_MAX)
+
+/* Callback calls of the direct benchmark. */
+#define FOC_BENCH_CALLS 1000000
+
+static double foc_i_full_scale;
+static int foc_pole_pairs;
+
+static int16_t foc_amps_to_q15(double amps)
+{
+	return (int16_t)(amps / foc_i_full_scale * 32768.0);
+}
+
+static double foc_q15_to_amps(int16_t value)
+{
+	return (double)value * foc_i_full_scale / 32768.0;
+}
+
+/**
+ * Rotor d axis angle of the plant. The back EMF of phase U is
+ * ke * omega * sin(theta_e), its flux linkage peaks at theta_e + 180deg.
+ */
+static double foc_plant_angle(void)
+{
+	return motor_get_state()->theta_e + FOC_PI;
+}
+
+static void foc_sensor_adc_callback(bool transfer_complete,
+				    uint16_t *raw_data)
+{
+	const struct motor_state *s = motor_get_state();
+	double turn = foc_plant_angle() / (2.0 * FOC_PI);
+	double speed = s->omega * foc_pole_pairs * FOC_PWM_CYCLES /
+		       (double)sim_get_sysclk() / (2.0 * FOC_PI);
+
+	foc_set_angle((uint16_t)(int64_t)floor(turn * 65536.0),
+		      (int16_t)lround(speed * 65536.0));
+	foc_adc_callback(transfer_complete, raw_data);
+}
+
+/**
+ * The d and q current the plant carries.
+ */
+static void foc_plant_dq(double *id, double *iq)
+{
+	const struct motor_state *s = motor_get_state();
+	double ia = s->i[0];
+	double ib = (s->i[0] + (2.0 * s->i[1])) / sqrt(3.0);
+	double angle = foc_plant_angle();
+
+	*id = (ia * cos(angle)) + (ib * sin(angle));
+	*iq = (ib * cos(angle)) - (ia * sin(angle));
+}
+
+static double foc_host_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+/**
+ * Host FOC test main function
+ *
+ * @param argc Argument count.
+ * @param argv Optional simulated run time in seconds.
+ */
+int main(int argc, char *argv[])
+{
+	const struct sim_isr_stats *isr;
+	struct motor_params params;
+	uint16_t raw_data[16];
+	uint32_t seconds = 1;
+	uint32_t ms, n, periods, samples, updates;
+	uint64_t sysclk;
+	double id, iq, id_sum = 0.0, iq_sum = 0.0, iq_sumsq = 0.0;
+	double foc_id_sum = 0.0, foc_iq_sum = 0.0;
+	double rpm, start, bench;
+	int16_t foc_id, foc_iq;
+	int errors = 0;
+
+	if (argc > 1) {
+		seconds = (uint32_t)strtoul(argv[1], NULL, 0);
+	}
+
+	sim_init();
+	motor_default_params(&params);
+	params.sinusoidal = true;
+	params.load = 0.002;
+	/* Fan like load, settles the speed below the voltage limit. */
+	params.b = 2e-5;
+	motor_init(&params);
+	motor_attach();
+	foc_i_full_scale = params.adc_i_full_scale;
+	foc_pole_pairs = params.pole_pairs;
+
+	mcu_init();
+	led_init();
+	pwm_init();
+	adc_init(foc_sensor_adc_callback, foc_sensor_adc_callback);
+	foc_init();
+	foc_set_current(foc_amps_to_q15(FOC_ID_REF),
+			foc_amps_to_q15(FOC_IQ_REF));
+
+	sysclk = sim_get_sysclk();
+
+	sim_run(sysclk / 100);
+	foc_start();
+
+	/* Spin up, the mechanical time constant is J / b = 0.5s. */
+	sim_run(sysclk * 2);
+	motor_reset_stats();
+	sim_reset_isr_stats();
+	periods = foc_get_periods();
+	samples = foc_get_samples();
+	updates = foc_get_updates();
+
+	for (ms = 0; ms < seconds * 1000; ms++) {
+		sim_run(sysclk / 1000);
+		foc_plant_dq(&id, &iq);
+		id_sum += id;
+		iq_sum += iq;
+		iq_sumsq += (iq - FOC_IQ_REF) * (iq - FOC_IQ_REF);
+		foc_get_current(&foc_id, &foc_iq);
+		foc_id_sum += foc_q15_to_amps(foc_id);
+		foc_iq_sum += foc_q15_to_amps(foc_iq);
+	}
+
+	periods = foc_get_periods() - periods;
+	samples = foc_get_samples() - samples;
+	updates = foc_get_updates() - updates;
+	id = id_sum / ms;
+	iq = iq_sum / ms;
+
+	motor_report(stdout);
+	sim_report(stdout);
+
+	/* Direct calls, same work as in the interrupt. */
+	for (n = 0; n < 16; n++) {
+		raw_data[n] = 2048 + (uint16_t)(n * 8);
+	}
+	start = foc_host_seconds();
+	for (n = 0; n < FOC_BENCH_CALLS; n++) {
+		foc_set_angle((uint16_t)(n * 97), 97);
+		foc_adc_callback((n & 1) != 0, raw_data);
+	}
+	bench = foc_host_seconds() - start;
+	foc_stop();
+
+	rpm = motor_get_state()->omega * 60.0 / (2.0 * FOC_PI);
+	isr = sim_get_isr_stats(NVIC_ADC1_2_IRQ);
+
+	printf("foc: %lu periods, %lu current samples, %lu regulator "
+	       "updates\n", (unsigned long)periods, (unsigned long)samples,
+	       (unsigned long)updates);
+	printf("foc: plant id %.3fA iq %.3fA (ref %.3fA %.3fA), iq rms "
+	       "error %.3fA, engine id %.3fA iq %.3fA\n", id, iq, FOC_ID_REF,
+	       FOC_IQ_REF, sqrt(iq_sumsq / ms), foc_id_sum / ms,
+	       foc_iq_sum / ms);
+	printf("foc: %.0fns and %.1f register accesses per period in the "
+	       "interrupt, %.0fns per direct call\n",
+	       (isr->count != 0) ? (double)isr->ns_total / isr->count : 0.0,
+	       (isr->count != 0) ? (double)isr->mmio / isr->count : 0.0,
+	       bench * 1e9 / FOC_BENCH_CALLS);
+
+	if (rpm < 1000.0) {
+		fprintf(stderr, "motor did not spin up: %.0frpm\n", rpm);
+		errors++;
+	}
+	if (fabs(iq - FOC_IQ_REF) > 0.1 * FOC_IQ_REF ||
+	    fabs(id - FOC_ID_REF) > 0.1 * FOC_IQ_REF) {
+		fprintf(stderr, "current not regulated\n");
+		errors++;
+	}
+	if (periods < seconds * 15000 || updates < periods / 2) {
+		fprintf(stderr, "too few control periods or updates\n");
+		errors++;
+	}
+
+	if (errors != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
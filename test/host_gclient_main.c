@@ -0,0 +1,305 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   host_gclient_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Governor client against the governor test firmware on a pty.
+ *
+ * Forks the governor test firmware, test/governor_main.c run in the host
+ * simulation in real time with USART1 on a pty, and talks to it with the
+ * client library in host/gclient.c like to a controller on a serial device.
+ * Checks version strings, reads, writes and the rate limited counter
+ * notifications and the interrupt profile registers, then benchmarks the round trip time of reads and writes
+ * and the register throughput at the default line speed and after
+ * negotiating a faster one. No frame may be lost or malformed. The target
+ * is linked with -Wl,--wrap=main, the firmware main() runs in the child.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host/sim.h"
+#include "host/sim_pty.h"
+#include "host/gclient.h"
+
+#include "driver/usart.h"
+
+/* Seconds the controller runs at most, in case the test does not stop it. */
+#define TEST_CONTROLLER_TIMEOUT 120
+
+/* Line speed the client negotiates. */
+#define TEST_FAST_BAUDRATE 921600
+
+/* Round trips per latency benchmark and throughput benchmark time. */
+#define TEST_ROUNDS 100
+#define TEST_BENCH_MS 500
+
+/* Registers of the governor test firmware. */
+#define TEST_COUNTER_REG 5
+#define TEST_UPTIME_REG 6
+#define TEST_SCRATCH_REG 8
+#define TEST_SCRATCH_COUNT 8
+#define TEST_PROFILE_DATA_REG 8
+#define TEST_PROFILE_SELECT_REG 16
+#define TEST_SPEED_REG 30
+#define TEST_CONFIRM_REG 31
+
+/* Profiled handlers, PROFILE_USART and PROFILE_SYS_TICK. */
+#define TEST_PROFILE_USART 3
+#define TEST_PROFILE_SYS_TICK 4
+
+/* Shortest interval of the counter notifications in ms. */
+#define TEST_NOTIFY_MS 50
+
+/* Timeout of a request in ms. */
+#define TEST_TIMEOUT 1000
+
+/* Bytes on the wire of a one register read request and its answer. */
+#define TEST_READ_WIRE_BYTES (7 + 8)
+
+int __real_main(void);
+int __wrap_main(void);
+
+static int test_controller(int fd)
+{
+	alarm(TEST_CONTROLLER_TIMEOUT);
+
+	sim_init();
+	sim_pty_attach(fd, true);
+
+	return __real_main();
+}
+
+/**
+ * Process what the controller sends for a while.
+ */
+static void test_poll(struct gclient *gc, int ms)
+{
+	struct timespec ts;
+	double end;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	end = (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9) + (ms / 1000.0);
+	do {
+		(void)gclient_poll(gc, 1);
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+	} while ((double)ts.tv_sec + ((double)ts.tv_nsec / 1e9) < end);
+}
+
+static int test_count_lines(const char *str)
+{
+	int lines = 0;
+
+	while (*str != '\0') {
+		lines += (*str++ == '\n') ? 1 : 0;
+	}
+
+	return lines;
+}
+
+static int test_bench(struct gclient *gc, struct gclient_throughput *tp)
+{
+	struct gclient_latency read, write;
+	double wire = TEST_READ_WIRE_BYTES * 10.0 * 1e6 / gc->baudrate;
+	int errors = 0;
+
+	(void)gclient_bench_latency(gc, false, 0, 1, TEST_ROUNDS, &read);
+	(void)gclient_bench_latency(gc, true, TEST_SCRATCH_REG,
+				    TEST_SCRATCH_COUNT, TEST_ROUNDS, &write);
+	gclient_bench_throughput(gc, TEST_BENCH_MS, tp);
+
+	printf("gclient: %lu baud, read of 1 register min %.0fus mean %.0fus "
+	       "p99 %.0fus max %.0fus (%.0fus on the wire)\n",
+	       (unsigned long)gc->baudrate, read.min, read.mean, read.p99,
+	       read.max, wire);
+	printf("gclient: %lu baud, write of %d registers min %.0fus mean "
+	       "%.0fus p99 %.0fus max %.0fus\n", (unsigned long)gc->baudrate,
+	       TEST_SCRATCH_COUNT, write.min, write.mean, write.p99,
+	       write.max);
+	printf("gclient: %lu baud, %.0f registers/s, line %.0f%% used\n",
+	       (unsigned long)gc->baudrate, tp->regs / tp->seconds,
+	       100.0 * tp->bytes * 10.0 / (gc->baudrate * tp->seconds));
+
+	if (read.count != TEST_ROUNDS || write.count != TEST_ROUNDS ||
+	    tp->timeouts != 0) {
+		fprintf(stderr, "requests not answered\n");
+		errors++;
+	}
+	/* The simulation makes up a step it fell behind. */
+	if (read.min < wire - SIM_PTY_STEP_US) {
+		fprintf(stderr, "answer faster than the line\n");
+		errors++;
+	}
+
+	return errors;
+}
+
+/**
+ * Host governor client test main function
+ */
+int __wrap_main(void)
+{
+	struct gclient gc;
+	struct gclient_throughput slow, fast;
+	struct gclient_profile profile;
+	uint16_t values[TEST_SCRATCH_COUNT];
+	uint32_t updates, uptime;
+	char name[64];
+	pid_t pid;
+	int fd, i, ms, lines = 0, status, errors = 0;
+
+	fd = sim_pty_open(name, sizeof(name));
+	if (fd < 0) {
+		perror("pty");
+		return 1;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 1;
+	}
+	if (pid == 0) {
+		exit(test_controller(fd));
+	}
+	close(fd);
+
+	if (gclient_open(&gc, name, USART_DEFAULT_BAUDRATE) != 0) {
+		perror(name);
+		kill(pid, SIGTERM);
+		return 1;
+	}
+
+	/* Version strings, three of them and four lines. */
+	(void)gclient_send_version(&gc);
+	for (ms = 0; ms < TEST_TIMEOUT && lines < 4; ms += 10) {
+		test_poll(&gc, 10);
+		lines = test_count_lines(gc.version);
+	}
+	printf("gclient: version%s", gc.version);
+	if (lines < 4 || strstr(gc.version, "firmware") == NULL) {
+		fprintf(stderr, "no version strings\n");
+		errors++;
+	}
+
+	/* The firmware initializes register n to 3n. */
+	if (gclient_read(&gc, 0, 5, values, TEST_TIMEOUT) != 0) {
+		fprintf(stderr, "registers not read\n");
+		errors++;
+	}
+	for (i = 0; i < 5; i++) {
+		if (values[i] != 3 * i) {
+			fprintf(stderr, "register %d is %u\n", i, values[i]);
+			errors++;
+		}
+	}
+
+	for (i = 0; i < TEST_SCRATCH_COUNT; i++) {
+		values[i] = (uint16_t)(1000 + i);
+	}
+	if (gclient_write(&gc, TEST_SCRATCH_REG, TEST_SCRATCH_COUNT, values,
+			  TEST_TIMEOUT) != 0 ||
+	    gclient_read(&gc, TEST_SCRATCH_REG, TEST_SCRATCH_COUNT, NULL,
+			 TEST_TIMEOUT) != 0 ||
+	    memcmp(&gc.regs[TEST_SCRATCH_REG], values, sizeof(values)) != 0) {
+		fprintf(stderr, "registers not written\n");
+		errors++;
+	}
+
+	/* The counter changes every ms and goes out at most every 50ms. */
+	updates = gc.updates[TEST_COUNTER_REG];
+	uptime = gc.regs[TEST_UPTIME_REG] |
+		 ((uint32_t)gc.regs[TEST_UPTIME_REG + 1] << 16);
+	test_poll(&gc, 500);
+	updates = gc.updates[TEST_COUNTER_REG] - updates;
+	uptime = (gc.regs[TEST_UPTIME_REG] |
+		  ((uint32_t)gc.regs[TEST_UPTIME_REG + 1] << 16)) - uptime;
+	printf("gclient: %lu counter notifications in 500ms, uptime %lums "
+	       "later\n", (unsigned long)updates, (unsigned long)uptime);
+	if (updates < 3 || updates > 500 / TEST_NOTIFY_MS + 1 ||
+	    uptime == 0) {
+		fprintf(stderr, "counter notifications wrong\n");
+		errors++;
+	}
+
+	/* The firmware is built with -DPROFILE, the usart and Sys Tick
+	 * handlers ran all along.
+	 */
+	for (i = TEST_PROFILE_USART; i <= TEST_PROFILE_SYS_TICK; i++) {
+		if (gclient_read_profile(&gc, TEST_PROFILE_SELECT_REG,
+					 TEST_PROFILE_DATA_REG, (uint16_t)i,
+					 &profile) != 0) {
+			fprintf(stderr, "profile not read\n");
+			errors++;
+			break;
+		}
+		printf("gclient: profile %d: %lu calls, %u/%u/%u cycles, load "
+		       "%.2f%% of %.2f%%\n", i, (unsigned long)profile.count,
+		       profile.min, profile.mean, profile.max,
+		       100.0 * profile.load, 100.0 * profile.total_load);
+		if (profile.count == 0 || profile.min > profile.mean ||
+		    profile.mean > profile.max || profile.load <= 0.0 ||
+		    profile.load > profile.total_load) {
+			fprintf(stderr, "profile %d wrong\n", i);
+			errors++;
+		}
+	}
+
+	errors += test_bench(&gc, &slow);
+
+	if (gclient_negotiate(&gc, TEST_FAST_BAUDRATE, TEST_SPEED_REG,
+			      TEST_CONFIRM_REG) != 0) {
+		fprintf(stderr, "line speed not negotiated\n");
+		errors++;
+	} else {
+		errors += test_bench(&gc, &fast);
+		if (fast.regs / fast.seconds <= slow.regs / slow.seconds) {
+			fprintf(stderr, "no faster at %d baud\n",
+				TEST_FAST_BAUDRATE);
+			errors++;
+		}
+	}
+
+	gclient_report(&gc, stdout);
+	if (gc.counters.lost != 0 || gc.counters.bad != 0) {
+		fprintf(stderr, "frames lost or malformed\n");
+		errors++;
+	}
+
+	gclient_close(&gc);
+	kill(pid, SIGTERM);
+	(void)waitpid(pid, &status, 0);
+
+	if (errors != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
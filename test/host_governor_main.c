@@ -0,0 +1,70 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   host_governor_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Governor test firmware on a pseudo terminal.
+ *
+ * Runs test/governor_main.c unchanged in the host simulation with the
+ * simulated USART1 on a pty, in real time, so host_gclient or any other
+ * host program can talk to it like to a controller on a serial device. The
+ * target is linked with -Wl,--wrap=main, the function here sets up the
+ * simulation and then runs the firmware main(), which never returns.
+ * Pass -f to run the simulation as fast as it goes instead.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "host/sim.h"
+#include "host/sim_pty.h"
+
+int __real_main(void);
+int __wrap_main(int argc, char *argv[]);
+
+/**
+ * Host governor test main function
+ *
+ * @param argc Argument count.
+ * @param argv Optional -f.
+ */
+int __wrap_main(int argc, char *argv[])
+{
+	char name[64];
+	bool realtime = true;
+	int fd;
+
+	if (argc > 1 && strcmp(argv[1], "-f") == 0) {
+		realtime = false;
+	}
+
+	fd = sim_pty_open(name, sizeof(name));
+	if (fd < 0) {
+		perror("pty");
+		return 1;
+	}
+	printf("governor: controller on %s\n", name);
+	fflush(stdout);
+
+	sim_init();
+	sim_pty_attach(fd, realtime);
+
+	return __real_main();
+}
@@ -0,0 +1,364 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   host_isr_bench_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Host simulation interrupt benchmark.
+ *
+ * Runs all drivers together on the simulated STM32 and reports how often
+ * each interrupt service routine ran and how long it took on the host. The
+ * commutation is driven from a TIM2 soft timer, the ADC runs continuously,
+ * the Sys Tick fires every 100us and a stream of bytes is echoed through the
+ * USART. Exits non zero if the interrupt rates do not match the
+ * configuration.
+ *
+ * Built with -DPROFILE the handlers profile themselves with the DWT cycle
+ * counter, which the simulation runs on by its cycle model. The profile has
+ * to agree with the statistics of the simulation. *
+ * Built with -DRAMFUNC the hot handlers and the vector table are in SRAM.
+ * Reports the cycles they take there against the cycles the model gives
+ * them from flash, and checks that they and only they run from SRAM.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libopencm3/stm32/f1/nvic.h>
+#include <libopencm3/cm3/scb.h>
+
+#include "host/sim.h"
+
+#include "driver/mcu.h"
+#include "driver/led.h"
+#include "driver/pwm.h"
+#include "driver/adc.h"
+#include "driver/timer.h"
+#include "driver/sys_tick.h"
+#include "driver/usart.h"
+#include "driver/profile.h"
+
+/* Commutation period in TIM2 ticks (0.25us). */
+#define BENCH_COMM_TICKS 400
+
+/* Bytes sent to the USART every simulated millisecond. */
+#define BENCH_USART_BURST 4
+
+static uint32_t adc_callbacks;
+static uint32_t usart_rx_bytes;
+static uint32_t usart_tx_bytes;
+static uint8_t echo_buf[256];
+static uint8_t echo_head;
+static uint8_t echo_tail;
+
+static void bench_adc_callback(bool transfer_complete, uint16_t *raw_data)
+{
+	(void)transfer_complete;
+	(void)raw_data;
+
+	adc_callbacks++;
+}
+
+static void bench_comm_callback(int id, uint16_t time)
+{
+	(void)id;
+	(void)time;
+
+	pwm_comm();
+}
+
+static int bench_usart_handle_byte(uint8_t byte)
+{
+	echo_buf[echo_head++] = byte;
+	usart_enable_send();
+
+	return 0;
+}
+
+static int32_t bench_usart_get_byte(void)
+{
+	if (echo_head == echo_tail) {
+		return -1;
+	}
+
+	return echo_buf[echo_tail++];
+}
+
+static uint16_t bench_adc_sample(int channel)
+{
+	return (uint16_t)(channel * 500);
+}
+
+static void bench_usart_tx(uint8_t byte)
+{
+	(void)byte;
+
+	usart_tx_bytes++;
+}
+
+/**
+ * Compare an observed interrupt count against the expected one.
+ *
+ * @return 0 if the count is within 1% of the expected value, 1 otherwise.
+ */
+static int bench_check(const char *name, uint64_t count, uint64_t expected)
+{
+	uint64_t diff = (count > expected) ? count - expected :
+					     expected - count;
+
+	if (diff * 100 > expected) {
+		fprintf(stderr, "%s: got %llu expected %llu\n", name,
+			(unsigned long long)count,
+			(unsigned long long)expected);
+		return 1;
+	}
+
+	return 0;
+}
+
+#ifdef PROFILE
+/* Simulation statistics slots of the profiled handlers. */
+static const struct {
+	const char *name;
+	int slot;
+} bench_profiled[PROFILE_ISRS] = {
+	{ "tim1_trg_com_isr", NVIC_TIM1_TRG_COM_IRQ },
+	{ "dma1_channel1_isr", NVIC_DMA1_CHANNEL1_IRQ },
+	{ "tim2_isr", NVIC_TIM2_IRQ },
+	{ "usart1_isr", NVIC_USART1_IRQ },
+	{ "sys_tick_handler", SIM_ISR_SYSTICK }
+};
+
+/**
+ * Print the profile and compare it against the simulation statistics.
+ *
+ * @return Number of errors.
+ */
+static int bench_profile(void)
+{
+	const struct sim_isr_stats *sim;
+	struct profile_stats stats;
+	uint64_t isr_cycles = sim_get_isr_cycles();
+	double sim_load = (double)isr_cycles /
+			  (double)(sim_get_cycles() + isr_cycles);
+	double load = profile_get_load(PROFILE_ISRS) / 10000.0;
+	int i, errors = 0;
+
+	printf("%-20s %10s %9s %9s %9s %9s %7s\n", "profile", "count",
+	       "min[cyc]", "mean[cyc]", "max[cyc]", "preempt", "load");
+
+	for (i = 0; i < PROFILE_ISRS; i++) {
+		profile_get((enum profile_isr)i, &stats);
+		sim = sim_get_isr_stats(bench_profiled[i].slot);
+		printf("%-20s %10lu %9lu %9lu %9lu %9lu %6.2f%%\n",
+		       bench_profiled[i].name, (unsigned long)stats.count,
+		       (unsigned long)stats.min,
+		       (unsigned long)((stats.count != 0) ?
+				       stats.total / stats.count : 0),
+		       (unsigned long)stats.max,
+		       (unsigned long)((stats.count != 0) ?
+				       stats.preempted / stats.count : 0),
+		       profile_get_load((enum profile_isr)i) / 100.0);
+
+		/* The profile does not see the exception entry and return. */
+		if (stats.count != sim->count ||
+		    stats.total > sim->cycles_total) {
+			fprintf(stderr, "%s: profile does not match the "
+				"simulation\n", bench_profiled[i].name);
+			errors++;
+		}
+	}
+
+	printf("profile: interrupts %.2f%% of the cycles, %.2f%% by the "
+	       "cycle model\n", 100.0 * load, 100.0 * sim_load);
+
+	if (load > sim_load || load < sim_load / 2) {
+		fprintf(stderr, "profile load does not match the "
+			"simulation\n");
+		errors++;
+	}
+
+	return errors;
+}
+#endif
+
+#ifdef RAMFUNC
+/* Handlers and whether they are built to run from SRAM. */
+static const struct {
+	const char *name;
+	int slot;
+	bool ram;
+} bench_ramfunc_isrs[] = {
+	{ "tim1_trg_com_isr", NVIC_TIM1_TRG_COM_IRQ, true },
+	{ "dma1_channel1_isr", NVIC_DMA1_CHANNEL1_IRQ, true },
+	{ "tim2_isr", NVIC_TIM2_IRQ, true },
+	{ "usart1_isr", NVIC_USART1_IRQ, false },
+	{ "sys_tick_handler", SIM_ISR_SYSTICK, false }
+};
+
+/**
+ * Print the mean cycles of the handlers from SRAM and from flash and check
+ * where they run.
+ *
+ * From flash every register access pays the wait states on its literal
+ * load and the exception entry on the vector fetch.
+ *
+ * @return Number of errors.
+ */
+static int bench_ramfunc(void)
+{
+	const struct sim_cycle_model *model = sim_get_cycle_model();
+	const struct sim_isr_stats *sim;
+	double cycles, flash;
+	unsigned int i;
+	int errors = 0;
+
+	printf("%-20s %5s %9s %10s\n", "ramfunc", "from", "mean[cyc]",
+	       "flash[cyc]");
+
+	for (i = 0; i < sizeof(bench_ramfunc_isrs) /
+		    sizeof(bench_ramfunc_isrs[0]); i++) {
+		sim = sim_get_isr_stats(bench_ramfunc_isrs[i].slot);
+		if (sim->count == 0) {
+			continue;
+		}
+		cycles = (double)sim->cycles_total / (double)sim->count;
+		flash = cycles;
+		if (sim->ram) {
+			flash += (double)model->flash_wait *
+				 (1.0 + ((double)sim->mmio /
+					 (double)sim->count));
+		}
+		printf("%-20s %5s %9.1f %10.1f\n", bench_ramfunc_isrs[i].name,
+		       sim->ram ? "sram" : "flash", cycles, flash);
+
+		if (sim->ram != bench_ramfunc_isrs[i].ram) {
+			fprintf(stderr, "%s: runs from %s\n",
+				bench_ramfunc_isrs[i].name,
+				sim->ram ? "sram" : "flash");
+			errors++;
+		}
+	}
+
+	if ((SCB_VTOR & 0xff000000U) == 0x08000000U || SCB_VTOR == 0) {
+		fprintf(stderr, "vector table not moved to sram\n");
+		errors++;
+	}
+
+	return errors;
+}
+#endif
+
+/**
+ * Host ISR benchmark main function
+ *
+ * @param argc Argument count.
+ * @param argv Optional simulated run time in seconds.
+ */
+int main(int argc, char *argv[])
+{
+	const uint8_t burst[BENCH_USART_BURST] = { 'o', 'b', 'l', 'd' };
+	uint32_t seconds = 1;
+	uint32_t ms;
+	uint64_t sysclk;
+	int errors = 0;
+
+	if (argc > 1) {
+		seconds = (uint32_t)strtoul(argv[1], NULL, 0);
+	}
+
+	sim_init();
+	sim_set_adc_sample_callback(bench_adc_sample);
+	sim_set_usart_tx_callback(bench_usart_tx);
+
+	mcu_init();
+	led_init();
+	profile_init();
+	pwm_init();
+	pwm_set(INT16_MAX / 10);
+	adc_init(bench_adc_callback, bench_adc_callback);
+	timer_init();
+	sys_tick_init();
+	usart_init(bench_usart_handle_byte, bench_usart_get_byte,
+		   USART_DEFAULT_BAUDRATE);
+
+	(void)timer_register(BENCH_COMM_TICKS, bench_comm_callback, false);
+
+	sysclk = sim_get_sysclk();
+
+	/* Let TIM2 pick up its prescaler on the first update event. */
+	sim_run(sysclk / 100);
+	sim_reset_isr_stats();
+	profile_reset();
+	adc_callbacks = 0;
+
+	for (ms = 0; ms < seconds * 1000; ms++) {
+		sim_usart_receive(burst, sizeof(burst));
+		usart_rx_bytes += sizeof(burst);
+		sim_run(sysclk / 1000);
+	}
+
+	sim_report(stdout);
+
+	errors += bench_check("sys_tick_handler",
+		sim_get_isr_stats(SIM_ISR_SYSTICK)->count,
+		(uint64_t)seconds * 10000);
+	errors += bench_check("tim2_isr",
+		sim_get_isr_stats(NVIC_TIM2_IRQ)->count,
+		(uint64_t)seconds * 4000000 / BENCH_COMM_TICKS);
+#ifdef PWM_COMM_GAPLESS
+	errors += bench_check("tim1_trg_com_isr",
+		sim_get_isr_stats(NVIC_TIM1_TRG_COM_IRQ)->count,
+		(uint64_t)seconds * 4000000 / BENCH_COMM_TICKS);
+#else
+	/* Every commutation generates two COM events, one for the idle step. */
+	errors += bench_check("tim1_trg_com_isr",
+		sim_get_isr_stats(NVIC_TIM1_TRG_COM_IRQ)->count,
+		(uint64_t)seconds * 2 * 4000000 / BENCH_COMM_TICKS);
+#endif
+	/* 20 ADC clock cycles per conversion and 4 dual conversions per half
+	 * transfer, 100kHz at 8MHz.
+	 */
+	errors += bench_check("dma1_channel1_isr",
+		sim_get_isr_stats(NVIC_DMA1_CHANNEL1_IRQ)->count,
+		(uint64_t)seconds * MCU_ADC_CLK / (20 * 4));
+	errors += bench_check("adc callbacks", adc_callbacks,
+		sim_get_isr_stats(NVIC_DMA1_CHANNEL1_IRQ)->count);
+	errors += bench_check("usart", usart_tx_bytes + BENCH_USART_BURST,
+		usart_rx_bytes);
+
+	printf("adc callbacks %lu, usart rx %lu tx %lu\n",
+	       (unsigned long)adc_callbacks, (unsigned long)usart_rx_bytes,
+	       (unsigned long)usart_tx_bytes);
+
+#ifdef PROFILE
+	errors += bench_profile();
+#endif
+#ifdef RAMFUNC
+	errors += bench_ramfunc();
+#endif
+
+	if (errors != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
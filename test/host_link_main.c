@@ -0,0 +1,219 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   host_link_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Line speed negotiation test on the simulated STM32.
+ *
+ * Streams a counting byte sequence through the USART driver, the way the
+ * governor sends register values, and switches the line speed with the link
+ * negotiation in driver/link.c. Checks that the baud rate only changes while
+ * the transmitter is idle, that no byte is lost or repeated across a switch,
+ * that unreachable speeds are rejected, that an unconfirmed switch falls
+ * back to the default speed and that a confirmed one stays. Reports the
+ * throughput at both speeds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libopencm3/stm32/usart.h>
+
+#include "host/sim.h"
+
+#include "driver/mcu.h"
+#include "driver/led.h"
+#include "driver/usart.h"
+#include "driver/sys_tick.h"
+#include "driver/link.h"
+
+/* Line speed the test switches to. */
+#define TEST_FAST_BAUDRATE 2000000
+
+/* Throughput measurement interval in ms. */
+#define TEST_RATE_MS 100
+
+static uint8_t test_next_byte;
+static uint8_t test_expected;
+static uint32_t test_received;
+static uint32_t test_errors;
+static uint32_t test_brr;
+static uint32_t test_switches;
+static uint32_t test_busy_switches;
+
+static int test_handle_byte(uint8_t byte)
+{
+	(void)byte;
+
+	return 0;
+}
+
+static int32_t test_get_byte(void)
+{
+	return test_next_byte++;
+}
+
+static void test_tx(uint8_t byte)
+{
+	if (byte != test_expected) {
+		test_errors++;
+	}
+	test_expected = byte + 1;
+	test_received++;
+}
+
+/**
+ * Runs after the interrupts and before the USART model, catches every baud
+ * rate change before the next byte starts.
+ */
+static void test_step(uint32_t cycles)
+{
+	(void)cycles;
+
+	if (USART_BRR(USART1) == test_brr) {
+		return;
+	}
+
+	test_brr = USART_BRR(USART1);
+	test_switches++;
+	if (!sim_usart_tx_idle()) {
+		test_busy_switches++;
+	}
+}
+
+/**
+ * Run for TEST_RATE_MS and return the bytes per second sent meanwhile.
+ */
+static uint32_t test_rate(void)
+{
+	uint32_t received = test_received;
+
+	sim_run(sim_get_sysclk() / 1000 * TEST_RATE_MS);
+
+	return (test_received - received) * (1000 / TEST_RATE_MS);
+}
+
+/**
+ * Host link test main function
+ */
+int main(void)
+{
+	uint64_t sysclk;
+	uint32_t slow_rate, fast_rate;
+	int errors = 0;
+
+	sim_init();
+	sim_set_usart_tx_callback(test_tx);
+	sim_set_step_callback(test_step);
+
+	mcu_init();
+	led_init();
+	sys_tick_init();
+	usart_init(test_handle_byte, test_get_byte, USART_DEFAULT_BAUDRATE);
+	link_init();
+
+	sysclk = sim_get_sysclk();
+	test_brr = USART_BRR(USART1);
+
+	usart_enable_send();
+	slow_rate = test_rate();
+
+	/* Too fast for the APB2 clock, or no speed at all. */
+	if (link_request(10000000) || link_request(MCU_PCLK2 / 14) ||
+	    link_request(0) ||
+	    usart_get_baudrate() != USART_DEFAULT_BAUDRATE ||
+	    link_get_state() != LINK_DEFAULT) {
+		fprintf(stderr, "unreachable line speed accepted\n");
+		errors++;
+	}
+
+	/* The host never confirms. */
+	if (!link_request(TEST_FAST_BAUDRATE)) {
+		fprintf(stderr, "line speed rejected\n");
+		errors++;
+	}
+	sim_run(sysclk / 1000 * 20);
+	if (usart_get_baudrate() != TEST_FAST_BAUDRATE ||
+	    link_get_state() != LINK_SWITCHING) {
+		fprintf(stderr, "line speed not switched\n");
+		errors++;
+	}
+	sim_run(sysclk / 1000000 * LINK_CONFIRM_TIMEOUT);
+	if (usart_get_baudrate() != USART_DEFAULT_BAUDRATE ||
+	    link_get_state() != LINK_DEFAULT ||
+	    link_get_fallbacks() != 1) {
+		fprintf(stderr, "unconfirmed line speed kept\n");
+		errors++;
+	}
+
+	/* The host confirms. */
+	(void)link_request(TEST_FAST_BAUDRATE);
+	sim_run(sysclk / 1000 * 20);
+	link_confirm();
+	fast_rate = test_rate();
+	sim_run(sysclk / 1000000 * LINK_CONFIRM_TIMEOUT);
+	if (usart_get_baudrate() != TEST_FAST_BAUDRATE ||
+	    link_get_state() != LINK_CONFIRMED ||
+	    link_get_fallbacks() != 1) {
+		fprintf(stderr, "confirmed line speed not kept\n");
+		errors++;
+	}
+
+	/* Back to the default, no confirmation needed. */
+	(void)link_request(USART_DEFAULT_BAUDRATE);
+	sim_run(sysclk / 1000 * 20);
+	if (usart_get_baudrate() != USART_DEFAULT_BAUDRATE ||
+	    link_get_state() != LINK_DEFAULT) {
+		fprintf(stderr, "default line speed not restored\n");
+		errors++;
+	}
+
+	sim_report(stdout);
+
+	printf("link: %lu bytes/s at %d baud, %lu bytes/s at %d baud\n",
+	       (unsigned long)slow_rate, USART_DEFAULT_BAUDRATE,
+	       (unsigned long)fast_rate, TEST_FAST_BAUDRATE);
+	printf("link: %lu bytes, %lu out of sequence, %lu speed switches, %lu "
+	       "while sending\n", (unsigned long)test_received,
+	       (unsigned long)test_errors, (unsigned long)test_switches,
+	       (unsigned long)test_busy_switches);
+
+	if (test_errors != 0) {
+		fprintf(stderr, "bytes lost or repeated\n");
+		errors++;
+	}
+	if (test_switches != 4 || test_busy_switches != 0) {
+		fprintf(stderr, "line speed switched while sending\n");
+		errors++;
+	}
+	if (slow_rate < USART_DEFAULT_BAUDRATE / 10 * 95 / 100 ||
+	    fast_rate < TEST_FAST_BAUDRATE / 10 * 95 / 100) {
+		fprintf(stderr, "line not used to capacity\n");
+		errors++;
+	}
+
+	if (errors != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
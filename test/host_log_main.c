@@ -0,0 +1,380 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   host_log_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Deferred binary log test on the simulated STM32.
+ *
+ * Logs from a TIM2 soft timer, a Sys Tick soft timer, the main loop and the
+ * usart driver, which logs the received bytes the handler did not take,
+ * and streams the log out of the usart. The test decodes the frames with
+ * the format strings of its own ELF file, like logdec does with the
+ * firmware, and checks every message and that no record is lost. Then the
+ * main loop logs a burst larger than its ring, the records dropped on the
+ * controller have to show up as the gap in the sequence numbers. Reports
+ * the cost of a LOG() call against formatting the same message with
+ * snprintf.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "host/sim.h"
+#include "host/logdec.h"
+
+#include "driver/mcu.h"
+#include "driver/led.h"
+#include "driver/timer.h"
+#include "driver/sys_tick.h"
+#include "driver/usart.h"
+#include "driver/log.h"
+
+/* Line speed of the stream. */
+#define TEST_BAUDRATE 921600
+
+/* TIM2 soft timer period in ticks (0.25us), 1kHz. */
+#define TEST_TIMER_TICKS 4000
+
+/* Sys Tick soft timer period in us. */
+#define TEST_SYS_TICK_US 1000
+
+/* Milliseconds between received bytes. */
+#define TEST_RX_MS 10
+
+/* Records the main loop logs at once, more than its ring takes. */
+#define TEST_BURST 100
+
+/* Records per ring, matches the default LOG_RING_SIZE. */
+#define TEST_RING_SIZE 16
+
+/* LOG() calls of the benchmark. */
+#define TEST_BENCH_CALLS 1000000
+
+/* Longest message put together. */
+#define TEST_MESSAGE_MAX 128
+
+/* Sources of the messages. */
+enum test_source {
+	TEST_TIMER,
+	TEST_SYS_TICK,
+	TEST_MAIN,
+	TEST_USART,
+	TEST_SOURCES
+};
+
+static const char *const test_names[TEST_SOURCES] = {
+	"timer", "sys_tick", "main", "usart"
+};
+
+struct test_stream {
+	uint32_t logged; /**< Messages logged */
+	uint32_t expected; /**< Next counter value expected */
+	uint32_t decoded;
+	uint32_t gaps; /**< Counter values skipped */
+	uint32_t errors; /**< Wrong messages */
+};
+
+static struct test_stream test_streams[TEST_SOURCES];
+static struct logdec test_ld;
+static uint32_t test_unknown;
+static uint8_t test_rx_byte;
+
+static void test_timer_callback(int timer_id, uint16_t time)
+{
+	(void)timer_id;
+
+	LOG(LOG_ISR_HIGH, "timer: %u at %u",
+	    test_streams[TEST_TIMER].logged++, time);
+}
+
+static void test_sys_tick_callback(int id)
+{
+	uint32_t n = test_streams[TEST_SYS_TICK].logged++;
+
+	(void)id;
+
+	LOG(LOG_ISR_LOW, "sys_tick: %u, %d, 0x%04X", n, -(int32_t)n,
+	    n & 0xffff);
+}
+
+/**
+ * Usart receive callback, does not take the odd bytes.
+ */
+static int test_usart_handle_byte(uint8_t byte)
+{
+	if ((byte & 1) != 0) {
+		test_streams[TEST_USART].logged++;
+		return -(int)(byte >> 1) - 1;
+	}
+
+	return 0;
+}
+
+static void test_check(enum test_source source, uint32_t n, bool ok)
+{
+	struct test_stream *stream = &test_streams[source];
+
+	if (!ok || n < stream->expected) {
+		stream->errors++;
+	} else {
+		stream->gaps += n - stream->expected;
+	}
+	stream->expected = n + 1;
+	stream->decoded++;
+}
+
+/**
+ * Check a message against what its source logged.
+ */
+static void test_message(const char *message)
+{
+	char expect[TEST_MESSAGE_MAX];
+	unsigned int n, a, b;
+	int s;
+
+	if (sscanf(message, "timer: %u at %u", &n, &a) == 2) {
+		test_check(TEST_TIMER, n, a < 65536);
+	} else if (sscanf(message, "sys_tick: %u, %d", &n, &s) == 2) {
+		snprintf(expect, sizeof(expect), "sys_tick: %u, %d, 0x%04X",
+			 n, -(int)n, n & 0xffff);
+		test_check(TEST_SYS_TICK, n, strcmp(message, expect) == 0);
+	} else if (sscanf(message, "main: %u", &n) == 1) {
+		test_check(TEST_MAIN, n, true);
+	} else if (sscanf(message, "usart: byte 0x%x not taken, error %d",
+			  &a, &s) == 2) {
+		/* The odd bytes count up by two, starting at 1. */
+		snprintf(expect, sizeof(expect), "usart: byte 0x%02x not "
+			 "taken, error %d", a, -(int)(a >> 1) - 1);
+		b = a >> 1;
+		test_check(TEST_USART, b, (a & 1) != 0 &&
+			   strcmp(message, expect) == 0);
+	} else {
+		test_unknown++;
+	}
+}
+
+static void test_tx(uint8_t byte)
+{
+	struct log_record record;
+	char message[TEST_MESSAGE_MAX];
+
+	if (!logdec_feed(&test_ld, byte, &record)) {
+		return;
+	}
+
+	if (logdec_format(&test_ld, &record, message, sizeof(message)) < 0) {
+		test_unknown++;
+		return;
+	}
+
+	test_message(message);
+}
+
+static void test_receive(void)
+{
+	uint8_t byte = test_rx_byte++;
+
+	sim_usart_receive(&byte, 1);
+}
+
+static void test_log_main(void)
+{
+	LOG(LOG_MAIN, "main: %u, time %u, cycles 0x%08x",
+	    test_streams[TEST_MAIN].logged++, timer_get_time(),
+	    (uint32_t)sim_get_cycles());
+}
+
+/**
+ * Let the usart send what is left in the log.
+ */
+static void test_flush(uint64_t sysclk)
+{
+	int ms;
+
+	for (ms = 0; ms < 100 && (log_pending() || !sim_usart_tx_idle());
+	     ms++) {
+		sim_run(sysclk / 1000);
+	}
+	sim_run(sysclk / 1000);
+}
+
+static double test_host_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+/**
+ * Host log test main function
+ *
+ * @param argc Argument count.
+ * @param argv Optional simulated run time in seconds.
+ */
+int main(int argc, char *argv[])
+{
+	struct log_record record;
+	char message[TEST_MESSAGE_MAX];
+	uint32_t seconds = 1;
+	uint32_t ms, i, n, dropped = 0, logged = 0, gaps;
+	uint64_t sysclk;
+	double start, bench_log = 0.0, bench_printf;
+	int errors = 0;
+
+	if (argc > 1) {
+		seconds = (uint32_t)strtoul(argv[1], NULL, 0);
+	}
+
+	if (logdec_load(&test_ld, "/proc/self/exe") != 0) {
+		fprintf(stderr, "no log strings in the test binary\n");
+		printf("FAILED\n");
+		return 1;
+	}
+
+	sim_init();
+	sim_set_usart_tx_callback(test_tx);
+	mcu_init();
+	led_init();
+	timer_init();
+	sys_tick_init();
+	log_init(usart_enable_send);
+	usart_init(test_usart_handle_byte, log_get_byte, TEST_BAUDRATE);
+
+	sysclk = sim_get_sysclk();
+
+	/* Let TIM2 pick up its prescaler on the first update event. */
+	sim_run(sysclk / 100);
+
+	(void)timer_register(TEST_TIMER_TICKS, test_timer_callback, false);
+	(void)sys_tick_timer_register(test_sys_tick_callback,
+				      TEST_SYS_TICK_US);
+	sim_reset_isr_stats();
+
+	for (ms = 0; ms < seconds * 1000; ms++) {
+		if ((ms % TEST_RX_MS) == 0) {
+			test_receive();
+		}
+		test_log_main();
+		sim_run(sysclk / 1000);
+	}
+
+	/* The main loop outruns its ring, the rest is dropped and shows as
+	 * a gap before the next messages.
+	 */
+	for (i = 0; i < TEST_BURST; i++) {
+		test_log_main();
+	}
+	for (ms = 0; ms < 10; ms++) {
+		sim_run(sysclk / 1000);
+		test_log_main();
+	}
+	test_flush(sysclk);
+
+	sim_report(stdout);
+
+	for (i = 0; i < LOG_CONTEXTS; i++) {
+		dropped += log_get_dropped((enum log_context)i);
+	}
+	gaps = 0;
+	for (i = 0; i < TEST_SOURCES; i++) {
+		/* Sources logging while the test flushes are not done. */
+		n = test_streams[i].decoded + test_streams[i].gaps;
+		printf("log: %s logged %lu, decoded %lu, gaps %lu\n",
+		       test_names[i], (unsigned long)test_streams[i].logged,
+		       (unsigned long)test_streams[i].decoded,
+		       (unsigned long)test_streams[i].gaps);
+		if (n > test_streams[i].logged ||
+		    test_streams[i].errors != 0) {
+			fprintf(stderr, "%s messages wrong\n", test_names[i]);
+			errors++;
+		}
+		if (i != TEST_MAIN && test_streams[i].gaps != 0) {
+			fprintf(stderr, "%s messages lost\n", test_names[i]);
+			errors++;
+		}
+		gaps += test_streams[i].gaps;
+		logged += test_streams[i].logged;
+	}
+	printf("log: %lu records, %lu dropped, %lu lost in the sequence, "
+	       "%lu malformed frames\n", (unsigned long)test_ld.records,
+	       (unsigned long)dropped, (unsigned long)test_ld.lost,
+	       (unsigned long)test_ld.bad);
+
+	if (test_streams[TEST_USART].decoded < (seconds * 1000 / TEST_RX_MS /
+						2) - 1) {
+		fprintf(stderr, "too few usart messages\n");
+		errors++;
+	}
+	if (dropped < TEST_BURST - TEST_RING_SIZE ||
+	    dropped != log_get_dropped(LOG_MAIN) ||
+	    test_streams[TEST_MAIN].gaps != dropped ||
+	    test_ld.lost != dropped) {
+		fprintf(stderr, "dropped records do not match the gaps\n");
+		errors++;
+	}
+	if (test_ld.records + dropped > logged || test_ld.bad != 0 ||
+	    test_unknown != 0) {
+		fprintf(stderr, "%lu unknown messages\n",
+			(unsigned long)test_unknown);
+		errors++;
+	}
+
+	/* Direct calls, drained between batches of a ring size. */
+	log_init(NULL);
+	for (n = 0; n < TEST_BENCH_CALLS; n += TEST_RING_SIZE) {
+		start = test_host_seconds();
+		for (i = 0; i < TEST_RING_SIZE; i++) {
+			LOG(LOG_MAIN, "main: %u, time %u, cycles 0x%08x",
+			    n + i, i, n);
+		}
+		bench_log += test_host_seconds() - start;
+		while (log_read(&record)) {
+		}
+	}
+	start = test_host_seconds();
+	for (n = 0; n < TEST_BENCH_CALLS; n++) {
+		snprintf(message, sizeof(message),
+			 "main: %u, time %u, cycles 0x%08x", n, n & 15, n);
+	}
+	bench_printf = test_host_seconds() - start;
+	if (log_get_dropped(LOG_MAIN) != 0) {
+		fprintf(stderr, "benchmark dropped records\n");
+		errors++;
+	}
+
+	printf("log: %.1fns per LOG() call, %.1fns per snprintf() of the "
+	       "same message\n", bench_log * 1e9 / TEST_BENCH_CALLS,
+	       bench_printf * 1e9 / TEST_BENCH_CALLS);
+
+	logdec_free(&test_ld);
+
+	if (errors != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
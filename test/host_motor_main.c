@@ -0,0 +1,198 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   host_motor_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Closed loop run of the drivers against the simulated motor.
+ *
+ * The PWM and ADC drivers run on the simulated STM32 with the motor plant
+ * attached to the TIM1 outputs and the ADC inputs. Commutation uses an ideal
+ * rotor position sensor polled from a 20kHz TIM2 soft timer, so the numbers
+ * reported are the ones of the power stage and the motor, not of a position
+ * estimator. Exits non zero if the motor does not spin up or the plant
+ * results are implausible.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <libopencm3/stm32/f1/nvic.h>
+
+#include "host/sim.h"
+#include "host/motor.h"
+
+#include "driver/mcu.h"
+#include "driver/led.h"
+#include "driver/pwm.h"
+#include "driver/adc.h"
+#include "driver/timer.h"
+
+/* Position sensor poll period in TIM2 ticks (0.25us). */
+#define MOTOR_POLL_TICKS 200
+
+static int comm_step;
+static bool comm_started;
+static uint32_t adc_callbacks;
+static uint32_t adc_vbatt_errors;
+static uint16_t adc_vbatt_expected;
+
+static void motor_adc_callback(bool transfer_complete, uint16_t *raw_data)
+{
+	(void)transfer_complete;
+
+	adc_callbacks++;
+
+	if (raw_data[ADC_RAW_A1_VB1] != adc_vbatt_expected ||
+	    raw_data[ADC_RAW_A1_VB2] != adc_vbatt_expected) {
+		adc_vbatt_errors++;
+	}
+}
+
+/**
+ * Commutation step that produces the most torque at the current rotor
+ * position. Step n is centered at 60 * n degrees electrical.
+ */
+static int motor_best_step(void)
+{
+	double deg = motor_get_state()->theta_e * 180.0 / 3.14159265358979;
+	int sector = (int)((deg + 330.0) / 60.0) % 6;
+
+	return (sector + 1) % 6;
+}
+
+static void motor_poll_callback(int id, uint16_t time)
+{
+	(void)id;
+	(void)time;
+
+	/* The driver leaves its idle state with step 1, the motor will align
+	 * to it from any position.
+	 */
+	if (!comm_started) {
+		comm_started = true;
+		comm_step = 1;
+		pwm_comm();
+		return;
+	}
+
+	if (motor_best_step() != comm_step) {
+		comm_step = (comm_step + 1) % 6;
+		pwm_comm();
+	}
+}
+
+static double motor_host_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+/**
+ * Host motor simulation main function
+ *
+ * @param argc Argument count.
+ * @param argv Optional simulated run time in seconds.
+ */
+int main(int argc, char *argv[])
+{
+	const struct motor_stats *st;
+	struct motor_params params;
+	uint32_t seconds = 2;
+	uint32_t ms;
+	uint64_t sysclk;
+	double rpm, start, host;
+	int errors = 0;
+
+	if (argc > 1) {
+		seconds = (uint32_t)strtoul(argv[1], NULL, 0);
+	}
+
+	sim_init();
+	motor_default_params(&params);
+	params.load = 0.002;
+	motor_init(&params);
+	motor_attach();
+	adc_vbatt_expected = motor_adc_sample(3);
+
+	mcu_init();
+	led_init();
+	pwm_init();
+	pwm_set(INT16_MAX / 4);
+	adc_init(motor_adc_callback, motor_adc_callback);
+	timer_init();
+
+	(void)timer_register(MOTOR_POLL_TICKS, motor_poll_callback, false);
+
+	sysclk = sim_get_sysclk();
+	start = motor_host_seconds();
+
+	/* Spin up, the mechanical time constant is about 100ms. */
+	sim_run(sysclk / 2);
+	motor_reset_stats();
+	sim_reset_isr_stats();
+	adc_callbacks = 0;
+	adc_vbatt_errors = 0;
+
+	for (ms = 0; ms < seconds * 1000; ms++) {
+		sim_run(sysclk / 1000);
+	}
+
+	host = motor_host_seconds() - start;
+
+	motor_report(stdout);
+	sim_report(stdout);
+	printf("host time %.2fs for %.2fs simulated, %.1fx real time\n", host,
+	       (double)seconds + 0.5, ((double)seconds + 0.5) / host);
+
+	st = motor_get_stats();
+	rpm = motor_get_state()->omega * 60.0 / (2.0 * 3.14159265358979);
+
+	if (rpm < 1000.0) {
+		fprintf(stderr, "motor did not spin up: %.0frpm\n", rpm);
+		errors++;
+	}
+	if (st->energy_mech <= 0.0 || st->energy_mech >= st->energy_in) {
+		fprintf(stderr, "implausible efficiency\n");
+		errors++;
+	}
+	if (st->delays == 0 || st->delay_max > 60.0) {
+		fprintf(stderr, "commutation not in sync with the rotor\n");
+		errors++;
+	}
+	if (adc_callbacks == 0 || adc_vbatt_errors != 0) {
+		fprintf(stderr, "adc: %lu callbacks, %lu bad supply samples\n",
+			(unsigned long)adc_callbacks,
+			(unsigned long)adc_vbatt_errors);
+		errors++;
+	}
+
+	if (errors != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
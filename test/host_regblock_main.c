@@ -0,0 +1,216 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   host_regblock_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Register block access test on the simulated STM32.
+ *
+ * Maps a 32 bit counter and a three element vector, that a Sys Tick soft
+ * timer keeps changing together, onto protocol registers. Takes block
+ * snapshots at random times and checks that they match the variables and
+ * that every register of the block is sent once, in order. Checks block
+ * writes of whole and partial 32 bit values, read only variables and the
+ * range and mapping checks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host/sim.h"
+
+#include "driver/mcu.h"
+#include "driver/led.h"
+#include "driver/sys_tick.h"
+#include "driver/regblock.h"
+
+#define TEST_REGS 16
+#define TEST_SNAPSHOTS 1000
+
+/* Register layout. */
+#define TEST_REG_COUNTER 0 /* and 1 */
+#define TEST_REG_VECTOR 2 /* to 4 */
+#define TEST_REG_GAIN 6 /* and 7 */
+#define TEST_REG_STATUS 8
+
+static uint16_t test_regs[TEST_REGS];
+static volatile uint32_t test_counter;
+static volatile uint16_t test_vector[3];
+static volatile uint32_t test_gain;
+static volatile uint16_t test_status;
+
+static uint8_t test_touched[TEST_REGS * 2];
+static int test_touches;
+
+static void test_touch(uint8_t addr)
+{
+	if (test_touches < (int)sizeof(test_touched)) {
+		test_touched[test_touches] = addr;
+	}
+	test_touches++;
+}
+
+/**
+ * Advances the counter across the low word often, keeps the vector adding
+ * up to zero.
+ */
+static void test_update(int id)
+{
+	(void)id;
+
+	test_counter += 0x9001;
+	test_vector[0] += 7;
+	test_vector[1] += 11;
+	test_vector[2] -= 18;
+}
+
+/**
+ * Check that a block read touched first to first + count - 1 in order.
+ */
+static int test_check_touches(uint8_t first, uint8_t count)
+{
+	int i;
+
+	if (test_touches != count) {
+		return 1;
+	}
+	for (i = 0; i < count; i++) {
+		if (test_touched[i] != first + i) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Host register block test main function
+ */
+int main(void)
+{
+	uint32_t counter, last = 0;
+	uint64_t sysclk;
+	int n, bad = 0, errors = 0;
+
+	srand(1);
+	sim_init();
+	mcu_init();
+	led_init();
+	sys_tick_init();
+
+	regblock_init(test_regs, TEST_REGS, test_touch);
+	if (regblock_map(TEST_REG_COUNTER, &test_counter, REGBLOCK_U32,
+			 false) < 0 ||
+	    regblock_map(TEST_REG_VECTOR, &test_vector[0], REGBLOCK_U16,
+			 false) < 0 ||
+	    regblock_map(TEST_REG_VECTOR + 1, &test_vector[1], REGBLOCK_U16,
+			 false) < 0 ||
+	    regblock_map(TEST_REG_VECTOR + 2, &test_vector[2], REGBLOCK_U16,
+			 false) < 0 ||
+	    regblock_map(TEST_REG_GAIN, &test_gain, REGBLOCK_U32, true) < 0 ||
+	    regblock_map(TEST_REG_STATUS, &test_status, REGBLOCK_U16,
+			 false) < 0) {
+		fprintf(stderr, "mapping failed\n");
+		errors++;
+	}
+
+	/* Overlapping and out of range mappings. */
+	if (regblock_map(TEST_REG_COUNTER + 1, &test_status, REGBLOCK_U16,
+			 false) >= 0 ||
+	    regblock_map(TEST_REGS - 1, &test_gain, REGBLOCK_U32, true) >= 0) {
+		fprintf(stderr, "bad mapping accepted\n");
+		errors++;
+	}
+
+	(void)sys_tick_timer_register(test_update, 100);
+	sysclk = sim_get_sysclk();
+
+	/* Snapshots of the counter and the vector. */
+	for (n = 0; n < TEST_SNAPSHOTS; n++) {
+		sim_run((uint64_t)(rand() % (int)(sysclk / 1000)));
+		test_touches = 0;
+		(void)regblock_read(TEST_REG_COUNTER, 5);
+
+		counter = test_regs[TEST_REG_COUNTER] |
+			  ((uint32_t)test_regs[TEST_REG_COUNTER + 1] << 16);
+		if (counter != test_counter || counter < last ||
+		    (uint16_t)(test_regs[TEST_REG_VECTOR] +
+			       test_regs[TEST_REG_VECTOR + 1] +
+			       test_regs[TEST_REG_VECTOR + 2]) != 0 ||
+		    test_check_touches(TEST_REG_COUNTER, 5) != 0) {
+			bad++;
+		}
+		last = counter;
+	}
+
+	/* A whole 32 bit value, the read only status stays. */
+	test_regs[TEST_REG_GAIN] = 0x5678;
+	test_regs[TEST_REG_GAIN + 1] = 0x1234;
+	test_regs[TEST_REG_STATUS] = 0xdead;
+	test_status = 42;
+	if (!regblock_write(TEST_REG_GAIN, 3) || test_gain != 0x12345678 ||
+	    test_status != 42) {
+		fprintf(stderr, "block write failed\n");
+		errors++;
+	}
+
+	/* Only the high word. */
+	test_regs[TEST_REG_GAIN + 1] = 0xabcd;
+	test_regs[TEST_REG_GAIN] = 0;
+	if (!regblock_write(TEST_REG_GAIN + 1, 1) || test_gain != 0xabcd5678) {
+		fprintf(stderr, "partial write failed: 0x%08lx\n",
+			(unsigned long)test_gain);
+		errors++;
+	}
+
+	/* Unmapped registers in a block are sent as they are. */
+	test_regs[TEST_REG_STATUS + 1] = 0x55;
+	test_touches = 0;
+	if (!regblock_read(TEST_REG_STATUS, 2) ||
+	    test_regs[TEST_REG_STATUS] != 42 ||
+	    test_regs[TEST_REG_STATUS + 1] != 0x55 ||
+	    test_check_touches(TEST_REG_STATUS, 2) != 0) {
+		fprintf(stderr, "mixed block read failed\n");
+		errors++;
+	}
+
+	/* Ranges that do not exist. */
+	test_touches = 0;
+	if (regblock_read(TEST_REGS - 2, 3) || regblock_read(0, 0) ||
+	    regblock_write(TEST_REGS, 1) || test_touches != 0) {
+		fprintf(stderr, "bad range accepted\n");
+		errors++;
+	}
+
+	printf("regblock: %d snapshots of 5 registers, %d bad, counter "
+	       "0x%08lx\n", TEST_SNAPSHOTS, bad, (unsigned long)last);
+
+	if (bad != 0) {
+		fprintf(stderr, "snapshots do not match\n");
+		errors++;
+	}
+
+	if (errors != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   host_regnotify_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Register change notification test on the simulated STM32.
+ *
+ * A Sys Tick soft timer changes a fast register every 100us and a slow one
+ * every 300ms, the main loop flushes the notifications every ms. Checks that
+ * the fast register is sent no more often than its interval, that every
+ * change of the slow register is sent right away and that the last value of
+ * a burst of changes is never lost. Reports the touches that were
+ * coalesced.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host/sim.h"
+
+#include "driver/mcu.h"
+#include "driver/led.h"
+#include "driver/sys_tick.h"
+#include "driver/regnotify.h"
+
+/* Registers. */
+#define TEST_REG_FAST 3
+#define TEST_REG_SLOW 17
+
+/* Update interval of the fast register in us. */
+#define TEST_INTERVAL 50000
+
+/* Flush period in ms. */
+#define TEST_FLUSH_MS 1
+
+static volatile uint16_t test_regs[REGNOTIFY_REGS];
+static uint16_t test_seen[REGNOTIFY_REGS];
+static uint32_t test_sends[REGNOTIFY_REGS];
+static uint64_t test_last_send[REGNOTIFY_REGS];
+static uint64_t test_min_gap[REGNOTIFY_REGS];
+static uint32_t test_ticks;
+static bool test_changing;
+
+static void test_send(uint8_t addr)
+{
+	uint64_t now = sim_get_cycles();
+
+	if (test_sends[addr] != 0 &&
+	    now - test_last_send[addr] < test_min_gap[addr]) {
+		test_min_gap[addr] = now - test_last_send[addr];
+	}
+	test_last_send[addr] = now;
+	test_sends[addr]++;
+	test_seen[addr] = test_regs[addr];
+}
+
+static void test_change(int id)
+{
+	(void)id;
+
+	if (!test_changing) {
+		return;
+	}
+
+	test_ticks++;
+	test_regs[TEST_REG_FAST]++;
+	regnotify_touch(TEST_REG_FAST);
+	if ((test_ticks % 3000) == 0) {
+		test_regs[TEST_REG_SLOW]++;
+		regnotify_touch(TEST_REG_SLOW);
+	}
+}
+
+/**
+ * Host register notification test main function
+ */
+int main(void)
+{
+	uint64_t sysclk;
+	uint32_t ms, slow_changes, touches;
+	int i, stray = 0, errors = 0;
+
+	sim_init();
+	mcu_init();
+	led_init();
+	sys_tick_init();
+
+	regnotify_init(test_send, 0);
+	regnotify_set_interval(TEST_REG_FAST, TEST_INTERVAL);
+	for (i = 0; i < REGNOTIFY_REGS; i++) {
+		test_min_gap[i] = UINT64_MAX;
+	}
+
+	sysclk = sim_get_sysclk();
+	test_changing = true;
+	(void)sys_tick_timer_register(test_change, 100);
+
+	for (ms = 0; ms < 1000; ms += TEST_FLUSH_MS) {
+		sim_run(sysclk / 1000 * TEST_FLUSH_MS);
+		(void)regnotify_flush();
+		/* A change of the slow register is out at the next flush. */
+		if (test_seen[TEST_REG_SLOW] != test_regs[TEST_REG_SLOW]) {
+			fprintf(stderr, "slow register late at %lums\n",
+				(unsigned long)ms);
+			errors++;
+		}
+	}
+	slow_changes = test_regs[TEST_REG_SLOW];
+
+	/* Stop changing, the last value has to come out. */
+	test_changing = false;
+	for (ms = 0; ms < 100; ms += TEST_FLUSH_MS) {
+		sim_run(sysclk / 1000 * TEST_FLUSH_MS);
+		(void)regnotify_flush();
+	}
+
+	for (i = 0; i < REGNOTIFY_REGS; i++) {
+		if (i != TEST_REG_FAST && i != TEST_REG_SLOW &&
+		    test_sends[i] != 0) {
+			stray++;
+		}
+	}
+	touches = regnotify_get_touches();
+
+	printf("regnotify: %lu touches, %lu sent, %lu coalesced, fast "
+	       "register sent %lu times, every %.1fms or more, slow %lu "
+	       "times\n", (unsigned long)touches,
+	       (unsigned long)regnotify_get_sent(),
+	       (unsigned long)(touches - regnotify_get_sent()),
+	       (unsigned long)test_sends[TEST_REG_FAST],
+	       (double)test_min_gap[TEST_REG_FAST] * 1000.0 / sysclk,
+	       (unsigned long)test_sends[TEST_REG_SLOW]);
+
+	if (test_min_gap[TEST_REG_FAST] < sysclk / 1000000 * TEST_INTERVAL ||
+	    test_sends[TEST_REG_FAST] < 1000000 / TEST_INTERVAL) {
+		fprintf(stderr, "fast register not rate limited\n");
+		errors++;
+	}
+	if (test_sends[TEST_REG_SLOW] != slow_changes) {
+		fprintf(stderr, "slow register changes lost\n");
+		errors++;
+	}
+	if (test_seen[TEST_REG_FAST] != test_regs[TEST_REG_FAST] ||
+	    regnotify_pending()) {
+		fprintf(stderr, "last value not sent\n");
+		errors++;
+	}
+	if (stray != 0) {
+		fprintf(stderr, "untouched registers sent\n");
+		errors++;
+	}
+
+	if (errors != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
@@ -0,0 +1,234 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   host_sched_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Cooperative scheduler test.
+ *
+ * Runs three periodic tasks of different rates and run times with the
+ * scheduler, the run time of a task is simulated time passing while it
+ * runs. A TIM2 soft timer posts events meanwhile. Checks that every task
+ * ran as often as its period asks for, that the measured run times match,
+ * that the fastest task never waited longer than the longest other task
+ * runs and that the rest of the time was spent asleep in WFI. Exits non
+ * zero on any mismatch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host/sim.h"
+
+#include "driver/mcu.h"
+#include "driver/led.h"
+#include "driver/timer.h"
+#include "driver/sys_tick.h"
+#include "driver/event.h"
+#include "driver/sched.h"
+
+/* Event source period in TIM2 ticks (0.25us), 2kHz. */
+#define TEST_EVENT_TICKS 2000
+
+/* Run times may be off by this many core clock cycles, the simulation
+ * advances in quanta.
+ */
+#define TEST_TOLERANCE_CYCLES 32
+
+struct test_task {
+	const char *name;
+	uint32_t period; /**< us */
+	uint32_t cycles; /**< Simulated run time */
+	int id;
+};
+
+static void test_fast_task(void);
+static void test_medium_task(void);
+static void test_slow_task(void);
+
+static struct test_task test_tasks[] = {
+	/* Registered slowest first, the scheduler orders them by period. */
+	{ "slow", 100000, 51200, -1 },
+	{ "medium", 10000, 19200, -1 },
+	{ "fast", 1000, 3200, -1 }
+};
+
+static const sched_task_t test_functions[] = {
+	test_slow_task,
+	test_medium_task,
+	test_fast_task
+};
+
+#define TEST_TASKS (sizeof(test_tasks) / sizeof(test_tasks[0]))
+
+static uint32_t test_events_posted;
+static uint32_t test_events_processed;
+
+static void test_slow_task(void)
+{
+	sim_run(test_tasks[0].cycles);
+}
+
+static void test_medium_task(void)
+{
+	sim_run(test_tasks[1].cycles);
+}
+
+static void test_fast_task(void)
+{
+	sim_run(test_tasks[2].cycles);
+}
+
+static void test_event_handler(uint32_t data)
+{
+	(void)data;
+
+	test_events_processed++;
+}
+
+static void test_timer_callback(int timer_id, uint16_t time)
+{
+	(void)timer_id;
+	(void)time;
+
+	if (event_post(EVENT_PRIORITY_NORMAL, test_event_handler, 0)) {
+		test_events_posted++;
+	}
+}
+
+/**
+ * Host scheduler test main function
+ *
+ * @param argc Argument count.
+ * @param argv Optional simulated run time in seconds.
+ */
+int main(int argc, char *argv[])
+{
+	const struct sched_stats *stats;
+	uint32_t seconds = 1;
+	uint64_t sysclk, start, end, busy = 0;
+	uint32_t i, expected, latency_bound = 0;
+	double idle;
+	int errors = 0;
+
+	if (argc > 1) {
+		seconds = (uint32_t)strtoul(argv[1], NULL, 0);
+	}
+
+	sim_init();
+	mcu_init();
+	led_init();
+	event_init();
+	timer_init();
+	sys_tick_init();
+	sched_init();
+
+	sysclk = sim_get_sysclk();
+
+	/* Let TIM2 pick up its prescaler on the first update event. */
+	sim_run(sysclk / 100);
+
+	(void)timer_register(TEST_EVENT_TICKS, test_timer_callback, false);
+	for (i = 0; i < TEST_TASKS; i++) {
+		test_tasks[i].id = sched_task_register(test_functions[i],
+						       test_tasks[i].period);
+	}
+
+	sim_reset_isr_stats();
+	start = sim_get_cycles();
+	end = start + (sysclk * seconds);
+	while (sim_get_cycles() < end) {
+		(void)sched_process();
+	}
+
+	sim_report(stdout);
+
+	for (i = 0; i < TEST_TASKS; i++) {
+		stats = sched_get_stats(test_tasks[i].id);
+		printf("sched: %-6s %6luus period, %6lu runs, %lu skipped, "
+		       "%lu..%lu cycles, %luus latency\n", test_tasks[i].name,
+		       (unsigned long)test_tasks[i].period,
+		       (unsigned long)stats->runs,
+		       (unsigned long)stats->skipped,
+		       (unsigned long)stats->cycles_min,
+		       (unsigned long)stats->cycles_max,
+		       (unsigned long)stats->latency_max);
+
+		expected = seconds * (1000000 / test_tasks[i].period);
+		if (stats->runs + 1 < expected || stats->runs > expected) {
+			fprintf(stderr, "%s task ran %lu times, expected %lu\n",
+				test_tasks[i].name, (unsigned long)stats->runs,
+				(unsigned long)expected);
+			errors++;
+		}
+		if (stats->skipped != 0) {
+			fprintf(stderr, "%s task skipped releases\n",
+				test_tasks[i].name);
+			errors++;
+		}
+		if (stats->cycles_min + TEST_TOLERANCE_CYCLES <
+		    test_tasks[i].cycles ||
+		    stats->cycles_max > test_tasks[i].cycles +
+		    TEST_TOLERANCE_CYCLES) {
+			fprintf(stderr, "%s task run time measured wrong\n",
+				test_tasks[i].name);
+			errors++;
+		}
+		busy += stats->cycles_total;
+		if (i + 1 < TEST_TASKS &&
+		    test_tasks[i].cycles > latency_bound) {
+			latency_bound = test_tasks[i].cycles;
+		}
+	}
+
+	idle = (double)sched_get_idle_cycles() / (double)(end - start);
+	printf("sched: %lu of %lu events, %.1f%% busy in tasks, %.1f%% "
+	       "idle\n", (unsigned long)test_events_processed,
+	       (unsigned long)test_events_posted,
+	       100.0 * (double)busy / (double)(end - start), 100.0 * idle);
+
+	/* The fast task waits at most for the longest other task and the
+	 * next tick.
+	 */
+	latency_bound = (latency_bound / (uint32_t)(sysclk / 1000000)) + 100;
+	if (sched_get_stats(test_tasks[TEST_TASKS - 1].id)->latency_max >
+	    latency_bound) {
+		fprintf(stderr, "fast task waited longer than %luus\n",
+			(unsigned long)latency_bound);
+		errors++;
+	}
+	if (test_events_processed + 1 < test_events_posted ||
+	    test_events_posted + 1 < seconds * 4000000 / TEST_EVENT_TICKS) {
+		fprintf(stderr, "events lost\n");
+		errors++;
+	}
+	if (idle + ((double)busy / (double)(end - start)) < 0.98 ||
+	    sim_get_sleep_cycles() < sched_get_idle_cycles() / 2) {
+		fprintf(stderr, "the idle time was not spent in wfi\n");
+		errors++;
+	}
+
+	if (errors != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
@@ -0,0 +1,265 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   host_scope_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Scope capture test on the simulated STM32.
+ *
+ * Runs the sensorless commutation engine on the simulated motor and
+ * captures the current, a phase voltage, the commutation step and an ADC
+ * callback counter at the full ADC rate. Triggers on a commutation, on an
+ * overcurrent after a step of the duty cycle, on a counter level and by
+ * hand, and checks that the captures are gapless and hold the trigger
+ * sample at the pre trigger index.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host/sim.h"
+#include "host/motor.h"
+
+#include "driver/mcu.h"
+#include "driver/led.h"
+#include "driver/pwm.h"
+#include "driver/adc.h"
+#include "driver/timer.h"
+#include "driver/scope.h"
+
+#include "src/bemf.h"
+
+/* Channels in the order they are added. */
+#define TEST_CH_CU 0
+#define TEST_CH_UV 1
+#define TEST_CH_STEP 2
+#define TEST_CH_CALL 3
+
+/* Samples kept before the trigger. */
+#define TEST_PRE 256
+
+static volatile int16_t test_calls;
+static uint64_t test_sysclk;
+static int test_errors;
+
+static int32_t test_get_step(void)
+{
+	return bemf_get_step();
+}
+
+static void test_adc_callback(bool transfer_complete, uint16_t *raw_data)
+{
+	bemf_adc_callback(transfer_complete, raw_data);
+
+	test_calls++;
+	scope_adc_callback(transfer_complete, raw_data);
+}
+
+/**
+ * Run until the capture is done, at most a second.
+ *
+ * @return Simulated ms it took.
+ */
+static uint32_t test_wait(void)
+{
+	uint32_t ms;
+
+	for (ms = 0; ms < 1000 && scope_get_mode() != SCOPE_DONE; ms++) {
+		sim_run(test_sysclk / 1000);
+	}
+
+	return ms;
+}
+
+/**
+ * Check that the capture has no gaps and triggered on the right sample.
+ */
+static void test_check(const char *name, uint16_t pre)
+{
+	uint16_t depth = scope_get_depth();
+	uint16_t i;
+	int gaps = 0;
+
+	if (scope_get_mode() != SCOPE_DONE) {
+		fprintf(stderr, "%s: capture not done\n", name);
+		test_errors++;
+		return;
+	}
+
+	for (i = 1; i < depth; i++) {
+		if ((int16_t)(scope_read(i, TEST_CH_CALL) -
+			      scope_read(i - 1, TEST_CH_CALL)) != 1) {
+			gaps++;
+		}
+	}
+	if (gaps != 0) {
+		fprintf(stderr, "%s: %d gaps in the capture\n", name, gaps);
+		test_errors++;
+	}
+
+	printf("scope: %s, %u samples, trigger at %u: current %d -> %d, "
+	       "step %d -> %d\n", name, (unsigned int)depth,
+	       (unsigned int)pre,
+	       (pre > 0) ? scope_read(pre - 1, TEST_CH_CU) : 0,
+	       scope_read(pre, TEST_CH_CU),
+	       (pre > 0) ? scope_read(pre - 1, TEST_CH_STEP) : 0,
+	       scope_read(pre, TEST_CH_STEP));
+}
+
+/**
+ * Host scope test main function
+ */
+int main(void)
+{
+	struct motor_params params;
+	int16_t level, max_current;
+	int16_t armed_at;
+	uint16_t i;
+	uint32_t ms;
+
+	sim_init();
+	motor_default_params(&params);
+	params.load = 0.002;
+	motor_init(&params);
+	motor_attach();
+
+	mcu_init();
+	led_init();
+	pwm_init();
+	pwm_set(INT16_MAX / 8);
+	adc_init(test_adc_callback, test_adc_callback);
+	timer_init();
+	bemf_init();
+
+	scope_init();
+	(void)scope_add_raw(ADC_RAW_A2_CU1, ADC_RAW_A2_CU2);
+	(void)scope_add_raw(ADC_RAW_A1_UV1, ADC_RAW_A1_UV2);
+	(void)scope_add_getter(test_get_step);
+	(void)scope_add_var(&test_calls);
+	if (scope_add_raw(ADC_RAW_A1_VV1, ADC_RAW_A1_VV2) != -1) {
+		fprintf(stderr, "too many channels accepted\n");
+		test_errors++;
+	}
+
+	test_sysclk = sim_get_sysclk();
+
+	sim_run(test_sysclk / 100);
+	bemf_start();
+	sim_run(test_sysclk / 2);
+
+	/* Not possible: no room for the trigger, no such trigger channel. */
+	scope_set_trigger(4, SCOPE_TRIGGER_CHANGE, 0);
+	if (scope_arm(TEST_PRE)) {
+		fprintf(stderr, "missing trigger channel accepted\n");
+		test_errors++;
+	}
+	scope_set_trigger(TEST_CH_STEP, SCOPE_TRIGGER_CHANGE, 0);
+	if (scope_arm(SCOPE_BUFFER_SIZE / 4)) {
+		fprintf(stderr, "pre trigger samples beyond the buffer "
+			"accepted\n");
+		test_errors++;
+	}
+
+	/* Commutation. */
+	(void)scope_arm(TEST_PRE);
+	ms = test_wait();
+	test_check("commutation", TEST_PRE);
+	if (scope_read(TEST_PRE, TEST_CH_STEP) ==
+	    scope_read(TEST_PRE - 1, TEST_CH_STEP)) {
+		fprintf(stderr, "commutation: step did not change at the "
+			"trigger\n");
+		test_errors++;
+	}
+	if (ms > 20) {
+		fprintf(stderr, "commutation: took %lums\n",
+			(unsigned long)ms);
+		test_errors++;
+	}
+
+	/* Overcurrent, above anything seen at the present duty cycle. */
+	max_current = 0;
+	for (i = 0; i < scope_get_depth(); i++) {
+		if (scope_read(i, TEST_CH_CU) > max_current) {
+			max_current = scope_read(i, TEST_CH_CU);
+		}
+	}
+	level = max_current + 16;
+	scope_set_trigger(TEST_CH_CU, SCOPE_TRIGGER_RISING, level);
+	(void)scope_arm(TEST_PRE);
+	sim_run(test_sysclk / 100);
+	if (scope_get_mode() != SCOPE_ARMED) {
+		fprintf(stderr, "overcurrent: triggered before the duty "
+			"step\n");
+		test_errors++;
+	}
+	pwm_set(INT16_MAX / 2);
+	(void)test_wait();
+	pwm_set(INT16_MAX / 8);
+	test_check("overcurrent", TEST_PRE);
+	if (scope_read(TEST_PRE, TEST_CH_CU) <= level ||
+	    scope_read(TEST_PRE - 1, TEST_CH_CU) > level) {
+		fprintf(stderr, "overcurrent: no edge through %d at the "
+			"trigger\n", level);
+		test_errors++;
+	}
+	sim_run(test_sysclk / 10);
+
+	/* Counter level. */
+	level = (int16_t)(test_calls + 3000);
+	scope_set_trigger(TEST_CH_CALL, SCOPE_TRIGGER_RISING, level);
+	(void)scope_arm(TEST_PRE);
+	(void)test_wait();
+	test_check("level", TEST_PRE);
+	if (scope_read(TEST_PRE, TEST_CH_CALL) != (int16_t)(level + 1)) {
+		fprintf(stderr, "level: trigger sample %d, expected %d\n",
+			scope_read(TEST_PRE, TEST_CH_CALL), level + 1);
+		test_errors++;
+	}
+
+	/* By hand right after arming, waits for the pre trigger samples. */
+	scope_set_trigger(0, SCOPE_TRIGGER_MANUAL, 0);
+	armed_at = test_calls;
+	(void)scope_arm(TEST_PRE);
+	scope_trigger();
+	(void)test_wait();
+	test_check("manual", TEST_PRE);
+	if (scope_read(0, TEST_CH_CALL) != (int16_t)(armed_at + 1)) {
+		fprintf(stderr, "manual: did not wait for the pre trigger "
+			"samples\n");
+		test_errors++;
+	}
+
+	/* The capture stays until the next arm. */
+	sim_run(test_sysclk / 100);
+	if (scope_get_mode() != SCOPE_DONE ||
+	    scope_read(0, TEST_CH_CALL) != (int16_t)(armed_at + 1)) {
+		fprintf(stderr, "capture overwritten\n");
+		test_errors++;
+	}
+
+	sim_report(stdout);
+
+	if (test_errors != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
@@ -0,0 +1,245 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   host_sine_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Sinusoidal pwm drive against the simulated motor.
+ *
+ * Drives a sinusoidal motor plant with pwm_set_sine(), the angle is taken
+ * from the plant in a TIM2 soft timer like from a position sensor, the same
+ * way host_motor runs the six step commutation. Reports the torque ripple
+ * of the pwm period averages, without the pwm current ripple, and the cost
+ * of the angle update. Exits non zero if the motor does not
+ * spin up or the torque ripple is not well below the six step drive.
+ *
+ * Also recomputes the space vector modulation table of the pwm driver from
+ * its formula, all four quarters through pwm_svm(), so a stale table fails.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <libopencm3/stm32/f1/nvic.h>
+
+#include "host/sim.h"
+#include "host/motor.h"
+
+#include "driver/mcu.h"
+#include "driver/led.h"
+#include "driver/pwm.h"
+#include "driver/adc.h"
+#include "driver/timer.h"
+
+#define SINE_PI 3.14159265358979
+
+/* Position sensor poll period in TIM2 ticks (0.25us). */
+#define SINE_POLL_TICKS 200
+
+/* Drive amplitude, the same as the duty cycle of host_motor. */
+#define SINE_AMPLITUDE (INT16_MAX / 4)
+
+/* Highest rms torque ripple accepted, the six step drive has over 100%. */
+#define SINE_MAX_RIPPLE 20.0
+
+/* Core clock cycles of one center aligned pwm period and the torque samples
+ * taken in it.
+ */
+#define SINE_PWM_CYCLES (2 * PWM_DUTY_MAX)
+#define SINE_TORQUE_SAMPLES 32
+
+static uint32_t sine_updates;
+
+static void sine_adc_callback(bool transfer_complete, uint16_t *raw_data)
+{
+	(void)transfer_complete;
+	(void)raw_data;
+}
+
+/**
+ * Drive the phase voltages in line with the back EMF, phase U back EMF is
+ * ke * omega * sin(theta_e).
+ */
+static void sine_poll_callback(int id, uint16_t time)
+{
+	double turn = motor_get_state()->theta_e / (2.0 * SINE_PI);
+
+	(void)id;
+	(void)time;
+
+	pwm_set_sine((uint16_t)(int64_t)floor(turn * 65536.0),
+		     SINE_AMPLITUDE);
+	sine_updates++;
+}
+
+/**
+ * Space vector modulation waveform, sin(a) minus the mean of the largest
+ * and the smallest of the three phase sines, scaled by 2/sqrt(3).
+ */
+static double sine_svm(double a)
+{
+	double s[3], max, min;
+	int i;
+
+	s[0] = sin(a);
+	s[1] = sin(a - (2.0 * SINE_PI / 3.0));
+	s[2] = sin(a + (2.0 * SINE_PI / 3.0));
+	max = s[0];
+	min = s[0];
+	for (i = 1; i < 3; i++) {
+		max = fmax(max, s[i]);
+		min = fmin(min, s[i]);
+	}
+
+	return (s[0] - ((max + min) / 2.0)) * 2.0 / sqrt(3.0);
+}
+
+/**
+ * Compare the table entries, at multiples of 64, against the formula.
+ *
+ * @return Number of wrong entries.
+ */
+static int sine_check_svm_table(void)
+{
+	int32_t expected, value;
+	int wrong = 0;
+	uint32_t i;
+
+	for (i = 0; i < 65536; i += 64) {
+		expected = (int32_t)lround(32767.0 *
+					   sine_svm(i * SINE_PI / 32768.0));
+		value = pwm_svm((uint16_t)i);
+		if (value != expected) {
+			if (wrong == 0) {
+				fprintf(stderr, "svm table: angle %lu is %ld, "
+					"expected %ld\n", (unsigned long)i,
+					(long)value, (long)expected);
+			}
+			wrong++;
+		}
+	}
+
+	return wrong;
+}
+
+/**
+ * Host sine drive test main function
+ *
+ * @param argc Argument count.
+ * @param argv Optional simulated run time in seconds.
+ */
+int main(int argc, char *argv[])
+{
+	const struct motor_stats *st;
+	const struct sim_isr_stats *isr;
+	struct motor_params params;
+	uint32_t seconds = 1;
+	uint32_t n, periods;
+	uint64_t sysclk;
+	double torque, sum = 0.0, sumsq = 0.0;
+	double rpm, mean, ripple;
+	int errors = 0;
+
+	if (argc > 1) {
+		seconds = (uint32_t)strtoul(argv[1], NULL, 0);
+	}
+
+	if (sine_check_svm_table() != 0) {
+		fprintf(stderr, "svm table does not match its formula\n");
+		errors++;
+	}
+
+	sim_init();
+	motor_default_params(&params);
+	params.sinusoidal = true;
+	params.load = 0.002;
+	motor_init(&params);
+	motor_attach();
+
+	mcu_init();
+	led_init();
+	pwm_init();
+	adc_init(sine_adc_callback, sine_adc_callback);
+	timer_init();
+
+	pwm_all_on();
+	(void)timer_register(SINE_POLL_TICKS, sine_poll_callback, false);
+
+	sysclk = sim_get_sysclk();
+
+	/* Spin up, the mechanical time constant is about 100ms. */
+	sim_run(sysclk / 2);
+	motor_reset_stats();
+	sim_reset_isr_stats();
+	sine_updates = 0;
+
+	periods = (uint32_t)(seconds * sysclk / SINE_PWM_CYCLES);
+	while (periods-- > 0) {
+		torque = 0.0;
+		for (n = 0; n < SINE_TORQUE_SAMPLES; n++) {
+			sim_run(SINE_PWM_CYCLES / SINE_TORQUE_SAMPLES);
+			torque += motor_get_state()->torque;
+		}
+		torque /= SINE_TORQUE_SAMPLES;
+		sum += torque;
+		sumsq += torque * torque;
+	}
+	periods = (uint32_t)(seconds * sysclk / SINE_PWM_CYCLES);
+
+	motor_report(stdout);
+	sim_report(stdout);
+
+	st = motor_get_stats();
+	isr = sim_get_isr_stats(NVIC_TIM2_IRQ);
+	rpm = motor_get_state()->omega * 60.0 / (2.0 * SINE_PI);
+	mean = sum / periods;
+	ripple = (mean != 0.0) ?
+		 100.0 * sqrt(fmax((sumsq / periods) - (mean * mean), 0.0)) /
+		 fabs(mean) : 0.0;
+
+	printf("sine: %lu angle updates, %.1f%% rms ripple of the period torque, %.0fns "
+	       "and %.1f register accesses per update\n",
+	       (unsigned long)sine_updates, ripple,
+	       (isr->count != 0) ? (double)isr->ns_total / isr->count : 0.0,
+	       (isr->count != 0) ? (double)isr->mmio / isr->count : 0.0);
+
+	if (rpm < 1000.0) {
+		fprintf(stderr, "motor did not spin up: %.0frpm\n", rpm);
+		errors++;
+	}
+	if (st->energy_mech <= 0.0 || st->energy_mech >= st->energy_in) {
+		fprintf(stderr, "implausible efficiency\n");
+		errors++;
+	}
+	if (ripple > SINE_MAX_RIPPLE) {
+		fprintf(stderr, "torque ripple too high\n");
+		errors++;
+	}
+
+	if (errors != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   host_sys_tick_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Sys Tick soft timer test against the simulated time.
+ *
+ * Runs periodic and one shot Sys Tick soft timers, registered, updated and
+ * unregistered from the main loop and from the callbacks, and checks that
+ * every callback runs at its tick, and that sys_tick_get_timer() follows
+ * the simulated time. Then all timers are removed and the idle Sys Tick is
+ * checked. Reports the Sys Tick interrupts per second, SYS_TICK_RESOLUTION
+ * apart by default and only at the deadlines with -DSYS_TICK_TICKLESS.
+ * Exits non zero if a callback is late or missed or the time is off.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "host/sim.h"
+
+#include "driver/mcu.h"
+#include "driver/led.h"
+#include "driver/sys_tick.h"
+
+/* Sys Tick ticks in us and core clock cycles. */
+#define TEST_TICK_US 100
+#define TEST_TICK_CYCLES (MCU_HCLK / 1000000 * TEST_TICK_US)
+
+/* Soft timer durations in us. */
+#define TEST_FAST_US 1000
+#define TEST_SLOW_US 2500
+#define TEST_SLOW_UPDATE_US 3300
+#define TEST_ONE_SHOT_US 700
+
+/* A one shot timer is started every this many fast callbacks. */
+#define TEST_ONE_SHOT_EVERY 10
+
+/* Main loop step in core clock cycles, not a multiple of the tick. */
+#define TEST_STEP_CYCLES 12345
+
+/* Callbacks may run this many cycles after their tick, the simulation
+ * dispatches the interrupts only between its quanta.
+ */
+#define TEST_TOLERANCE_CYCLES 32
+
+struct test_timer {
+	int id;
+	uint32_t delta; /**< Duration in ticks */
+	uint32_t due; /**< Tick of the next expected callback */
+	uint32_t calls;
+};
+
+static struct test_timer test_fast;
+static struct test_timer test_slow;
+static struct test_timer test_one_shot;
+
+static uint64_t test_start_cycles;
+static uint32_t test_late;
+static uint32_t test_time_errors;
+static int32_t test_time_min;
+static int32_t test_time_max;
+
+static void test_start(struct test_timer *timer, int id, uint32_t us)
+{
+	timer->id = id;
+	timer->delta = us / TEST_TICK_US;
+	timer->due = sys_tick_get_timer() + timer->delta;
+}
+
+/**
+ * Check that a callback runs at its tick.
+ */
+static void test_check(struct test_timer *timer, const char *name)
+{
+	uint64_t due = test_start_cycles +
+		       ((uint64_t)timer->due * TEST_TICK_CYCLES);
+	uint64_t now = sim_get_cycles();
+
+	if (now < due || now > due + TEST_TOLERANCE_CYCLES) {
+		if (test_late < 10) {
+			fprintf(stderr, "%s callback at cycle %llu, due at "
+				"%llu\n", name, (unsigned long long)now,
+				(unsigned long long)due);
+		}
+		test_late++;
+	}
+
+	timer->due += timer->delta;
+	timer->calls++;
+}
+
+static void test_one_shot_callback(int id)
+{
+	test_check(&test_one_shot, "one shot");
+	sys_tick_timer_unregister(id);
+}
+
+static void test_fast_callback(int id)
+{
+	(void)id;
+
+	test_check(&test_fast, "fast");
+
+	if ((test_fast.calls % TEST_ONE_SHOT_EVERY) == 0) {
+		test_start(&test_one_shot,
+			   sys_tick_timer_register(test_one_shot_callback,
+						   TEST_ONE_SHOT_US),
+			   TEST_ONE_SHOT_US);
+	}
+}
+
+static void test_slow_callback(int id)
+{
+	(void)id;
+
+	test_check(&test_slow, "slow");
+}
+
+/**
+ * Compare sys_tick_get_timer() against the simulated time.
+ */
+static void test_check_time(void)
+{
+	uint64_t ticks = (sim_get_cycles() - test_start_cycles) /
+			 TEST_TICK_CYCLES;
+	int32_t error = (int32_t)(sys_tick_get_timer() - (uint32_t)ticks);
+
+	if (error < test_time_min) {
+		test_time_min = error;
+	}
+	if (error > test_time_max) {
+		test_time_max = error;
+	}
+	/* The counter may not have seen the last tick yet. */
+	if (error < -1 || error > 0) {
+		test_time_errors++;
+	}
+}
+
+/**
+ * Run the simulation in steps that do not line up with the ticks.
+ */
+static void test_run(uint32_t seconds)
+{
+	uint64_t end = sim_get_cycles() +
+		       ((uint64_t)seconds * sim_get_sysclk());
+
+	while (sim_get_cycles() < end) {
+		sim_run(TEST_STEP_CYCLES);
+		test_check_time();
+	}
+}
+
+/**
+ * Host Sys Tick test main function
+ *
+ * @param argc Argument count.
+ * @param argv Optional simulated run time in seconds.
+ */
+int main(int argc, char *argv[])
+{
+	uint32_t seconds = 1;
+	uint64_t active, idle;
+	uint32_t expected;
+	int errors = 0;
+
+	if (argc > 1) {
+		seconds = (uint32_t)strtoul(argv[1], NULL, 0);
+	}
+
+	sim_init();
+	mcu_init();
+	led_init();
+	test_start_cycles = sim_get_cycles();
+	sys_tick_init();
+
+	test_start(&test_fast, sys_tick_timer_register(test_fast_callback,
+						       TEST_FAST_US),
+		   TEST_FAST_US);
+	test_start(&test_slow, sys_tick_timer_register(test_slow_callback,
+						       TEST_SLOW_US),
+		   TEST_SLOW_US);
+
+	sim_reset_isr_stats();
+	test_run(seconds);
+
+	/* Change a running timer from the main loop. */
+	sys_tick_timer_update(test_slow.id, TEST_SLOW_UPDATE_US);
+	test_start(&test_slow, test_slow.id, TEST_SLOW_UPDATE_US);
+	test_run(seconds);
+
+	active = sim_get_isr_stats(SIM_ISR_SYSTICK)->count;
+
+	/* Without timers only the time has to go on. */
+	sys_tick_timer_unregister(test_fast.id);
+	sys_tick_timer_unregister(test_slow.id);
+	sys_tick_timer_unregister(test_one_shot.id);
+	sim_reset_isr_stats();
+	test_run(seconds);
+	idle = sim_get_isr_stats(SIM_ISR_SYSTICK)->count;
+
+	sim_report(stdout);
+
+	printf("sys_tick: fast %lu, slow %lu, one shot %lu callbacks, %lu "
+	       "late\n", (unsigned long)test_fast.calls,
+	       (unsigned long)test_slow.calls,
+	       (unsigned long)test_one_shot.calls, (unsigned long)test_late);
+	printf("sys_tick: timer error %ld..%ld ticks\n", (long)test_time_min,
+	       (long)test_time_max);
+	printf("sys_tick: %.0f interrupts/s with timers, %.0f idle\n",
+	       (double)active / (2 * seconds), (double)idle / seconds);
+
+	if (test_late != 0) {
+		fprintf(stderr, "%lu callbacks not at their tick\n",
+			(unsigned long)test_late);
+		errors++;
+	}
+	expected = seconds * 2 * 1000000 / TEST_FAST_US;
+	if (test_fast.calls + 1 < expected) {
+		fprintf(stderr, "fast timer missed callbacks: %lu of %lu\n",
+			(unsigned long)test_fast.calls,
+			(unsigned long)expected);
+		errors++;
+	}
+	expected /= TEST_ONE_SHOT_EVERY;
+	if (test_one_shot.calls + 1 < expected) {
+		fprintf(stderr, "one shot timer missed callbacks: %lu of %lu\n",
+			(unsigned long)test_one_shot.calls,
+			(unsigned long)expected);
+		errors++;
+	}
+	if (test_time_errors != 0) {
+		fprintf(stderr, "sys_tick_get_timer() off %lu times\n",
+			(unsigned long)test_time_errors);
+		errors++;
+	}
+#ifdef SYS_TICK_TICKLESS
+	/* Only the deadlines and the longest period interrupt. */
+	if (active > (uint64_t)seconds * 2 * 1500 || idle > seconds * 5) {
+		fprintf(stderr, "too many sys tick interrupts\n");
+		errors++;
+	}
+#else
+	if (idle + 1 < (uint64_t)seconds * 10000) {
+		fprintf(stderr, "sys tick interrupts missing\n");
+		errors++;
+	}
+#endif
+
+	if (errors != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
@@ -0,0 +1,370 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   host_telemetry_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Telemetry stream test on the simulated STM32.
+ *
+ * Runs the sensorless commutation engine on the simulated motor and
+ * streams the phase voltages, the current, the duty cycle, the commutation
+ * step and period through the telemetry at 2Mbaud. The test decodes the
+ * frames coming out of the USART the way a host would and compares every
+ * value against what the ADC callback saw when the record was taken. For a
+ * while the decimation is set too low for the line to keep up, the decoded
+ * values have to stay right across the dropped records. Reports the bytes
+ * per frame against the plain binary record size.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host/sim.h"
+#include "host/motor.h"
+
+#include "driver/mcu.h"
+#include "driver/led.h"
+#include "driver/pwm.h"
+#include "driver/adc.h"
+#include "driver/timer.h"
+#include "driver/usart.h"
+#include "driver/telemetry.h"
+
+#include "src/bemf.h"
+
+/* Line speed of the stream. */
+#define TEST_BAUDRATE 2000000
+
+/* ADC callbacks per record, 100kHz / 16. */
+#define TEST_DECIMATION 16
+
+/* Channels in the order they are added. */
+#define TEST_CH_CALL 0
+#define TEST_CH_UV 1
+#define TEST_CH_VV 2
+#define TEST_CH_WV 3
+#define TEST_CH_CU 4
+#define TEST_CH_DUTY 5
+#define TEST_CH_STEP 6
+#define TEST_CH_PERIOD 7
+#define TEST_CH_COUNT 8
+
+/* Plain binary record: header and the channels at their size. */
+#define TEST_RAW_RECORD_SIZE (1 + 4 + (4 * 2) + 2 + 1 + 2)
+
+/* ADC callbacks the expected values are kept for. */
+#define TEST_TRUTH_SIZE 4096
+
+/* raw_data slots of the sample channels in each half. */
+static const int test_slots[4][2] = {
+	{ ADC_RAW_A1_UV1, ADC_RAW_A1_UV2 },
+	{ ADC_RAW_A1_VV1, ADC_RAW_A1_VV2 },
+	{ ADC_RAW_A1_WV1, ADC_RAW_A1_WV2 },
+	{ ADC_RAW_A2_CU1, ADC_RAW_A2_CU2 }
+};
+
+static volatile uint32_t test_calls;
+static volatile int16_t test_duty;
+static int32_t test_truth[TEST_TRUTH_SIZE][TEST_CH_COUNT];
+
+/* Host side decoder state. */
+static struct {
+	uint8_t buf[256];
+	size_t len;
+	bool synced;
+	int32_t values[TEST_CH_COUNT];
+	uint32_t frames;
+	uint32_t keyframes;
+	uint32_t bytes;
+	uint32_t bad;
+	uint32_t mismatches;
+} test_dec;
+
+static int32_t test_get_step(void)
+{
+	return bemf_get_step();
+}
+
+static int32_t test_get_period(void)
+{
+	return bemf_get_period();
+}
+
+static void test_adc_callback(bool transfer_complete, uint16_t *raw_data)
+{
+	int32_t *truth;
+	int half = transfer_complete ? 1 : 0;
+	int i;
+
+	bemf_adc_callback(transfer_complete, raw_data);
+
+	test_calls++;
+	truth = test_truth[test_calls % TEST_TRUTH_SIZE];
+	truth[TEST_CH_CALL] = (int32_t)test_calls;
+	for (i = 0; i < 4; i++) {
+		truth[TEST_CH_UV + i] = raw_data[test_slots[i][half]];
+	}
+	truth[TEST_CH_DUTY] = test_duty;
+	truth[TEST_CH_STEP] = test_get_step();
+	truth[TEST_CH_PERIOD] = test_get_period();
+
+	telemetry_adc_callback(transfer_complete, raw_data);
+}
+
+/**
+ * Decode one COBS frame in place.
+ *
+ * @return Length of the decoded frame, 0 if it is malformed.
+ */
+static size_t test_cobs_decode(uint8_t *buf, size_t len)
+{
+	size_t in = 0, out = 0;
+	uint8_t code, i;
+
+	while (in < len) {
+		code = buf[in++];
+		if (code == 0 || in + code - 1 > len) {
+			return 0;
+		}
+		for (i = 1; i < code; i++) {
+			buf[out++] = buf[in++];
+		}
+		if (code < 0xff && in < len) {
+			buf[out++] = 0;
+		}
+	}
+
+	return out;
+}
+
+static void test_decode_frame(void)
+{
+	const int32_t *truth;
+	size_t len, pos;
+	uint32_t value;
+	uint8_t sum = 0;
+	bool key;
+	int ch, shift;
+
+	len = test_cobs_decode(test_dec.buf, test_dec.len);
+	for (pos = 0; pos < len; pos++) {
+		sum += test_dec.buf[pos];
+	}
+	if (len < 2 || sum != 0) {
+		test_dec.bad++;
+		test_dec.synced = false;
+		return;
+	}
+
+	key = (test_dec.buf[0] & TELEMETRY_KEYFRAME) != 0;
+	if (key) {
+		test_dec.keyframes++;
+		test_dec.synced = true;
+	}
+
+	pos = 1;
+	for (ch = 0; ch < TEST_CH_COUNT; ch++) {
+		value = 0;
+		shift = 0;
+		do {
+			if (pos >= len - 1 || shift > 28) {
+				test_dec.bad++;
+				test_dec.synced = false;
+				return;
+			}
+			value |= (uint32_t)(test_dec.buf[pos] & 0x7f) << shift;
+			shift += 7;
+		} while ((test_dec.buf[pos++] & 0x80) != 0);
+
+		value = (value >> 1) ^ (0U - (value & 1));
+		if (key) {
+			test_dec.values[ch] = (int32_t)value;
+		} else {
+			test_dec.values[ch] = (int32_t)((uint32_t)
+				test_dec.values[ch] + value);
+		}
+	}
+	if (pos != len - 1) {
+		test_dec.bad++;
+		test_dec.synced = false;
+		return;
+	}
+
+	test_dec.frames++;
+	if (!test_dec.synced) {
+		return;
+	}
+
+	truth = test_truth[(uint32_t)test_dec.values[TEST_CH_CALL] %
+			   TEST_TRUTH_SIZE];
+	if (memcmp(truth, test_dec.values, sizeof(test_dec.values)) != 0) {
+		test_dec.mismatches++;
+	}
+}
+
+static void test_tx(uint8_t byte)
+{
+	test_dec.bytes++;
+	if (byte != 0) {
+		if (test_dec.len < sizeof(test_dec.buf)) {
+			test_dec.buf[test_dec.len++] = byte;
+		}
+		return;
+	}
+
+	test_decode_frame();
+	test_dec.len = 0;
+}
+
+/**
+ * Host telemetry test main function
+ *
+ * @param argc Argument count.
+ * @param argv Optional simulated run time in seconds.
+ */
+int main(int argc, char *argv[])
+{
+	struct motor_params params;
+	uint32_t seconds = 1;
+	uint32_t ms, records, dropped, overload_dropped;
+	uint32_t frames, bytes;
+	uint64_t sysclk;
+	double per_frame;
+	int errors = 0;
+
+	if (argc > 1) {
+		seconds = (uint32_t)strtoul(argv[1], NULL, 0);
+	}
+
+	sim_init();
+	motor_default_params(&params);
+	params.load = 0.002;
+	motor_init(&params);
+	motor_attach();
+	sim_set_usart_tx_callback(test_tx);
+
+	mcu_init();
+	led_init();
+	pwm_init();
+	test_duty = INT16_MAX / 4;
+	pwm_set(test_duty);
+	adc_init(test_adc_callback, test_adc_callback);
+	timer_init();
+	bemf_init();
+	usart_init(NULL, telemetry_get_byte, TEST_BAUDRATE);
+
+	telemetry_init();
+	(void)telemetry_add_var(&test_calls, TELEMETRY_U32);
+	(void)telemetry_add_raw(ADC_RAW_A1_UV1, ADC_RAW_A1_UV2);
+	(void)telemetry_add_raw(ADC_RAW_A1_VV1, ADC_RAW_A1_VV2);
+	(void)telemetry_add_raw(ADC_RAW_A1_WV1, ADC_RAW_A1_WV2);
+	(void)telemetry_add_raw(ADC_RAW_A2_CU1, ADC_RAW_A2_CU2);
+	(void)telemetry_add_var(&test_duty, TELEMETRY_S16);
+	(void)telemetry_add_getter(test_get_step);
+	if (telemetry_add_getter(test_get_period) != TEST_CH_PERIOD ||
+	    telemetry_add_getter(test_get_period) != -1) {
+		fprintf(stderr, "channels not added as expected\n");
+		errors++;
+	}
+
+	sysclk = sim_get_sysclk();
+
+	sim_run(sysclk / 100);
+	bemf_start();
+	sim_run(sysclk / 2);
+
+	/* More records than the line can carry. */
+	telemetry_set_decimation(1);
+	telemetry_start();
+	sim_run(sysclk / 100);
+	overload_dropped = telemetry_get_dropped();
+
+	telemetry_set_decimation(TEST_DECIMATION);
+	sim_run(sysclk / 100);
+	sim_reset_isr_stats();
+	records = telemetry_get_records();
+	dropped = telemetry_get_dropped();
+	frames = test_dec.frames;
+	bytes = test_dec.bytes;
+
+	for (ms = 0; ms < seconds * 1000; ms++) {
+		/* Steps of the duty cycle, as when tuning. */
+		if ((ms % 100) == 0) {
+			test_duty = (int16_t)((INT16_MAX / 4) +
+					      (int16_t)((ms / 100) % 3) * 256);
+			pwm_set(test_duty);
+		}
+		sim_run(sysclk / 1000);
+	}
+
+	telemetry_stop();
+	records = telemetry_get_records() - records;
+	dropped = telemetry_get_dropped() - dropped;
+	/* Let the last frames go out. */
+	sim_run(sysclk / 100);
+	frames = test_dec.frames - frames;
+	bytes = test_dec.bytes - bytes;
+	per_frame = (frames != 0) ? (double)bytes / frames : 0.0;
+
+	sim_report(stdout);
+
+	printf("telemetry: %lu records at %luHz, %lu frames, %lu keyframes, "
+	       "%lu bad, %lu wrong values\n", (unsigned long)records,
+	       (unsigned long)(records / seconds), (unsigned long)frames,
+	       (unsigned long)test_dec.keyframes,
+	       (unsigned long)test_dec.bad,
+	       (unsigned long)test_dec.mismatches);
+	printf("telemetry: %.1f bytes per frame, %d bytes plain, line %.0f%% "
+	       "used, %lu dropped at full rate, %lu at 1/%d\n", per_frame,
+	       TEST_RAW_RECORD_SIZE,
+	       100.0 * bytes * 10.0 / ((double)TEST_BAUDRATE * seconds),
+	       (unsigned long)overload_dropped, (unsigned long)dropped,
+	       TEST_DECIMATION);
+
+	if (bemf_get_mode() != BEMF_RUN) {
+		fprintf(stderr, "engine did not close the loop\n");
+		errors++;
+	}
+	if (test_dec.bad != 0 || test_dec.mismatches != 0) {
+		fprintf(stderr, "stream does not match the samples\n");
+		errors++;
+	}
+	if (overload_dropped == 0 || dropped != 0) {
+		fprintf(stderr, "unexpected dropped records\n");
+		errors++;
+	}
+	if (frames < records || records < seconds * 100000 / TEST_DECIMATION -
+					    seconds * 100) {
+		fprintf(stderr, "records missing\n");
+		errors++;
+	}
+	if (per_frame >= TEST_RAW_RECORD_SIZE) {
+		fprintf(stderr, "frames not smaller than plain records\n");
+		errors++;
+	}
+
+	if (errors != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
@@ -0,0 +1,345 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   host_timer_bench_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  Soft timer dispatch benchmark.
+ *
+ * Registers a growing number of periodic TIM2 soft timers, all but the
+ * first three are virtual timers sharing OC4, and reports for every count
+ * how late the callbacks ran in TIM2 ticks and the host time of the
+ * interrupt per callback and at worst. The simulated interrupts take no
+ * simulated time, the worst interrupt host time is the bound of the
+ * dispatch jitter once all timers due at the same time run in one
+ * interrupt.
+ *
+ * Then a compare channel timer and a virtual timer each get a callback that
+ * overruns by 2.5 periods every few calls, they have to skip the missed
+ * periods instead of waiting for the counter to wrap.
+ *
+ * Last the extended TIM2 time is compared against the simulated time, from
+ * the main loop and from a timer callback, across many counter wraps. Exits
+ * non zero if a timer is late or missed a period or the time is off.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libopencm3/stm32/f1/nvic.h>
+#include <libopencm3/stm32/timer.h>
+
+#include "host/sim.h"
+
+#include "driver/mcu.h"
+#include "driver/led.h"
+#include "driver/timer.h"
+
+/* Largest number of timers, needs -DTIMER_VIRTUAL_COUNT of at least this
+ * minus the three compare channel timers.
+ */
+#define BENCH_MAX_TIMERS 512
+
+/* Timer periods in TIM2 ticks (0.25us), spread so that the deadlines
+ * drift against each other.
+ */
+#define BENCH_PERIOD_TICKS 4000
+#define BENCH_PERIOD_SPREAD 37
+
+/* Simulated time of one measurement. */
+#define BENCH_MS 100
+
+/* Every BENCH_OVERRUN_EVERY calls the overrun callback stalls the core for
+ * BENCH_OVERRUN_TICKS TIM2 ticks.
+ */
+#define BENCH_OVERRUN_EVERY 8
+#define BENCH_OVERRUN_TICKS (BENCH_PERIOD_TICKS * 5 / 2)
+
+static const int bench_counts[] = { 1, 4, 16, 64, 256, BENCH_MAX_TIMERS };
+
+static uint32_t bench_calls[BENCH_MAX_TIMERS];
+static int bench_ids[BENCH_MAX_TIMERS];
+static int bench_timers;
+static uint32_t bench_late_max;
+static uint64_t bench_late_sum;
+static uint64_t bench_callbacks;
+static uint64_t bench_last_cycles;
+static uint64_t bench_gap_max;
+static uint64_t bench_clock_base;
+static uint64_t bench_clock_error;
+
+static uint16_t bench_period(int n)
+{
+	return (uint16_t)(BENCH_PERIOD_TICKS + (n * BENCH_PERIOD_SPREAD));
+}
+
+static void bench_callback(int id, uint16_t time)
+{
+	uint16_t late = timer_get_counter(TIM2) - time;
+	int n;
+
+	for (n = 0; n < bench_timers; n++) {
+		if (bench_ids[n] == id) {
+			bench_calls[n]++;
+			break;
+		}
+	}
+
+	if (late > bench_late_max) {
+		bench_late_max = late;
+	}
+	bench_late_sum += late;
+	bench_callbacks++;
+}
+
+static void bench_overrun_callback(int id, uint16_t time)
+{
+	uint64_t now = sim_get_cycles();
+
+	(void)id;
+	(void)time;
+
+	if (bench_callbacks != 0 && now - bench_last_cycles > bench_gap_max) {
+		bench_gap_max = now - bench_last_cycles;
+	}
+	bench_last_cycles = now;
+
+	if ((++bench_callbacks % BENCH_OVERRUN_EVERY) == 0) {
+		sim_stall((uint64_t)BENCH_OVERRUN_TICKS *
+			  (sim_get_sysclk() / 4000000));
+	}
+}
+
+/**
+ * Run a periodic timer with an overrunning callback.
+ *
+ * @param virtual Use a virtual timer instead of a compare channel.
+ *
+ * @return Number of errors.
+ */
+static int bench_overrun(bool virtual)
+{
+	uint64_t sysclk = sim_get_sysclk();
+	uint64_t period = (uint64_t)BENCH_PERIOD_TICKS * (sysclk / 4000000);
+	uint32_t overruns;
+	int n, id, errors = 0;
+
+	timer_init();
+	sim_run(sysclk / 100);
+
+	/* Occupy the compare channels to get a virtual timer. */
+	if (virtual) {
+		for (n = 0; n < 3; n++) {
+			bench_ids[n] = timer_register(BENCH_PERIOD_TICKS,
+						      bench_callback, false);
+		}
+	}
+	id = timer_register(BENCH_PERIOD_TICKS, bench_overrun_callback, false);
+	if (virtual) {
+		for (n = 0; n < 3; n++) {
+			timer_unregister(bench_ids[n]);
+		}
+	}
+
+	bench_callbacks = 0;
+	bench_gap_max = 0;
+	overruns = timer_get_overruns();
+	sim_run(sysclk * BENCH_MS / 1000);
+	timer_unregister(id);
+	overruns = timer_get_overruns() - overruns;
+
+	printf("%s timer %d: %llu calls, %lu skipped periods, longest gap "
+	       "%.2f periods\n", virtual ? "virtual" : "channel", id,
+	       (unsigned long long)bench_callbacks, (unsigned long)overruns,
+	       (double)bench_gap_max / period);
+
+	if (overruns == 0 || bench_gap_max > 4 * period) {
+		fprintf(stderr, "%s timer did not catch up\n",
+			virtual ? "virtual" : "channel");
+		errors++;
+	}
+
+	return errors;
+}
+
+/**
+ * Difference between the extended TIM2 time and the simulated time in TIM2
+ * ticks.
+ */
+static uint64_t bench_clock_diff(void)
+{
+	uint64_t sim = (sim_get_cycles() - bench_clock_base) /
+		       (sim_get_sysclk() / 4000000);
+	uint64_t time = timer_get_time64();
+	uint32_t time32 = timer_get_time();
+
+	if ((uint32_t)time != time32) {
+		return UINT64_MAX;
+	}
+
+	return (time > sim) ? time - sim : sim - time;
+}
+
+static void bench_clock_callback(int id, uint16_t time)
+{
+	uint64_t diff = bench_clock_diff();
+
+	(void)id;
+	(void)time;
+
+	if (diff > bench_clock_error) {
+		bench_clock_error = diff;
+	}
+}
+
+/**
+ * Compare the extended time against the simulated time for two seconds,
+ * 122 counter wraps.
+ *
+ * @return Number of errors.
+ */
+static int bench_clock(void)
+{
+	uint64_t sysclk = sim_get_sysclk();
+	uint64_t diff;
+	uint32_t ms;
+	int id;
+
+	timer_init();
+	bench_clock_base = sim_get_cycles();
+	bench_clock_error = 0;
+
+	/* An odd period, the callbacks move across the wraps. */
+	id = timer_register(997, bench_clock_callback, false);
+	for (ms = 0; ms < 2000; ms++) {
+		sim_run(sysclk / 1000 + 3);
+		diff = bench_clock_diff();
+		if (diff > bench_clock_error) {
+			bench_clock_error = diff;
+		}
+	}
+	timer_unregister(id);
+
+	printf("extended time: %llu ticks after 2s, largest error %llu "
+	       "ticks\n", (unsigned long long)timer_get_time64(),
+	       (unsigned long long)bench_clock_error);
+
+	/* A read in the middle of a tick may be one behind. */
+	if (bench_clock_error > 1) {
+		fprintf(stderr, "extended time is off\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Run one measurement with the given number of timers.
+ *
+ * @return Number of errors.
+ */
+static int bench_run(int timers)
+{
+	const struct sim_isr_stats *isr;
+	uint64_t sysclk = sim_get_sysclk();
+	uint32_t expected;
+	int n, errors = 0;
+
+	/* Let TIM2 pick up its prescaler on the first update event. */
+	timer_init();
+	sim_run(sysclk / 100);
+
+	bench_timers = timers;
+	bench_late_max = 0;
+	bench_late_sum = 0;
+	bench_callbacks = 0;
+	for (n = 0; n < timers; n++) {
+		bench_calls[n] = 0;
+		bench_ids[n] = timer_register(bench_period(n), bench_callback,
+					      false);
+		if (bench_ids[n] < 0) {
+			fprintf(stderr, "timer %d: register failed\n", n);
+			return 1;
+		}
+	}
+
+	sim_reset_isr_stats();
+	sim_run(sysclk * BENCH_MS / 1000);
+
+	for (n = 0; n < timers; n++) {
+		timer_unregister(bench_ids[n]);
+
+		expected = (uint32_t)(4000ULL * BENCH_MS / bench_period(n));
+		if (bench_calls[n] + 1 < expected ||
+		    bench_calls[n] > expected + 1) {
+			fprintf(stderr, "timer %d: %lu calls, expected %lu\n",
+				n, (unsigned long)bench_calls[n],
+				(unsigned long)expected);
+			errors++;
+		}
+	}
+
+	isr = sim_get_isr_stats(NVIC_TIM2_IRQ);
+	printf("%6d %10.0f %8.2f %8lu %10.1f %10llu\n", timers,
+	       bench_callbacks * 1000.0 / BENCH_MS,
+	       (bench_callbacks != 0) ?
+	       (double)bench_late_sum / bench_callbacks : 0.0,
+	       (unsigned long)bench_late_max,
+	       (bench_callbacks != 0) ?
+	       (double)isr->ns_total / bench_callbacks : 0.0,
+	       (unsigned long long)isr->ns_max);
+
+	if (bench_late_max > 1) {
+		fprintf(stderr, "%d timers: callback %lu ticks late\n",
+			timers, (unsigned long)bench_late_max);
+		errors++;
+	}
+
+	return errors;
+}
+
+/**
+ * Host timer benchmark main function
+ */
+int main(void)
+{
+	unsigned int i;
+	int errors = 0;
+
+	sim_init();
+	mcu_init();
+	led_init();
+
+	printf("timers  calls/s  late[tick] max[tick]  ns/call  isr max[ns]\n");
+	for (i = 0; i < sizeof(bench_counts) / sizeof(bench_counts[0]); i++) {
+		errors += bench_run(bench_counts[i]);
+	}
+
+	errors += bench_overrun(false);
+	errors += bench_overrun(true);
+	errors += bench_clock();
+
+	if (errors != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * Open-BLDC - Open BrushLess DC Motor Controller
+ * Copyright (C) 2013 by Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file   host_usart_main.c
+ * @author Piotr Esden-Tempski <piotr@esden.net>
+ *
+ * @brief  USART echo test.
+ *
+ * Sends bursts of bytes of random length to the USART, like the packets of
+ * the governor protocol, and echoes them back through the driver callbacks.
+ * Checks that every byte comes back unchanged and in order and reports the
+ * interrupts taken and the spans handed over per byte. Built with
+ * -DUSART_DMA the driver has to get along with less than one interrupt and
+ * one span every five bytes. Exits non zero on any mismatch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libopencm3/stm32/f1/nvic.h>
+
+#include "host/sim.h"
+
+#include "driver/mcu.h"
+#include "driver/led.h"
+#include "driver/usart.h"
+
+/* Line speed in baud. */
+#ifndef TEST_BAUDRATE
+#define TEST_BAUDRATE USART_DEFAULT_BAUDRATE
+#endif
+
+/* A burst is sent every this many ms. */
+#define TEST_BURST_MS 10
+
+/* Bytes the line can carry per burst interval, 10 bits per byte. */
+#define TEST_CAPACITY (TEST_BAUDRATE / 10 * TEST_BURST_MS / 1000)
+
+static uint8_t echo_buf[256];
+static uint8_t echo_head;
+static uint8_t echo_tail;
+
+/* Bytes sent and not yet received back, to compare against. */
+static uint8_t test_sent[4096];
+static uint32_t test_sent_count;
+static uint32_t test_echo_count;
+static uint32_t test_mismatches;
+static uint32_t test_spans;
+
+static int test_handle_span(const uint8_t *data, uint16_t len)
+{
+	test_spans++;
+	while (len-- > 0) {
+		echo_buf[echo_head++] = *data++;
+	}
+	usart_enable_send();
+
+	return 0;
+}
+
+static int32_t test_get_byte(void)
+{
+	if (echo_head == echo_tail) {
+		return -1;
+	}
+
+	return echo_buf[echo_tail++];
+}
+
+static void test_tx(uint8_t byte)
+{
+	if (test_echo_count >= test_sent_count ||
+	    test_sent[test_echo_count % sizeof(test_sent)] != byte) {
+		test_mismatches++;
+	}
+	test_echo_count++;
+}
+
+static void test_send_burst(void)
+{
+	uint8_t burst[TEST_CAPACITY];
+	uint32_t len, i;
+
+	len = (TEST_CAPACITY / 4) + ((uint32_t)rand() % (TEST_CAPACITY / 2));
+	for (i = 0; i < len; i++) {
+		burst[i] = (uint8_t)rand();
+		test_sent[test_sent_count % sizeof(test_sent)] = burst[i];
+		test_sent_count++;
+	}
+	sim_usart_receive(burst, len);
+}
+
+/**
+ * Host USART test main function
+ *
+ * @param argc Argument count.
+ * @param argv Optional simulated run time in seconds.
+ */
+int main(int argc, char *argv[])
+{
+	uint32_t seconds = 1;
+	uint32_t bursts, isrs;
+	uint64_t sysclk;
+	double per_byte, spans_per_byte;
+	int errors = 0;
+
+	if (argc > 1) {
+		seconds = (uint32_t)strtoul(argv[1], NULL, 0);
+	}
+
+	srand(1);
+	sim_init();
+	sim_set_usart_tx_callback(test_tx);
+
+	mcu_init();
+	led_init();
+	usart_init(NULL, test_get_byte, TEST_BAUDRATE);
+	usart_set_span_callback(test_handle_span);
+
+	sysclk = sim_get_sysclk();
+
+	sim_reset_isr_stats();
+	for (bursts = 0; bursts < seconds * 1000 / TEST_BURST_MS; bursts++) {
+		test_send_burst();
+		sim_run(sysclk * TEST_BURST_MS / 1000);
+	}
+	/* Let the last echo go out. */
+	sim_run(sysclk * TEST_BURST_MS / 1000);
+
+	sim_report(stdout);
+
+	isrs = (uint32_t)(sim_get_isr_stats(NVIC_USART1_IRQ)->count +
+			  sim_get_isr_stats(NVIC_DMA1_CHANNEL4_IRQ)->count +
+			  sim_get_isr_stats(NVIC_DMA1_CHANNEL5_IRQ)->count);
+	per_byte = (double)isrs / (double)test_sent_count;
+	spans_per_byte = (double)test_spans / (double)test_sent_count;
+	printf("usart: %d baud, %lu bytes sent, %lu echoed, %lu wrong, %.3f "
+	       "interrupts and %.3f spans per byte\n", TEST_BAUDRATE,
+	       (unsigned long)test_sent_count, (unsigned long)test_echo_count,
+	       (unsigned long)test_mismatches, per_byte, spans_per_byte);
+
+	if (test_echo_count != test_sent_count || test_mismatches != 0) {
+		fprintf(stderr, "echo does not match\n");
+		errors++;
+	}
+#ifdef USART_DMA
+	if (per_byte > 0.2) {
+		fprintf(stderr, "too many interrupts\n");
+		errors++;
+	}
+	if (spans_per_byte > 0.2) {
+		fprintf(stderr, "too many spans\n");
+		errors++;
+	}
+#endif
+
+	if (errors != 0) {
+		printf("FAILED\n");
+		return 1;
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
@@ -75,7 +75,8 @@ int main(void)
 {
 	mcu_init();
 	led_init();
-	usart_init(usart_handle_byte, usart_get_byte);
+	usart_init(usart_handle_byte, usart_get_byte,
+		   USART_DEFAULT_BAUDRATE);
 
 	while (1) {
 		__asm("nop");